@@ -20,6 +20,9 @@ See the Mulan PSL v2 for more details. */
 /** Cycle detection is performed every CYCLE_DETECTION_INTERVAL milliseconds. */
 extern std::chrono::milliseconds cycle_detection_interval;
 
+/** A transaction holding this many row locks on one table escalates them to a table lock, 0 disables escalation. */
+extern std::atomic<int> lock_escalation_threshold;
+
 /** True if logging should be enabled, false otherwise. */
 extern std::atomic<bool> enable_logging;
 
@@ -36,6 +39,7 @@ static constexpr int PAGE_SIZE = 4096;                                        //
 //static constexpr int BUFFER_POOL_SIZE = 65536;                                // size of buffer pool 256MB
 static constexpr int BUFFER_POOL_SIZE = 262144 * 4;                                // size of buffer pool 4GB
 static constexpr int LOG_BUFFER_SIZE = (1024 * PAGE_SIZE);                    // size of a log buffer in byte
+static constexpr int LOG_BUFFER_COUNT = 2;                                    // number of log buffers used in turn
 static constexpr int BUCKET_SIZE = 50;                                        // size of extendible hash bucket
 
 using frame_id_t = int32_t;  // frame id type, 帧页ID, 页在BufferPool中的存储单元称为帧,一帧对应一页
@@ -12,6 +12,7 @@ See the Mulan PSL v2 for more details. */
 
 #include "transaction/transaction.h"
 #include "transaction/concurrency/lock_manager.h"
+#include "transaction/concurrency/version_store.h"
 #include "recovery/log_manager.h"
 
 // class TransactionManager;
@@ -22,12 +23,31 @@ static int const_offset = -1;
 class Context {
 public:
     Context (LockManager *lock_mgr, LogManager *log_mgr, 
-            Transaction *txn, char *data_send = nullptr, int *offset = &const_offset, bool output_ellipsis = false)
+            Transaction *txn, char *data_send = nullptr, int *offset = &const_offset, bool output_ellipsis = false,
+            VersionStore *version_store = nullptr)
         : lock_mgr_(lock_mgr), log_mgr_(log_mgr), txn_(txn),
-          data_send_(data_send), offset_(offset), output_ellipsis_(output_ellipsis) {
+          data_send_(data_send), offset_(offset), output_ellipsis_(output_ellipsis), version_store_(version_store) {
         ellipsis_ = false;
     }
 
+    // 返回写索引插入/删除日志的回调，索引修改完页面后通过它写入日志，日志的lsn用于标记被修改的页面
+    IxLogger index_logger(LogType log_type, char *key, Rid rid, int ix_id, int key_len) {
+        return [this, log_type, key, rid, ix_id, key_len](const IxRedoInfo &redo) mutable {
+            auto append = [this](LogRecord *index_log) {
+                index_log->prev_lsn_ = txn_->get_prev_lsn();
+                log_mgr_->add_log_to_buffer(index_log);
+                txn_->set_prev_lsn(index_log->lsn_);
+                return index_log->lsn_;
+            };
+            if (log_type == LogType::INDEX_INSERT) {
+                IndexInsertLogRecord index_log(txn_->get_transaction_id(), key, rid, ix_id, key_len, redo);
+                return append(&index_log);
+            }
+            IndexDeleteLogRecord index_log(txn_->get_transaction_id(), key, rid, ix_id, key_len, redo);
+            return append(&index_log);
+        };
+    }
+
     // TransactionManager *txn_mgr_;
     LockManager *lock_mgr_;
     LogManager *log_mgr_;
@@ -36,4 +56,5 @@ public:
     int *offset_;
     bool ellipsis_;
     bool output_ellipsis_;
+    VersionStore *version_store_;   // 写操作在修改记录之前保存旧版本，快照读从中得到可见的版本
 };
\ No newline at end of file
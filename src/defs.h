@@ -10,6 +10,7 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <cstdint>
 #include <iostream>
 #include <map>
 
@@ -39,6 +40,33 @@ struct Rid {
     friend bool operator!=(const Rid &x, const Rid &y) { return !(x == y); }
 };
 
+/* 变长整数（varint）：每个字节的低7位存放数据，最高位为1表示后面还有字节。日志中的id、长度、页号等都用varint存放 */
+inline int varint_size(uint32_t val) {
+    int size = 1;
+    for (; val >= 0x80; val >>= 7) size++;
+    return size;
+}
+
+inline char *put_varint(char *dest, uint32_t val) {
+    for (; val >= 0x80; val >>= 7) {
+        *dest++ = static_cast<char>(val | 0x80);
+    }
+    *dest++ = static_cast<char>(val);
+    return dest;
+}
+
+template<typename T>
+inline const char *get_varint(const char *src, T *val) {
+    uint32_t res = 0;
+    for (int shift = 0;; shift += 7) {
+        auto byte = static_cast<uint8_t>(*src++);
+        res |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) break;
+    }
+    *val = static_cast<T>(res);
+    return src;
+}
+
 enum ColType {
     TYPE_INT, TYPE_FLOAT, TYPE_STRING, TYPE_BIGINT, TYPE_DATETIME
 };
@@ -25,7 +25,7 @@ const char *help_info = "Supported SQL syntax:\n"
                         "command:\n"
                         "  CREATE TABLE table_name (column_name type [, column_name type ...])\n"
                         "  DROP TABLE table_name\n"
-                        "  CREATE INDEX table_name (column_name)\n"
+                        "  CREATE [NONUNIQUE] INDEX table_name (column_name [, column_name ...]) [INCLUDE (column_name [, ...])]\n"
                         "  DROP INDEX table_name (column_name)\n"
                         "  INSERT INTO table_name VALUES (value [, value ...])\n"
                         "  DELETE FROM table_name [WHERE where_clause]\n"
@@ -61,7 +61,8 @@ void QlManager::run_mutli_query(std::shared_ptr<Plan> plan, Context *context) {
                 break;
             }
             case T_CreateIndex: {
-                sm_manager_->create_index(x->tab_name_, x->tab_col_names_, context);
+                sm_manager_->create_index(x->tab_name_, x->tab_col_names_, context, x->unique_,
+                                          x->include_col_names_);
                 break;
             }
             case T_DropIndex: {
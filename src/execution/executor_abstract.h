@@ -166,6 +166,23 @@ public:
                            [&](const Condition &cond) { return eval_cond(rec_cols, cond, rec); });
     }
 
+    /**
+     * @brief 乐观事务不加锁扫描时把扫描的谓词加入读集合，提交时检查其他事务是否修改了满足谓词的记录。
+     * 只保留本表上的条件，涉及其他表的条件被忽略，谓词只会变宽，验证是保守的
+     */
+    void append_read_predicate(int fd, const std::string &tab_name, const std::vector<ColMeta> &cols,
+                               const std::vector<Condition> &conds) {
+        if (!context_->txn_->is_optimistic()) return;
+        std::vector<Condition> local_conds;
+        std::copy_if(conds.begin(), conds.end(), std::back_inserter(local_conds), [&](const Condition &cond) {
+            return cond.lhs_col.tab_name == tab_name && (cond.is_rhs_val || cond.rhs_col.tab_name == tab_name);
+        });
+        context_->txn_->append_read_record({fd, [cols, local_conds](const RmRecord &rec) {
+            return std::all_of(local_conds.begin(), local_conds.end(),
+                               [&](const Condition &cond) { return eval_cond(cols, cond, &rec); });
+        }});
+    }
+
     static void convert(Value &a, Value &b) {
         // 数值类型的转化(int, float, bigint)
         // int -> float
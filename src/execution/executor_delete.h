@@ -46,37 +46,42 @@ public:
         for (auto &index: tab_.indexes) {
             auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
             auto ih = sm_manager_->ihs_.at(ix_name).get();
-            char *key = new char[index.col_tot_len];
-            int offset = 0;
-            for (size_t j = 0; j < index.col_num; ++j) {
-                memcpy(key + offset, rec->data + index.cols[j].offset, index.cols[j].len);
-                offset += index.cols[j].len;
-            }
-            //更新索引删除日志
-            auto *index_log = new IndexDeleteLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name, index.col_tot_len);
-            index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(index_log);
-            context_->txn_->set_prev_lsn(index_log->lsn_);
+            std::vector<char> key(index.entry_len());
+            index.get_key(rec->data, key.data());
+            //写索引删除日志，由索引在修改完页面后调用
+            auto logger = context_->index_logger(LogType::INDEX_DELETE, key.data(), rid_, index.id, index.entry_len());
             //删除索引
-            ih->delete_entry(key, context_->txn_);
-            free(key);
+            ih->delete_entry(key.data(), rid_, context_->txn_, logger);
         }
     }
 
     std::unique_ptr<RmRecord> Next() override {
         for(auto rid : rids_){
             auto rec = fh_->get_record(rid, context_);
+            // 修改之前先加好记录和所有索引键上的锁，加锁失败回滚时不会留下写集合中没有记录的修改
+            context_->lock_mgr_->lock_exclusive_on_record(context_->txn_, rid, fh_->GetFd());
+            for (auto &index: tab_.indexes) {
+                std::vector<char> key(index.entry_len());
+                index.get_key(rec->data, key.data());
+                context_->lock_mgr_->lock_exclusive_on_key(context_->txn_, index.id, key.data(), index.col_tot_len);
+                if (index.unique && context_->version_store_ != nullptr) {
+                    context_->version_store_->add_key_intent(index.id, key.data(), index.col_tot_len, context_->txn_);
+                }
+            }
+            // 修改索引和页面之前保存旧版本，快照读在修改过程中也能读到删除之前的记录
+            if (context_->version_store_ != nullptr) {
+                context_->version_store_->add_version(fh_->GetFd(), rid, context_->txn_, rec.get());
+            }
             //更新日志
-            auto *logRecord = new DeleteLogRecord(context_->txn_->get_transaction_id(), *rec, rid,tab_name_);
-            logRecord->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(logRecord);
-            context_->txn_->set_prev_lsn(logRecord->lsn_);
+            DeleteLogRecord logRecord(context_->txn_->get_transaction_id(), *rec, rid, tab_.id);
+            logRecord.prev_lsn_ = context_->txn_->get_prev_lsn();
+            context_->log_mgr_->add_log_to_buffer(&logRecord);
+            context_->txn_->set_prev_lsn(logRecord.lsn_);
             //实际删除
             delete_index(rec.get(), rid);
-            fh_->delete_record(rid, context_);
+            fh_->delete_record(rid, context_, logRecord.lsn_);
             //更新事务
-            auto *wr = new WriteRecord(WType::DELETE_TUPLE, tab_name_, rid, *rec);
-            context_->txn_->append_write_record(wr);
+            context_->txn_->append_write_record(WType::DELETE_TUPLE, tab_name_, rid, rec.get());
         }
         return nullptr;
     }
@@ -10,6 +10,11 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <algorithm>
+#include <climits>
+#include <limits>
+#include <set>
+#include <string>
 #include <utility>
 
 #include "execution_defs.h"
@@ -35,15 +40,45 @@ private:
     std::unique_ptr<IxScan> scan_;
     IxIndexHandle *ih;
     IxManager *im;
-    int index_cnt;                                    // 匹配的索引字段长度
+    bool index_only_;                                 // 索引覆盖了所有需要的字段，直接从索引项构造记录，不回表
+    bool reverse_;                                    // 按索引逆序输出，用于满足order by ... desc
+    bool lock_free_;                                  // 隔离级别低于可串行化或乐观事务不加锁，读取对当前事务可见的版本
+
+    /* 不加锁扫描的一个候选项：索引项（索引字段 + INCLUDE字段）和rid，来自版本链时还有可见的记录 */
+    struct SnapshotRow {
+        std::string key;
+        Rid rid;
+        std::unique_ptr<RmRecord> rec;
+    };
+    std::vector<SnapshotRow> batch_;                  // 从索引中读出的一批索引项，结束于一个键的边界
+    size_t batch_pos_ = 0;
+    bool index_done_ = false;                         // 索引中的扫描区间已经读完
+    std::string resume_key_;                          // 上一批最后一个索引键，下一批从它之后开始
+    std::vector<SnapshotRow> versioned_rows_;         // 有版本链的记录的可见版本，按输出顺序排列
+    size_t versioned_pos_ = 0;
+    std::set<std::pair<int, int>> versioned_;         // 已经知道有版本链的rid，它们只从versioned_rows_输出
+    int invisible_page_ = INT_MAX;                    // 对当前事务不可见的批量导入的第一个页面
+    uint64_t epoch_ = 0;                              // 上次获取版本链时表上的版本计数
+    bool epoch_valid_ = false;
+    SnapshotRow last_;                                // 最后输出的候选项，之后发现的版本链只补上它之后的记录
+    bool has_last_ = false;
+    std::unique_ptr<RmRecord> cur_rec_;               // 当前输出的记录
+    bool snapshot_end_ = false;
+
+    /* 扫描区间两端的索引键，由conds_决定，在beginTuple中计算一次 */
+    std::vector<char> lower_key_, upper_key_;
+    bool lower_strict_ = false, upper_strict_ = false;
+    bool range_empty_ = false;
 
     SmManager *sm_manager_;
 
 public:
     IndexScanExecutor(SmManager *sm_manager, std::string tab_name, std::vector<Condition> conds,
                       std::vector<std::string> index_col_names,
-                      Context *context) {
+                      Context *context, bool index_only = false, bool reverse = false) {
         sm_manager_ = sm_manager;
+        index_only_ = index_only;
+        reverse_ = reverse;
         context_ = context;
         tab_name_ = std::move(tab_name);
         tab_ = sm_manager_->db_.get_table(tab_name_);
@@ -80,7 +115,13 @@ public:
             }
         }
         fed_conds_ = conds_;
-        context_->lock_mgr_->lock_shared_on_table(context_->txn_, sm_manager_->fhs_[tab_name_]->GetFd());
+        lock_free_ = context_->txn_->get_isolation_level() != IsolationLevel::SERIALIZABLE ||
+                     context_->txn_->is_optimistic();
+        if (lock_free_) {
+            append_read_predicate(fh_->GetFd(), tab_name_, cols_, fed_conds_);
+        } else {
+            context_->lock_mgr_->lock_shared_on_table(context_->txn_, sm_manager_->fhs_[tab_name_]->GetFd());
+        }
     }
 
     std::string getType() override { return "IndexScanExecutor"; };
@@ -88,131 +129,17 @@ public:
     size_t tupleLen() const override { return len_; };
 
     void beginTuple() override {
-        std::string ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index_col_names_);
-        std::cout << "index_scan::" << ix_name << "\n\n";
-        char *key = new char[index_meta_.col_tot_len];
-        Value min_int, min_float, min_datetime;
-        {
-            min_int.set_int(INT32_MIN);
-            min_int.init_raw(sizeof(int));
-            min_float.set_float(-1e40);
-            min_float.init_raw(sizeof(double));
-            min_datetime.set_datetime(10000101000000);
-            min_datetime.init_raw(sizeof(long long));
-        }
-        Value max_int, max_float, max_datetime;
-        {
-            max_int.set_int(INT32_MAX);
-            max_int.init_raw(sizeof(int));
-            max_float.set_float(1e40);
-            max_float.init_raw(sizeof(double));
-            max_datetime.set_datetime(99991231235959);
-            max_datetime.init_raw(sizeof(long long));
-        }
-        int offset = 0, i, f = 1;
-        for (i = 0; i < conds_.size() && f; i++) {
-            auto cond = conds_[i];
-            if (!cond.is_rhs_val || i >= index_col_names_.size() || cond.lhs_col.tab_name != tab_name_ ||
-                    cond.lhs_col.col_name != index_col_names_[i] || cond.op == OP_NE)
-                break;
-            if(cond.op == OP_GE || cond.op == OP_GT){// >= | >
-                memcpy(key + offset, cond.rhs_val.raw->data, index_meta_.cols[i].len);
-                offset += index_meta_.cols[i].len;
-                f = 0;
-            }else if(cond.op == OP_LE || cond.op == OP_LT) {// <= | <
-                switch (cond.rhs_val.type) {
-                    case TYPE_INT: {
-                        memcpy(key + offset, min_int.raw->data, index_meta_.cols[i].len);
-                        break;
-                    }
-                    case TYPE_FLOAT:{
-                        memcpy(key + offset, min_float.raw->data, index_meta_.cols[i].len);
-                        break;
-                    }
-                    case TYPE_STRING:{
-                        Value min_char;
-                        std::string val;
-                        min_char.set_str(val);
-                        min_char.init_raw(index_meta_.cols[i].len);
-                        memcpy(key + offset, min_char.raw->data, index_meta_.cols[i].len);
-                        break;
-                    }
-                    case TYPE_DATETIME:{
-                        memcpy(key + offset, min_datetime.raw->data, index_meta_.cols[i].len);
-                        break;
-                    }
-                    default:
-                        break;
-                }
-                offset += index_meta_.cols[i].len;
-                f = 0;
-            }else{// =
-                memcpy(key + offset, cond.rhs_val.raw->data, index_meta_.cols[i].len);
-                offset += index_meta_.cols[i].len;
-            }
-        }
-        index_cnt = i;
-        auto &type = conds_[index_cnt - 1].op;
-        int flag = type == OP_GT ? 1 : 0;
-        for(; i < index_meta_.cols.size(); i++){
-            auto &col = index_meta_.cols[i];
-            switch (col.type) {
-                case TYPE_INT: {
-                    if(flag){
-                        memcpy(key + offset, max_int.raw->data, col.len);
-                    }else{
-                        memcpy(key + offset, min_int.raw->data, col.len);
-                    }
-                    break;
-                }
-                case TYPE_FLOAT:{
-                    if(flag){
-                        memcpy(key + offset, max_float.raw->data, col.len);
-                    }else{
-                        memcpy(key + offset, min_float.raw->data, col.len);
-                    }
-                    break;
-                }
-                case TYPE_STRING:{
-                    if(flag){
-                        Value str_val;
-                        std::string val(col.len, (char)(127));
-                        str_val.set_str(val);
-                        str_val.init_raw(col.len);
-                        memcpy(key + offset, str_val.raw->data, col.len);
-                    }else {
-                        Value min_char;
-                        std::string val;
-                        min_char.set_str(val);
-                        min_char.init_raw(index_meta_.cols[i].len);
-                        memcpy(key + offset, min_char.raw->data, col.len);
-                    }
-                    break;
-                }
-                case TYPE_DATETIME:{
-                    if(flag){
-                        memcpy(key + offset, max_datetime.raw->data, index_meta_.cols[i].len);
-                    }else{
-                        memcpy(key + offset, min_datetime.raw->data, index_meta_.cols[i].len);
-                    }
-                    break;
-                }
-                default:
-                    break;
-            }
-            offset += col.len;
+        compute_range_keys();
+        if (lock_free_) {
+            begin_snapshot_scan();
+            next_snapshot_row();
+            return;
         }
-        std::cout << index_cnt << '\n';
-        Iid start = ih->leaf_begin();
-        if(flag) start = ih->upper_bound(key);
-        else start = ih->lower_bound(key);
-        std::cout << start.page_no << " " << start.slot_no << "\n";
-        Iid end = ih->leaf_end();
-        scan_ = std::make_unique<IxScan>(ih, start, end, sm_manager_->get_bpm());
-        while(!is_end()){
-            rid_ = scan_->rid();
-            auto rec = fh_->get_record(rid_, context_);
-//                auto rec = fh_->get_record(rid_, context_);
+        Iid lower, upper;
+        compute_range(lower, upper);
+        scan_ = std::make_unique<IxScan>(ih, lower, upper, sm_manager_->get_bpm(), reverse_);
+        while (!is_end()) {
+            auto rec = fetch_tuple(rid_);
             if (fed_conds_.empty() || eval_conds(cols_, fed_conds_, rec.get())) {
                 break;
             }
@@ -221,14 +148,18 @@ public:
     }
 
     void nextTuple() override {
+        if (lock_free_) {
+            if (!is_end()) {
+                next_snapshot_row();
+            }
+            return;
+        }
         if (!is_end()) {
             scan_->next();
         }
         while (!is_end()) {
-            rid_ = scan_->rid();
             try {
-                auto rec = fh_->get_record(rid_, context_);
-//                auto rec = fh_->get_record(rid_, context_);
+                auto rec = fetch_tuple(rid_);
                 if (fed_conds_.empty() || eval_conds(cols_, fed_conds_, rec.get())) {
                     break;
                 }
@@ -240,7 +171,39 @@ public:
     }
 
     std::unique_ptr<RmRecord> Next() override {
-        auto rec = fh_->get_record(rid_, context_);
+        if (lock_free_) {
+            return std::make_unique<RmRecord>(*cur_rec_);
+        }
+        return fetch_tuple(rid_);
+    }
+
+    /**
+     * @brief 读取扫描当前位置对应的记录
+     * index-only scan时由索引项（索引字段 + INCLUDE字段）拼出记录，未被覆盖的字段置0，planner保证上层不会用到它们
+     */
+    std::unique_ptr<RmRecord> fetch_tuple(Rid &rid) const {
+        if (!index_only_) {
+            rid = scan_->rid();
+            return fh_->get_record(rid, context_);
+        }
+        char entry[IX_MAX_COL_LEN];
+        rid = scan_->entry(entry);
+        return record_from_entry(entry);
+    }
+
+    /* 由索引项（索引字段 + INCLUDE字段）拼出记录，未被覆盖的字段置0 */
+    std::unique_ptr<RmRecord> record_from_entry(const char *entry) const {
+        auto rec = std::make_unique<RmRecord>(len_);
+        memset(rec->data, 0, len_);
+        int offset = 0;
+        for (auto &col: index_meta_.cols) {
+            memcpy(rec->data + col.offset, entry + offset, col.len);
+            offset += col.len;
+        }
+        for (auto &col: index_meta_.include_cols) {
+            memcpy(rec->data + col.offset, entry + offset, col.len);
+            offset += col.len;
+        }
         return rec;
     }
 
@@ -248,15 +211,274 @@ public:
         return cols_;
     }
 
-    bool is_end() const override{
-        if(scan_->is_end()) return true;
-        auto rid = scan_->rid();
-        auto rec = fh_->get_record(rid, context_);
-        for(int i = 0; i < index_cnt; i++){
-            if(!eval_cond(cols_, conds_[i], rec.get())) return true;
+    // 扫描区间在beginTuple中已经确定，到达上界即结束，不需要再读取记录判断条件
+    bool is_end() const override { return lock_free_ ? snapshot_end_ : scan_->is_end(); }
+
+    Rid &rid() override { return rid_; }
+
+private:
+    /**
+     * @brief 不加锁扫描按批读取索引，不物化整个扫描区间。
+     * 索引中是记录的最新键值，写事务在修改索引和页面之前先保存版本，因此没有版本链的记录在索引中的位置就是可见版本的位置，
+     * 可以直接输出索引项（index-only scan）或回表读取；有版本链的记录单独读出可见版本，按索引顺序与索引中的项归并输出。
+     * 每读一批索引项之后检查表上是否有新的版本链：扫描期间被修改的记录在修改索引之前已经有了版本链，
+     * 它们原来的索引项被删除时，下一批读取之后一定能发现，可见版本位于已输出位置之后时补入归并
+     */
+    void begin_snapshot_scan() {
+        batch_.clear();
+        batch_pos_ = 0;
+        index_done_ = range_empty_;
+        resume_key_.clear();
+        versioned_rows_.clear();
+        versioned_pos_ = 0;
+        versioned_.clear();
+        invisible_page_ = INT_MAX;
+        epoch_valid_ = false;
+        has_last_ = false;
+        snapshot_end_ = false;
+        refresh_versioned_rows();
+    }
+
+    /* 读取下一批索引项：从上一批最后一个键之后开始，读完一个叶子后在键变化处停止，同一个键的所有项在同一批中 */
+    void load_batch() {
+        batch_.clear();
+        batch_pos_ = 0;
+        {
+            // 插入和删除都持有root_latch_，读取一批期间树的结构不会变化
+            std::lock_guard<std::mutex> lock(ih->get_root_latch());
+            bool resume = !resume_key_.empty();
+            Iid lower = !reverse_ && resume ? ih->upper_bound(resume_key_.data()) : range_lower();
+            Iid upper = reverse_ && resume ? ih->lower_bound(resume_key_.data()) : range_upper();
+            IxScan scan(ih, lower, upper, sm_manager_->get_bpm(), reverse_);
+            int first_page = scan.is_end() ? -1 : scan.iid().page_no;
+            char entry[IX_MAX_COL_LEN];
+            for (; !scan.is_end(); scan.next()) {
+                Rid rid = scan.entry(entry);
+                if (scan.iid().page_no != first_page &&
+                    compare_keys(entry, batch_.back().key.data()) != 0) {
+                    break;
+                }
+                batch_.push_back({std::string(entry, index_meta_.entry_len()), rid, nullptr});
+            }
+            index_done_ = scan.is_end();
+        }
+        if (!batch_.empty()) {
+            resume_key_ = batch_.back().key.substr(0, index_meta_.col_tot_len);
+        }
+        refresh_versioned_rows();
+    }
+
+    /* 表上有新的版本链时读出它们的可见版本，满足条件且位于已输出位置之后的加入versioned_rows_ */
+    void refresh_versioned_rows() {
+        auto *version_store = context_->version_store_;
+        if (version_store == nullptr) return;
+        if (epoch_valid_ && version_store->get_epoch(fh_->GetFd()) == epoch_) return;
+        auto rids = version_store->get_versioned_rids(fh_->GetFd(), context_->txn_, &invisible_page_, &epoch_);
+        epoch_valid_ = true;
+        for (auto &rid: rids) {
+            if (!versioned_.insert({rid.page_no, rid.slot_no}).second) continue;
+            auto rec = fh_->get_visible_record(rid, context_);
+            if (rec == nullptr || (!fed_conds_.empty() && !eval_conds(cols_, fed_conds_, rec.get()))) continue;
+            SnapshotRow row{std::string(index_meta_.entry_len(), '\0'), rid, std::move(rec)};
+            index_meta_.get_key(row.rec->data, row.key.data());
+            if (has_last_ && !row_before(last_, row)) continue;
+            auto pos = std::upper_bound(versioned_rows_.begin() + versioned_pos_, versioned_rows_.end(), row,
+                                        [this](const SnapshotRow &a, const SnapshotRow &b) { return row_before(a, b); });
+            versioned_rows_.insert(pos, std::move(row));
+        }
+    }
+
+    /* 归并索引中的项和有版本链的记录，找到下一条可见且满足条件的记录 */
+    void next_snapshot_row() {
+        while (true) {
+            if (batch_pos_ == batch_.size() && !index_done_) {
+                load_batch();
+                continue;
+            }
+            bool has_entry = batch_pos_ < batch_.size();
+            bool has_versioned = versioned_pos_ < versioned_rows_.size();
+            if (has_entry) {
+                auto &entry = batch_[batch_pos_];
+                if (entry.rid.page_no >= invisible_page_ ||
+                    versioned_.count({entry.rid.page_no, entry.rid.slot_no})) {
+                    batch_pos_++;
+                    continue;
+                }
+            }
+            if (!has_entry && !has_versioned) {
+                snapshot_end_ = true;
+                return;
+            }
+            if (has_versioned && (!has_entry || row_before(versioned_rows_[versioned_pos_], batch_[batch_pos_]))) {
+                auto &row = versioned_rows_[versioned_pos_++];
+                emit(row, std::move(row.rec));
+                return;
+            }
+            auto &entry = batch_[batch_pos_++];
+            auto rec = index_only_ ? record_from_entry(entry.key.data()) : fh_->get_visible_record(entry.rid, context_);
+            if (rec == nullptr || (!fed_conds_.empty() && !eval_conds(cols_, fed_conds_, rec.get()))) continue;
+            emit(entry, std::move(rec));
+            return;
+        }
+    }
+
+    void emit(const SnapshotRow &row, std::unique_ptr<RmRecord> rec) {
+        last_.key = row.key;
+        last_.rid = row.rid;
+        has_last_ = true;
+        rid_ = row.rid;
+        cur_rec_ = std::move(rec);
+    }
+
+    /* 比较两个索引项的索引字段部分 */
+    int compare_keys(const char *a, const char *b) const {
+        int offset = 0;
+        for (auto &col: index_meta_.cols) {
+            int cmp = ix_compare(a + offset, b + offset, col.type, col.len);
+            if (cmp != 0) return cmp;
+            offset += col.len;
+        }
+        return 0;
+    }
+
+    /* a是否在扫描的输出顺序中位于b之前：按索引字段排序，相同时按rid，逆序扫描时反过来 */
+    bool row_before(const SnapshotRow &a, const SnapshotRow &b) const {
+        int cmp = compare_keys(a.key.data(), b.key.data());
+        if (cmp == 0) {
+            auto ra = std::make_pair(a.rid.page_no, a.rid.slot_no), rb = std::make_pair(b.rid.page_no, b.rid.slot_no);
+            cmp = ra < rb ? -1 : (rb < ra ? 1 : 0);
+        }
+        return reverse_ ? cmp > 0 : cmp < 0;
+    }
+
+    /* 扫描区间一端在某个索引字段上的取值 */
+    struct Bound {
+        bool valid = false;     // 该字段上是否有这一侧的条件
+        bool strict = false;    // 是否为开区间（> 或 <）
+        std::string val;        // 已转换为字段类型的取值
+    };
+
+    /**
+     * @brief 将条件中的常量转换为索引字段的类型
+     * @return 无法无损转换时返回false，该条件不参与区间计算，仍由fed_conds_过滤
+     */
+    static bool bound_value(const ColMeta &col, const Value &val, std::string &out) {
+        if (val.type == col.type) {
+            out.assign(val.raw->data, col.len);
+            return true;
+        }
+        if (col.type == TYPE_FLOAT && (val.type == TYPE_INT || val.type == TYPE_BIGINT)) {
+            double x = val.type == TYPE_INT ? (double) val.int_val : (double) val.bigint_val;
+            out.assign((const char *) &x, sizeof(double));
+            return true;
+        }
+        if (col.type == TYPE_BIGINT && val.type == TYPE_INT) {
+            long long x = val.int_val;
+            out.assign((const char *) &x, sizeof(long long));
+            return true;
         }
         return false;
     }
 
-    Rid &rid() override { return rid_; }
+    /* 用字段类型的最小值或最大值填充dest */
+    static void fill_extreme(char *dest, const ColMeta &col, bool is_max) {
+        switch (col.type) {
+            case TYPE_INT: {
+                int x = is_max ? INT32_MAX : INT32_MIN;
+                memcpy(dest, &x, sizeof(int));
+                break;
+            }
+            case TYPE_FLOAT: {
+                double x = is_max ? std::numeric_limits<double>::infinity() : -std::numeric_limits<double>::infinity();
+                memcpy(dest, &x, sizeof(double));
+                break;
+            }
+            case TYPE_BIGINT:
+            case TYPE_DATETIME: {
+                long long x = is_max ? LLONG_MAX : LLONG_MIN;
+                memcpy(dest, &x, sizeof(long long));
+                break;
+            }
+            case TYPE_STRING:
+                memset(dest, is_max ? 0xff : 0, col.len);
+                break;
+        }
+    }
+
+    /* 用另一侧的取值收紧bound：lower取较大者，upper取较小者，相等时开区间更紧 */
+    static void tighten(Bound &bound, const ColMeta &col, std::string val, bool strict, bool is_lower) {
+        if (bound.valid) {
+            int cmp = ix_compare(val.data(), bound.val.data(), col.type, col.len);
+            if (is_lower ? cmp < 0 : cmp > 0) return;
+            if (cmp == 0) strict = strict || bound.strict;
+        }
+        bound = {true, strict, std::move(val)};
+    }
+
+    /**
+     * @brief 根据索引字段上与常量比较的条件计算扫描区间两端的索引键
+     * 依次处理索引字段：等值条件把该字段固定为一个值并继续处理下一个字段，遇到范围条件（或没有条件）的字段后停止。
+     * 下界中其余字段填最小值（>时填最大值并取upper_bound），上界中其余字段填最大值（<时填最小值并取lower_bound），
+     * 这样IxScan只需比较Iid即可结束，区间外的叶子和记录都不会被访问
+     */
+    void compute_range_keys() {
+        auto &index_cols = index_meta_.cols;
+        lower_key_.assign(index_meta_.col_tot_len, 0);
+        upper_key_.assign(index_meta_.col_tot_len, 0);
+        lower_strict_ = upper_strict_ = false;
+        int offset = 0;
+        size_t i = 0;
+        for (; i < index_cols.size(); i++) {
+            auto &col = index_cols[i];
+            Bound lo, hi;
+            for (auto &cond: conds_) {
+                if (!cond.is_rhs_val || cond.lhs_col.tab_name != tab_name_ || cond.lhs_col.col_name != col.name) continue;
+                std::string val;
+                if (cond.op == OP_NE || !bound_value(col, cond.rhs_val, val)) continue;
+                if (cond.op == OP_EQ || cond.op == OP_GE || cond.op == OP_GT) {
+                    tighten(lo, col, val, cond.op == OP_GT, true);
+                }
+                if (cond.op == OP_EQ || cond.op == OP_LE || cond.op == OP_LT) {
+                    tighten(hi, col, val, cond.op == OP_LT, false);
+                }
+            }
+            if (lo.valid) memcpy(lower_key_.data() + offset, lo.val.data(), col.len);
+            else fill_extreme(lower_key_.data() + offset, col, false);
+            if (hi.valid) memcpy(upper_key_.data() + offset, hi.val.data(), col.len);
+            else fill_extreme(upper_key_.data() + offset, col, true);
+            offset += col.len;
+            bool is_eq = lo.valid && hi.valid && !lo.strict && !hi.strict &&
+                         ix_compare(lo.val.data(), hi.val.data(), col.type, col.len) == 0;
+            if (!is_eq) {
+                lower_strict_ = lo.valid && lo.strict;
+                upper_strict_ = hi.valid && hi.strict;
+                i++;
+                break;
+            }
+        }
+        for (; i < index_cols.size(); i++) {
+            fill_extreme(lower_key_.data() + offset, index_cols[i], lower_strict_);
+            fill_extreme(upper_key_.data() + offset, index_cols[i], !upper_strict_);
+            offset += index_cols[i].len;
+        }
+        int cmp = compare_keys(lower_key_.data(), upper_key_.data());
+        range_empty_ = cmp > 0 || (cmp == 0 && (lower_strict_ || upper_strict_));
+    }
+
+    /* 扫描区间的下界在索引中的位置 */
+    Iid range_lower() {
+        return lower_strict_ ? ih->upper_bound(lower_key_.data()) : ih->lower_bound(lower_key_.data());
+    }
+
+    /* 扫描区间的上界在索引中的位置，区间为空时与下界相同 */
+    Iid range_upper() {
+        if (range_empty_) return range_lower();
+        return upper_strict_ ? ih->lower_bound(upper_key_.data()) : ih->upper_bound(upper_key_.data());
+    }
+
+    /* 由compute_range_keys()得到的索引键确定扫描区间[lower, upper) */
+    void compute_range(Iid &lower, Iid &upper) {
+        lower = range_lower();
+        upper = range_empty_ ? lower : range_upper();
+    }
 };
\ No newline at end of file
@@ -36,7 +36,7 @@ public:
         }
         fh_ = sm_manager_->fhs_.at(tab_name).get();
         context_ = context;
-        context_->lock_mgr_->lock_exclusive_on_table(context->txn_, sm_manager_->fhs_[tab_name_]->GetFd());
+        context_->lock_mgr_->lock_IX_on_table(context->txn_, sm_manager_->fhs_[tab_name_]->GetFd());
     };
 
     std::string getType() override { return "InsertExecutor"; };
@@ -59,34 +59,39 @@ public:
             memcpy(rec.data + col.offset, val.raw->data, col.len);
         }
 
+        // 修改之前先锁住所有索引键，加锁失败回滚时不会留下写集合中没有记录的修改
+        // 乐观事务不加键锁，改为在唯一索引键上登记写意向
+        for (auto &index: tab_.indexes) {
+            std::vector<char> key(index.entry_len());
+            index.get_key(rec.data, key.data());
+            context_->lock_mgr_->lock_exclusive_on_key(context_->txn_, index.id, key.data(), index.col_tot_len);
+            if (index.unique && context_->version_store_ != nullptr) {
+                context_->version_store_->add_key_intent(index.id, key.data(), index.col_tot_len, context_->txn_);
+            }
+        }
+
         // 插入记录, 获取rid
-        //实际插入
-        rid_ = fh_->insert_record(rec.data, context_);
-        //更新日志-插入
-        auto *logRecord = new InsertLogRecord(context_->txn_->get_transaction_id(), rec, rid_,tab_name_);
-        logRecord->prev_lsn_ = context_->txn_->get_prev_lsn();
-        context_->log_mgr_->add_log_to_buffer(logRecord);
-        context_->txn_->set_prev_lsn(logRecord->lsn_);
+        //实际插入，插入日志在页面unpin之前写入，页面被换出时page lsn已经是这条日志
+        rid_ = fh_->insert_record(rec.data, context_, [this, &rec](Rid rid) {
+            //更新日志-插入
+            InsertLogRecord logRecord(context_->txn_->get_transaction_id(), rec, rid, tab_.id);
+            logRecord.prev_lsn_ = context_->txn_->get_prev_lsn();
+            context_->log_mgr_->add_log_to_buffer(&logRecord);
+            context_->txn_->set_prev_lsn(logRecord.lsn_);
+            return logRecord.lsn_;
+        });
         // 更新索引
         for (int i = 0; i < tab_.indexes.size(); i++) {
             auto &index = tab_.indexes[i];
             auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
             auto ih = sm_manager_->ihs_.at(ix_name).get();
-            char *key = new char[index.col_tot_len];
-            int offset = 0;
-            for (size_t j = 0; j < index.col_num; ++j) {
-                memcpy(key + offset, rec.data + index.cols[j].offset, index.cols[j].len);
-                offset += index.cols[j].len;
-            }
+            std::vector<char> key(index.entry_len());
+            index.get_key(rec.data, key.data());
 
-            //更新索引插入日志
-            auto *index_log = new IndexInsertLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name, index.col_tot_len);
-            index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(index_log);
-            context_->txn_->set_prev_lsn(index_log->lsn_);
+            //写索引插入日志，由索引在修改完页面后调用
+            auto logger = context_->index_logger(LogType::INDEX_INSERT, key.data(), rid_, index.id, index.entry_len());
 
-            auto result = ih->insert_entry(key, rid_, context_->txn_);
-            free(key);
+            auto result = ih->insert_entry(key.data(), rid_, context_->txn_, logger);
             if(!result.second){
                 //说明插入失败
                 fail_pos = i;
@@ -100,34 +105,26 @@ public:
                 auto index = tab_.indexes[i];
                 auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
                 auto ih = sm_manager_->ihs_.at(ix_name).get();
-                char *key = new char[index.col_tot_len];
-                int offset = 0;
-                for (size_t j = 0; j < index.col_num; ++j) {
-                    memcpy(key + offset, rec.data + index.cols[j].offset, index.cols[j].len);
-                    offset += index.cols[j].len;
-                }
-                //更新索引删除日志
-                auto *index_log = new IndexDeleteLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name, index.col_tot_len);
-                index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-                context_->log_mgr_->add_log_to_buffer(index_log);
-                context_->txn_->set_prev_lsn(index_log->lsn_);
+                std::vector<char> key(index.entry_len());
+                index.get_key(rec.data, key.data());
+                //写索引删除日志，由索引在修改完页面后调用
+                auto logger = context_->index_logger(LogType::INDEX_DELETE, key.data(), rid_, index.id,
+                                                     index.entry_len());
 
-                ih->delete_entry(key, context_->txn_);
-                free(key);
+                ih->delete_entry(key.data(), rid_, context_->txn_, logger);
             }
             //更新日志
-            auto *logRecord_ = new DeleteLogRecord(context_->txn_->get_transaction_id(), rec, rid_,tab_name_);
-            logRecord_->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(logRecord_);
-            context_->txn_->set_prev_lsn(logRecord_->lsn_);
+            DeleteLogRecord logRecord_(context_->txn_->get_transaction_id(), rec, rid_, tab_.id);
+            logRecord_.prev_lsn_ = context_->txn_->get_prev_lsn();
+            context_->log_mgr_->add_log_to_buffer(&logRecord_);
+            context_->txn_->set_prev_lsn(logRecord_.lsn_);
             //实际删除
-            fh_->delete_record(rid_, context_);
+            fh_->delete_record(rid_, context_, logRecord_.lsn_);
             throw RMDBError("Insert Error!!");
         }
 
         //更新事务
-        auto *wr = new WriteRecord(WType::INSERT_TUPLE, tab_name_, rid_, rec);
-        context_->txn_->append_write_record(wr);
+        context_->txn_->append_write_record(WType::INSERT_TUPLE, tab_name_, rid_, &rec);
         return nullptr;
     }
 
@@ -58,6 +58,8 @@ public:
 
     void nextTuple() override {
         assert(!prev_->is_end());
+        // 已经输出了limit条记录，不再让子节点继续扫描
+        if (cnt == limit->len) return;
         prev_->nextTuple();
     }
 
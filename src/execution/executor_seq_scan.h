@@ -28,6 +28,10 @@ private:
     Rid rid_;                           // 当前扫描到的记录的rid,Next()返回该rid对应的records
     std::unique_ptr<RecScan> scan_;     // table_iterator
 
+    bool lock_free_;                    // 隔离级别低于可串行化或乐观事务不加锁，读取对当前事务可见的版本
+    bool end_ = false;                  // 不加锁扫描时是否已经结束
+    std::unique_ptr<RmRecord> rec_;     // 不加锁扫描时rid_对应的可见版本
+
     SmManager *sm_manager_;
 
 public:
@@ -41,9 +45,14 @@ public:
         len_ = cols_.back().offset + cols_.back().len;
 
         context_ = context;
-        context_->lock_mgr_->lock_shared_on_table(context_->txn_, sm_manager_->fhs_[tab_name_]->GetFd());
+        lock_free_ = context_->txn_->get_isolation_level() != IsolationLevel::SERIALIZABLE ||
+                     context_->txn_->is_optimistic();
+        if (!lock_free_) {
+            context_->lock_mgr_->lock_shared_on_table(context_->txn_, sm_manager_->fhs_[tab_name_]->GetFd());
+        }
 
         fed_conds_ = conds_;
+        append_read_predicate(fh_->GetFd(), tab_name_, cols_, fed_conds_);
     }
 
     std::string getType() override { return "SeqScanExecutor"; };
@@ -57,6 +66,12 @@ public:
     void beginTuple() override {
         // 构建scan_
         scan_ = std::make_unique<RmScan>(fh_);
+        if (lock_free_) {
+            end_ = false;
+            rid_ = {RM_FIRST_RECORD_PAGE, RM_NO_SLOT};
+            next_visible();
+            return;
+        }
         while (!scan_->is_end()) {
             rid_ = scan_->rid();
             auto rec = fh_->get_record(rid_, context_);
@@ -73,6 +88,10 @@ public:
      *
      */
     void nextTuple() override {
+        if (lock_free_) {
+            if (!end_) next_visible();
+            return;
+        }
         if (!scan_->is_end()) {
             scan_->next();
         }
@@ -92,6 +111,9 @@ public:
      * @return std::unique_ptr<RmRecord>
      */
     std::unique_ptr<RmRecord> Next() override {
+        if (lock_free_) {
+            return std::make_unique<RmRecord>(*rec_);
+        }
         auto rec = fh_->get_record(rid_, context_);
         return rec;
     }
@@ -101,8 +123,40 @@ public:
     }
 
     bool is_end() const override {
-        return scan_->is_end();
+        return lock_free_ ? end_ : scan_->is_end();
     }
 
     Rid &rid() override { return rid_; }
+
+private:
+    /**
+     * @brief 不加锁扫描时找到rid_之后下一条可见且满足条件的记录。其他事务可能正在并发地修改页面，
+     * 快照中存在但已从页面上删除的记录按rid顺序从版本链中补上；scan_停在尚未处理的下一条记录上，
+     * 删除在清除bitmap之前保存了版本，因此scan_越过被删除的位置之后再查找版本链不会遗漏
+     */
+    void next_visible() {
+        auto *version_store = context_->version_store_;
+        while (true) {
+            Rid versioned{};
+            bool has_versioned = version_store != nullptr &&
+                                 version_store->next_versioned_rid(fh_->GetFd(), rid_, &versioned);
+            if (scan_->is_end() && !has_versioned) {
+                end_ = true;
+                return;
+            }
+            if (!scan_->is_end()) {
+                Rid cur = scan_->rid();
+                if (!has_versioned || std::make_pair(cur.page_no, cur.slot_no) <=
+                                          std::make_pair(versioned.page_no, versioned.slot_no)) {
+                    versioned = cur;
+                    scan_->next();
+                }
+            }
+            rid_ = versioned;
+            rec_ = fh_->get_visible_record(rid_, context_);
+            if (rec_ != nullptr && (fed_conds_.empty() || eval_conds(cols_, fed_conds_, rec_.get()))) {
+                return;
+            }
+        }
+    }
 };
\ No newline at end of file
@@ -10,6 +10,7 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <algorithm>
 #include <utility>
 
 #include "execution_defs.h"
@@ -28,6 +29,9 @@ private:
     std::string tab_name_;
     std::vector<SetClause> set_clauses_;
     SmManager *sm_manager_;
+    std::vector<IndexMeta *> indexes_;      // 索引项中包含被SET修改的字段的索引，只需要维护这些索引
+    std::vector<IxIndexHandle *> ihs_;      // 与indexes_一一对应的索引句柄
+    std::vector<char> key_;                 // 构造索引项的缓冲区，长度为最长的索引项
 
 public:
     UpdateExecutor(SmManager *sm_manager, const std::string &tab_name, std::vector<SetClause> set_clauses,
@@ -40,9 +44,22 @@ public:
         conds_ = std::move(conds);
         rids_ = std::move(rids);
         context_ = context;
+        context_->lock_mgr_->lock_IX_on_table(context->txn_, fh_->GetFd());
         for (const auto &i: tab_.cols) {
             len_ += i.len;
         }
+        // SET没有修改任何索引字段和INCLUDE字段时，更新前后的索引项相同，不需要删除再插入
+        size_t key_len = 0;
+        for (auto &index: tab_.indexes) {
+            bool affected = std::any_of(set_clauses_.begin(), set_clauses_.end(),
+                                        [&index](const SetClause &set) { return index.covers(set.lhs.col_name); });
+            if (!affected) continue;
+            indexes_.push_back(&index);
+            auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
+            ihs_.push_back(sm_manager_->ihs_.at(ix_name).get());
+            key_len = std::max(key_len, (size_t) index.entry_len());
+        }
+        key_.resize(key_len);
     }
 
     std::string getType() override { return "UpdateExecutor"; };
@@ -50,51 +67,28 @@ public:
     size_t tupleLen() const override { return len_; };
 
     void delete_index(RmRecord *rec, Rid rid_) {
-        // 删除索引
-        for (auto &index: tab_.indexes) {
-            auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
-            auto ih = sm_manager_->ihs_.at(ix_name).get();
-            char *key = new char[index.col_tot_len];
-            int offset = 0;
-            for (size_t j = 0; j < index.col_num; ++j) {
-                memcpy(key + offset, rec->data + index.cols[j].offset, index.cols[j].len);
-                offset += index.cols[j].len;
-            }
+        // 删除受影响的索引中的索引项
+        for (size_t i = 0; i < indexes_.size(); i++) {
+            auto &index = *indexes_[i];
+            index.get_key(rec->data, key_.data());
 
-            //更新索引删除日志
-            auto *index_log = new IndexDeleteLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name,
-                                                       index.col_tot_len);
-            index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(index_log);
-            context_->txn_->set_prev_lsn(index_log->lsn_);
+            //写索引删除日志，由索引在修改完页面后调用
+            auto logger = context_->index_logger(LogType::INDEX_DELETE, key_.data(), rid_, index.id, index.entry_len());
 
-            ih->delete_entry(key, context_->txn_);
-            free(key);
+            ihs_[i]->delete_entry(key_.data(), rid_, context_->txn_, logger);
         }
     }
 
     bool insert_index(RmRecord *rec, Rid rid_) {
-        // 插入索引
+        // 插入受影响的索引中的索引项
         int fail_p = -1;
-        for (int i = 0; i < tab_.indexes.size(); i++) {
-            auto &index = tab_.indexes[i];
-            auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
-            auto ih = sm_manager_->ihs_.at(ix_name).get();
-            char *key = new char[index.col_tot_len];
-            int offset = 0;
-            for (size_t j = 0; j < index.col_num; ++j) {
-                memcpy(key + offset, rec->data + index.cols[j].offset, index.cols[j].len);
-                offset += index.cols[j].len;
-            }
-            //更新索引插入日志
-            auto *index_log = new IndexInsertLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name,
-                                                       index.col_tot_len);
-            index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(index_log);
-            context_->txn_->set_prev_lsn(index_log->lsn_);
-
-            auto result = ih->insert_entry(key, rid_, context_->txn_);
-            free(key);
+        for (int i = 0; i < indexes_.size(); i++) {
+            auto &index = *indexes_[i];
+            index.get_key(rec->data, key_.data());
+            //写索引插入日志，由索引在修改完页面后调用
+            auto logger = context_->index_logger(LogType::INDEX_INSERT, key_.data(), rid_, index.id, index.entry_len());
+
+            auto result = ihs_[i]->insert_entry(key_.data(), rid_, context_->txn_, logger);
             if (!result.second) {
                 fail_p = i;
                 break;
@@ -104,25 +98,14 @@ public:
             //说明插入失败，需要rollback
             //删掉已插入索引
             for (int i = 0; i < fail_p; i++) {
-                auto &index = tab_.indexes[i];
-                auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name_, index.cols);
-                auto ih = sm_manager_->ihs_.at(ix_name).get();
-                char *key = new char[index.col_tot_len];
-                int offset = 0;
-                for (size_t j = 0; j < index.col_num; ++j) {
-                    memcpy(key + offset, rec->data + index.cols[j].offset, index.cols[j].len);
-                    offset += index.cols[j].len;
-                }
+                auto &index = *indexes_[i];
+                index.get_key(rec->data, key_.data());
 
-                //更新索引删除日志
-                auto *index_log = new IndexDeleteLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name,
-                                                           index.col_tot_len);
-                index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-                context_->log_mgr_->add_log_to_buffer(index_log);
-                context_->txn_->set_prev_lsn(index_log->lsn_);
+                //写索引删除日志，由索引在修改完页面后调用
+                auto logger = context_->index_logger(LogType::INDEX_DELETE, key_.data(), rid_, index.id,
+                                                     index.entry_len());
 
-                ih->delete_entry(key, context_->txn_);
-                free(key);
+                ihs_[i]->delete_entry(key_.data(), rid_, context_->txn_, logger);
             }
             return false;
         }
@@ -142,7 +125,6 @@ public:
             //查找记录
             auto rec = fh_->get_record(rid, context_);
             auto old_rec = fh_->get_record(rid, context_);
-            delete_index(rec.get(), rid);
             upd_cnt++;
             for (const auto &i: set_clauses_) {
                 auto col = mp[i.lhs];
@@ -185,6 +167,24 @@ public:
                 //更新记录数据
                 memcpy(rec->data + col.offset, value.raw->data, col.len);
             }
+            // 修改之前先加好记录和新旧索引键上的锁，加锁失败回滚时不会留下写集合中没有记录的修改
+            context_->lock_mgr_->lock_exclusive_on_record(context_->txn_, rid, fh_->GetFd());
+            for (auto *index: indexes_) {
+                for (auto *data: {old_rec->data, rec->data}) {
+                    index->get_key(data, key_.data());
+                    context_->lock_mgr_->lock_exclusive_on_key(context_->txn_, index->id, key_.data(),
+                                                               index->col_tot_len);
+                    if (index->unique && context_->version_store_ != nullptr) {
+                        context_->version_store_->add_key_intent(index->id, key_.data(), index->col_tot_len,
+                                                                 context_->txn_);
+                    }
+                }
+            }
+            // 修改索引和页面之前保存旧版本，快照读在修改过程中也能读到更新之前的记录
+            if (context_->version_store_ != nullptr) {
+                context_->version_store_->add_version(fh_->GetFd(), rid, context_->txn_, old_rec.get());
+            }
+            delete_index(old_rec.get(), rid);
             if (!insert_index(rec.get(), rid)) {
                 is_fail = true;
                 insert_index(old_rec.get(), rid);
@@ -192,15 +192,15 @@ public:
                 break;
             }
             //更新日志
-            auto *logRecord = new UpdateLogRecord(context_->txn_->get_transaction_id(), *old_rec, rid, tab_name_, *rec);
-            logRecord->prev_lsn_ = context_->txn_->get_prev_lsn();
-            context_->log_mgr_->add_log_to_buffer(logRecord);
-            context_->txn_->set_prev_lsn(logRecord->lsn_);
+            UpdateLogRecord logRecord(context_->txn_->get_transaction_id(), *old_rec, rid, tab_.id, *rec,
+                                      tab_.cols);
+            logRecord.prev_lsn_ = context_->txn_->get_prev_lsn();
+            context_->log_mgr_->add_log_to_buffer(&logRecord);
+            context_->txn_->set_prev_lsn(logRecord.lsn_);
             //更新记录
-            fh_->update_record(rid, rec->data, context_);
+            fh_->update_record(rid, rec->data, context_, logRecord.lsn_);
             //更新事务
-            auto *wr = new WriteRecord(WType::UPDATE_TUPLE, tab_name_, rid, *old_rec);
-            context_->txn_->append_write_record(wr);
+            context_->txn_->append_write_record(WType::UPDATE_TUPLE, tab_name_, rid, old_rec.get());
         }
 
         if (is_fail) {
@@ -216,13 +216,13 @@ public:
                 delete_index(now_rec.get(), rid_);
                 insert_index(&rec_, rid_);
                 //更新日志
-                auto *logRecord = new UpdateLogRecord(context_->txn_->get_transaction_id(), *now_rec, rid_, tab_name_,
-                                                      rec_);
-                logRecord->prev_lsn_ = context_->txn_->get_prev_lsn();
-                context_->log_mgr_->add_log_to_buffer(logRecord);
-                context_->txn_->set_prev_lsn(logRecord->lsn_);
+                UpdateLogRecord logRecord(context_->txn_->get_transaction_id(), *now_rec, rid_, tab_.id,
+                                          rec_, tab_.cols);
+                logRecord.prev_lsn_ = context_->txn_->get_prev_lsn();
+                context_->log_mgr_->add_log_to_buffer(&logRecord);
+                context_->txn_->set_prev_lsn(logRecord.lsn_);
 
-                fh_->update_record(rid_, rec_.data, context_);
+                fh_->update_record(rid_, rec_.data, context_, logRecord.lsn_);
                 context_->txn_->delete_write_record();
             }
             throw RMDBError("update error!!");
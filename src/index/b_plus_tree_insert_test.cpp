@@ -327,3 +327,180 @@ TEST_F(BPlusTreeTests, LargeScaleTest) {
     }
     EXPECT_EQ(current_key, keys.size() + 1);
 }
+
+/**
+ * @brief 非唯一索引：每个key插入多个rid，使用get_value()和IxScan测试所有重复key都能被查到，并按rid删除
+ */
+TEST_F(BPlusTreeTests, DuplicateKeyTest) {
+    const int scale = 200;
+    const int dup = 7;
+    const int order = 4;
+
+    // 将SetUp中创建的唯一索引替换为非唯一索引
+    std::vector<ColMeta> cols = {{.tab_name = TEST_FILE_NAME,
+                                  .name = std::to_string(index_no),
+                                  .type = TYPE_INT,
+                                  .len = sizeof(int),
+                                  .offset = 0,
+                                  .index = false}};
+    ix_manager_->close_index(ih_.get());
+    ix_manager_->destroy_index(TEST_FILE_NAME, cols);
+    ix_manager_->create_index(TEST_FILE_NAME, cols, false);
+    ih_ = ix_manager_->open_index(TEST_FILE_NAME, cols);
+    ASSERT_FALSE(ih_->is_unique());
+
+    assert(order > 2 && order <= ih_->file_hdr_->btree_order_);
+    ih_->file_hdr_->btree_order_ = order;
+
+    std::vector<std::pair<int, Rid>> entries;
+    for (int key = 0; key < scale; key++) {
+        for (int j = 0; j < dup; j++) {
+            entries.push_back({key, Rid{.page_no = key, .slot_no = j}});
+        }
+    }
+    auto rng = std::default_random_engine{};
+    std::shuffle(entries.begin(), entries.end(), rng);
+    for (auto &entry : entries) {
+        auto insert_ret = ih_->insert_entry((const char *)&entry.first, entry.second, txn_.get());
+        ASSERT_EQ(insert_ret.second, true);
+    }
+    // (key, rid)完全相同时仍然拒绝插入
+    auto insert_ret = ih_->insert_entry((const char *)&entries[0].first, entries[0].second, txn_.get());
+    ASSERT_EQ(insert_ret.second, false);
+
+    std::vector<Rid> rids;
+    for (int key = 0; key < scale; key++) {
+        ih_->get_value((const char *)&key, &rids, txn_.get());
+        ASSERT_EQ(rids.size(), dup);
+        for (int j = 0; j < dup; j++) {
+            EXPECT_EQ(rids[j], (Rid{.page_no = key, .slot_no = j}));
+        }
+    }
+
+    // 等值范围扫描：[lower_bound(key), upper_bound(key))
+    for (int key = 0; key < scale; key += 13) {
+        IxScan scan(ih_.get(), ih_->lower_bound((const char *)&key), ih_->upper_bound((const char *)&key),
+                    buffer_pool_manager_.get());
+        int cnt = 0;
+        while (!scan.is_end()) {
+            EXPECT_EQ(scan.rid().page_no, key);
+            cnt++;
+            scan.next();
+        }
+        EXPECT_EQ(cnt, dup);
+    }
+
+    // 按rid删除一半重复key，其余仍能被查到
+    for (int key = 0; key < scale; key++) {
+        for (int j = 0; j < dup; j += 2) {
+            ASSERT_TRUE(ih_->delete_entry((const char *)&key, Rid{.page_no = key, .slot_no = j}, txn_.get()));
+        }
+    }
+    for (int key = 0; key < scale; key++) {
+        ih_->get_value((const char *)&key, &rids, txn_.get());
+        ASSERT_EQ(rids.size(), dup / 2);
+        for (auto &rid : rids) {
+            EXPECT_EQ(rid.slot_no % 2, 1);
+        }
+    }
+}
+
+/**
+ * @brief INCLUDE字段：随索引字段一起存放在键中但不参与比较，使用IxScan::entry()读出完整的索引项
+ */
+TEST_F(BPlusTreeTests, IncludeColumnTest) {
+    const int scale = 500;
+    const int order = 5;
+
+    std::vector<ColMeta> cols = {{.tab_name = TEST_FILE_NAME,
+                                  .name = std::to_string(index_no),
+                                  .type = TYPE_INT,
+                                  .len = sizeof(int),
+                                  .offset = 0,
+                                  .index = false}};
+    std::vector<ColMeta> include_cols = {{.tab_name = TEST_FILE_NAME,
+                                          .name = "inc",
+                                          .type = TYPE_INT,
+                                          .len = sizeof(int),
+                                          .offset = sizeof(int),
+                                          .index = false}};
+    ix_manager_->close_index(ih_.get());
+    ix_manager_->destroy_index(TEST_FILE_NAME, cols);
+    ix_manager_->create_index(TEST_FILE_NAME, cols, false, include_cols);
+    ih_ = ix_manager_->open_index(TEST_FILE_NAME, cols);
+    ASSERT_EQ(ih_->file_hdr_->include_len_, sizeof(int));
+
+    assert(order > 2 && order <= ih_->file_hdr_->btree_order_);
+    ih_->file_hdr_->btree_order_ = order;
+
+    // 每个key插入两次，INCLUDE字段分别为key * 10和key * 10 + 1
+    for (int key = scale - 1; key >= 0; key--) {
+        for (int j = 0; j < 2; j++) {
+            int entry[2] = {key, key * 10 + j};
+            auto insert_ret = ih_->insert_entry((const char *)entry, Rid{.page_no = key, .slot_no = j}, txn_.get());
+            ASSERT_EQ(insert_ret.second, true);
+        }
+    }
+
+    // 比较只看索引字段，get_value能查到两个rid
+    std::vector<Rid> rids;
+    int key = scale / 2;
+    ih_->get_value((const char *)&key, &rids, txn_.get());
+    ASSERT_EQ(rids.size(), 2);
+
+    IxScan scan(ih_.get(), ih_->leaf_begin(), ih_->leaf_end(), buffer_pool_manager_.get());
+    int cnt = 0;
+    while (!scan.is_end()) {
+        int entry[2];
+        Rid rid = scan.entry((char *)entry);
+        EXPECT_EQ(entry[0], cnt / 2);
+        EXPECT_EQ(entry[1], entry[0] * 10 + rid.slot_no);
+        EXPECT_EQ(rid.page_no, entry[0]);
+        cnt++;
+        scan.next();
+    }
+    EXPECT_EQ(cnt, scale * 2);
+}
+
+/**
+ * @brief 反向扫描：IxScan从upper的前一个位置开始，跨叶子向前遍历到lower为止
+ */
+TEST_F(BPlusTreeTests, ReverseScanTest) {
+    const int scale = 1000;
+    const int order = 4;
+
+    assert(order > 2 && order <= ih_->file_hdr_->btree_order_);
+    ih_->file_hdr_->btree_order_ = order;
+
+    for (int key = 0; key < scale; key++) {
+        auto insert_ret = ih_->insert_entry((const char *)&key, Rid{.page_no = key, .slot_no = key}, txn_.get());
+        ASSERT_EQ(insert_ret.second, true);
+    }
+
+    // 全表逆序
+    IxScan scan(ih_.get(), ih_->leaf_begin(), ih_->leaf_end(), buffer_pool_manager_.get(), true);
+    int expect = scale - 1;
+    while (!scan.is_end()) {
+        EXPECT_EQ(scan.rid().page_no, expect);
+        expect--;
+        scan.next();
+    }
+    EXPECT_EQ(expect, -1);
+
+    // 范围[lo, hi]逆序
+    int lo = 123, hi = 876;
+    IxScan range_scan(ih_.get(), ih_->lower_bound((const char *)&lo), ih_->upper_bound((const char *)&hi),
+                      buffer_pool_manager_.get(), true);
+    expect = hi;
+    while (!range_scan.is_end()) {
+        EXPECT_EQ(range_scan.rid().page_no, expect);
+        expect--;
+        range_scan.next();
+    }
+    EXPECT_EQ(expect, lo - 1);
+
+    // 空范围
+    IxScan empty_scan(ih_.get(), ih_->lower_bound((const char *)&lo), ih_->lower_bound((const char *)&lo),
+                      buffer_pool_manager_.get(), true);
+    EXPECT_TRUE(empty_scan.is_end());
+}
@@ -10,6 +10,8 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <functional>
+#include <string>
 #include <vector>
 
 #include "defs.h"
@@ -25,7 +27,7 @@ constexpr int IX_MAX_COL_LEN = 512;
 class IxFileHdr {
 public:
     page_id_t first_free_page_no_;      // 文件中第一个空闲的磁盘页面的页面号
-    int num_pages_;                     // 磁盘文件中页面的数量
+    int num_pages_;                     // 文件中已分配的页面数量，包括空闲链表中的页面，新分配页面的页号从num_pages_开始
     page_id_t root_page_;               // B+树根节点对应的页面号
     int col_num_;                       // 索引包含的字段数量
     std::vector<ColType> col_types_;    // 字段的类型
@@ -36,22 +38,34 @@ public:
     // first_leaf初始化之后没有进行修改，只不过是在测试文件中遍历叶子结点的时候用了
     page_id_t first_leaf_;              // 首叶节点对应的页号，在上层IxManager的open函数进行初始化，初始化为root page_no
     page_id_t last_leaf_;               // 尾叶节点对应的页号
+    bool unique_;                       // 是否为唯一索引，非唯一索引在每个key后附加rid，以(key, rid)作为实际的键
+    int include_len_;                   // INCLUDE字段的总长度，紧跟在索引字段之后存放，不参与比较
     int tot_len_;                       // 记录结构体的整体长度
 
     IxFileHdr() {
         tot_len_ = col_num_ = 0;
+        unique_ = true;
+        include_len_ = 0;
     }
 
     IxFileHdr(page_id_t first_free_page_no, int num_pages, page_id_t root_page, int col_num,
-              int col_tot_len, int btree_order, int keys_size, page_id_t first_leaf, page_id_t last_leaf)
+              int col_tot_len, int btree_order, int keys_size, page_id_t first_leaf, page_id_t last_leaf,
+              bool unique = true, int include_len = 0)
             : first_free_page_no_(first_free_page_no), num_pages_(num_pages), root_page_(root_page), col_num_(col_num),
-              col_tot_len_(col_tot_len), btree_order_(btree_order), keys_size_(keys_size), first_leaf_(first_leaf), last_leaf_(last_leaf) {
+              col_tot_len_(col_tot_len), btree_order_(btree_order), keys_size_(keys_size), first_leaf_(first_leaf), last_leaf_(last_leaf),
+              unique_(unique), include_len_(include_len) {
         tot_len_ = 0;
     }
 
+    /* 结点中每个键实际占用的长度：索引字段 + INCLUDE字段，非唯一索引需要额外存放rid */
+    int key_len() const { return col_tot_len_ + include_len_ + (unique_ ? 0 : (int) sizeof(Rid)); }
+
+    /* 非唯一索引中rid在键中的偏移 */
+    int rid_offset() const { return col_tot_len_ + include_len_; }
+
     void update_tot_len() {
         tot_len_ = 0;
-        tot_len_ += sizeof(page_id_t) * 4 + sizeof(int) * 6;
+        tot_len_ += sizeof(page_id_t) * 4 + sizeof(int) * 7 + sizeof(bool);
         tot_len_ += sizeof(ColType) * col_num_ + sizeof(int) * col_num_;
     }
 
@@ -85,6 +99,10 @@ public:
         offset += sizeof(page_id_t);
         memcpy(dest + offset, &last_leaf_, sizeof(page_id_t));
         offset += sizeof(page_id_t);
+        memcpy(dest + offset, &unique_, sizeof(bool));
+        offset += sizeof(bool);
+        memcpy(dest + offset, &include_len_, sizeof(int));
+        offset += sizeof(int);
         assert(offset == tot_len_);
     }
 
@@ -100,7 +118,6 @@ public:
         offset += sizeof(page_id_t);
         col_num_ = *reinterpret_cast<const int*>(src + offset);
         offset += sizeof(int);
-        std::cout << col_num_ << "\n";
         for(int i = 0; i < col_num_; ++i) {
             // col_types_[i] = *reinterpret_cast<const ColType*>(src + offset);
             ColType type = *reinterpret_cast<const ColType*>(src + offset);
@@ -123,20 +140,110 @@ public:
         offset += sizeof(page_id_t);
         last_leaf_ = *reinterpret_cast<const page_id_t*>(src + offset);
         offset += sizeof(page_id_t);
+        unique_ = *reinterpret_cast<const bool*>(src + offset);
+        offset += sizeof(bool);
+        include_len_ = *reinterpret_cast<const int*>(src + offset);
+        offset += sizeof(int);
         assert(offset == tot_len_);
     }
 };
 
 class IxPageHdr {
 public:
-    page_id_t next_free_page_no;    // unused
+    lsn_t page_lsn;                 // 最后一次修改该结点的日志的lsn，与Page::OFFSET_LSN处的page lsn是同一个字段
     page_id_t parent;               // 父亲节点所在页面的叶号
     int num_key;                    // # current keys (always equals to #child - 1) 已插入的keys数量，key_idx∈[0,num_key)
     bool is_leaf;                   // 是否为叶节点
     page_id_t prev_leaf;            // previous leaf node's page_no, effective only when is_leaf is true
     page_id_t next_leaf;            // next leaf node's page_no, effective only when is_leaf is true
+                                    // 被删除的结点中存放空闲链表中下一个空闲页面的页号
+};
+
+/* 一次索引操作对一个页面的修改：页面中从offset_开始的一段字节修改后的内容 */
+struct IxPageDelta {
+    page_id_t page_no_;
+    int offset_;
+    std::string data_;
+};
+
+/**
+ * 一次索引插入/删除的重做信息，随索引日志写入磁盘
+ * 只修改了一个叶子结点中的键值对时，重做时直接在leaf_page_no_上重新插入/删除该键值对；
+ * 否则（分裂、合并、重分配等）记录每个被修改页面的变化，以及修改后的file header
+ */
+class IxRedoInfo {
+public:
+    page_id_t leaf_page_no_ = IX_NO_PAGE;   // 逻辑重做的叶子结点，IX_NO_PAGE表示按deltas_重做
+    std::vector<IxPageDelta> deltas_;       // 被修改页面的变化
+    bool hdr_changed_ = false;              // 是否修改了file header，为true时以下字段有效
+    page_id_t root_page_ = IX_NO_PAGE;
+    page_id_t first_leaf_ = IX_NO_PAGE;
+    page_id_t last_leaf_ = IX_NO_PAGE;
+    int num_pages_ = 0;
+    page_id_t first_free_ = IX_NO_PAGE;
+
+    // 页号、偏移量和长度都以varint存放，file header的字段只在被修改时存放
+    int size() const {
+        int size = varint_size(leaf_page_no_) + varint_size(deltas_.size());
+        for (auto &delta: deltas_) {
+            size += varint_size(delta.page_no_) + varint_size(delta.offset_) + varint_size(delta.data_.size()) +
+                    delta.data_.size();
+        }
+        size += sizeof(bool);
+        if (hdr_changed_) {
+            size += varint_size(root_page_) + varint_size(first_leaf_) + varint_size(last_leaf_) +
+                    varint_size(num_pages_) + varint_size(first_free_);
+        }
+        return size;
+    }
+
+    void serialize(char *dest) const {
+        dest = put_varint(dest, leaf_page_no_);
+        dest = put_varint(dest, deltas_.size());
+        for (auto &delta: deltas_) {
+            dest = put_varint(dest, delta.page_no_);
+            dest = put_varint(dest, delta.offset_);
+            dest = put_varint(dest, delta.data_.size());
+            memcpy(dest, delta.data_.data(), delta.data_.size());
+            dest += delta.data_.size();
+        }
+        *dest++ = hdr_changed_;
+        if (hdr_changed_) {
+            dest = put_varint(dest, root_page_);
+            dest = put_varint(dest, first_leaf_);
+            dest = put_varint(dest, last_leaf_);
+            dest = put_varint(dest, num_pages_);
+            put_varint(dest, first_free_);
+        }
+    }
+
+    void deserialize(const char *src) {
+        src = get_varint(src, &leaf_page_no_);
+        size_t delta_num;
+        src = get_varint(src, &delta_num);
+        deltas_.resize(delta_num);
+        for (auto &delta: deltas_) {
+            src = get_varint(src, &delta.page_no_);
+            src = get_varint(src, &delta.offset_);
+            size_t len;
+            src = get_varint(src, &len);
+            delta.data_.assign(src, len);
+            src += len;
+        }
+        hdr_changed_ = *src++;
+        if (hdr_changed_) {
+            src = get_varint(src, &root_page_);
+            src = get_varint(src, &first_leaf_);
+            src = get_varint(src, &last_leaf_);
+            src = get_varint(src, &num_pages_);
+            get_varint(src, &first_free_);
+        }
+    }
 };
 
+/* 写索引日志的回调：索引操作修改完页面、unpin之前调用，返回日志的lsn，用于标记被修改的页面 */
+using IxLogger = std::function<lsn_t(const IxRedoInfo &)>;
+
 class Iid {
 public:
     int page_no;
@@ -12,21 +12,36 @@ See the Mulan PSL v2 for more details. */
 
 #include "ix_scan.h"
 
+thread_local const IxIndexHandle *IxIndexHandle::op_index_ = nullptr;
+
+/**
+ * @brief 比较target与当前node中第key_idx个key
+ *
+ * @param is_prefix 为true时target只包含索引字段，只比较索引字段部分；
+ * 否则对于非唯一索引，target为(key, rid)，索引字段相等时继续比较rid
+ * @return target<key返回负数，相等返回0，大于返回正数
+ */
+int IxNodeHandle::compare_key(const char *target, int key_idx, bool is_prefix) const {
+    const char *now = get_key(key_idx);
+    int res = ix_compare(target, now, file_hdr->col_types_, file_hdr->col_lens_);
+    if (res != 0 || is_prefix || file_hdr->unique_) return res;
+    return ix_compare_rid(target + file_hdr->rid_offset(), now + file_hdr->rid_offset());
+}
+
 /**
  * @brief 在当前node中查找第一个>=target的key_idx
  *
  * @return key_idx，范围为[0,num_key)，如果返回的key_idx=num_key，则表示target大于最后一个key
  * @note 返回key index（同时也是rid index），作为slot no
  */
-int IxNodeHandle::lower_bound(const char *target) const {
+int IxNodeHandle::lower_bound(const char *target, bool is_prefix) const {
     // Todo:
     // 查找当前节点中第一个大于等于target的key，并返回key的位置给上层
     // 提示: 可以采用多种查找方式，如顺序遍历、二分查找等；使用ix_compare()函数进行比较
     int l = 0, r = page_hdr->num_key - 1;
     while (l <= r) {
         int mid = (l + r) >> 1;
-        char *now = get_key(mid);
-        int res = ix_compare(target, now, file_hdr->col_types_, file_hdr->col_lens_);
+        int res = compare_key(target, mid, is_prefix);
         if (res <= 0) {// target <= now
             r = mid - 1;
         } else {// target > now
@@ -42,15 +57,14 @@ int IxNodeHandle::lower_bound(const char *target) const {
  * @return key_idx，范围为[0,num_key)，如果返回的key_idx=num_key，则表示target大于等于最后一个key
  * @note 注意此处的范围从1开始
  */
-int IxNodeHandle::upper_bound(const char *target) const {
+int IxNodeHandle::upper_bound(const char *target, bool is_prefix) const {
     // Todo:
     // 查找当前节点中第一个大于target的key，并返回key的位置给上层
     // 提示: 可以采用多种查找方式：顺序遍历、二分查找等；使用ix_compare()函数进行比较
     int l = 0, r = get_size() - 1;
     while (l <= r) {
         int mid = (l + r) >> 1;
-        char *now = get_key(mid);
-        int res = ix_compare(target, now, file_hdr->col_types_, file_hdr->col_lens_);
+        int res = compare_key(target, mid, is_prefix);
         if (res < 0) {// target < now
             r = mid - 1;
         } else {// target >= now
@@ -75,14 +89,12 @@ bool IxNodeHandle::leaf_lookup(const char *key, Rid **value) {
     // 3. 如果存在，获取key对应的Rid，并赋值给传出参数value
     // 提示：可以调用lower_bound()和get_rid()函数。
     assert(is_leaf_page());
-    int key_idx = lower_bound(key);
+    int key_idx = lower_bound(key, true);
     if (key_idx == get_size()) {
         //不存在
         return false;
     }
-    char *now = get_key(key_idx);
-    int res = ix_compare(key, now, file_hdr->col_types_, file_hdr->col_lens_);
-    if (res != 0) {
+    if (compare_key(key, key_idx, true) != 0) {
         //不相等
         return false;
     }
@@ -93,14 +105,16 @@ bool IxNodeHandle::leaf_lookup(const char *key, Rid **value) {
 /**
  * 用于内部结点（非叶子节点）查找目标key所在的孩子结点（子树）
  * @param key 目标key
+ * @param is_prefix key是否只包含索引字段（非唯一索引的查询）
+ * @param find_first 是否查找第一个>=key的位置所在的孩子，非唯一索引中相同的key可能跨越多个孩子
  * @return page_id_t 目标key所在的孩子节点（子树）的存储页面编号
  */
-page_id_t IxNodeHandle::internal_lookup(const char *key) {
+page_id_t IxNodeHandle::internal_lookup(const char *key, bool is_prefix, bool find_first) {
     // Todo:
     // 1. 查找当前非叶子节点中目标key所在孩子节点（子树）的位置
     // 2. 获取该孩子节点（子树）所在页面的编号
     // 3. 返回页面编号
-    int key_idx = upper_bound(key) - 1;
+    int key_idx = (find_first ? lower_bound(key, is_prefix) : upper_bound(key, is_prefix)) - 1;
     key_idx = std::max(key_idx, 0);
     return value_at(key_idx);
 }
@@ -126,9 +140,10 @@ void IxNodeHandle::insert_pairs(int pos, const char *key, const Rid *rid, int n)
     // 3. 通过rid获取n个连续键值对的rid值，并把n个rid值插入到pos位置
     // 4. 更新当前节点的键数量
     if (pos >= 0 && pos <= page_hdr->num_key) {
+        int key_len = file_hdr->key_len();
         auto kp = get_key(pos);
-        memmove(kp + n * file_hdr->col_tot_len_, kp, (page_hdr->num_key - pos) * file_hdr->col_tot_len_);
-        memcpy(kp, key, n * file_hdr->col_tot_len_);
+        memmove(kp + n * key_len, kp, (page_hdr->num_key - pos) * key_len);
+        memcpy(kp, key, n * key_len);
         auto rp = get_rid(pos);
         memmove(rp + n, rp, (page_hdr->num_key - pos) * sizeof(Rid));
         memcpy(rp, rid, n * sizeof(Rid));
@@ -151,10 +166,8 @@ int IxNodeHandle::insert(const char *key, const Rid &value) {
     // 4. 返回完成插入操作之后的键值对数量
     int pos = lower_bound(key);
     if (pos < get_size()) {
-        char *now = get_key(pos);
-        int res = ix_compare(key, now, file_hdr->col_types_, file_hdr->col_lens_);
-        if (res == 0) {
-            //key重复则不插入
+        if (compare_key(key, pos, false) == 0) {
+            //key重复则不插入，非唯一索引中只有(key, rid)完全相同才视为重复
             return page_hdr->num_key;
         }
     }
@@ -173,8 +186,9 @@ void IxNodeHandle::erase_pairs(int pos, int n){
     // 2. 删除该位置的rid
     // 3. 更新结点的键值对数量
     if (pos >= 0 && pos < page_hdr->num_key) {
+        int key_len = file_hdr->key_len();
         auto kp = get_key(pos);
-        memmove(kp, kp + n * file_hdr->col_tot_len_, (page_hdr->num_key - pos - n) * file_hdr->col_tot_len_);
+        memmove(kp, kp + n * key_len, (page_hdr->num_key - pos - n) * key_len);
         auto rp = get_rid(pos);
         memmove(rp, rp + n, (page_hdr->num_key - pos - n) * sizeof(Rid));
         page_hdr->num_key -= n;
@@ -197,9 +211,7 @@ int IxNodeHandle::remove(const char *key) {
         //不存在
         return page_hdr->num_key;
     }
-    char *now = get_key(key_idx);
-    int res = ix_compare(key, now, file_hdr->col_types_, file_hdr->col_lens_);
-    if (res != 0) {
+    if (compare_key(key, key_idx, false) != 0) {
         //不相等
         return page_hdr->num_key;
     }
@@ -218,8 +230,7 @@ IxIndexHandle::IxIndexHandle(DiskManager *disk_manager, BufferPoolManager *buffe
     file_hdr_->deserialize(buf);
 
     // disk_manager管理的fd对应的文件中，设置从file_hdr_->num_pages开始分配page_no
-    int now_page_no = disk_manager_->get_fd2pageno(fd);
-    disk_manager_->set_fd2pageno(fd, now_page_no + 1);
+    disk_manager_->set_fd2pageno(fd, file_hdr_->num_pages_);
 }
 
 /**
@@ -237,10 +248,12 @@ std::pair<IxNodeHandle *, bool> IxIndexHandle::find_leaf_page(const char *key, O
     // 1. 获取根节点
     // 2. 从根节点开始不断向下查找目标key
     // 3. 找到包含该key值的叶子结点停止查找，并返回叶子节点
+    // 查询时key只包含索引字段；插入和删除时，非唯一索引的key为(key, rid)
+    bool is_prefix = operation == Operation::FIND;
     auto root = fetch_node(file_hdr_->root_page_);
     while (!root->page_hdr->is_leaf) {
-        auto nex = fetch_node(root->internal_lookup(key));
-        buffer_pool_manager_->unpin_page(root->get_page_id(), true);
+        auto nex = fetch_node(root->internal_lookup(key, is_prefix, find_first));
+        unpin_page(root->get_page_id(), true);
         root = nex;
     }
     return {root, false};
@@ -250,7 +263,7 @@ std::pair<IxNodeHandle *, bool> IxIndexHandle::find_leaf_page(const char *key, O
  * @brief 用于查找指定键在叶子结点中的对应的值result
  *
  * @param key 查找的目标key值
- * @param result 用于存放结果的容器
+ * @param result 用于存放结果的容器，非唯一索引会返回所有匹配的rid
  * @param transaction 事务指针
  * @return bool 返回目标键值对是否存在
  */
@@ -261,18 +274,29 @@ bool IxIndexHandle::get_value(const char *key, std::vector<Rid> *result, Transac
     // 3. 把rid存入result参数中
     // 提示：使用完buffer_pool提供的page之后，记得unpin page；记得处理并发的上锁
     std::scoped_lock lock{root_latch_};
-    auto leaf = find_leaf_page(key, Operation::FIND, nullptr, false).first;
+    auto leaf = find_leaf_page(key, Operation::FIND, nullptr, true).first;
     if (leaf == nullptr) return false;
-    Rid *lt;
-    if (leaf->leaf_lookup(key, &lt)) {
-        std::vector<Rid> ans(1);
-        ans[0] = (*lt);
-        *result = ans;
-        buffer_pool_manager_->unpin_page(leaf->get_page_id(), true);
-        return true;
+    result->clear();
+    int pos = leaf->lower_bound(key, true);
+    while (true) {
+        if (pos == leaf->get_size()) {
+            // 相同的key可能延续到下一个叶子
+            if (leaf->get_page_no() == file_hdr_->last_leaf_) break;
+            auto nex = fetch_node(leaf->get_next_leaf());
+            unpin_page(leaf->get_page_id(), false);
+            delete leaf;
+            leaf = nex;
+            pos = 0;
+            continue;
+        }
+        if (leaf->compare_key(key, pos, true) != 0) break;
+        result->push_back(*leaf->get_rid(pos));
+        if (file_hdr_->unique_) break;
+        pos++;
     }
-    buffer_pool_manager_->unpin_page(leaf->get_page_id(), true);
-    return false;
+    unpin_page(leaf->get_page_id(), false);
+    delete leaf;
+    return !result->empty();
 }
 
 /**
@@ -310,6 +334,8 @@ IxNodeHandle *IxIndexHandle::split(IxNodeHandle *node) {
         nex->set_prev_leaf(rt->get_page_no());
         rt->page_hdr->prev_leaf = node->get_page_no();
         node->page_hdr->next_leaf = rt->get_page_no();
+        unpin_page(nex->get_page_id(), true);
+        delete nex;
     } else {
         //不是叶子，更新该结点的所有孩子结点的父节点信息
         for (int i = 0; i < right; i++) {
@@ -354,7 +380,7 @@ void IxIndexHandle::insert_into_parent(IxNodeHandle *old_node, const char *key,
         new_root->insert(old_node->get_key(0), {.page_no = old_node->get_page_no(), .slot_no = -1});
         new_root->insert(key, {.page_no = new_node->get_page_no(), .slot_no = -1});
         file_hdr_->root_page_ = new_root->get_page_no();
-        buffer_pool_manager_->unpin_page(new_root->get_page_id(), true);
+        unpin_page(new_root->get_page_id(), true);
     } else {
         auto fa = fetch_node(old_node->get_parent_page_no());
         new_node->set_parent_page_no(fa->get_page_no());
@@ -363,9 +389,9 @@ void IxIndexHandle::insert_into_parent(IxNodeHandle *old_node, const char *key,
             //split
             auto rt = split(fa);
             insert_into_parent(fa, rt->get_key(0), rt, transaction);
-            buffer_pool_manager_->unpin_page(rt->get_page_id(), true);
+            unpin_page(rt->get_page_id(), true);
         }
-        buffer_pool_manager_->unpin_page(fa->get_page_id(), true);
+        unpin_page(fa->get_page_id(), true);
     }
 }
 
@@ -375,19 +401,25 @@ void IxIndexHandle::insert_into_parent(IxNodeHandle *old_node, const char *key,
  * @param transaction 事务指针
  * @return page_id_t 插入到的叶结点的page_no
  */
-std::pair<page_id_t, bool> IxIndexHandle::insert_entry(const char *key, const Rid &value, Transaction *transaction) {
+std::pair<page_id_t, bool> IxIndexHandle::insert_entry(const char *key, const Rid &value, Transaction *transaction,
+                                                       const IxLogger &logger) {
     // Todo:
     // 1. 查找key值应该插入到哪个叶子节点
     // 2. 在该叶子节点中插入键值对
     // 3. 如果结点已满，分裂结点，并把新结点的相关信息插入父节点
     // 提示：记得unpin page；若当前叶子节点是最右叶子节点，则需要更新file_hdr_.last_leaf；记得处理并发的上锁
     std::scoped_lock lock{root_latch_};
-    auto leaf = find_leaf_page(key, Operation::FIND, transaction).first;
+    OpGuard op(this, logger);
+    char buf[IX_MAX_COL_LEN + sizeof(Rid)];
+    key = make_entry_key(key, value, buf);
+    auto leaf = find_leaf_page(key, Operation::INSERT, transaction).first;
     int old_cnt = leaf->get_size();
     // 插入数据
     int cnt = leaf->insert(key, value);
     if(old_cnt == cnt){
         //说明插入失败
+        unpin_page(leaf->get_page_id(), false);
+        op.finish(IX_NO_PAGE);
         return {leaf->get_page_id().page_no, false};
     }
     //插入后更新父节点键值
@@ -403,7 +435,7 @@ std::pair<page_id_t, bool> IxIndexHandle::insert_entry(const char *key, const Ri
             //更新表头
             auto header = fetch_node(IX_LEAF_HEADER_PAGE);
             header->set_prev_leaf(node->get_page_no());
-            buffer_pool_manager_->unpin_page(header->get_page_id(), true);
+            unpin_page(header->get_page_id(), true);
         }
         if (pos < leaf->get_size()) {
             //说明插入的是左边
@@ -412,42 +444,52 @@ std::pair<page_id_t, bool> IxIndexHandle::insert_entry(const char *key, const Ri
             //说明插入的是右边
             res = node->get_page_no();
         }
-        buffer_pool_manager_->unpin_page(leaf->get_page_id(), true);
-        buffer_pool_manager_->unpin_page(node->get_page_id(), true);
+        unpin_page(leaf->get_page_id(), true);
+        unpin_page(node->get_page_id(), true);
     } else {
         res = leaf->get_page_no();
-        buffer_pool_manager_->unpin_page(leaf->get_page_id(), true);
+        unpin_page(leaf->get_page_id(), true);
     }
+    op.finish(leaf->get_page_no());
     return {res, true};
 }
 
 bool IxIndexHandle::check_entry(const char *key, Transaction *transaction){
-    auto leaf = find_leaf_page(key, Operation::FIND, transaction).first;
-    auto pos = leaf->lower_bound(key);
+    auto leaf = find_leaf_page(key, Operation::FIND, transaction, true).first;
+    auto pos = leaf->lower_bound(key, true);
+    bool exist = false;
     if (pos < leaf->get_size()) {
-        char *now = leaf->get_key(pos);
-        int res = ix_compare(key, now, leaf->file_hdr->col_types_, leaf->file_hdr->col_lens_);
-        if (res == 0) {
-            //key重复
-            return true;
-        }
+        //key重复
+        exist = leaf->compare_key(key, pos, true) == 0;
+    } else if (leaf->get_page_no() != file_hdr_->last_leaf_) {
+        auto nex = fetch_node(leaf->get_next_leaf());
+        exist = nex->get_size() > 0 && nex->compare_key(key, 0, true) == 0;
+        unpin_page(nex->get_page_id(), false);
+        delete nex;
     }
-    return false;
+    unpin_page(leaf->get_page_id(), false);
+    delete leaf;
+    return exist;
 }
 
 /**
  * @brief 用于删除B+树中含有指定key的键值对
  * @param key 要删除的key值
+ * @param value key对应的rid，非唯一索引通过(key, rid)定位要删除的键值对
  * @param transaction 事务指针
  */
-bool IxIndexHandle::delete_entry(const char *key, Transaction *transaction) {
+bool IxIndexHandle::delete_entry(const char *key, const Rid &value, Transaction *transaction, const IxLogger &logger) {
     // Todo:
     // 1. 获取该键值对所在的叶子结点
     // 2. 在该叶子结点中删除键值对
     // 3. 如果删除成功需要调用CoalesceOrRedistribute来进行合并或重分配操作，并根据函数返回结果判断是否有结点需要删除
     // 4. 如果需要并发，并且需要删除叶子结点，则需要在事务的delete_page_set中添加删除结点的对应页面；记得处理并发的上锁
     std::scoped_lock lock{root_latch_};
-    auto leaf = find_leaf_page(key, Operation::FIND, transaction, false).first;
+    OpGuard op(this, logger);
+    char buf[IX_MAX_COL_LEN + sizeof(Rid)];
+    key = make_entry_key(key, value, buf);
+    auto leaf = find_leaf_page(key, Operation::DELETE, transaction, false).first;
+    page_id_t leaf_page_no = leaf->get_page_no();
     int old_cnt = leaf->get_size();
     int idx = leaf->lower_bound(key);
     int now_cnt = leaf->remove(key);
@@ -455,14 +497,24 @@ bool IxIndexHandle::delete_entry(const char *key, Transaction *transaction) {
         // 说明删除了一个键值对
         if(!idx) maintain_parent(leaf);
         if(!coalesce_or_redistribute(leaf)){
-            buffer_pool_manager_->unpin_page(leaf->get_page_id(), true);
+            unpin_page(leaf->get_page_id(), true);
         }
+        op.finish(leaf_page_no);
         return true;
     }
-    buffer_pool_manager_->unpin_page(leaf->get_page_id(), true);
+    unpin_page(leaf->get_page_id(), true);
+    op.finish(IX_NO_PAGE);
     return false;
 }
 
+/**
+ * @brief 唯一索引按key删除键值对
+ */
+bool IxIndexHandle::delete_entry(const char *key, Transaction *transaction) {
+    assert(file_hdr_->unique_);
+    return delete_entry(key, Rid{-1, -1}, transaction);
+}
+
 /**
  * @brief 用于处理合并和重分配的逻辑，用于删除键值对后调用
  *
@@ -495,11 +547,11 @@ bool IxIndexHandle::coalesce_or_redistribute(IxNodeHandle *node, Transaction *tr
                 erase_leaf(node);
             }
             release_node_handle(*node);
-            buffer_pool_manager_->unpin_page(node->get_page_id(), true);
+            unpin_page(node->get_page_id(), true);
             free(node);
             return true;
         }
-        buffer_pool_manager_->unpin_page(node->get_page_id(), true);
+        unpin_page(node->get_page_id(), true);
         return false;
     }
     //获取父节点
@@ -511,17 +563,17 @@ bool IxIndexHandle::coalesce_or_redistribute(IxNodeHandle *node, Transaction *tr
     if (node->get_size() + neighbor->get_size() >= node->get_min_size() * 2) {
         //重分配
         redistribute(neighbor, node, fa, pos - idx);
-        buffer_pool_manager_->unpin_page(neighbor->get_page_id(), true);
-        buffer_pool_manager_->unpin_page(fa->get_page_id(), true);
+        unpin_page(neighbor->get_page_id(), true);
+        unpin_page(fa->get_page_id(), true);
     } else {
         //合并
-        if(coalesce(&neighbor, &node, &fa, pos - idx, transaction, root_is_latched)){
-            if(!coalesce_or_redistribute(fa)){
-                buffer_pool_manager_->unpin_page(fa->get_page_id(), true);
-            }
+        // 父节点不需要删除时由这里unpin，需要删除时由递归调用负责
+        if(!coalesce(&neighbor, &node, &fa, pos - idx, transaction, root_is_latched) ||
+           !coalesce_or_redistribute(fa)){
+            unpin_page(fa->get_page_id(), true);
         }
         if(pos > idx){// node在右边, 说明node被删
-            buffer_pool_manager_->unpin_page(neighbor->get_page_id(), true);
+            unpin_page(neighbor->get_page_id(), true);
             ok = true;
         }
     }
@@ -543,7 +595,6 @@ bool IxIndexHandle::adjust_root(IxNodeHandle *old_root_node) {
         old_root_node->page_hdr->next_leaf = IX_LEAF_HEADER_PAGE;
         old_root_node->page_hdr->prev_leaf = IX_LEAF_HEADER_PAGE;
         old_root_node->page_hdr->parent = IX_NO_PAGE;
-        old_root_node->page_hdr->next_free_page_no = IX_NO_PAGE;
         return false;
     }
     if(!old_root_node->is_leaf_page() && old_root_node->get_size() == 1){
@@ -551,8 +602,7 @@ bool IxIndexHandle::adjust_root(IxNodeHandle *old_root_node) {
         auto child = fetch_node(child_id);
         child->page_hdr->parent = IX_NO_PAGE;
         file_hdr_->root_page_ = child_id;
-        release_node_handle(*old_root_node);
-        buffer_pool_manager_->unpin_page(child->get_page_id(), true);
+        unpin_page(child->get_page_id(), true);
         return true;
     }
     return false;
@@ -643,9 +693,9 @@ bool IxIndexHandle::coalesce(IxNodeHandle **neighbor_node, IxNodeHandle **node,
         file_hdr_->last_leaf_ = lt->get_page_no();
         //更新表头
     }
-    buffer_pool_manager_->unpin_page(rt->get_page_id(), true);
     if(rt->is_leaf_page()) erase_leaf(rt);
     release_node_handle(*rt);
+    unpin_page(rt->get_page_id(), true);
     free(rt);
     return (*parent)->get_size() < (*parent)->get_min_size();
 }
@@ -664,7 +714,7 @@ Rid IxIndexHandle::get_rid(const Iid &iid) const {
     if (iid.slot_no >= node->get_size()) {
         throw IndexEntryNotFoundError();
     }
-    buffer_pool_manager_->unpin_page(node->get_page_id(), false);  // unpin it!
+    unpin_page(node->get_page_id(), false);  // unpin it!
     return *node->get_rid(iid.slot_no);
 }
 
@@ -677,8 +727,8 @@ Rid IxIndexHandle::get_rid(const Iid &iid) const {
  * 可用*(int *)key转换回去
  */
 Iid IxIndexHandle::lower_bound(const char *key) {
-    IxNodeHandle *node = find_leaf_page(key, Operation::FIND, nullptr).first;
-    int key_idx = node->lower_bound(key);
+    IxNodeHandle *node = find_leaf_page(key, Operation::FIND, nullptr, true).first;
+    int key_idx = node->lower_bound(key, true);
 
     Iid iid = {.page_no = node->get_page_no(), .slot_no = key_idx};
     if(key_idx == node->get_size()){
@@ -693,7 +743,7 @@ Iid IxIndexHandle::lower_bound(const char *key) {
     }
 
     // unpin leaf node
-    buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+    unpin_page(node->get_page_id(), false);
     return iid;
 }
 
@@ -705,7 +755,7 @@ Iid IxIndexHandle::lower_bound(const char *key) {
  */
 Iid IxIndexHandle::upper_bound(const char *key) {
     IxNodeHandle *node = find_leaf_page(key, Operation::FIND, nullptr).first;
-    int key_idx = node->upper_bound(key);
+    int key_idx = node->upper_bound(key, true);
 
     Iid iid = {.page_no = node->get_page_no(), .slot_no = key_idx};
     if(key_idx == node->get_size()){
@@ -720,7 +770,7 @@ Iid IxIndexHandle::upper_bound(const char *key) {
     }
 
     // unpin leaf node
-    buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+    unpin_page(node->get_page_id(), false);
     return iid;
 }
 
@@ -733,7 +783,7 @@ Iid IxIndexHandle::upper_bound(const char *key) {
 Iid IxIndexHandle::leaf_end() const {
     IxNodeHandle *node = fetch_node(file_hdr_->last_leaf_);
     Iid iid = {.page_no = file_hdr_->last_leaf_, .slot_no = node->get_size()};
-    buffer_pool_manager_->unpin_page(node->get_page_id(), false);  // unpin it!
+    unpin_page(node->get_page_id(), false);  // unpin it!
     return iid;
 }
 
@@ -748,6 +798,20 @@ Iid IxIndexHandle::leaf_begin() const {
     return iid;
 }
 
+/**
+ * @brief 构造B+树中实际存放的键
+ * key为索引字段 + INCLUDE字段。唯一索引直接使用key；非唯一索引将rid附加在key之后，以(key, rid)作为键，使相同key的键值对互不相同
+ *
+ * @param buf 存放(key, rid)的缓冲区，长度至少为key_len
+ * @return 实际使用的键
+ */
+const char *IxIndexHandle::make_entry_key(const char *key, const Rid &value, char *buf) const {
+    if (file_hdr_->unique_) return key;
+    memcpy(buf, key, file_hdr_->rid_offset());
+    memcpy(buf + file_hdr_->rid_offset(), &value, sizeof(Rid));
+    return buf;
+}
+
 /**
  * @brief 获取一个指定结点
  *
@@ -757,6 +821,7 @@ Iid IxIndexHandle::leaf_begin() const {
  */
 IxNodeHandle *IxIndexHandle::fetch_node(int page_no) const {
     Page *page = buffer_pool_manager_->fetch_page(PageId{fd_, page_no});
+    track_page(page);
     auto *node = new IxNodeHandle(file_hdr_, page);
 
     return node;
@@ -774,15 +839,146 @@ IxNodeHandle *IxIndexHandle::fetch_node(int page_no) const {
  */
 IxNodeHandle *IxIndexHandle::create_node() {
     IxNodeHandle *node;
+    if (file_hdr_->first_free_page_no_ != IX_NO_PAGE) {
+        // 优先复用被删除的结点，空闲链表的修改和结点的初始化一起记录在这次操作的日志中
+        node = fetch_node(file_hdr_->first_free_page_no_);
+        file_hdr_->first_free_page_no_ = node->page_hdr->next_leaf;
+        return node;
+    }
     file_hdr_->num_pages_++;
 
     PageId new_page_id = {.fd = fd_, .page_no = INVALID_PAGE_ID};
     // 从3开始分配page_no，第一次分配之后，new_page_id.page_no=3，file_hdr_.num_pages=4
     Page *page = buffer_pool_manager_->new_page(&new_page_id);
+    track_page(page);
     node = new IxNodeHandle(file_hdr_, page);
     return node;
 }
 
+/**
+ * @brief unpin结点所在的页面。写日志的操作在写入日志之后才把修改过的页面标记为脏页，
+ * 使页面的rec_lsn为第一条修改它的日志
+ */
+bool IxIndexHandle::unpin_page(PageId page_id, bool is_dirty) const {
+    return buffer_pool_manager_->unpin_page(page_id, is_dirty && op_index_ != this);
+}
+
+/**
+ * @brief 开始一次写日志的操作，之后当前线程访问的页面都会被记录下来，直到end_op
+ * @param logger 写日志的回调，为空时不写日志，页面按原来的方式unpin
+ */
+void IxIndexHandle::begin_op(const IxLogger &logger) {
+    if (!logger) return;
+    op_index_ = this;
+    op_hdr_.root_page_ = file_hdr_->root_page_;
+    op_hdr_.first_leaf_ = file_hdr_->first_leaf_;
+    op_hdr_.last_leaf_ = file_hdr_->last_leaf_;
+    op_hdr_.num_pages_ = file_hdr_->num_pages_;
+    op_hdr_.first_free_ = file_hdr_->first_free_page_no_;
+}
+
+/**
+ * @brief 第一次访问一个页面时再pin一次并保存页面修改前的内容，使页面在写入日志之前不会被写回磁盘
+ */
+void IxIndexHandle::track_page(Page *page) const {
+    if (op_index_ != this) return;
+    for (auto op_page: op_pages_) {
+        if (op_page == page) return;
+    }
+    buffer_pool_manager_->fetch_page(page->get_page_id());
+    op_before_images_.resize((op_pages_.size() + 1) * PAGE_SIZE);
+    memcpy(op_before_images_.data() + op_pages_.size() * PAGE_SIZE, page->get_data(), PAGE_SIZE);
+    op_pages_.push_back(page);
+}
+
+/**
+ * @brief 结束一次写日志的操作：找出被修改的页面，写入日志，用日志的lsn标记这些页面后再unpin
+ * @param leaf_page_no 插入/删除键值对的叶子结点，只有该结点被修改时日志只记录键值对，重做时在该结点上重新插入/删除
+ */
+void IxIndexHandle::end_op(const IxLogger &logger, page_id_t leaf_page_no) {
+    if (!logger) return;
+    op_index_ = nullptr;
+    IxRedoInfo redo;
+    redo.root_page_ = file_hdr_->root_page_;
+    redo.first_leaf_ = file_hdr_->first_leaf_;
+    redo.last_leaf_ = file_hdr_->last_leaf_;
+    redo.num_pages_ = file_hdr_->num_pages_;
+    redo.first_free_ = file_hdr_->first_free_page_no_;
+    redo.hdr_changed_ = redo.root_page_ != op_hdr_.root_page_ || redo.first_leaf_ != op_hdr_.first_leaf_ ||
+                        redo.last_leaf_ != op_hdr_.last_leaf_ || redo.num_pages_ != op_hdr_.num_pages_ ||
+                        redo.first_free_ != op_hdr_.first_free_;
+    std::vector<Page *> modified;
+    for (size_t i = 0; i < op_pages_.size(); i++) {
+        const char *before = op_before_images_.data() + i * PAGE_SIZE;
+        const char *after = op_pages_[i]->get_data();
+        if (memcmp(before, after, PAGE_SIZE) == 0) {
+            buffer_pool_manager_->unpin_page(op_pages_[i]->get_page_id(), false);
+            continue;
+        }
+        modified.push_back(op_pages_[i]);
+        int begin = 0, end = PAGE_SIZE;
+        while (before[begin] == after[begin]) begin++;
+        while (before[end - 1] == after[end - 1]) end--;
+        redo.deltas_.push_back({op_pages_[i]->get_page_id().page_no, begin, std::string(after + begin, end - begin)});
+    }
+    op_pages_.clear();
+    if (modified.empty()) return;
+    if (!redo.hdr_changed_ && modified.size() == 1 && modified[0]->get_page_id().page_no == leaf_page_no) {
+        redo.leaf_page_no_ = leaf_page_no;
+        redo.deltas_.clear();
+    }
+    lsn_t lsn = logger(redo);
+    for (auto page: modified) {
+        page->set_page_lsn(lsn);
+        buffer_pool_manager_->unpin_page(page->get_page_id(), true);
+    }
+}
+
+/**
+ * @brief 放弃一次写日志的操作：操作中途抛出异常时调用，把被访问过的页面和file header恢复为操作开始时的内容，
+ * 释放track_page额外的pin，并结束当前线程的操作，使之后的操作不会沿用op_index_
+ */
+void IxIndexHandle::abort_op(const IxLogger &logger) {
+    if (!logger) return;
+    op_index_ = nullptr;
+    for (size_t i = 0; i < op_pages_.size(); i++) {
+        memcpy(op_pages_[i]->get_data(), op_before_images_.data() + i * PAGE_SIZE, PAGE_SIZE);
+        buffer_pool_manager_->unpin_page(op_pages_[i]->get_page_id(), false);
+    }
+    op_pages_.clear();
+    file_hdr_->root_page_ = op_hdr_.root_page_;
+    file_hdr_->first_leaf_ = op_hdr_.first_leaf_;
+    file_hdr_->last_leaf_ = op_hdr_.last_leaf_;
+    // 已经分配的新页面仍留在缓冲池中，num_pages_不回退，避免同一个页号被再次分配
+    file_hdr_->first_free_page_no_ = op_hdr_.first_free_;
+}
+
+/**
+ * @brief 恢复时在叶子结点上重新插入/删除一个键值对，调用者负责检查和更新页面的lsn
+ */
+void IxIndexHandle::redo_leaf(Page *page, const char *key, const Rid &value, bool is_insert) {
+    char buf[IX_MAX_COL_LEN + sizeof(Rid)];
+    key = make_entry_key(key, value, buf);
+    IxNodeHandle node(file_hdr_, page);
+    if (is_insert) {
+        node.insert(key, value);
+    } else {
+        node.remove(key);
+    }
+}
+
+/**
+ * @brief 恢复时把file header恢复为日志中记录的修改后的内容
+ */
+void IxIndexHandle::redo_file_hdr(const IxRedoInfo &redo) {
+    file_hdr_->root_page_ = redo.root_page_;
+    file_hdr_->first_leaf_ = redo.first_leaf_;
+    file_hdr_->last_leaf_ = redo.last_leaf_;
+    file_hdr_->num_pages_ = redo.num_pages_;
+    file_hdr_->first_free_page_no_ = redo.first_free_;
+    disk_manager_->set_fd2pageno(fd_, file_hdr_->num_pages_);
+}
+
 /**
  * @brief 从node开始更新其父节点的第一个key，一直向上更新直到根节点
  *
@@ -796,14 +992,14 @@ void IxIndexHandle::maintain_parent(IxNodeHandle *node) {
         int rank = parent->find_child(curr);
         char *parent_key = parent->get_key(rank);
         char *child_first_key = curr->get_key(0);
-        if (memcmp(parent_key, child_first_key, file_hdr_->col_tot_len_) == 0) {
-            assert(buffer_pool_manager_->unpin_page(parent->get_page_id(), true));
+        if (memcmp(parent_key, child_first_key, file_hdr_->key_len()) == 0) {
+            assert(unpin_page(parent->get_page_id(), true));
             break;
         }
-        memcpy(parent_key, child_first_key, file_hdr_->col_tot_len_);  // 修改了parent node
+        memcpy(parent_key, child_first_key, file_hdr_->key_len());  // 修改了parent node
         curr = parent;
 
-        assert(buffer_pool_manager_->unpin_page(parent->get_page_id(), true));
+        assert(unpin_page(parent->get_page_id(), true));
     }
 }
 
@@ -817,20 +1013,25 @@ void IxIndexHandle::erase_leaf(IxNodeHandle *leaf) {
 
     IxNodeHandle *prev = fetch_node(leaf->get_prev_leaf());
     prev->set_next_leaf(leaf->get_next_leaf());
-    buffer_pool_manager_->unpin_page(prev->get_page_id(), true);
+    unpin_page(prev->get_page_id(), true);
 
     IxNodeHandle *next = fetch_node(leaf->get_next_leaf());
     next->set_prev_leaf(leaf->get_prev_leaf());  // 注意此处是SetPrevLeaf()
-    buffer_pool_manager_->unpin_page(next->get_page_id(), true);
+    unpin_page(next->get_page_id(), true);
 }
 
 /**
- * @brief 删除node时，更新file_hdr_.num_pages
+ * @brief 删除node，把它的页面放入空闲链表的头部，之后create_node优先复用该页面。
+ * 空闲链表的指针存放在被删除结点的next_leaf中，调用时node所在的页面必须仍被pin住，修改和其他页面一起写入日志
  *
  * @param node
  */
 void IxIndexHandle::release_node_handle(IxNodeHandle &node) {
-    file_hdr_->num_pages_--;
+    node.page_hdr->next_leaf = file_hdr_->first_free_page_no_;
+    node.page_hdr->prev_leaf = IX_NO_PAGE;
+    node.page_hdr->parent = IX_NO_PAGE;
+    node.set_size(0);
+    file_hdr_->first_free_page_no_ = node.get_page_no();
 }
 
 /**
@@ -842,6 +1043,6 @@ void IxIndexHandle::maintain_child(IxNodeHandle *node, int child_idx) {
         int child_page_no = node->value_at(child_idx);
         IxNodeHandle *child = fetch_node(child_page_no);
         child->set_parent_page_no(node->get_page_no());
-        buffer_pool_manager_->unpin_page(child->get_page_id(), true);
+        unpin_page(child->get_page_id(), true);
     }
 }
\ No newline at end of file
@@ -54,6 +54,15 @@ ix_compare(const char *a, const char *b, const std::vector<ColType> &col_types,
     return 0;
 }
 
+/* 比较非唯一索引键中附加的rid，按(page_no, slot_no)排序 */
+inline int ix_compare_rid(const char *a, const char *b) {
+    const Rid *ra = reinterpret_cast<const Rid *>(a);
+    const Rid *rb = reinterpret_cast<const Rid *>(b);
+    if (ra->page_no != rb->page_no) return ra->page_no < rb->page_no ? -1 : 1;
+    if (ra->slot_no != rb->slot_no) return ra->slot_no < rb->slot_no ? -1 : 1;
+    return 0;
+}
+
 /* 管理B+树中的每个节点 */
 class IxNodeHandle {
     friend class IxIndexHandle;
@@ -110,24 +119,26 @@ public:
     void set_parent_page_no(page_id_t parent) { page_hdr->parent = parent; }
 
     //得到键数组中指定位置的地址。
-    char *get_key(int key_idx) const { return keys + key_idx * file_hdr->col_tot_len_; }
+    char *get_key(int key_idx) const { return keys + key_idx * file_hdr->key_len(); }
 
     //得到值数组中指定位置的地址。
     Rid *get_rid(int rid_idx) const { return &rids[rid_idx]; }
 
     void set_key(int key_idx, const char *key) {
-        memcpy(keys + key_idx * file_hdr->col_tot_len_, key, file_hdr->col_tot_len_);
+        memcpy(keys + key_idx * file_hdr->key_len(), key, file_hdr->key_len());
     }
 
     void set_rid(int rid_idx, const Rid &rid) { rids[rid_idx] = rid; }
 
-    int lower_bound(const char *target) const;
+    int compare_key(const char *target, int key_idx, bool is_prefix) const;
+
+    int lower_bound(const char *target, bool is_prefix = false) const;
 
-    int upper_bound(const char *target) const;
+    int upper_bound(const char *target, bool is_prefix = false) const;
 
     void insert_pairs(int pos, const char *key, const Rid *rid, int n);
 
-    page_id_t internal_lookup(const char *key);
+    page_id_t internal_lookup(const char *key, bool is_prefix = false, bool find_first = false);
 
     bool leaf_lookup(const char *key, Rid **value);
 
@@ -185,11 +196,48 @@ private:
     IxFileHdr *file_hdr_;                       // 存了root_page，但其初始化为2（第0页存FILE_HDR_PAGE，第1页存LEAF_HEADER_PAGE）
     std::mutex root_latch_;
 
+    // 写日志的插入/删除操作中访问过的页面，在日志写入之前一直被pin住，受root_latch_保护
+    mutable std::vector<Page *> op_pages_;
+    mutable std::vector<char> op_before_images_;    // op_pages_中每个页面修改前的内容，依次存放
+    IxRedoInfo op_hdr_;                             // 操作开始时file header中的root_page、first_leaf等字段
+    static thread_local const IxIndexHandle *op_index_; // 当前线程正在执行写日志操作的索引
+
+    /**
+     * 一次写日志的插入/删除操作：构造时begin_op，finish时end_op。
+     * 操作中途抛出异常时由析构函数调用abort_op，恢复被修改的页面和file header，并释放额外pin住的页面
+     */
+    class OpGuard {
+    public:
+        OpGuard(IxIndexHandle *ih, const IxLogger &logger) : ih_(ih), logger_(logger) { ih_->begin_op(logger_); }
+
+        ~OpGuard() {
+            if (!finished_) ih_->abort_op(logger_);
+        }
+
+        OpGuard(const OpGuard &) = delete;
+        OpGuard &operator=(const OpGuard &) = delete;
+
+        void finish(page_id_t leaf_page_no) {
+            finished_ = true;
+            ih_->end_op(logger_, leaf_page_no);
+        }
+
+    private:
+        IxIndexHandle *ih_;
+        const IxLogger &logger_;
+        bool finished_ = false;
+    };
+
 public:
     IxIndexHandle(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager, int fd);
 
     int get_fd(){return fd_;}
 
+    bool is_unique() const { return file_hdr_->unique_; }
+
+    // 插入和删除都持有root_latch_，不加表锁的快照读在它之下遍历叶子，避免与结点的分裂合并并发
+    std::mutex &get_root_latch() { return root_latch_; }
+
     // for search
     bool get_value(const char *key, std::vector<Rid> *result, Transaction *transaction);
 
@@ -197,7 +245,8 @@ public:
                                                    bool find_first = false);
 
     // for insert
-    std::pair<page_id_t, bool> insert_entry(const char *key, const Rid &value, Transaction *transaction);
+    std::pair<page_id_t, bool> insert_entry(const char *key, const Rid &value, Transaction *transaction,
+                                            const IxLogger &logger = nullptr);
 
     // for check insert
     bool check_entry(const char *key, Transaction *transaction);
@@ -207,6 +256,8 @@ public:
     void insert_into_parent(IxNodeHandle *old_node, const char *key, IxNodeHandle *new_node, Transaction *transaction);
 
     // for delete
+    bool delete_entry(const char *key, const Rid &value, Transaction *transaction, const IxLogger &logger = nullptr);
+
     bool delete_entry(const char *key, Transaction *transaction);
 
     bool coalesce_or_redistribute(IxNodeHandle *node, Transaction *transaction = nullptr,
@@ -227,8 +278,15 @@ public:
 
     Iid leaf_begin() const;
 
+    // for recovery
+    void redo_leaf(Page *page, const char *key, const Rid &value, bool is_insert);
+
+    void redo_file_hdr(const IxRedoInfo &redo);
+
 private:
     // 辅助函数
+    const char *make_entry_key(const char *key, const Rid &value, char *buf) const;
+
     void update_root_page_no(page_id_t root) { file_hdr_->root_page_ = root; }
 
     bool is_empty() const { return file_hdr_->root_page_ == IX_NO_PAGE; }
@@ -238,6 +296,17 @@ private:
 
     IxNodeHandle *create_node();
 
+    bool unpin_page(PageId page_id, bool is_dirty) const;
+
+    // for logging
+    void begin_op(const IxLogger &logger);
+
+    void track_page(Page *page) const;
+
+    void end_op(const IxLogger &logger, page_id_t leaf_page_no);
+
+    void abort_op(const IxLogger &logger);
+
     // for maintain data structure
     void maintain_parent(IxNodeHandle *node);
 
@@ -54,7 +54,8 @@ public:
         return disk_manager_->is_file(ix_name);
     }
 
-    void create_index(const std::string &filename, const std::vector<ColMeta>& index_cols) {
+    void create_index(const std::string &filename, const std::vector<ColMeta>& index_cols, bool unique = true,
+                      const std::vector<ColMeta>& include_cols = {}) {
         std::string ix_name = get_index_name(filename, index_cols);
         // Create index file
         disk_manager_->create_file(ix_name);
@@ -70,18 +71,25 @@ public:
         for(auto& col: index_cols) {
             col_tot_len += col.len;
         }
-        if (col_tot_len > IX_MAX_COL_LEN) {
-            throw InvalidColLengthError(col_tot_len);
+        // INCLUDE字段跟随索引字段一起存放在键中，但不参与比较
+        int include_len = 0;
+        for(auto& col: include_cols) {
+            include_len += col.len;
         }
-        // 根据 |page_hdr| + (|attr| + |rid|) * (n + 1) <= PAGE_SIZE 求得n的最大值btree_order
+        if (col_tot_len + include_len > IX_MAX_COL_LEN) {
+            throw InvalidColLengthError(col_tot_len + include_len);
+        }
+        // 非唯一索引的键为(attr, rid)，每个键多占用一个rid的长度
+        int key_len = col_tot_len + include_len + (unique ? 0 : static_cast<int>(sizeof(Rid)));
+        // 根据 |page_hdr| + (|key| + |rid|) * (n + 1) <= PAGE_SIZE 求得n的最大值btree_order
         // 即 n <= btree_order，那么btree_order就是每个结点最多可插入的键值对数量（实际还多留了一个空位，但其不可插入）
-        int btree_order = static_cast<int>((PAGE_SIZE - sizeof(IxPageHdr)) / (col_tot_len + sizeof(Rid))) - 1;
+        int btree_order = static_cast<int>((PAGE_SIZE - sizeof(IxPageHdr)) / (key_len + sizeof(Rid))) - 1;
         assert(btree_order > 2);
 
         // Create file header and write to file
         IxFileHdr* fhdr = new IxFileHdr(IX_NO_PAGE, IX_INIT_NUM_PAGES, IX_INIT_ROOT_PAGE,
-                                        col_num, col_tot_len, btree_order, (btree_order + 1) * col_tot_len,
-                                        IX_INIT_ROOT_PAGE, IX_INIT_ROOT_PAGE);
+                                        col_num, col_tot_len, btree_order, (btree_order + 1) * key_len,
+                                        IX_INIT_ROOT_PAGE, IX_INIT_ROOT_PAGE, unique, include_len);
         for(int i = 0; i < col_num; ++i) {
             fhdr->col_types_.push_back(index_cols[i].type);
             fhdr->col_lens_.push_back(index_cols[i].len);
@@ -101,7 +109,7 @@ public:
             memset(page_buf, 0, PAGE_SIZE);
             auto phdr = reinterpret_cast<IxPageHdr *>(page_buf);
             *phdr = {
-                    .next_free_page_no = IX_NO_PAGE,
+                    .page_lsn = INVALID_LSN,
                     .parent = IX_NO_PAGE,
                     .num_key = 0,
                     .is_leaf = true,
@@ -116,7 +124,7 @@ public:
             memset(page_buf, 0, PAGE_SIZE);
             auto phdr = reinterpret_cast<IxPageHdr *>(page_buf);
             *phdr = {
-                    .next_free_page_no = IX_NO_PAGE,
+                    .page_lsn = INVALID_LSN,
                     .parent = IX_NO_PAGE,
                     .num_key = 0,
                     .is_leaf = true,
@@ -157,11 +165,16 @@ public:
     }
 
     void close_index(const IxIndexHandle *ih) {
-        char* data = new char[ih->file_hdr_->tot_len_];
-        ih->file_hdr_->serialize(data);
-        disk_manager_->write_page(ih->fd_, IX_FILE_HDR_PAGE, data, ih->file_hdr_->tot_len_);
+        flush_index_hdr(ih);
         // 缓冲区的所有页刷到磁盘，注意这句话必须写在close_file前面
         buffer_pool_manager_->flush_all_pages(ih->fd_);
         disk_manager_->close_file(ih->fd_);
     }
+
+    // 把内存中的file header写回索引文件，关闭索引和检查点时调用
+    void flush_index_hdr(const IxIndexHandle *ih) {
+        std::vector<char> data(ih->file_hdr_->tot_len_);
+        ih->file_hdr_->serialize(data.data());
+        disk_manager_->write_page(ih->fd_, IX_FILE_HDR_PAGE, data.data(), ih->file_hdr_->tot_len_);
+    }
 };
\ No newline at end of file
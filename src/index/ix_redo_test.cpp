@@ -0,0 +1,265 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+#include "gtest/gtest.h"
+
+#define private public
+#include "ix.h"
+#undef private  // for use private variables in "ix.h"
+
+#include "storage/buffer_pool_manager.h"
+
+const std::string TEST_DB_NAME = "IxRedoTest_db";   // 以数据库名作为根目录
+const std::string TEST_FILE_NAME = "table1";        // 测试文件名的前缀
+
+/**
+ * 测试索引日志中的重做信息：IxRedoInfo的序列化，以及按重做信息（叶子上的逻辑重做或页面的delta）能否重建出与真实页面相同的内容
+ * 每个测试点在目录TEST_DB_NAME下重新创建索引文件
+ */
+class IxRedoTests : public ::testing::Test {
+   public:
+    std::unique_ptr<DiskManager> disk_manager_;
+    std::unique_ptr<BufferPoolManager> buffer_pool_manager_;
+    std::unique_ptr<IxManager> ix_manager_;
+    std::unique_ptr<IxIndexHandle> ih_;
+    std::unique_ptr<Transaction> txn_;
+    std::vector<ColMeta> cols_;
+
+    std::map<int, std::string> shadow_;     // 只按重做信息修改的页面内容，页号 -> 页面
+    IxRedoInfo shadow_hdr_;                 // 只按重做信息修改的file header字段
+    lsn_t lsn_ = 0;
+
+   public:
+    void SetUp() override {
+        ::testing::Test::SetUp();
+        disk_manager_ = std::make_unique<DiskManager>();
+        buffer_pool_manager_ = std::make_unique<BufferPoolManager>(100, disk_manager_.get());
+        ix_manager_ = std::make_unique<IxManager>(disk_manager_.get(), buffer_pool_manager_.get());
+        txn_ = std::make_unique<Transaction>(0);
+
+        if (!disk_manager_->is_dir(TEST_DB_NAME)) {
+            disk_manager_->create_dir(TEST_DB_NAME);
+        }
+        if (chdir(TEST_DB_NAME.c_str()) < 0) {
+            throw UnixError();
+        }
+        ColMeta col = {
+                .tab_name = TEST_FILE_NAME,
+                .name = "0",
+                .type = TYPE_INT,
+                .len = sizeof(int),
+                .offset = 0,
+                .index = false,
+        };
+        cols_.push_back(col);
+        if (ix_manager_->exists(TEST_FILE_NAME, cols_)) {
+            ix_manager_->destroy_index(TEST_FILE_NAME, cols_);
+        }
+        ix_manager_->create_index(TEST_FILE_NAME, cols_);
+        ih_ = ix_manager_->open_index(TEST_FILE_NAME, cols_);
+        assert(ih_ != nullptr);
+    }
+
+    void TearDown() override {
+        ix_manager_->close_index(ih_.get());
+        if (chdir("..") < 0) {
+            throw UnixError();
+        }
+    };
+
+    // 记录当前所有结点页面（不包括file header页面）和file header字段，作为重做的起点
+    void take_shadow() {
+        shadow_.clear();
+        for (int page_no = IX_LEAF_HEADER_PAGE; page_no < ih_->file_hdr_->num_pages_; page_no++) {
+            Page *page = buffer_pool_manager_->fetch_page(PageId{ih_->fd_, page_no});
+            shadow_[page_no].assign(page->get_data(), PAGE_SIZE);
+            buffer_pool_manager_->unpin_page(page->get_page_id(), false);
+        }
+        shadow_hdr_.root_page_ = ih_->file_hdr_->root_page_;
+        shadow_hdr_.first_leaf_ = ih_->file_hdr_->first_leaf_;
+        shadow_hdr_.last_leaf_ = ih_->file_hdr_->last_leaf_;
+        shadow_hdr_.num_pages_ = ih_->file_hdr_->num_pages_;
+        shadow_hdr_.first_free_ = ih_->file_hdr_->first_free_page_no_;
+    }
+
+    // 和恢复时一样，把重做信息序列化后再反序列化，然后只用它更新shadow_
+    IxLogger make_logger(const char *key, const Rid &rid, bool is_insert) {
+        return [this, key, rid, is_insert](const IxRedoInfo &logged) {
+            std::vector<char> buf(logged.size());
+            logged.serialize(buf.data());
+            IxRedoInfo redo;
+            redo.deserialize(buf.data());
+            if (redo.leaf_page_no_ != IX_NO_PAGE) {
+                Page page;
+                memcpy(page.get_data(), shadow_.at(redo.leaf_page_no_).data(), PAGE_SIZE);
+                ih_->redo_leaf(&page, key, rid, is_insert);
+                shadow_[redo.leaf_page_no_].assign(page.get_data(), PAGE_SIZE);
+            }
+            for (auto &delta: redo.deltas_) {
+                auto &page = shadow_[delta.page_no_];
+                page.resize(PAGE_SIZE, '\0');
+                page.replace(delta.offset_, delta.data_.size(), delta.data_);
+            }
+            if (redo.hdr_changed_) {
+                shadow_hdr_ = redo;
+            }
+            return ++lsn_;
+        };
+    }
+
+    // 比较shadow_和缓冲池中真实的页面，页面开头的page lsn由日志决定，不参与比较
+    void check_shadow() {
+        ASSERT_EQ(shadow_hdr_.root_page_, ih_->file_hdr_->root_page_);
+        ASSERT_EQ(shadow_hdr_.first_leaf_, ih_->file_hdr_->first_leaf_);
+        ASSERT_EQ(shadow_hdr_.last_leaf_, ih_->file_hdr_->last_leaf_);
+        ASSERT_EQ(shadow_hdr_.num_pages_, ih_->file_hdr_->num_pages_);
+        ASSERT_EQ(shadow_hdr_.first_free_, ih_->file_hdr_->first_free_page_no_);
+        for (int page_no = IX_LEAF_HEADER_PAGE; page_no < ih_->file_hdr_->num_pages_; page_no++) {
+            Page *page = buffer_pool_manager_->fetch_page(PageId{ih_->fd_, page_no});
+            ASSERT_TRUE(shadow_.count(page_no)) << "page " << page_no;
+            EXPECT_EQ(memcmp(shadow_[page_no].data() + sizeof(lsn_t), page->get_data() + sizeof(lsn_t),
+                             PAGE_SIZE - sizeof(lsn_t)), 0) << "page " << page_no;
+            buffer_pool_manager_->unpin_page(page->get_page_id(), false);
+        }
+    }
+};
+
+/**
+ * @brief IxRedoInfo序列化后再反序列化得到相同的内容，size()与实际写入的字节数一致
+ */
+TEST_F(IxRedoTests, SerializeTest) {
+    IxRedoInfo redo;
+    redo.deltas_.push_back({3, 16, std::string("abc")});
+    redo.deltas_.push_back({100000, PAGE_SIZE - 200, std::string(200, 'x')});
+    redo.hdr_changed_ = true;
+    redo.root_page_ = 128;
+    redo.first_leaf_ = 2;
+    redo.last_leaf_ = 70000;
+    redo.num_pages_ = 70001;
+    redo.first_free_ = IX_NO_PAGE;
+
+    const char sentinel = 0x5a;
+    std::vector<char> buf(redo.size() + 1, sentinel);
+    redo.serialize(buf.data());
+    EXPECT_EQ(buf.back(), sentinel);
+
+    IxRedoInfo res;
+    res.deserialize(buf.data());
+    EXPECT_EQ(res.leaf_page_no_, IX_NO_PAGE);
+    ASSERT_EQ(res.deltas_.size(), redo.deltas_.size());
+    for (size_t i = 0; i < redo.deltas_.size(); i++) {
+        EXPECT_EQ(res.deltas_[i].page_no_, redo.deltas_[i].page_no_);
+        EXPECT_EQ(res.deltas_[i].offset_, redo.deltas_[i].offset_);
+        EXPECT_EQ(res.deltas_[i].data_, redo.deltas_[i].data_);
+    }
+    EXPECT_TRUE(res.hdr_changed_);
+    EXPECT_EQ(res.root_page_, redo.root_page_);
+    EXPECT_EQ(res.first_leaf_, redo.first_leaf_);
+    EXPECT_EQ(res.last_leaf_, redo.last_leaf_);
+    EXPECT_EQ(res.num_pages_, redo.num_pages_);
+    EXPECT_EQ(res.first_free_, redo.first_free_);
+
+    // 只在叶子上插入/删除时不记录delta和file header
+    IxRedoInfo leaf;
+    leaf.leaf_page_no_ = 5;
+    std::vector<char> leaf_buf(leaf.size());
+    leaf.serialize(leaf_buf.data());
+    IxRedoInfo leaf_res;
+    leaf_res.deserialize(leaf_buf.data());
+    EXPECT_EQ(leaf_res.leaf_page_no_, 5);
+    EXPECT_TRUE(leaf_res.deltas_.empty());
+    EXPECT_FALSE(leaf_res.hdr_changed_);
+}
+
+/**
+ * @brief 不引起分裂的插入和不引起合并的删除只记录叶子页号，redo_leaf在修改之前的叶子上重做得到相同的页面
+ */
+TEST_F(IxRedoTests, RedoLeafTest) {
+    for (int key = 0; key < 10; key += 2) {
+        ih_->insert_entry((const char *) &key, Rid{key, key}, txn_.get());
+    }
+    take_shadow();
+
+    int key = 5;
+    Rid rid{key, key};
+    bool leaf_only = false;
+    auto logger = make_logger((const char *) &key, rid, true);
+    auto check_leaf = [&](const IxRedoInfo &redo) {
+        leaf_only = redo.leaf_page_no_ != IX_NO_PAGE && redo.deltas_.empty() && !redo.hdr_changed_;
+        return logger(redo);
+    };
+    ASSERT_TRUE(ih_->insert_entry((const char *) &key, rid, txn_.get(), check_leaf).second);
+    EXPECT_TRUE(leaf_only);
+    check_shadow();
+
+    leaf_only = false;
+    logger = make_logger((const char *) &key, rid, false);
+    ASSERT_TRUE(ih_->delete_entry((const char *) &key, rid, txn_.get(), check_leaf));
+    EXPECT_TRUE(leaf_only);
+    check_shadow();
+}
+
+/**
+ * @brief 阶数很小时插入和删除会不断分裂、合并结点，删除的结点进入空闲链表后又被复用，
+ * 每次操作之后，只按日志中的重做信息修改的页面都与真实的页面相同
+ */
+TEST_F(IxRedoTests, SplitAndMergeRedoTest) {
+    const int scale = 300;
+    const int order = 4;
+    ih_->file_hdr_->btree_order_ = order;
+    take_shadow();
+
+    std::vector<int> keys;
+    for (int key = 0; key < scale; key++) {
+        keys.push_back(key);
+    }
+    auto rng = std::default_random_engine{};
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    for (int key: keys) {
+        Rid rid{key, key};
+        ASSERT_TRUE(ih_->insert_entry((const char *) &key, rid, txn_.get(),
+                                      make_logger((const char *) &key, rid, true)).second);
+        check_shadow();
+    }
+    int pages_after_insert = ih_->file_hdr_->num_pages_;
+
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (int i = 0; i < scale * 2 / 3; i++) {
+        int key = keys[i];
+        Rid rid{key, key};
+        ASSERT_TRUE(ih_->delete_entry((const char *) &key, rid, txn_.get(),
+                                      make_logger((const char *) &key, rid, false)));
+        check_shadow();
+    }
+    EXPECT_NE(ih_->file_hdr_->first_free_page_no_, IX_NO_PAGE);
+
+    // 重新插入删除的key，新结点使用空闲链表中的页面，文件不再增长
+    for (int i = 0; i < scale * 2 / 3; i++) {
+        int key = keys[i];
+        Rid rid{key, key};
+        ASSERT_TRUE(ih_->insert_entry((const char *) &key, rid, txn_.get(),
+                                      make_logger((const char *) &key, rid, true)).second);
+        check_shadow();
+    }
+    EXPECT_LE(ih_->file_hdr_->num_pages_, pages_after_insert);
+
+    std::vector<Rid> rids;
+    for (int key = 0; key < scale; key++) {
+        rids.clear();
+        ih_->get_value((const char *) &key, &rids, txn_.get());
+        ASSERT_EQ(rids.size(), 1);
+        EXPECT_EQ(rids[0].slot_no, key);
+    }
+}
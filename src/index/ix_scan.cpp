@@ -11,24 +11,84 @@ See the Mulan PSL v2 for more details. */
 #include "ix_scan.h"
 
 /**
- * @brief 
- * @todo 加上读锁（需要使用缓冲池得到page）
+ * @brief 移动到下一个键值对（反向扫描时为前一个）
+ * 在当前叶子内只移动slot，不访问buffer pool；跨越到下一个叶子时才unpin当前叶子并pin下一个
  */
 void IxScan::next() {
     assert(!is_end());
-    IxNodeHandle *node = ih_->fetch_node(iid_.page_no);
-    assert(node->is_leaf_page());
-    assert(iid_.slot_no < node->get_size());
+    assert(pinned_ && iid_.slot_no < leaf_.get_size());
+    if (reverse_) {
+        if (iid_ == lower_) {
+            done_ = true;
+            unpin_leaf();
+        } else {
+            step_back();
+        }
+        return;
+    }
     // increment slot no
     iid_.slot_no++;
-    if (iid_.page_no != ih_->file_hdr_->last_leaf_ && iid_.slot_no == node->get_size()) {
+    if (iid_.page_no != ih_->file_hdr_->last_leaf_ && iid_.slot_no == leaf_.get_size()) {
         // go to next leaf
         iid_.slot_no = 0;
-        iid_.page_no = node->get_next_leaf();
+        iid_.page_no = leaf_.get_next_leaf();
+        unpin_leaf();
+        pin_leaf();
+    } else if (is_end()) {
+        // 扫描结束，不再占用页面
+        unpin_leaf();
     }
-    bpm_->unpin_page(node->get_page_id(), true);
+}
+
+/**
+ * @brief 反向移动一个位置，位于叶子第一个slot时移动到prev_leaf的最后一个slot
+ */
+void IxScan::step_back() {
+    if (iid_.slot_no > 0) {
+        iid_.slot_no--;
+        return;
+    }
+    iid_.page_no = leaf_.get_prev_leaf();
+    unpin_leaf();
+    pin_leaf();
+    iid_.slot_no = leaf_.get_size() - 1;
 }
 
 Rid IxScan::rid() const {
-    return ih_->get_rid(iid_);
-}
\ No newline at end of file
+    assert(pinned_ && iid_.slot_no < leaf_.get_size());
+    return *leaf_.get_rid(iid_.slot_no);
+}
+
+Rid IxScan::entry(char *dest) const {
+    assert(pinned_ && iid_.slot_no < leaf_.get_size());
+    memcpy(dest, leaf_.get_key(iid_.slot_no), ih_->file_hdr_->rid_offset());
+    return *leaf_.get_rid(iid_.slot_no);
+}
+
+/**
+ * @brief pin当前iid所在的叶子，并预读下一个叶子
+ * 扫描区间在本叶子之后仍未结束时，提前让磁盘读取next_leaf（反向扫描时为prev_leaf），跨越叶子时通常已经在内存中
+ */
+void IxScan::pin_leaf() {
+    if (is_end()) return;
+    Page *page = bpm_->fetch_page(PageId{ih_->fd_, iid_.page_no});
+    leaf_ = IxNodeHandle(ih_->file_hdr_, page);
+    pinned_ = true;
+    assert(leaf_.is_leaf_page());
+    if (reverse_) {
+        if (lower_.page_no != iid_.page_no) {
+            bpm_->prefetch_page(PageId{ih_->fd_, leaf_.get_prev_leaf()});
+        }
+    } else if (iid_.page_no != ih_->file_hdr_->last_leaf_ && end_.page_no != iid_.page_no) {
+        bpm_->prefetch_page(PageId{ih_->fd_, leaf_.get_next_leaf()});
+    }
+}
+
+/**
+ * @brief 扫描只读取叶子，unpin时不标记为脏页
+ */
+void IxScan::unpin_leaf() {
+    if (!pinned_) return;
+    bpm_->unpin_page(leaf_.get_page_id(), false);
+    pinned_ = false;
+}
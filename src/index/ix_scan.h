@@ -22,17 +22,51 @@ class IxScan : public RecScan {
     const IxIndexHandle *ih_;
     Iid iid_;  // 初始为lower（用于遍历的指针）
     Iid end_;  // 初始为upper
+    Iid lower_;  // 反向扫描时最后一个位置
     BufferPoolManager *bpm_;
+    IxNodeHandle leaf_;         // 当前所在的叶子，遍历该叶子期间一直保持pin
+    bool pinned_ = false;       // leaf_是否持有pin
+    bool reverse_;              // 是否从upper的前一个位置向lower反向扫描
+    bool done_ = false;         // 反向扫描是否已经越过lower
 
    public:
-    IxScan(const IxIndexHandle *ih, const Iid &lower, const Iid &upper, BufferPoolManager *bpm)
-        : ih_(ih), iid_(lower), end_(upper), bpm_(bpm) {}
+    IxScan(const IxIndexHandle *ih, const Iid &lower, const Iid &upper, BufferPoolManager *bpm, bool reverse = false)
+        : ih_(ih), iid_(lower), end_(upper), lower_(lower), bpm_(bpm), reverse_(reverse) {
+        if (!reverse_) {
+            pin_leaf();
+            return;
+        }
+        // 反向扫描从upper的前一个位置开始
+        if (lower == upper) {
+            done_ = true;
+            return;
+        }
+        iid_ = upper;
+        pin_leaf();
+        step_back();
+    }
+
+    ~IxScan() { unpin_leaf(); }
+
+    IxScan(const IxScan &) = delete;
+
+    IxScan &operator=(const IxScan &) = delete;
 
     void next() override;
 
-    bool is_end() const override { return iid_ == end_; }
+    bool is_end() const override { return reverse_ ? done_ : iid_ == end_; }
 
     Rid rid() const override;
 
+    // 读取当前位置的索引项（索引字段 + INCLUDE字段），返回其rid
+    Rid entry(char *dest) const;
+
     const Iid &iid() const { return iid_; }
-};
\ No newline at end of file
+
+   private:
+    void pin_leaf();
+
+    void unpin_leaf();
+
+    void step_back();
+};
@@ -76,6 +76,8 @@ class ScanPlan : public Plan
         size_t len_;                               
         std::vector<Condition> fed_conds_;
         std::vector<std::string> index_col_names_;
+        bool index_only_ = false;                   // 索引覆盖了查询用到的所有字段，可以不回表
+        bool reverse_ = false;                      // 按索引逆序扫描，用于满足order by ... desc
     
 };
 
@@ -174,6 +176,8 @@ class DDLPlan : public Plan
         std::string tab_name_;
         std::vector<std::string> tab_col_names_;
         std::vector<ColDef> cols_;
+        bool unique_ = true;    // create index时是否为唯一索引
+        std::vector<std::string> include_col_names_;    // create index时的INCLUDE字段
 };
 
 // load语句
@@ -294,11 +294,64 @@ std::shared_ptr<Plan> Planner::make_one_rel(std::shared_ptr<Query> query) {
 }
 
 
+/**
+ * @brief 单表查询的order by能由索引顺序满足时，改为按该索引扫描（desc时反向扫描），从而不需要SortPlan
+ * order by的字段需要依次对应索引的字段，索引中被等值条件固定的字段可以跳过；所有排序方向必须相同。
+ * 已经选用了其他索引的扫描不做改动，仍然排序
+ * @return 是否已经由索引扫描保证了顺序
+ */
+bool Planner::use_index_order(const std::shared_ptr<ast::SelectStmt> &x, const std::shared_ptr<Plan> &plan) {
+    auto scan = std::dynamic_pointer_cast<ScanPlan>(plan);
+    if (scan == nullptr) return false;
+    bool is_desc = x->order.front()->orderby_dir == ast::OrderBy_DESC;
+    for (auto &order: x->order) {
+        if ((order->orderby_dir == ast::OrderBy_DESC) != is_desc) return false;
+        if (!order->cols->tab_name.empty() && order->cols->tab_name != scan->tab_name_) return false;
+    }
+    auto eq_fixed = [&](const std::string &col_name) {
+        return std::any_of(scan->conds_.begin(), scan->conds_.end(), [&](const Condition &cond) {
+            return cond.is_rhs_val && cond.op == OP_EQ && cond.lhs_col.tab_name == scan->tab_name_ &&
+                   cond.lhs_col.col_name == col_name;
+        });
+    };
+    auto match = [&](const IndexMeta &index) {
+        size_t p = 0;
+        for (auto &order: x->order) {
+            auto &col_name = order->cols->col_name;
+            while (p < index.cols.size() && index.cols[p].name != col_name && eq_fixed(index.cols[p].name)) p++;
+            if (p < index.cols.size() && index.cols[p].name == col_name) {
+                p++;
+            } else if (!eq_fixed(col_name)) {
+                return false;
+            }
+        }
+        return true;
+    };
+    auto &tab = sm_manager_->db_.get_table(scan->tab_name_);
+    if (scan->tag == T_IndexScan) {
+        if (!match(*tab.get_index_meta(scan->index_col_names_))) return false;
+    } else {
+        auto index = std::find_if(tab.indexes.begin(), tab.indexes.end(), match);
+        if (index == tab.indexes.end()) return false;
+        scan->tag = T_IndexScan;
+        scan->index_col_names_.clear();
+        for (auto &col: index->cols) {
+            scan->index_col_names_.push_back(col.name);
+        }
+    }
+    scan->reverse_ = is_desc;
+    return true;
+}
+
 std::shared_ptr<Plan> Planner::generate_sort_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan) {
     auto x = std::dynamic_pointer_cast<ast::SelectStmt>(query->parse);
     if (!x->has_sort) {
         return plan;
     }
+    // 索引顺序已经满足order by，不需要再排序
+    if (use_index_order(x, plan)) {
+        return plan;
+    }
     std::vector<std::string> tables = query->tables;
     std::vector<ColMeta> all_cols;
     for (auto &sel_tab_name: tables) {
@@ -325,6 +378,48 @@ std::shared_ptr<Plan> Planner::generate_sort_plan(std::shared_ptr<Query> query,
 }
 
 
+/**
+ * @brief 收集查询中用到的所有字段：投影列、条件两侧的列以及order by的列
+ * order by的列未经analyze补全表名，tab_name为空时视为可能属于任意一张表
+ */
+std::vector<TabCol> Planner::collect_used_cols(const std::shared_ptr<Query> &query) {
+    std::vector<TabCol> used_cols = query->cols;
+    for (auto &cond: query->conds) {
+        used_cols.push_back(cond.lhs_col);
+        if (!cond.is_rhs_val) used_cols.push_back(cond.rhs_col);
+    }
+    if (auto x = std::dynamic_pointer_cast<ast::SelectStmt>(query->parse)) {
+        for (auto &order: x->order) {
+            used_cols.push_back({.tab_name = order->cols->tab_name, .col_name = order->cols->col_name});
+        }
+    }
+    return used_cols;
+}
+
+/**
+ * @brief 对计划树中的index scan，如果索引项（索引字段 + INCLUDE字段）覆盖了该表上用到的所有字段，则标记为index-only
+ */
+void Planner::mark_index_only(const std::shared_ptr<Plan> &plan, const std::vector<TabCol> &used_cols) {
+    if (auto x = std::dynamic_pointer_cast<ScanPlan>(plan)) {
+        if (x->tag != T_IndexScan) return;
+        auto &tab = sm_manager_->db_.get_table(x->tab_name_);
+        auto &index = *tab.get_index_meta(x->index_col_names_);
+        for (auto &col: used_cols) {
+            if (!col.tab_name.empty() && col.tab_name != x->tab_name_) continue;
+            if (col.tab_name.empty() && !tab.is_col(col.col_name)) continue;
+            if (!index.covers(col.col_name)) return;
+        }
+        x->index_only_ = true;
+    } else if (auto x = std::dynamic_pointer_cast<JoinPlan>(plan)) {
+        mark_index_only(x->left_, used_cols);
+        mark_index_only(x->right_, used_cols);
+    } else if (auto x = std::dynamic_pointer_cast<SortPlan>(plan)) {
+        mark_index_only(x->subplan_, used_cols);
+    } else if (auto x = std::dynamic_pointer_cast<ProjectionPlan>(plan)) {
+        mark_index_only(x->subplan_, used_cols);
+    }
+}
+
 /**
  * @brief select plan 生成
  *
@@ -338,7 +433,10 @@ std::shared_ptr<Plan> Planner::generate_select_plan(std::shared_ptr<Query> query
 
     //物理优化
     auto sel_cols = query->cols;
+    // make_one_rel会把条件下推并从query->conds中取走，需要先收集用到的字段
+    auto used_cols = collect_used_cols(query);
     std::shared_ptr<Plan> plannerRoot = physical_optimization(query, context);
+    mark_index_only(plannerRoot, used_cols);
     plannerRoot = std::make_shared<ProjectionPlan>(T_Projection, std::move(plannerRoot),
                                                    std::move(sel_cols), limit);
 
@@ -368,7 +466,10 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
                                                 std::vector<ColDef>());
     } else if (auto x = std::dynamic_pointer_cast<ast::CreateIndex>(query->parse)) {
         // create index;
-        plannerRoot = std::make_shared<DDLPlan>(T_CreateIndex, x->tab_name, x->col_names, std::vector<ColDef>());
+        auto ddl = std::make_shared<DDLPlan>(T_CreateIndex, x->tab_name, x->col_names, std::vector<ColDef>());
+        ddl->unique_ = x->unique;
+        ddl->include_col_names_ = x->include_col_names;
+        plannerRoot = ddl;
     } else if (auto x = std::dynamic_pointer_cast<ast::ShowIndex>(query->parse)) {
         // show index;
         plannerRoot = std::make_shared<DDLPlan>(T_ShowIndex, x->tab_name, std::vector<std::string>(),
@@ -399,6 +500,8 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
         } else {  // 存在索引
             table_scan_executors =
                     std::make_shared<ScanPlan>(T_IndexScan, sm_manager_, x->tab_name, query->conds, index_col_names);
+            // 扫描只需产出rid，条件用到的字段都在索引中时不必回表
+            mark_index_only(table_scan_executors, collect_used_cols(query));
         }
 
         plannerRoot = std::make_shared<DMLPlan>(T_Delete, table_scan_executors, x->tab_name,
@@ -419,6 +522,7 @@ std::shared_ptr<Plan> Planner::do_planner(std::shared_ptr<Query> query, Context
         } else {  // 存在索引
             table_scan_executors =
                     std::make_shared<ScanPlan>(T_IndexScan, sm_manager_, x->tab_name, query->conds, index_col_names);
+            mark_index_only(table_scan_executors, collect_used_cols(query));
         }
         plannerRoot = std::make_shared<DMLPlan>(T_Update, table_scan_executors, x->tab_name,
                                                 std::vector<Value>(), query->conds,
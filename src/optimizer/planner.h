@@ -45,6 +45,8 @@ private:
 
     std::shared_ptr<Plan> generate_sort_plan(std::shared_ptr<Query> query, std::shared_ptr<Plan> plan);
 
+    bool use_index_order(const std::shared_ptr<ast::SelectStmt> &x, const std::shared_ptr<Plan> &plan);
+
     // int get_indexNo(std::string tab_name, std::vector<Condition> curr_conds);
     bool
     get_index_cols(std::string tab_name, std::vector<Condition> &curr_conds, std::vector<std::string> &index_col_names);
@@ -59,6 +61,11 @@ private:
         return m.at(sv_type);
     }
 
+    // index-only scan：收集查询用到的字段，索引覆盖了这些字段时扫描无需回表
+    std::vector<TabCol> collect_used_cols(const std::shared_ptr<Query> &query);
+
+    void mark_index_only(const std::shared_ptr<Plan> &plan, const std::vector<TabCol> &used_cols);
+
     std::shared_ptr<Plan>
     generate_select_plan(std::shared_ptr<Query> query, Context *context, const std::shared_ptr<ast::Limit>& limit);
 };
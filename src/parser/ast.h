@@ -102,9 +102,13 @@ namespace ast {
     struct CreateIndex : public TreeNode {
         std::string tab_name;
         std::vector<std::string> col_names;
+        bool unique;
+        std::vector<std::string> include_col_names;     // INCLUDE字段
 
-        CreateIndex(std::string tab_name_, std::vector<std::string> col_names_) :
-                tab_name(std::move(tab_name_)), col_names(std::move(col_names_)) {}
+        CreateIndex(std::string tab_name_, std::vector<std::string> col_names_, bool unique_ = true,
+                    std::vector<std::string> include_col_names_ = {}) :
+                tab_name(std::move(tab_name_)), col_names(std::move(col_names_)), unique(unique_),
+                include_col_names(std::move(include_col_names_)) {}
     };
 
     struct ShowIndex : public TreeNode {
@@ -94,9 +94,12 @@ namespace ast {
             } else if (auto x = std::dynamic_pointer_cast<CreateIndex>(node)) {
                 std::cout << "CREATE_INDEX\n";
                 print_val(x->tab_name, offset);
+                print_val(x->unique ? "UNIQUE" : "NON_UNIQUE", offset);
                 // print_val(x->col_name, offset);
                 for (auto col_name: x->col_names)
                     print_val(col_name, offset);
+                for (auto col_name: x->include_col_names)
+                    print_val("INCLUDE " + col_name, offset);
             } else if (auto x = std::dynamic_pointer_cast<DropIndex>(node)) {
                 std::cout << "DROP_INDEX\n";
                 print_val(x->tab_name, offset);
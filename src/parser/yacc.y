@@ -22,7 +22,7 @@ using namespace ast;
 
 // keywords
 %token SHOW TABLES CREATE TABLE DROP LOAD DESC INSERT INTO VALUES DELETE FROM ASC ORDER BY SUM COUNT MAX MIN AS LIMIT
-WHERE UPDATE SET SELECT INT CHAR FLOAT BIGINT DATETIME INDEX AND JOIN EXIT HELP TXN_BEGIN TXN_COMMIT TXN_ABORT TXN_ROLLBACK ORDER_BY
+WHERE UPDATE SET SELECT INT CHAR FLOAT BIGINT DATETIME INDEX NONUNIQUE INCLUDE AND JOIN EXIT HELP TXN_BEGIN TXN_COMMIT TXN_ABORT TXN_ROLLBACK ORDER_BY
 // non-keywords
 %token LEQ NEQ GEQ T_EOF
 
@@ -43,7 +43,7 @@ WHERE UPDATE SET SELECT INT CHAR FLOAT BIGINT DATETIME INDEX AND JOIN EXIT HELP
 %type <sv_val> value
 %type <sv_vals> valueList
 %type <sv_str> tbName colName fileName suffix
-%type <sv_strs> tableList colNameList
+%type <sv_strs> tableList colNameList optIncludeClause
 %type <sv_col> col
 %type <sv_cols> colList selector
 %type <sv_set_clause> setClause
@@ -124,9 +124,13 @@ ddl:
     {
         $$ = std::make_shared<DescTable>($2);
     }
-    |   CREATE INDEX tbName '(' colNameList ')'
+    |   CREATE INDEX tbName '(' colNameList ')' optIncludeClause
     {
-        $$ = std::make_shared<CreateIndex>($3, $5);
+        $$ = std::make_shared<CreateIndex>($3, $5, true, $7);
+    }
+    |   CREATE NONUNIQUE INDEX tbName '(' colNameList ')' optIncludeClause
+    {
+        $$ = std::make_shared<CreateIndex>($4, $6, false, $8);
     }
     |   DROP INDEX tbName '(' colNameList ')'
     {
@@ -254,6 +258,14 @@ condition:
     }
     ;
 
+optIncludeClause:
+        /* epsilon */ { /* ignore*/ }
+    |   INCLUDE '(' colNameList ')'
+    {
+        $$ = $3;
+    }
+    ;
+
 optWhereClause:
         /* epsilon */ { /* ignore*/ }
     |   WHERE whereClause
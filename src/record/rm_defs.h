@@ -36,8 +36,8 @@ struct RmPageHdr {
 
 /* 表中的记录 */
 struct RmRecord {
-    char *data;  // 记录的数据
-    int size;    // 记录的大小
+    char *data = nullptr;  // 记录的数据
+    int size = 0;          // 记录的大小
     bool allocated_ = false;    // 是否已经为数据分配空间
 
     RmRecord() = default;
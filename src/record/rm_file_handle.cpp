@@ -10,6 +10,9 @@ See the Mulan PSL v2 for more details. */
 
 #include "rm_file_handle.h"
 
+#include <algorithm>
+#include <unordered_set>
+
 /**
  * @description: 获取当前表中记录号为rid的记录
  * @param {Rid&} rid 记录号，指定记录的位置
@@ -27,37 +30,89 @@ std::unique_ptr<RmRecord> RmFileHandle::get_record(const Rid &rid, Context *cont
     return res;
 }
 
+/**
+ * @description: 快照读，不加锁地读取记录号为rid的记录对当前事务可见的版本。
+ * 页面上的内容和版本链在共享latch下一起读取，插入在同一个latch下先保存版本再写页面；
+ * READ_UNCOMMITTED直接读取页面上的最新内容
+ * @param {Rid&} rid 记录号
+ * @param {Context*} context
+ * @return {unique_ptr<RmRecord>} 可见的记录，记录对当前事务不存在时返回空指针
+ */
+std::unique_ptr<RmRecord> RmFileHandle::get_visible_record(const Rid &rid, Context *context) const {
+    std::shared_lock<std::shared_mutex> lock(latch_);
+    std::unique_ptr<RmRecord> res;
+    if (rid.page_no < file_hdr_.num_pages) {
+        RmPageHandle rph = fetch_page_handle(rid.page_no);
+        if (Bitmap::is_set(rph.bitmap, rid.slot_no)) {
+            res = std::make_unique<RmRecord>(rph.file_hdr->record_size, rph.get_slot(rid.slot_no));
+        }
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), false);
+    }
+    if (context->version_store_ != nullptr && VersionStore::is_snapshot_isolation(context->txn_)) {
+        context->version_store_->read_visible(fd_, rid, context->txn_, &res);
+    }
+    return res;
+}
+
 /**
  * @description: 在当前表中插入一条记录，不指定插入位置
  * @param {char*} buf 要插入的记录的数据
  * @param {Context*} context
+ * @param {RmLogger&} logger 写插入日志的回调，在页面unpin之前调用，页面被换出时日志已经可以刷盘
  * @return {Rid} 插入的记录的记录号（位置）
  */
-Rid RmFileHandle::insert_record(char *buf, Context *context) {
+Rid RmFileHandle::insert_record(char *buf, Context *context, const RmLogger &logger) {
     // Todo:
     // 1. 获取当前未满的page handle
     // 2. 在page handle中找到空闲slot位置
     // 3. 将buf复制到空闲slot位置
     // 4. 更新page_handle.page_hdr中的数据结构
     // 注意考虑插入一条记录后页面已满的情况，需要更新file_hdr_.first_free_page_no
-    if(context != nullptr) context->lock_mgr_->lock_exclusive_on_table(context->txn_, fd_);
-    RmPageHandle rph = create_page_handle();// 找空闲页
-    int slot_no = Bitmap::first_bit(false, rph.bitmap, file_hdr_.num_records_per_page);// 找第一个为0的位置
-    memcpy(rph.get_slot(slot_no), buf, rph.file_hdr->record_size);// 插入数据
-    Bitmap::set(rph.bitmap, slot_no);// 更新bitmap
-    rph.page_hdr->num_records++;// 页面记录数+1
-    if (rph.page_hdr->num_records == rph.file_hdr->num_records_per_page) {// 说明页面已满
-        file_hdr_.first_free_page_no = rph.page_hdr->next_free_page_no;
-    }
-    return {rph.page->get_page_id().page_no, slot_no};
+    // 调用者持有表上的IX锁，只使用能加上行级X锁的空闲slot，其他事务删除但尚未提交的记录所在的slot被跳过
+    // 乐观事务不加行锁，由版本链上未提交的版本识别这样的slot
+    std::lock_guard<std::shared_mutex> lock(latch_);
+    int page_no = file_hdr_.first_free_page_no;
+    while (true) {
+        RmPageHandle rph = page_no == RM_NO_PAGE ? create_new_page_handle() : fetch_page_handle(page_no);// 找空闲页
+        page_no = rph.page->get_page_id().page_no;
+        for (int slot_no = Bitmap::first_bit(false, rph.bitmap, file_hdr_.num_records_per_page);
+             slot_no < file_hdr_.num_records_per_page;
+             slot_no = Bitmap::next_bit(false, rph.bitmap, file_hdr_.num_records_per_page, slot_no)) {
+            Rid rid = {page_no, slot_no};
+            if (context != nullptr && !context->lock_mgr_->try_lock_exclusive_on_record(context->txn_, rid, fd_)) {
+                continue;
+            }
+            // 写页面之前保存版本，快照读不会看到这条未提交的记录
+            if (context != nullptr && context->version_store_ != nullptr &&
+                !context->version_store_->add_version(fd_, rid, context->txn_, nullptr)) {
+                continue;
+            }
+            memcpy(rph.get_slot(slot_no), buf, rph.file_hdr->record_size);// 插入数据
+            Bitmap::set(rph.bitmap, slot_no);// 更新bitmap
+            rph.page_hdr->num_records++;// 页面记录数+1
+            if (rph.page_hdr->num_records == rph.file_hdr->num_records_per_page) {// 说明页面已满
+                remove_from_free_list(rph);
+            }
+            if (logger != nullptr) {
+                rph.page->set_page_lsn(logger(rid));
+            }
+            buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+            return rid;
+        }
+        // 页面上的空闲slot都被其他事务锁住，继续找下一个空闲页面，没有时创建新页面
+        page_no = rph.page_hdr->next_free_page_no;
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), false);
+    }
 }
 
 /**
  * @description: 在当前表中的指定位置插入一条记录
  * @param {Rid&} rid 要插入记录的位置
  * @param {char*} buf 要插入记录的数据
+ * @param {lsn_t} lsn 已经写入的日志的lsn，在页面unpin之前标记页面
  */
-void RmFileHandle::insert_record(const Rid &rid, char *buf) {
+void RmFileHandle::insert_record(const Rid &rid, char *buf, lsn_t lsn) {
+    std::lock_guard<std::shared_mutex> lock(latch_);
     if (rid.page_no >= file_hdr_.num_pages) {
         throw PageNotExistError("insert_record ", rid.page_no);
     }
@@ -67,22 +122,102 @@ void RmFileHandle::insert_record(const Rid &rid, char *buf) {
         Bitmap::set(rph.bitmap, rid.slot_no);// 更新bitmap
         rph.page_hdr->num_records++;// 页面记录数+1
         if (rph.page_hdr->num_records == rph.file_hdr->num_records_per_page) {// 说明页面已满
-            file_hdr_.first_free_page_no = rph.page_hdr->next_free_page_no;//tbd
+            remove_from_free_list(rph);
         }
     }
+    if (lsn != INVALID_LSN) {
+        rph.page->set_page_lsn(lsn);
+    }
+    buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+}
+
+/**
+ * @description: 批量导入时插入连续存放的多条记录，只写入first_page及之后新分配的页面，不复用已有的空闲页面
+ * 新分配的页面总在空闲页面链表的头部，因此只需检查链表中的第一个页面；导入的页面从前往后填满，
+ * 空闲的slot都在已有记录之后，每个页面上的记录一次复制。调用者持有表上的X锁
+ * @param {char*} buf 要插入的记录，按record_size连续存放
+ * @param {int} num_records 记录条数
+ * @param {int} first_page 本次导入分配的第一个页面
+ * @param {lsn_t} lsn 批量导入日志的lsn，作为新页面的page lsn
+ * @param {vector<Rid>*} rids 传出插入记录的记录号
+ */
+void RmFileHandle::append_records(const char *buf, int num_records, int first_page, lsn_t lsn,
+                                  std::vector<Rid> *rids) {
+    while (num_records > 0) {
+        RmPageHandle rph = file_hdr_.first_free_page_no >= first_page
+                               ? fetch_page_handle(file_hdr_.first_free_page_no)
+                               : create_new_page_handle();
+        int page_no = rph.page->get_page_id().page_no;
+        int slot_no = rph.page_hdr->num_records;
+        int n = std::min(num_records, file_hdr_.num_records_per_page - slot_no);
+        memcpy(rph.get_slot(slot_no), buf, (size_t) n * file_hdr_.record_size);
+        for (int i = slot_no; i < slot_no + n; i++) {
+            Bitmap::set(rph.bitmap, i);
+            rids->push_back({page_no, i});
+        }
+        rph.page_hdr->num_records += n;
+        if (rph.page_hdr->num_records == file_hdr_.num_records_per_page) {
+            file_hdr_.first_free_page_no = rph.page_hdr->next_free_page_no;
+        }
+        rph.page->set_page_lsn(lsn);
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+        buf += (size_t) n * file_hdr_.record_size;
+        num_records -= n;
+    }
+}
+
+/**
+ * @description: 把表截断为前num_pages个页面，用于回滚批量导入。截断直接持久化：
+ * 空闲页面链表中被修改的页面和file header写回磁盘，文件被截断并刷盘，因此重复截断也是安全的
+ * @param {int} num_pages 保留的页面个数
+ */
+void RmFileHandle::truncate(int num_pages) {
+    std::lock_guard<std::shared_mutex> lock(latch_);
+    num_pages = std::min(num_pages, file_hdr_.num_pages);
+    // 先在截断前遍历空闲页面链表，找出保留下来的空闲页面
+    std::vector<int> free_pages;
+    std::unordered_set<int> visited;
+    int page_no = file_hdr_.first_free_page_no;
+    while (page_no >= RM_FIRST_RECORD_PAGE && page_no < file_hdr_.num_pages && visited.insert(page_no).second) {
+        RmPageHandle rph = fetch_page_handle(page_no);
+        if (page_no < num_pages) {
+            free_pages.push_back(page_no);
+        }
+        page_no = rph.page_hdr->next_free_page_no;
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), false);
+    }
+    buffer_pool_manager_->discard_pages_from(fd_, num_pages);
+    // 重新串联保留的空闲页面，只有next_free_page_no发生变化的页面需要写回
+    file_hdr_.first_free_page_no = RM_NO_PAGE;
+    for (auto it = free_pages.rbegin(); it != free_pages.rend(); it++) {
+        RmPageHandle rph = fetch_page_handle(*it);
+        bool changed = rph.page_hdr->next_free_page_no != file_hdr_.first_free_page_no;
+        rph.page_hdr->next_free_page_no = file_hdr_.first_free_page_no;
+        file_hdr_.first_free_page_no = *it;
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), changed);
+        if (changed) {
+            buffer_pool_manager_->flush_page(rph.page->get_page_id());
+        }
+    }
+    file_hdr_.num_pages = num_pages;
+    disk_manager_->write_page(fd_, RM_FILE_HDR_PAGE, (char *) &file_hdr_, sizeof(file_hdr_));
+    disk_manager_->truncate_file(fd_, num_pages);
+    disk_manager_->sync_file(fd_);
 }
 
 /**
  * @description: 删除记录文件中记录号为rid的记录
  * @param {Rid&} rid 要删除的记录的记录号（位置）
  * @param {Context*} context
+ * @param {lsn_t} lsn 已经写入的删除日志的lsn，在页面unpin之前标记页面
  */
-void RmFileHandle::delete_record(const Rid &rid, Context *context) {
+void RmFileHandle::delete_record(const Rid &rid, Context *context, lsn_t lsn) {
     // Todo:
     // 1. 获取指定记录所在的page handle
     // 2. 更新page_handle.page_hdr中的数据结构
     // 注意考虑删除一条记录后页面未满的情况，需要调用release_page_handle()
     if(context != nullptr) context->lock_mgr_->lock_exclusive_on_record(context->txn_, rid, fd_);
+    std::lock_guard<std::shared_mutex> lock(latch_);
     if (rid.page_no >= file_hdr_.num_pages) {
         throw PageNotExistError(" RmFileHandle delete_record ", rid.page_no);
     }
@@ -92,6 +227,10 @@ void RmFileHandle::delete_record(const Rid &rid, Context *context) {
     if (rph.page_hdr->num_records + 1 >= rph.file_hdr->num_records_per_page) {// 说明页面已满 -> 未满
         release_page_handle(rph);
     }
+    if (lsn != INVALID_LSN) {
+        rph.page->set_page_lsn(lsn);
+    }
+    buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
 }
 
 
@@ -100,17 +239,70 @@ void RmFileHandle::delete_record(const Rid &rid, Context *context) {
  * @param {Rid&} rid 要更新的记录的记录号（位置）
  * @param {char*} buf 新记录的数据
  * @param {Context*} context
+ * @param {lsn_t} lsn 已经写入的更新日志的lsn，在页面unpin之前标记页面
  */
-void RmFileHandle::update_record(const Rid &rid, char *buf, Context *context) {
+void RmFileHandle::update_record(const Rid &rid, char *buf, Context *context, lsn_t lsn) {
     // Todo:
     // 1. 获取指定记录所在的page handle
     // 2. 更新记录
     if(context != nullptr) context->lock_mgr_->lock_exclusive_on_record(context->txn_, rid, fd_);
+    std::lock_guard<std::shared_mutex> lock(latch_);
     if (rid.page_no >= file_hdr_.num_pages) {
         throw PageNotExistError(" RmFileHandle update_record ", rid.page_no);
     }
     RmPageHandle rph = fetch_page_handle(rid.page_no);
     memcpy(rph.get_slot(rid.slot_no), buf, rph.file_hdr->record_size);
+    if (lsn != INVALID_LSN) {
+        rph.page->set_page_lsn(lsn);
+    }
+    buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+}
+
+/**
+ * @description: 获取页面的page lsn，即最后一个修改该页面的日志的lsn
+ * @param {int} page_no 页面号
+ * @return {lsn_t} 页面的page lsn
+ */
+lsn_t RmFileHandle::get_page_lsn(int page_no) {
+    RmPageHandle rph = fetch_page_handle(page_no);
+    lsn_t lsn = rph.page->get_page_lsn();
+    buffer_pool_manager_->unpin_page(rph.page->get_page_id(), false);
+    return lsn;
+}
+
+/**
+ * @description: 恢复时按页面重做日志不维护空闲页面链表，重做完成后根据页面中的记录数重新串联空闲页面
+ * 原链表中已满的页面被移出，重做过的页面中未满且不在链表中的被加入
+ * @param {vector<int>&} page_nos 重做过的页面号
+ */
+void RmFileHandle::rebuild_free_list(const std::vector<int> &page_nos) {
+    std::vector<int> free_pages;
+    std::unordered_set<int> visited;
+    auto collect = [&](int page_no) {
+        RmPageHandle rph = fetch_page_handle(page_no);
+        int next_free_page_no = rph.page_hdr->next_free_page_no;
+        if (rph.page_hdr->num_records < file_hdr_.num_records_per_page) {
+            free_pages.push_back(page_no);
+        }
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), false);
+        return next_free_page_no;
+    };
+    int page_no = file_hdr_.first_free_page_no;
+    while (page_no >= RM_FIRST_RECORD_PAGE && page_no < file_hdr_.num_pages && visited.insert(page_no).second) {
+        page_no = collect(page_no);
+    }
+    for (int no: page_nos) {
+        if (visited.insert(no).second) {
+            collect(no);
+        }
+    }
+    file_hdr_.first_free_page_no = RM_NO_PAGE;
+    for (auto it = free_pages.rbegin(); it != free_pages.rend(); it++) {
+        RmPageHandle rph = fetch_page_handle(*it);
+        rph.page_hdr->next_free_page_no = file_hdr_.first_free_page_no;
+        file_hdr_.first_free_page_no = *it;
+        buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+    }
 }
 
 /**
@@ -186,4 +378,28 @@ void RmFileHandle::release_page_handle(RmPageHandle &page_handle) {
     // 将当前页面插入 file_hdr 和 first_free 之间即可
     page_handle.page_hdr->next_free_page_no = file_hdr_.first_free_page_no;
     file_hdr_.first_free_page_no = page_handle.page->get_page_id().page_no;
+}
+
+/**
+ * @description: 页面写满后把它从空闲页面链表中删除。页面通常在链表头部；插入时跳过了被锁住的slot，
+ * 或者回滚时在原位置重新插入记录，写满的页面可能在链表中间
+ */
+void RmFileHandle::remove_from_free_list(RmPageHandle &page_handle) {
+    int page_no = page_handle.page->get_page_id().page_no;
+    int next_free_page_no = page_handle.page_hdr->next_free_page_no;
+    if (file_hdr_.first_free_page_no == page_no) {
+        file_hdr_.first_free_page_no = next_free_page_no;
+        return;
+    }
+    int prev_page_no = file_hdr_.first_free_page_no;
+    while (prev_page_no != RM_NO_PAGE) {
+        RmPageHandle prev = fetch_page_handle(prev_page_no);
+        prev_page_no = prev.page_hdr->next_free_page_no;
+        bool found = prev_page_no == page_no;
+        if (found) {
+            prev.page_hdr->next_free_page_no = next_free_page_no;
+        }
+        buffer_pool_manager_->unpin_page(prev.page->get_page_id(), found);
+        if (found) return;
+    }
 }
\ No newline at end of file
@@ -12,7 +12,11 @@ See the Mulan PSL v2 for more details. */
 
 #include <assert.h>
 
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 
 #include "bitmap.h"
 #include "common/context.h"
@@ -40,6 +44,9 @@ struct RmPageHandle {
     }
 };
 
+/* 写记录插入日志的回调：插入的slot确定、页面unpin之前调用，返回日志的lsn，用于标记被修改的页面 */
+using RmLogger = std::function<lsn_t(const Rid &)>;
+
 /* 每个RmFileHandle对应一个表的数据文件，里面有多个page，每个page的数据封装在RmPageHandle中 */
 class RmFileHandle {      
     friend class RmScan;    
@@ -50,6 +57,8 @@ class RmFileHandle {
     BufferPoolManager *buffer_pool_manager_;
     int fd_;        // 打开文件后产生的文件句柄
     RmFileHdr file_hdr_;    // 文件头，维护当前表文件的元数据
+    mutable std::shared_mutex latch_;   // 插入和删除记录时保护空闲页面链表和页面的bitmap，表上只有IX锁时它们可能并发执行；
+                                        // 快照读不加锁，读取记录时持有共享latch，避免读到修改了一半的记录
 
    public:
     RmFileHandle(DiskManager *disk_manager, BufferPoolManager *buffer_pool_manager, int fd)
@@ -73,13 +82,23 @@ class RmFileHandle {
 
     std::unique_ptr<RmRecord> get_record(const Rid &rid, Context *context) const;
 
-    Rid insert_record(char *buf, Context *context);
+    std::unique_ptr<RmRecord> get_visible_record(const Rid &rid, Context *context) const;
+
+    Rid insert_record(char *buf, Context *context, const RmLogger &logger = nullptr);
+
+    void insert_record(const Rid &rid, char *buf, lsn_t lsn = INVALID_LSN);
+
+    void append_records(const char *buf, int num_records, int first_page, lsn_t lsn, std::vector<Rid> *rids);
 
-    void insert_record(const Rid &rid, char *buf);
+    void truncate(int num_pages);
 
-    void delete_record(const Rid &rid, Context *context);
+    void delete_record(const Rid &rid, Context *context, lsn_t lsn = INVALID_LSN);
 
-    void update_record(const Rid &rid, char *buf, Context *context);
+    void update_record(const Rid &rid, char *buf, Context *context, lsn_t lsn = INVALID_LSN);
+
+    lsn_t get_page_lsn(int page_no);
+
+    void rebuild_free_list(const std::vector<int> &page_nos);
 
     RmPageHandle create_new_page_handle();
 
@@ -89,4 +108,6 @@ class RmFileHandle {
     RmPageHandle create_page_handle();
 
     void release_page_handle(RmPageHandle &page_handle);
+
+    void remove_from_free_list(RmPageHandle &page_handle);
 };
\ No newline at end of file
@@ -76,10 +76,18 @@ public:
      * @param {RmFileHandle*} file_handle 要关闭文件的句柄
      */
     void close_file(const RmFileHandle *file_handle) {
-        disk_manager_->write_page(file_handle->fd_, RM_FILE_HDR_PAGE, (char *) &file_handle->file_hdr_,
-                                  sizeof(file_handle->file_hdr_));
+        flush_file_hdr(file_handle);
         // 缓冲区的所有页刷到磁盘，注意这句话必须写在close_file前面
         buffer_pool_manager_->flush_all_pages(file_handle->fd_);
         disk_manager_->close_file(file_handle->fd_);
     }
+
+    /**
+     * @description: 把内存中的file header写回表的数据文件，关闭文件和检查点时调用
+     * @param {RmFileHandle*} file_handle 表的数据文件句柄
+     */
+    void flush_file_hdr(const RmFileHandle *file_handle) {
+        disk_manager_->write_page(file_handle->fd_, RM_FILE_HDR_PAGE, (char *) &file_handle->file_hdr_,
+                                  sizeof(file_handle->file_hdr_));
+    }
 };
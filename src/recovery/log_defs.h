@@ -18,6 +18,12 @@ See the Mulan PSL v2 for more details. */
 #include <chrono>
 
 static constexpr std::chrono::duration<int64_t> FLUSH_TIMEOUT = std::chrono::seconds(3);
+// 两次检查点之间的间隔
+static constexpr std::chrono::duration<int64_t> CHECKPOINT_INTERVAL = std::chrono::seconds(30);
+// 当前日志文件超过该大小后归档为一个日志段，检查点之后不再需要的日志段会被删除
+static constexpr int LOG_SEGMENT_SIZE = 16 * 1024 * 1024;
+// 检查点每次在语句之间写回的页面数
+static constexpr int CHECKPOINT_FLUSH_BATCH = 256;
 // the offset of log_type_ in log header
 static constexpr int OFFSET_LOG_TYPE = 0;
 // the offset of lsn_ in log header
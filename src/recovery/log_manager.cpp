@@ -8,55 +8,139 @@ EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
 MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
 See the Mulan PSL v2 for more details. */
 
+#include <cassert>
 #include <cstring>
 #include "log_manager.h"
 
 /**
- * @description: 添加日志记录到日志缓冲区中，并返回日志记录号
+ * @description: 添加日志记录到日志缓冲区中，并返回日志记录号。日志只写入缓冲区，由日志写线程负责落盘
  * @param {LogRecord*} log_record 要写入缓冲区的日志记录
  * @return {lsn_t} 返回该日志的日志记录号
  */
 lsn_t LogManager::add_log_to_buffer(LogRecord* log_record) {
-    std::unique_lock<std::mutex> lock(latch_);
-//    if (log_buffer_.is_full(log_record->log_tot_len_)) {
-//        lock.unlock();
-//        flush_log_to_disk();
-//        lock.lock();
-//        persist_lsn_ = log_record->lsn_ - 1;
-//    }
-    char *dest = new char [log_record->log_tot_len_];
-    log_record->lsn_ = global_lsn_++;
-    log_record->serialize(dest);
-    memcpy(log_buffer_.buffer_ + log_buffer_.offset_, dest, log_record->log_tot_len_);
-    log_buffer_.offset_ += log_record->log_tot_len_;
-    lock.unlock();
-    flush_log_to_disk();
+    int len = log_record->log_tot_len_;
+    // 切换到空的缓冲区也放不下，不能等待日志写线程
+    if (len > LOG_BUFFER_SIZE) {
+        throw InternalError("LogManager::add_log_to_buffer log record larger than log buffer");
+    }
+    uint64_t tail = tail_.load();
+    while (true) {
+        if (tail_offset(tail) + len > LOG_BUFFER_SIZE) {
+            // 当前缓冲区已满，切换到空闲的缓冲区，没有空闲缓冲区时等待日志写线程
+            std::unique_lock<std::mutex> lock(latch_);
+            while (tail_.load() == tail && !seal_buffer(tail)) {
+                flush_requested_ = true;
+                flush_cv_.notify_one();
+                persist_cv_.wait(lock);
+            }
+            tail = tail_.load();
+            continue;
+        }
+        // 同时分配lsn和缓冲区中的位置，保证日志在文件中的顺序与lsn一致
+        uint64_t next = make_tail(tail_lsn(tail) + 1, tail_buffer(tail), tail_offset(tail) + len);
+        if (tail_.compare_exchange_weak(tail, next)) break;
+    }
+    LogBuffer &log_buffer = log_buffers_[tail_buffer(tail)];
+    log_record->lsn_ = tail_lsn(tail);
+    log_record->serialize(log_buffer.buffer_ + tail_offset(tail));
+    log_buffer.written_.fetch_add(len);
     return log_record->lsn_;
 }
-lsn_t LogManager::add_log_to_buffer_load(LogRecord *log_record) {
+
+/**
+ * @description: 把日志缓冲区的内容刷到磁盘中，返回时已经写入的日志都已持久化
+ */
+void LogManager::flush_log_to_disk() {
+    wait_for_flush(tail_lsn(tail_.load()) - 1);
+}
+
+/**
+ * @description: 等待lsn及之前的日志全部持久化，事务提交时调用。同一批等待的事务由日志写线程一次fsync完成
+ * @param {lsn_t} lsn 需要持久化的日志记录号
+ */
+void LogManager::wait_for_flush(lsn_t lsn) {
     std::unique_lock<std::mutex> lock(latch_);
-    if (log_buffer_.is_full(log_record->log_tot_len_)) {
-        lock.unlock();
-        flush_log_to_disk();
-        lock.lock();
-        persist_lsn_ = log_record->lsn_ - 1;
+    while (persist_lsn_ < lsn) {
+        flush_requested_ = true;
+        flush_cv_.notify_one();
+        persist_cv_.wait(lock);
     }
-    char *dest = new char [log_record->log_tot_len_];
-    log_record->lsn_ = global_lsn_++;
-    log_record->serialize(dest);
-    memcpy(log_buffer_.buffer_ + log_buffer_.offset_, dest, log_record->log_tot_len_);
-    log_buffer_.offset_ += log_record->log_tot_len_;
-//    lock.unlock();
-//    flush_log_to_disk();
-    return log_record->lsn_;
 }
 
 /**
- * @description: 把日志缓冲区的内容刷到磁盘中，由于目前只设置了一个缓冲区，因此需要阻塞其他日志操作
+ * @description: 设置下一条日志的lsn，恢复完成后、写入新的日志之前调用，使lsn在重启后继续递增
+ * @param {lsn_t} lsn 下一条日志的lsn
  */
-void LogManager::flush_log_to_disk() {
+void LogManager::set_next_lsn(lsn_t lsn) {
     std::unique_lock<std::mutex> lock(latch_);
-    disk_manager_->write_log(log_buffer_.buffer_, log_buffer_.offset_);
-    log_buffer_.offset_ = 0;
-    memset(log_buffer_.buffer_, 0, sizeof(log_buffer_.buffer_));
+    uint64_t tail = tail_.load();
+    assert(tail_offset(tail) == 0);
+    tail_.store(make_tail(lsn, tail_buffer(tail), 0));
+    persist_lsn_ = lsn - 1;
+}
+
+/**
+ * @description: 截断日志，删除所有日志都早于lsn的日志段，检查点完成后调用
+ * @param {lsn_t} lsn 恢复时需要的最早的日志
+ */
+void LogManager::truncate_log(lsn_t lsn) {
+    std::unique_lock<std::mutex> lock(latch_);
+    disk_manager_->remove_log_segments(lsn);
+}
+
+/**
+ * @description: 把tail对应的缓冲区交给日志写线程，后续日志写入下一个空闲缓冲区，调用者需要持有latch_
+ * @return {bool} 没有空闲缓冲区时返回false
+ * @param {uint64_t} tail 切换前的tail_，如果tail_已被其他线程修改则重新读取
+ */
+bool LogManager::seal_buffer(uint64_t tail) {
+    if (free_buffers_.empty()) return false;
+    int next_buffer = free_buffers_.front();
+    // 切换期间可能仍有线程在当前缓冲区中分配空间，CAS失败时以最新的tail_重试
+    while (!tail_.compare_exchange_weak(tail, make_tail(tail_lsn(tail), next_buffer, 0))) {
+    }
+    free_buffers_.pop_front();
+    sealed_buffers_.push_back({tail_buffer(tail), tail_offset(tail), tail_lsn(tail) - 1});
+    flush_cv_.notify_one();
+    return true;
+}
+
+/**
+ * @description: 日志写线程，有线程等待日志持久化时立即落盘，否则每隔FLUSH_TIMEOUT落盘一次。
+ * 写盘期间不持有latch_，其他线程可以继续向空闲缓冲区写日志；收到stop_后把缓冲区中的日志全部写盘再退出
+ */
+void LogManager::run_flush_thread() {
+    std::unique_lock<std::mutex> lock(latch_);
+    while (true) {
+        flush_cv_.wait_for(lock, FLUSH_TIMEOUT,
+                           [&] { return flush_requested_ || stop_ || !sealed_buffers_.empty(); });
+        flush_requested_ = false;
+        uint64_t tail = tail_.load();
+        if (sealed_buffers_.empty() && tail_offset(tail) > 0) {
+            // 当前缓冲区还没写满也一并写盘，此时其余缓冲区都是空闲的
+            seal_buffer(tail);
+        }
+        while (!sealed_buffers_.empty()) {
+            SealedBuffer sealed = sealed_buffers_.front();
+            lock.unlock();
+            LogBuffer &log_buffer = log_buffers_[sealed.buffer];
+            // 等待已经分配了空间的线程拷贝完日志
+            while (log_buffer.written_.load() < sealed.size) {
+                std::this_thread::yield();
+            }
+            disk_manager_->write_log(log_buffer.buffer_, sealed.size);
+            log_buffer.written_.store(0);
+            lock.lock();
+            // 日志段写满后归档，缓冲区按lsn顺序写盘，因此一个日志段中的日志是连续的
+            if (disk_manager_->get_file_size(LOG_FILE_NAME) >= LOG_SEGMENT_SIZE) {
+                disk_manager_->switch_log(sealed.last_lsn);
+            }
+            sealed_buffers_.pop_front();
+            free_buffers_.push_back(sealed.buffer);
+            persist_lsn_ = sealed.last_lsn;
+        }
+        persist_cv_.notify_all();
+        // 退出前写完所有日志，包括最后一个没有写满的缓冲区，之后等待持久化的线程不会一直阻塞
+        if (stop_ && sealed_buffers_.empty() && tail_offset(tail_.load()) == 0) break;
+    }
 }
@@ -10,12 +10,17 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <mutex>
+#include <thread>
 #include <vector>
 #include <iostream>
 #include "log_defs.h"
 #include "common/config.h"
 #include "record/rm_defs.h"
+#include "index/ix_defs.h"
+#include "system/sm_meta.h"
 
 /* 日志记录对应操作的类型 */
 enum LogType: int {
@@ -26,7 +31,9 @@ enum LogType: int {
     commit,
     ABORT,
     INDEX_INSERT,
-    INDEX_DELETE
+    INDEX_DELETE,
+    CHECKPOINT,
+    BULK_LOAD
 };
 static std::string LogTypeStr[] = {
     "UPDATE",
@@ -36,7 +43,9 @@ static std::string LogTypeStr[] = {
     "COMMIT",
     "ABORT",
     "INDEX_INSERT",
-    "INDEX_DELETE"
+    "INDEX_DELETE",
+    "CHECKPOINT",
+    "BULK_LOAD"
 };
 
 class LogRecord {
@@ -47,6 +56,8 @@ public:
     txn_id_t log_tid_;         /* 创建当前日志的事务ID */
     lsn_t prev_lsn_;           /* 事务创建的前一条日志记录的lsn，用于undo */
 
+    virtual ~LogRecord() = default;
+
     // 把日志记录序列化到dest中
     virtual void serialize (char* dest) const {
         memcpy(dest + OFFSET_LOG_TYPE, &log_type_, sizeof(LogType));
@@ -73,6 +84,24 @@ public:
         printf("log_tid: %d\n", log_tid_);
         printf("prev_lsn: %d\n", prev_lsn_);
     }
+
+protected:
+    // 日志正文中的rid以两个varint存放
+    static int rid_size(const Rid &rid) { return varint_size(rid.page_no) + varint_size(rid.slot_no); }
+    static char *put_rid(char *dest, const Rid &rid) { return put_varint(put_varint(dest, rid.page_no), rid.slot_no); }
+    static const char *get_rid(const char *src, Rid *rid) {
+        return get_varint(get_varint(src, &rid->page_no), &rid->slot_no);
+    }
+    // 从src中读出长度为size的记录
+    static void get_record(const char *src, int size, RmRecord *rec) {
+        if (rec->allocated_) {
+            delete[] rec->data;
+        }
+        rec->data = new char[size];
+        rec->size = size;
+        rec->allocated_ = true;
+        memcpy(rec->data, src, size);
+    }
 };
 
 class BeginLogRecord: public LogRecord {
@@ -167,60 +196,46 @@ public:
         log_tot_len_ = LOG_HEADER_SIZE;
         log_tid_ = INVALID_TXN_ID;
         prev_lsn_ = INVALID_LSN;
-        table_name_ = nullptr;
+        tab_id_ = -1;
     }
-    InsertLogRecord(txn_id_t txn_id, RmRecord& insert_value, Rid& rid, std::string table_name)
+    InsertLogRecord(txn_id_t txn_id, RmRecord& insert_value, Rid& rid, int tab_id)
         : InsertLogRecord() {
         log_tid_ = txn_id;
         insert_value_ = insert_value;
         rid_ = rid;
-        log_tot_len_ += sizeof(int);
-        log_tot_len_ += insert_value_.size;
-        log_tot_len_ += sizeof(Rid);
-        table_name_size_ = table_name.length() + 1;
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, table_name.c_str(), table_name_size_);
-        log_tot_len_ += sizeof(size_t) + table_name_size_;
+        tab_id_ = tab_id;
+        log_tot_len_ += varint_size(tab_id_) + rid_size(rid_);
+        log_tot_len_ += varint_size(insert_value_.size) + insert_value_.size;
     }
 
-    // 把insert日志记录序列化到dest中
+    // 把insert日志记录序列化到dest中：表id - rid - 记录长度 - 记录
     void serialize(char* dest) const override {
         LogRecord::serialize(dest);
-        int offset = OFFSET_LOG_DATA;
-        memcpy(dest + offset, &insert_value_.size, sizeof(int));
-        offset += sizeof(int);
-        memcpy(dest + offset, insert_value_.data, insert_value_.size);
-        offset += insert_value_.size;
-        memcpy(dest + offset, &rid_, sizeof(Rid));
-        offset += sizeof(Rid);
-        memcpy(dest + offset, &table_name_size_, sizeof(size_t));
-        offset += sizeof(size_t);
-        memcpy(dest + offset, table_name_, table_name_size_);
+        dest = put_varint(dest + OFFSET_LOG_DATA, tab_id_);
+        dest = put_rid(dest, rid_);
+        dest = put_varint(dest, insert_value_.size);
+        memcpy(dest, insert_value_.data, insert_value_.size);
     }
     // 从src中反序列化出一条Insert日志记录
     void deserialize(const char* src) override {
         LogRecord::deserialize(src);  
-        insert_value_.Deserialize(src + OFFSET_LOG_DATA);
-        int offset = OFFSET_LOG_DATA + insert_value_.size + sizeof(int);
-        rid_ = *reinterpret_cast<const Rid*>(src + offset);
-        offset += sizeof(Rid);
-        table_name_size_ = *reinterpret_cast<const size_t*>(src + offset);
-        offset += sizeof(size_t);
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, src + offset, table_name_size_);
+        src = get_varint(src + OFFSET_LOG_DATA, &tab_id_);
+        src = get_rid(src, &rid_);
+        int size;
+        src = get_varint(src, &size);
+        get_record(src, size, &insert_value_);
     }
     void format_print() override {
         printf("insert record\n");
         LogRecord::format_print();
         printf("insert_value: %s\n", insert_value_.data);
         printf("insert rid: %d, %d\n", rid_.page_no, rid_.slot_no);
-        printf("table name: %s\n", table_name_);
+        printf("table id: %d\n", tab_id_);
     }
 
     RmRecord insert_value_;     // 插入的记录
     Rid rid_;                   // 记录插入的位置
-    char* table_name_;          // 插入记录的表名称
-    size_t table_name_size_;    // 表名称的大小
+    int tab_id_;                // 插入记录的表的id
 };
 
 /**
@@ -234,65 +249,58 @@ public:
         log_tot_len_ = LOG_HEADER_SIZE;
         log_tid_ = INVALID_TXN_ID;
         prev_lsn_ = INVALID_LSN;
-        table_name_ = nullptr;
+        tab_id_ = -1;
     }
-    DeleteLogRecord(txn_id_t txn_id, RmRecord& delete_value, Rid& rid, std::string table_name)
+    DeleteLogRecord(txn_id_t txn_id, RmRecord& delete_value, Rid& rid, int tab_id)
     : DeleteLogRecord() {
         log_tid_ = txn_id;
         delete_value_ = delete_value;
         rid_ = rid;
-        log_tot_len_ += sizeof(int);
-        log_tot_len_ += delete_value_.size;
-        log_tot_len_ += sizeof(Rid);
-        table_name_size_ = table_name.length() + 1;
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, table_name.c_str(), table_name_size_);
-        log_tot_len_ += sizeof(size_t) + table_name_size_;
+        tab_id_ = tab_id;
+        log_tot_len_ += varint_size(tab_id_) + rid_size(rid_);
+        log_tot_len_ += varint_size(delete_value_.size) + delete_value_.size;
     }
 
-    // 把delete日志记录序列化到dest中
+    // 把delete日志记录序列化到dest中：表id - rid - 记录长度 - 记录
     void serialize(char* dest) const override {
         LogRecord::serialize(dest);
-        int offset = OFFSET_LOG_DATA;
-        memcpy(dest + offset, &delete_value_.size, sizeof(int));
-        offset += sizeof(int);
-        memcpy(dest + offset, delete_value_.data, delete_value_.size);
-        offset += delete_value_.size;
-        memcpy(dest + offset, &rid_, sizeof(Rid));
-        offset += sizeof(Rid);
-        memcpy(dest + offset, &table_name_size_, sizeof(size_t));
-        offset += sizeof(size_t);
-        memcpy(dest + offset, table_name_, table_name_size_);
+        dest = put_varint(dest + OFFSET_LOG_DATA, tab_id_);
+        dest = put_rid(dest, rid_);
+        dest = put_varint(dest, delete_value_.size);
+        memcpy(dest, delete_value_.data, delete_value_.size);
     }
     // 从src中反序列化出一条delete日志记录
     void deserialize(const char* src) override {
         LogRecord::deserialize(src);
-        delete_value_.Deserialize(src + OFFSET_LOG_DATA);
-        int offset = OFFSET_LOG_DATA + delete_value_.size + sizeof(int);
-        rid_ = *reinterpret_cast<const Rid*>(src + offset);
-        offset += sizeof(Rid);
-        table_name_size_ = *reinterpret_cast<const size_t*>(src + offset);
-        offset += sizeof(size_t);
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, src + offset, table_name_size_);
+        src = get_varint(src + OFFSET_LOG_DATA, &tab_id_);
+        src = get_rid(src, &rid_);
+        int size;
+        src = get_varint(src, &size);
+        get_record(src, size, &delete_value_);
     }
     void format_print() override {
         printf("delete record\n");
         LogRecord::format_print();
         printf("delete_value: %s\n", delete_value_.data);
         printf("delete rid: %d, %d\n", rid_.page_no, rid_.slot_no);
-        printf("table name: %s\n", table_name_);
+        printf("table id: %d\n", tab_id_);
     }
 
     RmRecord delete_value_;     // 删除的记录
     Rid rid_;                   // 记录删除的位置
-    char* table_name_;          // 删除记录的表名称
-    size_t table_name_size_;    // 表名称的大小
+    int tab_id_;                // 删除记录的表的id
 };
 
+/* update日志中一段连续的被修改字段：在记录中的偏移量，以及修改前后的内容 */
+struct UpdateDelta {
+    int offset_;
+    std::string before_;
+    std::string after_;
+};
 
 /**
  * TODO: update操作的日志记录
+ * 只记录被修改的字段，相邻的被修改字段合并为一段
 */
 class UpdateLogRecord: public LogRecord {
 public:
@@ -302,71 +310,88 @@ public:
         log_tot_len_ = LOG_HEADER_SIZE;
         log_tid_ = INVALID_TXN_ID;
         prev_lsn_ = INVALID_LSN;
-        table_name_ = nullptr;
+        tab_id_ = -1;
     }
-    UpdateLogRecord(txn_id_t txn_id, RmRecord& update_value, Rid& rid, std::string table_name, RmRecord& now_value)
+    UpdateLogRecord(txn_id_t txn_id, RmRecord& update_value, Rid& rid, int tab_id, RmRecord& now_value,
+                    const std::vector<ColMeta>& cols)
     : UpdateLogRecord() {
         log_tid_ = txn_id;
-        update_value_ = update_value;
-        now_value_ = now_value;
         rid_ = rid;
-        log_tot_len_ += sizeof(int);
-        log_tot_len_ += sizeof(int);
-        log_tot_len_ += update_value_.size;
-        log_tot_len_ += now_value_.size;
-        log_tot_len_ += sizeof(Rid);
-        table_name_size_ = table_name.length() + 1;
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, table_name.c_str(), table_name_size_);
-        log_tot_len_ += sizeof(size_t) + table_name_size_;
-    }
-
-    // 把update日志记录序列化到dest中
+        tab_id_ = tab_id;
+        for (auto &col: cols) {
+            const char *before = update_value.data + col.offset;
+            const char *after = now_value.data + col.offset;
+            if (memcmp(before, after, col.len) == 0) continue;
+            if (!deltas_.empty() && deltas_.back().offset_ + (int) deltas_.back().before_.size() == col.offset) {
+                deltas_.back().before_.append(before, col.len);
+                deltas_.back().after_.append(after, col.len);
+            } else {
+                deltas_.push_back({col.offset, std::string(before, col.len), std::string(after, col.len)});
+            }
+        }
+        log_tot_len_ += varint_size(tab_id_) + rid_size(rid_) + varint_size(deltas_.size());
+        for (auto &delta: deltas_) {
+            log_tot_len_ += varint_size(delta.offset_) + varint_size(delta.before_.size()) + delta.before_.size() * 2;
+        }
+    }
+
+    // 把修改前的内容写回记录rec
+    void undo(char *rec) const {
+        for (auto &delta: deltas_) {
+            memcpy(rec + delta.offset_, delta.before_.data(), delta.before_.size());
+        }
+    }
+    // 把修改后的内容写入记录rec
+    void redo(char *rec) const {
+        for (auto &delta: deltas_) {
+            memcpy(rec + delta.offset_, delta.after_.data(), delta.after_.size());
+        }
+    }
+
+    // 把update日志记录序列化到dest中：表id - rid - 段数 - (偏移量 - 长度 - 修改前 - 修改后)...
     void serialize(char* dest) const override {
         LogRecord::serialize(dest);
-        int offset = OFFSET_LOG_DATA;
-        memcpy(dest + offset, &update_value_.size, sizeof(int));
-        offset += sizeof(int);
-        memcpy(dest + offset, update_value_.data, update_value_.size);
-        offset += update_value_.size;
-        memcpy(dest + offset, &now_value_.size, sizeof(int));
-        offset += sizeof(int);
-        memcpy(dest + offset, now_value_.data, update_value_.size);
-        offset += now_value_.size;
-        memcpy(dest + offset, &rid_, sizeof(Rid));
-        offset += sizeof(Rid);
-        memcpy(dest + offset, &table_name_size_, sizeof(size_t));
-        offset += sizeof(size_t);
-        memcpy(dest + offset, table_name_, table_name_size_);
-    }
-    // 从src中反序列化出一条Insert日志记录
+        dest = put_varint(dest + OFFSET_LOG_DATA, tab_id_);
+        dest = put_rid(dest, rid_);
+        dest = put_varint(dest, deltas_.size());
+        for (auto &delta: deltas_) {
+            dest = put_varint(dest, delta.offset_);
+            dest = put_varint(dest, delta.before_.size());
+            memcpy(dest, delta.before_.data(), delta.before_.size());
+            dest += delta.before_.size();
+            memcpy(dest, delta.after_.data(), delta.after_.size());
+            dest += delta.after_.size();
+        }
+    }
+    // 从src中反序列化出一条update日志记录
     void deserialize(const char* src) override {
         LogRecord::deserialize(src);
-        update_value_.Deserialize(src + OFFSET_LOG_DATA);
-        int offset = OFFSET_LOG_DATA + update_value_.size + sizeof(int);
-        now_value_.Deserialize(src + offset);
-        offset += (int)(now_value_.size + sizeof(int));
-        rid_ = *reinterpret_cast<const Rid*>(src + offset);
-        offset += sizeof(Rid);
-        table_name_size_ = *reinterpret_cast<const size_t*>(src + offset);
-        offset += sizeof(size_t);
-        table_name_ = new char[table_name_size_];
-        memcpy(table_name_, src + offset, table_name_size_);
+        src = get_varint(src + OFFSET_LOG_DATA, &tab_id_);
+        src = get_rid(src, &rid_);
+        size_t delta_num;
+        src = get_varint(src, &delta_num);
+        deltas_.resize(delta_num);
+        for (auto &delta: deltas_) {
+            src = get_varint(src, &delta.offset_);
+            size_t len;
+            src = get_varint(src, &len);
+            delta.before_.assign(src, len);
+            src += len;
+            delta.after_.assign(src, len);
+            src += len;
+        }
     }
     void format_print() override {
         printf("update record\n");
         LogRecord::format_print();
-        printf("update_value: %s\n", update_value_.data);
-        printf("now_value: %s\n", now_value_.data);
+        printf("update columns: %d\n", (int) deltas_.size());
         printf("update rid: %d, %d\n", rid_.page_no, rid_.slot_no);
-        printf("table name: %s\n", table_name_);
+        printf("table id: %d\n", tab_id_);
     }
 
-    RmRecord update_value_;     // 更新前的记录
-    RmRecord now_value_;        // 更新后的记录
+    std::vector<UpdateDelta> deltas_;   // 被修改的字段
     Rid rid_;                   // 记录更新的位置
-    char* table_name_;          // 更新记录的表名称
-    size_t table_name_size_;    // 表名称的大小
+    int tab_id_;                // 更新记录的表的id
 };
 
 class IndexInsertLogRecord: public LogRecord {
@@ -377,66 +402,52 @@ public:
         log_tot_len_ = LOG_HEADER_SIZE;
         log_tid_ = INVALID_TXN_ID;
         prev_lsn_ = INVALID_LSN;
-        ix_name_ = nullptr;
+        ix_id_ = -1;
     }
-    IndexInsertLogRecord(txn_id_t txn_id, char* key, Rid& rid, std::string ix_name, int tot_len)
+    IndexInsertLogRecord(txn_id_t txn_id, char* key, Rid& rid, int ix_id, int tot_len, const IxRedoInfo& redo)
             : IndexInsertLogRecord() {
         log_tid_ = txn_id;
         key_ = key;
         tot_len_ = tot_len;
         rid_ = rid;
-        log_tot_len_ += sizeof(int);// tot_len
-        log_tot_len_ += tot_len;// key
-        log_tot_len_ += sizeof(Rid);// rid
-        ix_name_size_ = ix_name.length() + 1;// ix_name
-        ix_name_ = new char[ix_name_size_];
-        memcpy(ix_name_, ix_name.c_str(), ix_name_size_);
-        log_tot_len_ += sizeof(size_t) + ix_name_size_;// ix_size + ix_name
+        ix_id_ = ix_id;
+        redo_ = redo;
+        log_tot_len_ += varint_size(ix_id_) + varint_size(tot_len_) + tot_len_ + rid_size(rid_) + redo_.size();
     }
 
-    // 把delete日志记录序列化到dest中
+    // 把index insert日志记录序列化到dest中：索引id - key长度 - key - rid - redo
     void serialize(char* dest) const override {
         LogRecord::serialize(dest);
-        int offset = OFFSET_LOG_DATA;
-        //head - key_size - key - rid - ix_size - ix_name
-        memcpy(dest + offset, &tot_len_, sizeof(int));
-        offset += sizeof(int);
-        memcpy(dest + offset, key_, tot_len_);
-        offset += tot_len_;
-        memcpy(dest + offset, &rid_, sizeof(Rid));
-        offset += sizeof(Rid);
-        memcpy(dest + offset, &ix_name_size_, sizeof(size_t));
-        offset += sizeof(size_t);
-        memcpy(dest + offset, ix_name_, ix_name_size_);
+        dest = put_varint(dest + OFFSET_LOG_DATA, ix_id_);
+        dest = put_varint(dest, tot_len_);
+        memcpy(dest, key_, tot_len_);
+        dest = put_rid(dest + tot_len_, rid_);
+        redo_.serialize(dest);
     }
-    // 从src中反序列化出一条delete日志记录
+    // 从src中反序列化出一条index insert日志记录
     void deserialize(const char* src) override {
         LogRecord::deserialize(src);
-        tot_len_ = *reinterpret_cast<const int*>(src + OFFSET_LOG_DATA);
-        int offset = OFFSET_LOG_DATA + sizeof(int);
-        key_ = new char[tot_len_];
-        memcpy(key_, src + offset, tot_len_);
-        offset += tot_len_;
-        rid_ = *reinterpret_cast<const Rid*>(src + offset);
-        offset += sizeof(Rid);
-        ix_name_size_ = *reinterpret_cast<const size_t*>(src + offset);
-        offset += sizeof(size_t);
-        ix_name_ = new char[ix_name_size_];
-        memcpy(ix_name_, src + offset, ix_name_size_);
+        src = get_varint(src + OFFSET_LOG_DATA, &ix_id_);
+        src = get_varint(src, &tot_len_);
+        key_data_.assign(src, tot_len_);
+        key_ = key_data_.data();
+        src = get_rid(src + tot_len_, &rid_);
+        redo_.deserialize(src);
     }
     void format_print() override {
         printf("index insert record\n");
         LogRecord::format_print();
         printf("delete_value: %s\n", key_);
         printf("delete rid: %d, %d\n", rid_.page_no, rid_.slot_no);
-        printf("ix name: %s\n", ix_name_);
+        printf("ix id: %d\n", ix_id_);
     }
 
     char * key_;                 // b+树插入的键值
     int tot_len_;                // key长度
     Rid rid_;                   // 插入的rid
-    char* ix_name_;        // index_name
-    size_t ix_name_size_;       // index_name的大小
+    int ix_id_;                 // 索引的id
+    IxRedoInfo redo_;           // 重做信息：修改的叶子结点，或被修改页面的变化
+    std::string key_data_;      // 反序列化得到的键值，key_指向这里
 };
 
 class IndexDeleteLogRecord: public LogRecord {
@@ -447,69 +458,173 @@ public:
         log_tot_len_ = LOG_HEADER_SIZE;
         log_tid_ = INVALID_TXN_ID;
         prev_lsn_ = INVALID_LSN;
-        ix_name_ = nullptr;
+        ix_id_ = -1;
     }
-    IndexDeleteLogRecord(txn_id_t txn_id, char* key, Rid& rid, std::string ix_name, int tot_len)
+    IndexDeleteLogRecord(txn_id_t txn_id, char* key, Rid& rid, int ix_id, int tot_len, const IxRedoInfo& redo)
             : IndexDeleteLogRecord() {
         log_tid_ = txn_id;
         key_ = key;
         tot_len_ = tot_len;
         rid_ = rid;
-        log_tot_len_ += sizeof(int);// tot_len
-        log_tot_len_ += tot_len;// key
-        log_tot_len_ += sizeof(Rid);// rid
-        ix_name_size_ = ix_name.length() + 1;// ix_name
-        ix_name_ = new char[ix_name_size_];
-        memcpy(ix_name_, ix_name.c_str(), ix_name_size_);
-        log_tot_len_ += sizeof(size_t) + ix_name_size_;// ix_size + ix_name
+        ix_id_ = ix_id;
+        redo_ = redo;
+        log_tot_len_ += varint_size(ix_id_) + varint_size(tot_len_) + tot_len_ + rid_size(rid_) + redo_.size();
     }
 
-    // 把delete日志记录序列化到dest中
+    // 把index delete日志记录序列化到dest中：索引id - key长度 - key - rid - redo
     void serialize(char* dest) const override {
         LogRecord::serialize(dest);
-        int offset = OFFSET_LOG_DATA;
-        //head - key_size - key - rid - ix_size - ix_name
-        memcpy(dest + offset, &tot_len_, sizeof(int));
-        offset += sizeof(int);
-        memcpy(dest + offset, key_, tot_len_);
-        offset += tot_len_;
-        memcpy(dest + offset, &rid_, sizeof(Rid));
-        offset += sizeof(Rid);
-        memcpy(dest + offset, &ix_name_size_, sizeof(size_t));
-        offset += sizeof(size_t);
-        memcpy(dest + offset, ix_name_, ix_name_size_);
+        dest = put_varint(dest + OFFSET_LOG_DATA, ix_id_);
+        dest = put_varint(dest, tot_len_);
+        memcpy(dest, key_, tot_len_);
+        dest = put_rid(dest + tot_len_, rid_);
+        redo_.serialize(dest);
     }
-    // 从src中反序列化出一条delete日志记录
+    // 从src中反序列化出一条index delete日志记录
     void deserialize(const char* src) override {
         LogRecord::deserialize(src);
-        tot_len_ = *reinterpret_cast<const int*>(src + OFFSET_LOG_DATA);
-        int offset = OFFSET_LOG_DATA + sizeof(int);
-        key_ = new char[tot_len_];
-        memcpy(key_, src + offset, tot_len_);
-        offset += tot_len_;
-        rid_ = *reinterpret_cast<const Rid*>(src + offset);
-        offset += sizeof(Rid);
-        ix_name_size_ = *reinterpret_cast<const size_t*>(src + offset);
-        offset += sizeof(size_t);
-        ix_name_ = new char[ix_name_size_];
-        memcpy(ix_name_, src + offset, ix_name_size_);
+        src = get_varint(src + OFFSET_LOG_DATA, &ix_id_);
+        src = get_varint(src, &tot_len_);
+        key_data_.assign(src, tot_len_);
+        key_ = key_data_.data();
+        src = get_rid(src + tot_len_, &rid_);
+        redo_.deserialize(src);
     }
     void format_print() override {
         printf("index delete record\n");
         LogRecord::format_print();
         printf("delete_value: %s\n", key_);
         printf("delete rid: %d, %d\n", rid_.page_no, rid_.slot_no);
-        printf("ix name: %s\n", ix_name_);
+        printf("ix id: %d\n", ix_id_);
     }
 
-    char * key_;                 // b+树插入的键值
+    char * key_;                 // b+树删除的键值
     int tot_len_;                // key长度
-    Rid rid_;                   // 插入的rid
-    char* ix_name_;        // index_name
-    size_t ix_name_size_;       // index_name的大小
+    Rid rid_;                   // 删除的rid
+    int ix_id_;                 // 索引的id
+    IxRedoInfo redo_;           // 重做信息：修改的叶子结点，或被修改页面的变化
+    std::string key_data_;      // 反序列化得到的键值，key_指向这里
+};
+
+/**
+ * 批量导入日志记录。导入的记录只写入first_page_及之后新分配的页面，不再逐条写insert日志，
+ * 这些页面在导入语句结束时写回磁盘；回滚时把表截断为first_page_个页面
+ */
+class BulkLoadLogRecord: public LogRecord {
+public:
+    BulkLoadLogRecord() {
+        log_type_ = LogType::BULK_LOAD;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+        tab_id_ = -1;
+        first_page_ = INVALID_PAGE_ID;
+    }
+    BulkLoadLogRecord(txn_id_t txn_id, int tab_id, page_id_t first_page) : BulkLoadLogRecord() {
+        log_tid_ = txn_id;
+        tab_id_ = tab_id;
+        first_page_ = first_page;
+        log_tot_len_ += varint_size(tab_id_) + varint_size(first_page_);
+    }
+
+    // 把批量导入日志记录序列化到dest中：表id - 第一个新页面的页号
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+        dest = put_varint(dest + OFFSET_LOG_DATA, tab_id_);
+        put_varint(dest, first_page_);
+    }
+    // 从src中反序列化出一条批量导入日志记录
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+        src = get_varint(src + OFFSET_LOG_DATA, &tab_id_);
+        get_varint(src, &first_page_);
+    }
+    void format_print() override {
+        printf("bulk load record\n");
+        LogRecord::format_print();
+        printf("table id: %d, first page: %d\n", tab_id_, first_page_);
+    }
+
+    int tab_id_;                // 导入的表的id
+    page_id_t first_page_;      // 导入前表的页面个数，即导入分配的第一个页面
 };
 
-/* 日志缓冲区，只有一个buffer，因此需要阻塞地去把日志写入缓冲区中 */
+/* 检查点脏页表中的一项：表或索引的id、页号，以及第一个修改该页面且未写回磁盘的日志的lsn */
+struct DirtyPageEntry {
+    int file_id_;
+    page_id_t page_no_;
+    lsn_t rec_lsn_;
+};
+
+/**
+ * 检查点日志记录。检查点先把缓冲池中的页面写回磁盘，再记录此时的脏页表；
+ * snapshot_lsn_之前的日志修改过的页面，只有在脏页表中的才可能需要重做。
+ * 活跃事务的日志不会被截断，恢复时扫描全部日志就能得到活跃事务表，检查点中不再记录
+ */
+class CheckpointLogRecord: public LogRecord {
+public:
+    CheckpointLogRecord() {
+        log_type_ = LogType::CHECKPOINT;
+        lsn_ = INVALID_LSN;
+        log_tot_len_ = LOG_HEADER_SIZE;
+        log_tid_ = INVALID_TXN_ID;
+        prev_lsn_ = INVALID_LSN;
+        snapshot_lsn_ = INVALID_LSN;
+        next_txn_id_ = 0;
+    }
+    CheckpointLogRecord(lsn_t snapshot_lsn, txn_id_t next_txn_id, std::vector<DirtyPageEntry> dpt)
+            : CheckpointLogRecord() {
+        snapshot_lsn_ = snapshot_lsn;
+        next_txn_id_ = next_txn_id;
+        dpt_ = std::move(dpt);
+        log_tot_len_ += varint_size(snapshot_lsn_) + varint_size(next_txn_id_);
+        log_tot_len_ += varint_size(dpt_.size());
+        for (auto &entry: dpt_) {
+            log_tot_len_ += varint_size(entry.file_id_) + varint_size(entry.page_no_) + varint_size(entry.rec_lsn_);
+        }
+    }
+
+    // 把检查点日志记录序列化到dest中
+    void serialize(char* dest) const override {
+        LogRecord::serialize(dest);
+        dest = put_varint(dest + OFFSET_LOG_DATA, snapshot_lsn_);
+        dest = put_varint(dest, next_txn_id_);
+        dest = put_varint(dest, dpt_.size());
+        for (auto &entry: dpt_) {
+            dest = put_varint(dest, entry.file_id_);
+            dest = put_varint(dest, entry.page_no_);
+            dest = put_varint(dest, entry.rec_lsn_);
+        }
+    }
+    // 从src中反序列化出一条检查点日志记录
+    void deserialize(const char* src) override {
+        LogRecord::deserialize(src);
+        src = get_varint(src + OFFSET_LOG_DATA, &snapshot_lsn_);
+        src = get_varint(src, &next_txn_id_);
+        size_t dpt_size;
+        src = get_varint(src, &dpt_size);
+        dpt_.resize(dpt_size);
+        for (auto &entry: dpt_) {
+            src = get_varint(src, &entry.file_id_);
+            src = get_varint(src, &entry.page_no_);
+            src = get_varint(src, &entry.rec_lsn_);
+        }
+    }
+    void format_print() override {
+        printf("checkpoint record\n");
+        LogRecord::format_print();
+        printf("snapshot_lsn: %d\n", snapshot_lsn_);
+        printf("next_txn_id: %d\n", next_txn_id_);
+        printf("dirty pages: %d\n", (int) dpt_.size());
+    }
+
+    lsn_t snapshot_lsn_;                                // 记录脏页表时的下一个lsn
+    txn_id_t next_txn_id_;                              // 检查点时下一个要分配的事务ID
+    std::vector<DirtyPageEntry> dpt_;                   // 脏页表
+};
+
+/* 日志缓冲区，LogManager中有多个缓冲区轮流使用：一个接收新的日志，其余的等待写盘或空闲 */
 
 class LogBuffer {
 public:
@@ -526,23 +641,72 @@ public:
 
     char buffer_[LOG_BUFFER_SIZE+1];
     int offset_;    // 写入log的offset
+    std::atomic<int> written_{0};   // 已经拷贝进缓冲区的字节数，等于缓冲区的大小时才能写盘
 };
 
-/* 日志管理器，负责把日志写入日志缓冲区，以及把日志缓冲区中的内容写入磁盘中 */
+/* 日志管理器，负责把日志写入日志缓冲区，以及把日志缓冲区中的内容写入磁盘中
+ * 写日志时通过对tail_的CAS同时分配lsn和缓冲区中的空间，之后各线程并行地拷贝日志，不需要加锁；
+ * 当前缓冲区写满时切换到下一个空闲缓冲区，写满的缓冲区交给后台的日志写线程批量写盘并fsync（group commit），
+ * 只有所有缓冲区都在等待写盘时，写日志的线程才需要等待。事务提交时调用wait_for_flush等待自己的commit日志持久化 */
 class LogManager {
 public:
-    LogManager(DiskManager* disk_manager) { disk_manager_ = disk_manager; }
-    
+    LogManager(DiskManager* disk_manager) {
+        disk_manager_ = disk_manager;
+        for (int i = 1; i < LOG_BUFFER_COUNT; i++) {
+            free_buffers_.push_back(i);
+        }
+        flush_thread_ = std::thread(&LogManager::run_flush_thread, this);
+    }
+
+    ~LogManager() {
+        {
+            std::unique_lock<std::mutex> lock(latch_);
+            stop_ = true;
+        }
+        flush_cv_.notify_one();
+        flush_thread_.join();
+    }
+
     lsn_t add_log_to_buffer(LogRecord* log_record);
-    lsn_t add_log_to_buffer_load(LogRecord* logRecord);
     void flush_log_to_disk();
+    void wait_for_flush(lsn_t lsn);
+
+    // 下一条日志的lsn
+    lsn_t get_next_lsn() { return tail_lsn(tail_.load()); }
+    void set_next_lsn(lsn_t lsn);
+    void truncate_log(lsn_t lsn);
 
-    LogBuffer* get_log_buffer() { return &log_buffer_; }
+private:
+    // tail_的编码：高32位为下一个lsn，24~31位为当前缓冲区的下标，低24位为当前缓冲区中已分配的字节数
+    static_assert(LOG_BUFFER_SIZE < (1 << 24) && LOG_BUFFER_COUNT <= (1 << 8));
+    static lsn_t tail_lsn(uint64_t tail) { return static_cast<lsn_t>(tail >> 32); }
+    static int tail_buffer(uint64_t tail) { return static_cast<int>((tail >> 24) & 0xff); }
+    static int tail_offset(uint64_t tail) { return static_cast<int>(tail & 0xffffff); }
+    static uint64_t make_tail(lsn_t lsn, int buffer, int offset) {
+        return (static_cast<uint64_t>(lsn) << 32) | (static_cast<uint64_t>(buffer) << 24) | offset;
+    }
+
+    // 等待写盘的缓冲区
+    struct SealedBuffer {
+        int buffer;         // 缓冲区下标
+        int size;           // 缓冲区中日志的总长度
+        lsn_t last_lsn;     // 缓冲区中最后一条日志的lsn
+    };
 
-private:    
-    std::atomic<lsn_t> global_lsn_{0};  // 全局lsn，递增，用于为每条记录分发lsn
-    std::mutex latch_;                  // 用于对log_buffer_的互斥访问
-    LogBuffer log_buffer_;              // 日志缓冲区
-    lsn_t persist_lsn_;                 // 记录已经持久化到磁盘中的最后一条日志的日志号
+    bool seal_buffer(uint64_t tail);
+    void run_flush_thread();
+
+    std::atomic<uint64_t> tail_{0};     // 下一个lsn与当前缓冲区的写入位置，见tail_lsn/tail_buffer/tail_offset
+    LogBuffer log_buffers_[LOG_BUFFER_COUNT];   // 日志缓冲区，轮流使用
+    std::mutex latch_;                  // 保护以下缓冲区切换与写盘相关的状态，不在写日志的常规路径上
+    std::deque<int> free_buffers_;      // 空闲的缓冲区
+    std::deque<SealedBuffer> sealed_buffers_;   // 已写满等待写盘的缓冲区，按切换顺序写盘
+    lsn_t persist_lsn_ = INVALID_LSN;   // 记录已经持久化到磁盘中的最后一条日志的日志号
     DiskManager* disk_manager_;
-}; 
+
+    std::thread flush_thread_;              // 后台日志写线程
+    std::condition_variable flush_cv_;      // 唤醒日志写线程
+    std::condition_variable persist_cv_;    // 一批日志持久化后唤醒等待提交或等待空闲缓冲区的线程
+    bool flush_requested_ = false;          // 有线程在等待日志持久化
+    bool stop_ = false;                     // 通知日志写线程退出
+};
\ No newline at end of file
@@ -0,0 +1,253 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include <unistd.h>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "errors.h"
+#include "gtest/gtest.h"
+#include "log_manager.h"
+
+/**
+ * @brief varint序列化后再反序列化得到相同的值，varint_size与实际写入的字节数一致
+ */
+TEST(LogRecordTest, VarintTest) {
+    std::vector<uint32_t> values = {0, 1, 127, 128, 300, 16383, 16384, (1u << 21) - 1, 1u << 21, 1u << 28,
+                                    UINT32_MAX};
+    char buf[16];
+    for (auto val: values) {
+        memset(buf, 0, sizeof(buf));
+        char *end = put_varint(buf, val);
+        EXPECT_EQ(end - buf, varint_size(val)) << val;
+
+        uint32_t res;
+        const char *src_end = get_varint(buf, &res);
+        EXPECT_EQ(res, val);
+        EXPECT_EQ(src_end, end);
+    }
+    EXPECT_EQ(varint_size(127), 1);
+    EXPECT_EQ(varint_size(128), 2);
+    EXPECT_EQ(varint_size(UINT32_MAX), 5);
+
+    // 连续存放的多个varint依次读出
+    char *dest = buf;
+    for (uint32_t val: {5u, 200u, 70000u}) {
+        dest = put_varint(dest, val);
+    }
+    const char *src = buf;
+    int a, b, c;
+    src = get_varint(src, &a);
+    src = get_varint(src, &b);
+    src = get_varint(src, &c);
+    EXPECT_EQ(a, 5);
+    EXPECT_EQ(b, 200);
+    EXPECT_EQ(c, 70000);
+    EXPECT_EQ(src, dest);
+}
+
+class UpdateLogRecordTest : public ::testing::Test {
+   public:
+    // 记录格式：a int | b int | c char(8) | d int
+    std::vector<ColMeta> cols_ = {
+            {"t", "a", TYPE_INT, 4, 0, false},
+            {"t", "b", TYPE_INT, 4, 4, false},
+            {"t", "c", TYPE_STRING, 8, 8, false},
+            {"t", "d", TYPE_INT, 4, 16, false},
+    };
+    static constexpr int record_size = 20;
+
+    void fill(RmRecord &rec, int a, int b, const char *c, int d) {
+        memset(rec.data, 0, rec.size);
+        memcpy(rec.data + 0, &a, sizeof(int));
+        memcpy(rec.data + 4, &b, sizeof(int));
+        strncpy(rec.data + 8, c, 8);
+        memcpy(rec.data + 16, &d, sizeof(int));
+    }
+
+    // 序列化后再反序列化，检查写入的字节数就是log_tot_len_
+    UpdateLogRecord round_trip(const UpdateLogRecord &log) {
+        const char sentinel = 0x5a;
+        std::vector<char> buf(log.log_tot_len_ + 1, sentinel);
+        log.serialize(buf.data());
+        EXPECT_EQ(buf.back(), sentinel);
+
+        UpdateLogRecord res;
+        res.deserialize(buf.data());
+        EXPECT_EQ(res.log_type_, LogType::UPDATE);
+        EXPECT_EQ(res.log_tot_len_, log.log_tot_len_);
+        EXPECT_EQ(res.log_tid_, log.log_tid_);
+        EXPECT_EQ(res.prev_lsn_, log.prev_lsn_);
+        EXPECT_EQ(res.tab_id_, log.tab_id_);
+        EXPECT_EQ(res.rid_, log.rid_);
+        return res;
+    }
+
+    // 在修改前的记录上redo得到修改后的记录，在修改后的记录上undo得到修改前的记录
+    void check_redo_undo(const UpdateLogRecord &log, const RmRecord &before, const RmRecord &after) {
+        RmRecord rec(before);
+        log.redo(rec.data);
+        EXPECT_EQ(memcmp(rec.data, after.data, record_size), 0);
+        log.undo(rec.data);
+        EXPECT_EQ(memcmp(rec.data, before.data, record_size), 0);
+    }
+};
+
+/**
+ * @brief 只记录被修改的字段，相邻的被修改字段合并成一段
+ */
+TEST_F(UpdateLogRecordTest, AdjacentColumnsTest) {
+    RmRecord before(record_size), after(record_size);
+    fill(before, 1, 2, "abc", 4);
+    fill(after, 1, 20, "xyz", 4);
+    Rid rid{300, 7};
+    UpdateLogRecord log(3, before, rid, 200, after, cols_);
+    log.prev_lsn_ = 42;
+
+    ASSERT_EQ(log.deltas_.size(), 1);
+    EXPECT_EQ(log.deltas_[0].offset_, 4);
+    EXPECT_EQ(log.deltas_[0].before_.size(), 12);
+
+    auto res = round_trip(log);
+    ASSERT_EQ(res.deltas_.size(), 1);
+    EXPECT_EQ(res.deltas_[0].offset_, 4);
+    EXPECT_EQ(res.deltas_[0].before_, log.deltas_[0].before_);
+    EXPECT_EQ(res.deltas_[0].after_, log.deltas_[0].after_);
+    check_redo_undo(res, before, after);
+}
+
+/**
+ * @brief 不相邻的被修改字段各自成一段，未修改的字段不出现在日志中
+ */
+TEST_F(UpdateLogRecordTest, SeparateColumnsTest) {
+    RmRecord before(record_size), after(record_size);
+    fill(before, 1, 2, "abc", 4);
+    fill(after, 10, 2, "abc", 40);
+    Rid rid{1, 2};
+    UpdateLogRecord log(5, before, rid, 1, after, cols_);
+
+    ASSERT_EQ(log.deltas_.size(), 2);
+    EXPECT_EQ(log.deltas_[0].offset_, 0);
+    EXPECT_EQ(log.deltas_[1].offset_, 16);
+
+    auto res = round_trip(log);
+    ASSERT_EQ(res.deltas_.size(), 2);
+    for (size_t i = 0; i < res.deltas_.size(); i++) {
+        EXPECT_EQ(res.deltas_[i].offset_, log.deltas_[i].offset_);
+        EXPECT_EQ(res.deltas_[i].before_, log.deltas_[i].before_);
+        EXPECT_EQ(res.deltas_[i].after_, log.deltas_[i].after_);
+    }
+    check_redo_undo(res, before, after);
+
+    // 记录没有变化时日志中没有任何一段
+    UpdateLogRecord same(5, before, rid, 1, before, cols_);
+    EXPECT_TRUE(same.deltas_.empty());
+    auto same_res = round_trip(same);
+    EXPECT_TRUE(same_res.deltas_.empty());
+}
+
+/**
+ * @brief 检查点日志只记录snapshot_lsn、下一个事务ID和脏页表，序列化写入的字节数就是log_tot_len_
+ */
+TEST(LogRecordTest, CheckpointTest) {
+    std::vector<DirtyPageEntry> dpt = {{1, 0, 10}, {1, 300, 12}, {4, 2, 200}};
+    CheckpointLogRecord log(150, 7, dpt);
+    // snapshot_lsn、next_txn_id、脏页数，之后每个脏页依次是file_id、page_no、rec_lsn
+    EXPECT_EQ(log.log_tot_len_, LOG_HEADER_SIZE + (2 + 1 + 1) + (1 + 1 + 1) + (1 + 2 + 1) + (1 + 1 + 2));
+
+    const char sentinel = 0x5a;
+    std::vector<char> buf(log.log_tot_len_ + 1, sentinel);
+    log.serialize(buf.data());
+    EXPECT_EQ(buf.back(), sentinel);
+
+    CheckpointLogRecord res;
+    res.deserialize(buf.data());
+    EXPECT_EQ(res.log_type_, LogType::CHECKPOINT);
+    EXPECT_EQ(res.log_tot_len_, log.log_tot_len_);
+    EXPECT_EQ(res.snapshot_lsn_, 150);
+    EXPECT_EQ(res.next_txn_id_, 7);
+    ASSERT_EQ(res.dpt_.size(), dpt.size());
+    for (size_t i = 0; i < dpt.size(); i++) {
+        EXPECT_EQ(res.dpt_[i].file_id_, dpt[i].file_id_);
+        EXPECT_EQ(res.dpt_[i].page_no_, dpt[i].page_no_);
+        EXPECT_EQ(res.dpt_[i].rec_lsn_, dpt[i].rec_lsn_);
+    }
+}
+
+class LogManagerTest : public ::testing::Test {
+   public:
+    const std::string db_name_ = "LogManagerTest_db";
+    std::unique_ptr<DiskManager> disk_manager_;
+
+    void SetUp() override {
+        ::testing::Test::SetUp();
+        disk_manager_ = std::make_unique<DiskManager>();
+        if (disk_manager_->is_dir(db_name_)) {
+            disk_manager_->destroy_dir(db_name_);
+        }
+        disk_manager_->create_dir(db_name_);
+        if (chdir(db_name_.c_str()) < 0) {
+            throw UnixError();
+        }
+    }
+
+    void TearDown() override {
+        if (chdir("..") < 0) {
+            throw UnixError();
+        }
+    }
+
+    // 所有日志段的总长度
+    int log_size() {
+        int size = 0;
+        for (const auto &segment: disk_manager_->get_log_segments()) {
+            size += disk_manager_->get_file_size(segment);
+        }
+        return size;
+    }
+};
+
+/**
+ * @brief 日志写线程退出前把已写满的缓冲区和最后一个没有写满的缓冲区都写盘
+ */
+TEST_F(LogManagerTest, FlushOnStopTest) {
+    int total = 0;
+    auto log_manager = std::make_unique<LogManager>(disk_manager_.get());
+    BeginLogRecord log(1);
+    // 写满第一个缓冲区，退出时新的缓冲区中还有日志
+    int count = LOG_BUFFER_SIZE / log.log_tot_len_ + 10;
+    for (int i = 0; i < count; i++) {
+        log_manager->add_log_to_buffer(&log);
+        total += log.log_tot_len_;
+    }
+    EXPECT_EQ(log_manager->get_next_lsn(), count);
+    log_manager.reset();
+    EXPECT_EQ(log_size(), total);
+}
+
+/**
+ * @brief 超过日志缓冲区大小的日志不能写入，不会一直等待空闲缓冲区
+ */
+TEST_F(LogManagerTest, OversizedRecordTest) {
+    auto log_manager = std::make_unique<LogManager>(disk_manager_.get());
+    BeginLogRecord log(1);
+    log_manager->add_log_to_buffer(&log);
+    lsn_t next_lsn = log_manager->get_next_lsn();
+
+    log.log_tot_len_ = LOG_BUFFER_SIZE + 1;
+    EXPECT_THROW(log_manager->add_log_to_buffer(&log), InternalError);
+    EXPECT_EQ(log_manager->get_next_lsn(), next_lsn);
+
+    log.log_tot_len_ = LOG_HEADER_SIZE;
+    EXPECT_EQ(log_manager->add_log_to_buffer(&log), next_lsn);
+    log_manager->flush_log_to_disk();
+    EXPECT_EQ(log_size(), 2 * LOG_HEADER_SIZE);
+}
@@ -10,248 +10,545 @@ See the Mulan PSL v2 for more details. */
 
 #include "log_recovery.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <thread>
+
 /**
- * @description: analyze阶段，需要获得脏页表（DPT）和未完成的事务列表（ATT）
+ * @description: analyze阶段，顺序扫描所有日志，获得脏页表（DPT）和未完成的事务列表（ATT）
+ * 检查点之前的日志已被截断，但所有活跃事务的begin日志都被保留，因此日志中最后一条不是commit/abort的事务即为未完成的事务
+ * 日志段只读映射到内存中，扫描时只记录每条日志的位置，redo和undo按lsn找到日志后再反序列化，
+ * 恢复占用的内存只与事务表、脏页表和日志条数有关，与日志内容的大小无关
  */
 void RecoveryManager::analyze() {
-    int off = 0;
-    std::unordered_set<std::string> tables;
-    while (true) {
-        int len = disk_manager_->read_log(buffer_.buffer_, LOG_BUFFER_SIZE, off);
-        if (len == -1 || len == 0) break;
-        int offset = 0;
-        while (offset < len) {
-            if (offset + OFFSET_LOG_TOT_LEN > len) {
-//                std::cout << offset << " " << OFFSET_LOG_TOT_LEN << " " << len << "\n";
+    open_files();
+    map_log();
+    for (size_t i = 0; i < log_segments_.size(); i++) {
+        auto &[data, size] = log_segments_[i];
+        size_t offset = 0;
+        while (offset < size) {
+            // 日志尾部有未写完整的日志，或者无法识别的日志类型，之后的内容都不是有效的日志
+            auto log_tot_len_ = offset + LOG_HEADER_SIZE <= size ?
+                                *reinterpret_cast<const uint32_t *>(data + offset + OFFSET_LOG_TOT_LEN) : 0;
+            auto log = log_tot_len_ >= LOG_HEADER_SIZE && offset + log_tot_len_ <= size ?
+                       decode_log(data + offset) : nullptr;
+            if (log == nullptr) {
+                truncate_log_tail(i, offset);
                 break;
             }
-            auto log_tot_len_ = *reinterpret_cast<const uint32_t *>(buffer_.buffer_ + offset + OFFSET_LOG_TOT_LEN);
-            if (offset + log_tot_len_ > len) {
-//                std::cout << offset << " " << log_tot_len_ << " " << len << "\n";
-                break;
+            if (log_addrs_.empty()) {
+                first_lsn_ = log->lsn_;
             }
-            LogType log_type_ = *reinterpret_cast<const LogType *>(buffer_.buffer_ + offset);
-            if (log_type_ == LogType::begin) {
-                auto log = std::make_shared<BeginLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                att[log->log_tid_] = log->lsn_;
-            } else if (log_type_ == LogType::commit) {
-                auto log = std::make_shared<CommitLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
-            } else if (log_type_ == LogType::ABORT) {
-                auto log = std::make_shared<AbortLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
-            } else if (log_type_ == LogType::UPDATE) {
-                auto log = std::make_shared<UpdateLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
-                tables.insert(log->table_name_);
-            } else if (log_type_ == LogType::DELETE) {
-                auto log = std::make_shared<DeleteLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
-                tables.insert(log->table_name_);
-            } else if (log_type_ == LogType::INSERT) {
-                auto log = std::make_shared<InsertLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
-                tables.insert(log->table_name_);
-            } else if (log_type_ == LogType::INDEX_INSERT) {
-                auto log = std::make_shared<IndexInsertLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
-            } else if (log_type_ == LogType::INDEX_DELETE) {
-                auto log = std::make_shared<IndexDeleteLogRecord>();
-                log->deserialize(buffer_.buffer_ + offset);
-                offset += log->log_tot_len_;
-                logs.push_back(log);
-//                log->format_print();
-                assert(att.count(log->log_tid_));
-                att[log->log_tid_] = log->lsn_;
+            assert(log->lsn_ == get_next_lsn());
+            log_addrs_.push_back(data + offset);
+            offset += log_tot_len_;
+//            log->format_print();
+            if (log->log_type_ == LogType::CHECKPOINT) {
+                auto ckpt = std::static_pointer_cast<CheckpointLogRecord>(log);
+                // 以最后一个检查点的脏页表为准，补上记录脏页表之后、检查点日志之前修改的页面
+                next_txn_id_ = std::max(next_txn_id_, ckpt->next_txn_id_);
+                dpt_.clear();
+                for (auto &entry: ckpt->dpt_) {
+                    dpt_.emplace(std::make_pair(entry.file_id_, entry.page_no_), entry.rec_lsn_);
+                }
+                // 按lsn顺序加入，使页面的rec_lsn为其中第一条修改它的日志
+                for (lsn_t lsn = std::max(ckpt->snapshot_lsn_, first_lsn_); lsn < ckpt->lsn_; lsn++) {
+                    add_dirty_page(get_log(lsn));
+                }
+                continue;
+            }
+            next_txn_id_ = std::max(next_txn_id_, log->log_tid_ + 1);
+            if (log->log_type_ == LogType::commit || log->log_type_ == LogType::ABORT) {
+                att.erase(log->log_tid_);
             } else {
-                std::cout << "huai le\n" << log_type_;
-                exit(0);
+                att[log->log_tid_] = log->lsn_;
+            }
+            if (log->log_type_ == LogType::BULK_LOAD) {
+                bulk_loads_[log->log_tid_].push_back(std::static_pointer_cast<BulkLoadLogRecord>(log));
+            } else if (log->log_type_ == LogType::commit) {
+                bulk_loads_.erase(log->log_tid_);
             }
+            add_dirty_page(log);
         }
-        off += offset;
     }
-    //清空索引并重建
-    for (auto &i: tables) {
-        auto &tab = sm_manager_->db_.get_table(i);
-        for (const auto &index: tab.indexes) {
-            auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab.name, index.cols);
-            if (sm_manager_->ihs_.count(ix_name)) {// 说明被打开了
-                disk_manager_->close_file(sm_manager_->ihs_[ix_name]->get_fd());
-                sm_manager_->ihs_.erase(ix_name);
-            }
-            sm_manager_->get_ix_manager()->destroy_index(tab.name, index.cols);
-            sm_manager_->get_ix_manager()->create_index(tab.name, index.cols);
-            sm_manager_->ihs_.emplace(ix_name, sm_manager_->get_ix_manager()->open_index(tab.name, index.cols));
+    // 重做从脏页表中最小的rec_lsn开始
+    redo_lsn_ = get_next_lsn();
+    for (auto &[page, rec_lsn]: dpt_) {
+        redo_lsn_ = std::min(redo_lsn_, rec_lsn);
+    }
+}
+
+/**
+ * @description: 丢弃日志尾部的无效内容。只有当前日志文件的尾部可能没有写完，归档的日志段中出现无效内容说明日志已损坏
+ * @param {size_t} segment 出现无效内容的日志段
+ * @param {size_t} offset 有效日志在该日志段中的长度
+ */
+void RecoveryManager::truncate_log_tail(size_t segment, size_t offset) {
+    bool is_current = segment + 1 == log_segments_.size() && disk_manager_->is_file(LOG_FILE_NAME) &&
+                      disk_manager_->get_file_size(LOG_FILE_NAME) > 0;
+    if (!is_current) {
+        throw InternalError("RecoveryManager::analyze: invalid log record in an archived log segment");
+    }
+    disk_manager_->truncate_log(offset);
+}
+
+/**
+ * @description: 日志中只记录表和索引的id，按id找到打开的表和索引。已经被删除的表和索引上的日志不需要恢复
+ */
+void RecoveryManager::open_files() {
+    for (auto &[tab_name, tab]: sm_manager_->db_.get_tables()) {
+        tables_.emplace(tab.id, std::make_pair(sm_manager_->fhs_.at(tab_name).get(), &tab));
+        for (auto &index: tab.indexes) {
+            auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name, index.cols);
+            indexes_.emplace(index.id, sm_manager_->ihs_.at(ix_name).get());
         }
     }
 }
 
 /**
- * @description: 重做所有未落盘的操作
+ * @description: 把所有日志段只读映射到内存中，按日志的先后顺序排列
  */
-void RecoveryManager::redo() {
-    rollback(true);
-    for (const auto &log_: logs) {
-        if (auto log = std::dynamic_pointer_cast<InsertLogRecord>(log_)) {
-            // redo insert
-//            std::cout << "redo insert\n";
-            assert(sm_manager_->fhs_.count(log->table_name_));
-            auto rfh = sm_manager_->fhs_[log->table_name_].get();
-            try {
-                rfh->insert_record(log->rid_, log->insert_value_.data);
-            } catch (RMDBError &e) {
-//                std::cout << "dirty_page\n";
-                auto new_rid = rfh->insert_record(log->insert_value_.data, nullptr);
-                assert(new_rid == log->rid_);
-            }
-        } else if (auto log = std::dynamic_pointer_cast<UpdateLogRecord>(log_)) {
-            // redo update
-//            std::cout << "redo update\n";
-            assert(sm_manager_->fhs_.count(log->table_name_));
-            auto rfh = sm_manager_->fhs_[log->table_name_].get();
-            rfh->update_record(log->rid_, log->now_value_.data, nullptr);
-        } else if (auto log = std::dynamic_pointer_cast<DeleteLogRecord>(log_)) {
-            //redo delete
-//            std::cout << "redo delete\n";
-            assert(sm_manager_->fhs_.count(log->table_name_));
-            auto rfh = sm_manager_->fhs_[log->table_name_].get();
-            rfh->delete_record(log->rid_, nullptr);
-        } else if (auto log = std::dynamic_pointer_cast<IndexInsertLogRecord>(log_)) {
-            //redo index insert
-//            std::cout << "redo index insert\n";
-            assert(sm_manager_->ihs_.count(log->ix_name_));
-            auto ih = sm_manager_->ihs_.at(log->ix_name_).get();
-            ih->insert_entry(log->key_, log->rid_, nullptr);
-        } else if (auto log = std::dynamic_pointer_cast<IndexDeleteLogRecord>(log_)) {
-            //redo index delete
-//            std::cout << "redo index delete\n";
-            assert(sm_manager_->ihs_.count(log->ix_name_));
-            auto ih = sm_manager_->ihs_.at(log->ix_name_).get();
-            ih->delete_entry(log->key_, nullptr);
-        } else if (auto log = std::dynamic_pointer_cast<BeginLogRecord>(log_)) {
-            continue;
-        } else if (auto log = std::dynamic_pointer_cast<AbortLogRecord>(log_)) {
-            continue;
-        } else if (auto log = std::dynamic_pointer_cast<CommitLogRecord>(log_)) {
-            continue;
-        } else {
-            std::cout << "redo error\n";
+void RecoveryManager::map_log() {
+    for (const auto &segment: disk_manager_->get_log_segments()) {
+        size_t size = disk_manager_->get_file_size(segment);
+        if (size == 0) continue;
+        int fd = open(segment.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw UnixError();
+        }
+        void *data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw UnixError();
         }
+        log_segments_.emplace_back(static_cast<char *>(data), size);
     }
 }
 
 /**
- * @description: 回滚未完成的事务
+ * @description: 解除日志段的映射。恢复完成后的检查点会删除旧的日志段，恢复结束时即解除映射
  */
-void RecoveryManager::undo() {
-    rollback(false);
+void RecoveryManager::unmap_log() {
+    for (auto &[data, size]: log_segments_) {
+        munmap(data, size);
+    }
+    log_segments_.clear();
+    // 日志的位置随映射一起释放，get_next_lsn()保持不变
+    first_lsn_ = get_next_lsn();
+    log_addrs_.clear();
+    log_addrs_.shrink_to_fit();
 }
 
-void RecoveryManager::rollback(bool flag) {
-    for (auto i = att.rbegin(); i != att.rend(); i++) {
-        auto [u, v] = *i;
-        int now = v;
-        while (now != -1) {
-            if (auto log = std::dynamic_pointer_cast<InsertLogRecord>(logs[now])) {
-                // 回滚insert
-                assert(sm_manager_->fhs_.count(log->table_name_));
-                auto rfh = sm_manager_->fhs_[log->table_name_].get();
-//                std::cout << "回滚insert\n";
-                try {
-                    rfh->delete_record(log->rid_, nullptr);
-                } catch (RMDBError &e) {
-                    std::cout << e.what() << '\n';
-                }
-                now = log->prev_lsn_;
-            } else if (auto log = std::dynamic_pointer_cast<UpdateLogRecord>(logs[now])) {
-                // 回滚update
-                assert(sm_manager_->fhs_.count(log->table_name_));
-                auto rfh = sm_manager_->fhs_[log->table_name_].get();
-//                std::cout << "回滚update\n";
-                try {
-                    rfh->update_record(log->rid_, log->update_value_.data, nullptr);
-                } catch (RMDBError &e) {
-                    std::cout << e.what() << '\n';
-                }
-                now = log->prev_lsn_;
-            } else if (auto log = std::dynamic_pointer_cast<DeleteLogRecord>(logs[now])) {
-                //回滚delete
-                assert(sm_manager_->fhs_.count(log->table_name_));
-                auto rfh = sm_manager_->fhs_[log->table_name_].get();
-//                std::cout << "回滚delete\n";
-                try {
-                    rfh->insert_record(log->rid_, log->delete_value_.data);
-                } catch (RMDBError &e) {
-                    std::cout << e.what() << '\n';
-                }
-                now = log->prev_lsn_;
-            } else if (auto log = std::dynamic_pointer_cast<IndexInsertLogRecord>(logs[now])) {
-                //回滚index insert
-                if (!flag) {
-                    assert(sm_manager_->ihs_.count(log->ix_name_));
-                    auto ih = sm_manager_->ihs_.at(log->ix_name_).get();
-                    ih->delete_entry(log->key_, nullptr);
-                }
-                now = log->prev_lsn_;
-            } else if (auto log = std::dynamic_pointer_cast<IndexDeleteLogRecord>(logs[now])) {
-                //回滚index delete
-                if (!flag) {
-                    assert(sm_manager_->ihs_.count(log->ix_name_));
-                    auto ih = sm_manager_->ihs_.at(log->ix_name_).get();
-                    ih->insert_entry(log->key_, log->rid_, nullptr);
+/**
+ * @description: 反序列化一条日志
+ * @return {shared_ptr<LogRecord>} 日志记录，日志类型无法识别时返回nullptr
+ * @param {char*} src 日志在映射的日志段中的位置
+ */
+std::shared_ptr<LogRecord> RecoveryManager::decode_log(const char *src) {
+    LogType log_type_ = *reinterpret_cast<const LogType *>(src);
+    std::shared_ptr<LogRecord> log;
+    if (log_type_ == LogType::begin) {
+        log = std::make_shared<BeginLogRecord>();
+    } else if (log_type_ == LogType::commit) {
+        log = std::make_shared<CommitLogRecord>();
+    } else if (log_type_ == LogType::ABORT) {
+        log = std::make_shared<AbortLogRecord>();
+    } else if (log_type_ == LogType::UPDATE) {
+        log = std::make_shared<UpdateLogRecord>();
+    } else if (log_type_ == LogType::DELETE) {
+        log = std::make_shared<DeleteLogRecord>();
+    } else if (log_type_ == LogType::INSERT) {
+        log = std::make_shared<InsertLogRecord>();
+    } else if (log_type_ == LogType::INDEX_INSERT) {
+        log = std::make_shared<IndexInsertLogRecord>();
+    } else if (log_type_ == LogType::INDEX_DELETE) {
+        log = std::make_shared<IndexDeleteLogRecord>();
+    } else if (log_type_ == LogType::CHECKPOINT) {
+        log = std::make_shared<CheckpointLogRecord>();
+    } else if (log_type_ == LogType::BULK_LOAD) {
+        log = std::make_shared<BulkLoadLogRecord>();
+    } else {
+        return nullptr;
+    }
+    log->deserialize(src);
+    return log;
+}
+
+/**
+ * @description: 重做脏页上丢失的修改
+ * 只有在脏页表中、且lsn不小于页面rec_lsn的日志才可能需要重做。需要重做的日志按页面分组，
+ * 每个页面上的日志按lsn顺序由同一个线程重做，不同页面由多个线程并行重做
+ */
+void RecoveryManager::redo() {
+    // 索引的file header恢复为最后一次修改后的内容
+    for (auto &[ix_id, lsn]: ix_hdr_lsn_) {
+        auto ih = indexes_.find(ix_id);
+        if (ih == indexes_.end()) continue;
+        ih->second->redo_file_hdr(*get_index_redo(get_log(lsn), nullptr));
+    }
+
+    std::vector<RedoLogsInPage> pages;
+    std::map<std::pair<int, page_id_t>, size_t> page_idx;
+    std::unordered_map<int, page_id_t> ix_file_pages;   // 索引文件在磁盘上的页面数
+    for (lsn_t lsn = std::max(redo_lsn_, first_lsn_); lsn < get_next_lsn(); lsn++) {
+        auto log = get_log(lsn);
+        int file_id;
+        if (auto redo = get_index_redo(log, &file_id)) {
+            auto ih = indexes_.find(file_id);
+            if (ih == indexes_.end()) continue;
+            std::vector<page_id_t> page_nos;
+            if (redo->leaf_page_no_ != IX_NO_PAGE) {
+                page_nos.push_back(redo->leaf_page_no_);
+            }
+            for (auto &delta: redo->deltas_) {
+                page_nos.push_back(delta.page_no_);
+            }
+            for (auto page_no: page_nos) {
+                auto it = dpt_.find({file_id, page_no});
+                if (it == dpt_.end() || lsn < it->second) continue;
+                auto idx = page_idx.find({file_id, page_no});
+                if (idx == page_idx.end()) {
+                    // 检查点之后新分配的页面可能没有写回磁盘，先在文件中补上空页面
+                    int fd = ih->second->get_fd();
+                    auto file_pages = ix_file_pages.find(fd);
+                    if (file_pages == ix_file_pages.end()) {
+                        int file_size = disk_manager_->get_file_size(disk_manager_->get_file_name(fd));
+                        file_pages = ix_file_pages.emplace(fd, file_size / PAGE_SIZE).first;
+                    }
+                    char zero_page[PAGE_SIZE] = {};
+                    for (; file_pages->second <= page_no; file_pages->second++) {
+                        disk_manager_->write_page(fd, file_pages->second, zero_page, PAGE_SIZE);
+                    }
+                    buffer_pool_manager_->prefetch_page({fd, page_no});
+                    idx = page_idx.emplace(std::make_pair(file_id, page_no), pages.size()).first;
+                    pages.emplace_back();
+                    pages.back().index_file_ = ih->second;
+                    pages.back().page_no_ = page_no;
                 }
-                now = log->prev_lsn_;
-            } else if (auto log = std::dynamic_pointer_cast<BeginLogRecord>(logs[now])) {
-                now = log->prev_lsn_;
-            } else if (auto log = std::dynamic_pointer_cast<AbortLogRecord>(logs[now])) {
-                if (flag) {
-                    now = log->prev_lsn_;
+                pages[idx->second].redo_logs_.push_back(lsn);
+            }
+            continue;
+        }
+        Rid rid{};
+        if (!get_table_rid(log, &file_id, &rid)) continue;
+        auto table = tables_.find(file_id);
+        if (table == tables_.end()) continue;
+        if (in_rolled_back_load(log, file_id, rid)) continue;
+        auto it = dpt_.find({file_id, rid.page_no});
+        if (it == dpt_.end() || lsn < it->second) continue;
+        auto idx = page_idx.find({file_id, rid.page_no});
+        if (idx == page_idx.end()) {
+            auto rfh = table->second.first;
+            // 检查点之后新分配的页面可能没有写回磁盘，需要重新分配
+            while (rid.page_no >= rfh->get_file_hdr().num_pages) {
+                auto rph = rfh->create_new_page_handle();
+                buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+            }
+            buffer_pool_manager_->prefetch_page({rfh->GetFd(), rid.page_no});
+            idx = page_idx.emplace(std::make_pair(file_id, rid.page_no), pages.size()).first;
+            pages.emplace_back();
+            pages.back().table_file_ = rfh;
+            pages.back().page_no_ = rid.page_no;
+        }
+        pages[idx->second].redo_logs_.push_back(lsn);
+    }
+
+    size_t thread_num = std::max(1u, std::thread::hardware_concurrency());
+    thread_num = std::min(thread_num, pages.size());
+    std::atomic<size_t> next_page{0};
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < thread_num; i++) {
+        workers.emplace_back([&] {
+            for (size_t j = next_page++; j < pages.size(); j = next_page++) {
+                if (pages[j].index_file_ != nullptr) {
+                    redo_index_page(pages[j]);
                 } else {
-                    break;
+                    redo_page(pages[j]);
                 }
-            } else if (auto log = std::dynamic_pointer_cast<CommitLogRecord>(logs[now])) {
-                if (flag) {
-                    now = log->prev_lsn_;
-                } else {
-                    break;
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+
+    // 重做时没有维护空闲页面链表，按重做后的页面重新串联
+    std::unordered_map<RmFileHandle *, std::vector<int>> table_pages;
+    for (auto &page: pages) {
+        if (page.table_file_ == nullptr) continue;
+        table_pages[page.table_file_].push_back(page.page_no_);
+    }
+    for (auto &[rfh, page_nos]: table_pages) {
+        rfh->rebuild_free_list(page_nos);
+    }
+}
+
+/**
+ * @description: 重做一个页面上的日志，跳过page lsn已经包含的修改
+ */
+void RecoveryManager::redo_page(const RedoLogsInPage &redo_logs) {
+    RmPageHandle rph = redo_logs.table_file_->fetch_page_handle(redo_logs.page_no_);
+    for (lsn_t lsn: redo_logs.redo_logs_) {
+        if (rph.page->get_page_lsn() >= lsn) continue;
+        auto log_ = get_log(lsn);
+        switch (log_->log_type_) {
+            case LogType::INSERT: {
+                auto log = static_cast<InsertLogRecord *>(log_.get());
+                memcpy(rph.get_slot(log->rid_.slot_no), log->insert_value_.data, rph.file_hdr->record_size);
+                if (!Bitmap::is_set(rph.bitmap, log->rid_.slot_no)) {
+                    Bitmap::set(rph.bitmap, log->rid_.slot_no);
+                    rph.page_hdr->num_records++;
                 }
+                break;
+            }
+            case LogType::UPDATE: {
+                auto log = static_cast<UpdateLogRecord *>(log_.get());
+                log->redo(rph.get_slot(log->rid_.slot_no));
+                break;
+            }
+            case LogType::DELETE: {
+                auto log = static_cast<DeleteLogRecord *>(log_.get());
+                if (Bitmap::is_set(rph.bitmap, log->rid_.slot_no)) {
+                    Bitmap::reset(rph.bitmap, log->rid_.slot_no);
+                    rph.page_hdr->num_records--;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+        rph.page->set_page_lsn(lsn);
+    }
+    buffer_pool_manager_->unpin_page(rph.page->get_page_id(), true);
+}
+
+/**
+ * @description: 重做一个索引页面上的日志，跳过page lsn已经包含的修改
+ * 只修改了一个叶子结点的日志在该结点上重新插入/删除键值对，其他日志直接写入记录的页面内容
+ */
+void RecoveryManager::redo_index_page(const RedoLogsInPage &redo_logs) {
+    auto ih = redo_logs.index_file_;
+    Page *page = buffer_pool_manager_->fetch_page({ih->get_fd(), redo_logs.page_no_});
+    for (lsn_t lsn: redo_logs.redo_logs_) {
+        if (page->get_page_lsn() >= lsn) continue;
+        auto log_ = get_log(lsn);
+        auto redo = get_index_redo(log_, nullptr);
+        if (redo->leaf_page_no_ == redo_logs.page_no_) {
+            if (log_->log_type_ == LogType::INDEX_INSERT) {
+                auto log = static_cast<IndexInsertLogRecord *>(log_.get());
+                ih->redo_leaf(page, log->key_, log->rid_, true);
             } else {
-                std::cout << "undo 不太对\n";
+                auto log = static_cast<IndexDeleteLogRecord *>(log_.get());
+                ih->redo_leaf(page, log->key_, log->rid_, false);
             }
+        } else {
+            for (auto &delta: redo->deltas_) {
+                if (delta.page_no_ != redo_logs.page_no_) continue;
+                memcpy(page->get_data() + delta.offset_, delta.data_.data(), delta.data_.size());
+            }
+        }
+        page->set_page_lsn(lsn);
+    }
+    buffer_pool_manager_->unpin_page(page->get_page_id(), true);
+}
+
+/**
+ * @description: 回滚未完成的事务。回滚操作和运行时的abort一样写入日志并标记页面的lsn，最后写入abort日志，
+ * 回滚过程中再次崩溃时，下次恢复会重做已经回滚的操作，再从事务的最后一条日志开始继续回滚
+ */
+void RecoveryManager::undo() {
+    for (auto i = att.rbegin(); i != att.rend(); i++) {
+        lsn_t prev_lsn = i->second;
+        lsn_t now = i->second;
+        while (now != INVALID_LSN && now >= first_lsn_) {
+            auto log_ = get_log(now);
+            undo_log(log_, &prev_lsn);
+            now = log_->prev_lsn_;
+        }
+        AbortLogRecord abort_log(i->first);
+        append_log(&abort_log, &prev_lsn);
+    }
+    unmap_log();
+}
+
+/**
+ * @description: 获取表数据日志修改的表和记录位置
+ * @return {bool} 是否为表数据上的操作
+ */
+bool RecoveryManager::get_table_rid(const std::shared_ptr<LogRecord> &log_, int *tab_id, Rid *rid) {
+    switch (log_->log_type_) {
+        case LogType::INSERT: {
+            auto log = static_cast<InsertLogRecord *>(log_.get());
+            *tab_id = log->tab_id_;
+            *rid = log->rid_;
+            return true;
+        }
+        case LogType::UPDATE: {
+            auto log = static_cast<UpdateLogRecord *>(log_.get());
+            *tab_id = log->tab_id_;
+            *rid = log->rid_;
+            return true;
+        }
+        case LogType::DELETE: {
+            auto log = static_cast<DeleteLogRecord *>(log_.get());
+            *tab_id = log->tab_id_;
+            *rid = log->rid_;
+            return true;
         }
+        default:
+            return false;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @description: 获取索引日志修改的索引和重做信息
+ * @return {const IxRedoInfo*} 重做信息，不是索引上的操作时返回nullptr
+ * @param {int*} ix_id 传出索引的id，可以为nullptr
+ */
+const IxRedoInfo *RecoveryManager::get_index_redo(const std::shared_ptr<LogRecord> &log_, int *ix_id) {
+    switch (log_->log_type_) {
+        case LogType::INDEX_INSERT: {
+            auto log = static_cast<IndexInsertLogRecord *>(log_.get());
+            if (ix_id != nullptr) *ix_id = log->ix_id_;
+            return &log->redo_;
+        }
+        case LogType::INDEX_DELETE: {
+            auto log = static_cast<IndexDeleteLogRecord *>(log_.get());
+            if (ix_id != nullptr) *ix_id = log->ix_id_;
+            return &log->redo_;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+/**
+ * @description: 日志修改的页面不在脏页表中时，以该日志的lsn作为页面的rec_lsn加入脏页表
+ */
+void RecoveryManager::add_dirty_page(const std::shared_ptr<LogRecord> &log_) {
+    int file_id;
+    if (auto redo = get_index_redo(log_, &file_id)) {
+        if (redo->leaf_page_no_ != IX_NO_PAGE) {
+            dpt_.emplace(std::make_pair(file_id, redo->leaf_page_no_), log_->lsn_);
+        }
+        for (auto &delta: redo->deltas_) {
+            dpt_.emplace(std::make_pair(file_id, delta.page_no_), log_->lsn_);
+        }
+        if (redo->hdr_changed_) {
+            ix_hdr_lsn_[file_id] = log_->lsn_;
+        }
+        return;
+    }
+    Rid rid{};
+    if (!get_table_rid(log_, &file_id, &rid)) return;
+    dpt_.emplace(std::make_pair(file_id, rid.page_no), log_->lsn_);
+}
+
+/**
+ * @description: 判断表数据日志是否修改了被回滚的批量导入分配的页面。回滚批量导入时这些页面被直接截断，
+ * 之后的同一事务在其上的修改（包括运行时回滚写入的日志）都不需要重做或撤销
+ * @return {bool} 是否在被回滚的批量导入的页面上
+ */
+bool RecoveryManager::in_rolled_back_load(const std::shared_ptr<LogRecord> &log_, int tab_id, const Rid &rid) {
+    auto loads = bulk_loads_.find(log_->log_tid_);
+    if (loads == bulk_loads_.end()) return false;
+    for (auto &load: loads->second) {
+        if (load->tab_id_ == tab_id && rid.page_no >= load->first_page_ && log_->lsn_ > load->lsn_) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @description: 撤销一条操作，并写入与运行时回滚相同的日志。上次恢复时可能已经撤销过，因此只在需要时撤销
+ * @param {lsn_t*} prev_lsn 事务的最后一条日志，写入日志后更新
+ */
+void RecoveryManager::undo_log(const std::shared_ptr<LogRecord> &log_, lsn_t *prev_lsn) {
+    auto txn_id = log_->log_tid_;
+    int file_id;
+    if (get_index_redo(log_, &file_id) != nullptr) {
+        auto ih = indexes_.find(file_id);
+        if (ih == indexes_.end()) return;
+        if (log_->log_type_ == LogType::INDEX_INSERT) {
+            // 回滚索引insert
+            auto log = static_cast<IndexInsertLogRecord *>(log_.get());
+            ih->second->delete_entry(log->key_, log->rid_, nullptr, [&](const IxRedoInfo &redo) {
+                IndexDeleteLogRecord undo_log(txn_id, log->key_, log->rid_, file_id, log->tot_len_, redo);
+                return append_log(&undo_log, prev_lsn);
+            });
+        } else {
+            // 回滚索引delete
+            auto log = static_cast<IndexDeleteLogRecord *>(log_.get());
+            ih->second->insert_entry(log->key_, log->rid_, nullptr, [&](const IxRedoInfo &redo) {
+                IndexInsertLogRecord undo_log(txn_id, log->key_, log->rid_, file_id, log->tot_len_, redo);
+                return append_log(&undo_log, prev_lsn);
+            });
+        }
+        return;
+    }
+    if (log_->log_type_ == LogType::BULK_LOAD) {
+        // 回滚批量导入：导入记录的索引项已经随之后的索引日志撤销，截断导入分配的页面即可
+        auto log = static_cast<BulkLoadLogRecord *>(log_.get());
+        auto table = tables_.find(log->tab_id_);
+        if (table != tables_.end()) {
+            table->second.first->truncate(log->first_page_);
+        }
+        return;
+    }
+    Rid rid{};
+    if (!get_table_rid(log_, &file_id, &rid)) return;
+    auto table = tables_.find(file_id);
+    if (table == tables_.end()) return;
+    if (in_rolled_back_load(log_, file_id, rid)) return;
+    auto [rfh, tab] = table->second;
+    switch (log_->log_type_) {
+        case LogType::INSERT: {
+            // 回滚insert
+            auto log = static_cast<InsertLogRecord *>(log_.get());
+            if (!rfh->is_record(rid)) break;
+            DeleteLogRecord undo_log(txn_id, log->insert_value_, rid, file_id);
+            append_log(&undo_log, prev_lsn);
+            rfh->delete_record(rid, nullptr, undo_log.lsn_);
+            break;
+        }
+        case LogType::UPDATE: {
+            // 回滚update
+            auto log = static_cast<UpdateLogRecord *>(log_.get());
+            if (!rfh->is_record(rid)) break;
+            auto now_value = rfh->get_record(rid, nullptr);
+            RmRecord update_value(*now_value);
+            log->undo(update_value.data);
+            UpdateLogRecord undo_log(txn_id, *now_value, rid, file_id, update_value, tab->cols);
+            append_log(&undo_log, prev_lsn);
+            rfh->update_record(rid, update_value.data, nullptr, undo_log.lsn_);
+            break;
+        }
+        case LogType::DELETE: {
+            //回滚delete
+            auto log = static_cast<DeleteLogRecord *>(log_.get());
+            if (rfh->is_record(rid)) break;
+            InsertLogRecord undo_log(txn_id, log->delete_value_, rid, file_id);
+            append_log(&undo_log, prev_lsn);
+            rfh->insert_record(rid, log->delete_value_.data, undo_log.lsn_);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @description: 写入一条回滚时产生的日志
+ * @return {lsn_t} 日志的lsn
+ * @param {lsn_t*} prev_lsn 事务的最后一条日志，写入后更新为该日志
+ */
+lsn_t RecoveryManager::append_log(LogRecord *log, lsn_t *prev_lsn) {
+    log->prev_lsn_ = *prev_lsn;
+    log_manager_->add_log_to_buffer(log);
+    *prev_lsn = log->lsn_;
+    return log->lsn_;
+}
@@ -12,36 +12,69 @@ See the Mulan PSL v2 for more details. */
 
 #include <map>
 #include <unordered_map>
+#include <utility>
 #include "log_manager.h"
 #include "storage/disk_manager.h"
 #include "system/sm_manager.h"
 
 class RedoLogsInPage {
 public:
-    RedoLogsInPage() { table_file_ = nullptr; }
-    RmFileHandle* table_file_;
+    RedoLogsInPage() { table_file_ = nullptr; index_file_ = nullptr; page_no_ = INVALID_PAGE_ID; }
+    RmFileHandle* table_file_;      // 表数据页面所在的表，索引页面为nullptr
+    IxIndexHandle* index_file_;     // 索引页面所在的索引，表数据页面为nullptr
+    page_id_t page_no_;
     std::vector<lsn_t> redo_logs_;   // 在该page上需要redo的操作的lsn
 };
 
 class RecoveryManager {
 public:
-    RecoveryManager(DiskManager* disk_manager, BufferPoolManager* buffer_pool_manager, SmManager* sm_manager) {
+    RecoveryManager(DiskManager* disk_manager, BufferPoolManager* buffer_pool_manager, SmManager* sm_manager,
+                    LogManager* log_manager) {
         disk_manager_ = disk_manager;
         buffer_pool_manager_ = buffer_pool_manager;
         sm_manager_ = sm_manager;
+        log_manager_ = log_manager;
     }
+    ~RecoveryManager() { unmap_log(); }
     void analyze();
     void redo();
     void undo();
+
+    // 恢复完成后，新的日志和事务从这里继续编号
+    lsn_t get_next_lsn() { return first_lsn_ + static_cast<lsn_t>(log_addrs_.size()); }
+    txn_id_t get_next_txn_id() { return next_txn_id_; }
 private:
     std::map<txn_id_t, lsn_t> att;
-    std::vector<std::shared_ptr<LogRecord>> logs;
-    LogBuffer buffer_;                                              // 读入日志
+    std::vector<std::pair<char *, size_t>> log_segments_;          // 只读映射到内存中的日志段
+    std::vector<const char *> log_addrs_;                           // 日志中的lsn是连续的，log_addrs_[i]为lsn为first_lsn_ + i的日志
+    lsn_t first_lsn_ = 0;                                           // 截断后日志中的第一条日志
+    lsn_t redo_lsn_ = INVALID_LSN;                                  // 重做的起点，即脏页表中最小的rec_lsn
+    std::map<std::pair<int, page_id_t>, lsn_t> dpt_;                // 脏页表：(表或索引的id, 页号) -> rec_lsn
+    txn_id_t next_txn_id_ = 0;
+    std::unordered_map<int, lsn_t> ix_hdr_lsn_;                     // 每个索引最后一条修改file header的日志
+    std::unordered_map<int, std::pair<RmFileHandle *, const TabMeta *>> tables_;  // 表的id -> 表的文件和元数据
+    std::unordered_map<int, IxIndexHandle *> indexes_;              // 索引的id -> 索引的文件
+    std::unordered_map<txn_id_t, std::vector<std::shared_ptr<BulkLoadLogRecord>>> bulk_loads_;  // 未提交事务的批量导入，都会被回滚
     DiskManager* disk_manager_;                                     // 用来读写文件
     BufferPoolManager* buffer_pool_manager_;                        // 对页面进行读写
     SmManager* sm_manager_;                                         // 访问数据库元数据
+    LogManager* log_manager_;                                       // 写入回滚时的日志
 
-    void rollback(bool flag);
+    void open_files();
+    void map_log();
+    void unmap_log();
+    void truncate_log_tail(size_t segment, size_t offset);
+    std::shared_ptr<LogRecord> decode_log(const char *src);
+    // 日志只在需要时反序列化，不在内存中保留
+    std::shared_ptr<LogRecord> get_log(lsn_t lsn) { return decode_log(log_addrs_[lsn - first_lsn_]); }
+    bool get_table_rid(const std::shared_ptr<LogRecord> &log_, int *tab_id, Rid *rid);
+    const IxRedoInfo *get_index_redo(const std::shared_ptr<LogRecord> &log_, int *ix_id);
+    void add_dirty_page(const std::shared_ptr<LogRecord> &log_);
+    bool in_rolled_back_load(const std::shared_ptr<LogRecord> &log_, int tab_id, const Rid &rid);
+    void redo_page(const RedoLogsInPage &redo_logs);
+    void redo_index_page(const RedoLogsInPage &redo_logs);
+    void undo_log(const std::shared_ptr<LogRecord> &log_, lsn_t *prev_lsn);
+    lsn_t append_log(LogRecord *log, lsn_t *prev_lsn);
 
     void Draw(BufferPoolManager *bpm, const std::string &outf);
 };
\ No newline at end of file
@@ -0,0 +1,313 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include <unistd.h>
+#include <fstream>
+#include <set>
+
+#include "gtest/gtest.h"
+
+#define private public
+#include "log_recovery.h"
+#undef private  // for use private variables in "ix.h"
+
+#include "analyze/analyze.h"
+#include "errors.h"
+#include "optimizer/optimizer.h"
+#include "optimizer/plan.h"
+#include "optimizer/planner.h"
+#include "portal.h"
+
+#define BUFFER_LENGTH 8192
+
+/**
+ * 崩溃恢复测试：执行SQL之后不关闭数据库，只保留已经写入磁盘的日志和页面，
+ * 重新打开数据库并执行analyze、redo、undo，检查表和索引中只剩下已提交事务的修改
+ */
+class RecoveryTest : public ::testing::Test {
+   public:
+    std::string db_name_ = "RecoveryTest_db";
+    std::unique_ptr<DiskManager> disk_manager_;
+    std::unique_ptr<BufferPoolManager> buffer_pool_manager_;
+    std::unique_ptr<RmManager> rm_manager_;
+    std::unique_ptr<IxManager> ix_manager_;
+    std::unique_ptr<SmManager> sm_manager_;
+    std::unique_ptr<LockManager> lock_manager_;
+    std::unique_ptr<TransactionManager> txn_manager_;
+    std::unique_ptr<QlManager> ql_manager_;
+    std::unique_ptr<LogManager> log_manager_;
+    std::unique_ptr<Planner> planner_;
+    std::unique_ptr<Optimizer> optimizer_;
+    std::unique_ptr<Portal> portal_;
+    std::unique_ptr<Analyze> analyze_;
+    txn_id_t txn_id_ = INVALID_TXN_ID;
+    char result_[BUFFER_LENGTH];
+    int offset_;
+    bool aborted_ = false;  // 上一条语句是否使事务回滚
+
+   public:
+    void SetUp() override {
+        ::testing::Test::SetUp();
+        create_managers();
+        if (sm_manager_->is_dir(db_name_)) {
+            sm_manager_->drop_db(db_name_);
+        }
+        sm_manager_->create_db(db_name_);
+        destroy_managers();
+        start();
+    }
+
+    void TearDown() override {
+        sm_manager_->close_db();
+        destroy_managers();
+    }
+
+    void create_managers() {
+        disk_manager_ = std::make_unique<DiskManager>();
+        buffer_pool_manager_ = std::make_unique<BufferPoolManager>(BUFFER_POOL_SIZE, disk_manager_.get());
+        rm_manager_ = std::make_unique<RmManager>(disk_manager_.get(), buffer_pool_manager_.get());
+        ix_manager_ = std::make_unique<IxManager>(disk_manager_.get(), buffer_pool_manager_.get());
+        sm_manager_ = std::make_unique<SmManager>(disk_manager_.get(), buffer_pool_manager_.get(), rm_manager_.get(),
+                                                  ix_manager_.get());
+        lock_manager_ = std::make_unique<LockManager>();
+        txn_manager_ = std::make_unique<TransactionManager>(lock_manager_.get(), sm_manager_.get());
+        ql_manager_ = std::make_unique<QlManager>(sm_manager_.get(), txn_manager_.get());
+        log_manager_ = std::make_unique<LogManager>(disk_manager_.get());
+        planner_ = std::make_unique<Planner>(sm_manager_.get());
+        optimizer_ = std::make_unique<Optimizer>(sm_manager_.get(), planner_.get());
+        portal_ = std::make_unique<Portal>(sm_manager_.get());
+        analyze_ = std::make_unique<Analyze>(sm_manager_.get());
+    }
+
+    void destroy_managers() {
+        analyze_.reset();
+        portal_.reset();
+        optimizer_.reset();
+        planner_.reset();
+        log_manager_.reset();
+        ql_manager_.reset();
+        txn_manager_.reset();
+        lock_manager_.reset();
+        sm_manager_.reset();
+        ix_manager_.reset();
+        rm_manager_.reset();
+        buffer_pool_manager_.reset();
+        disk_manager_.reset();
+        TransactionManager::txn_map.clear();
+        txn_id_ = INVALID_TXN_ID;
+    }
+
+    // 与rmdb.cpp中的启动过程相同：打开数据库，恢复，然后做一次检查点
+    void start() {
+        create_managers();
+        sm_manager_->open_db(db_name_);
+        RecoveryManager recovery(disk_manager_.get(), buffer_pool_manager_.get(), sm_manager_.get(),
+                                 log_manager_.get());
+        recovery.analyze();
+        log_manager_->set_next_lsn(recovery.get_next_lsn());
+        buffer_pool_manager_->set_flush_log([this](lsn_t lsn) { log_manager_->wait_for_flush(lsn); });
+        recovery.redo();
+        recovery.undo();
+        txn_manager_->set_next_txn_id(recovery.get_next_txn_id());
+        txn_manager_->checkpoint(log_manager_.get());
+    }
+
+    /**
+     * @description: 模拟崩溃：已经写入缓冲区的日志全部落盘，内存中的file header和没有写回的页面全部丢失
+     * @param {bool} flush_pages 崩溃之前是否把缓冲池中的页面全部写回，即未提交事务的修改（包括分裂后的索引页面）已经在磁盘上
+     */
+    void crash(bool flush_pages) {
+        log_manager_->flush_log_to_disk();
+        std::vector<int> fds;
+        for (auto &[tab_name, fh]: sm_manager_->fhs_) {
+            fds.push_back(fh->GetFd());
+        }
+        for (auto &[ix_name, ih]: sm_manager_->ihs_) {
+            fds.push_back(ih->get_fd());
+        }
+        for (int fd: fds) {
+            if (flush_pages) buffer_pool_manager_->flush_all_pages(fd);
+            disk_manager_->close_file(fd);
+        }
+        if (disk_manager_->GetLogFd() != -1) {
+            close(disk_manager_->GetLogFd());
+        }
+        if (chdir("..") < 0) {
+            throw UnixError();
+        }
+        destroy_managers();
+    }
+
+    void exec_sql(const std::string &sql) {
+        YY_BUFFER_STATE yy_buffer = yy_scan_string(sql.c_str());
+        ASSERT_TRUE(yyparse() == 0 && ast::parse_tree != nullptr);
+        yy_delete_buffer(yy_buffer);
+        memset(result_, 0, BUFFER_LENGTH);
+        offset_ = 0;
+        Context context(lock_manager_.get(), log_manager_.get(), nullptr, result_, &offset_, true,
+                        txn_manager_->get_version_store());
+        context.txn_ = txn_manager_->get_transaction(txn_id_);
+        if (context.txn_ == nullptr || context.txn_->get_state() == TransactionState::COMMITTED ||
+            context.txn_->get_state() == TransactionState::ABORTED) {
+            context.txn_ = txn_manager_->begin(nullptr, log_manager_.get());
+            txn_id_ = context.txn_->get_transaction_id();
+            context.txn_->set_txn_mode(false);
+        }
+        aborted_ = false;
+        try {
+            std::shared_ptr<Query> query = analyze_->do_analyze(ast::parse_tree);
+            std::shared_ptr<Plan> plan = optimizer_->plan_query(query, &context);
+            std::shared_ptr<PortalStmt> portal_stmt = portal_->start(plan, &context);
+            portal_->run(portal_stmt, ql_manager_.get(), &txn_id_, &context);
+            portal_->drop();
+        } catch (TransactionAbortException &e) {
+            // 与rmdb.cpp相同，回滚整个事务
+            txn_manager_->abort(&context, log_manager_.get());
+            aborted_ = true;
+        }
+        if (!context.txn_->get_txn_mode() && context.txn_->get_state() != TransactionState::COMMITTED &&
+            context.txn_->get_state() != TransactionState::ABORTED) {
+            txn_manager_->commit(context.txn_, log_manager_.get());
+        }
+    }
+
+    /**
+     * @description: 检查表t中恰好是keys中的记录（id为key，val为key * 10），并且索引按顺序指向这些记录
+     */
+    void check_table(const std::set<int> &keys) {
+        auto fh = sm_manager_->fhs_.at("t").get();
+        std::set<int> table_keys;
+        for (RmScan scan(fh); !scan.is_end(); scan.next()) {
+            auto rec = fh->get_record(scan.rid(), nullptr);
+            int id = *(int *) rec->data;
+            EXPECT_EQ(*(int *) (rec->data + sizeof(int)), id * 10);
+            EXPECT_TRUE(table_keys.insert(id).second) << "duplicate record " << id;
+        }
+        EXPECT_EQ(table_keys, keys);
+
+        auto ih = sm_manager_->ihs_.at(ix_manager_->get_index_name("t", std::vector<std::string>{"id"})).get();
+        std::vector<int> index_keys;
+        IxScan scan(ih, ih->leaf_begin(), ih->leaf_end(), buffer_pool_manager_.get());
+        for (; !scan.is_end(); scan.next()) {
+            auto rec = fh->get_record(scan.rid(), nullptr);
+            index_keys.push_back(*(int *) rec->data);
+        }
+        EXPECT_EQ(index_keys, std::vector<int>(keys.begin(), keys.end()));
+
+        Transaction txn(INVALID_TXN_ID);
+        for (int key = 0; key < 2 * scale; key++) {
+            std::vector<Rid> rids;
+            ih->get_value((const char *) &key, &rids, &txn);
+            EXPECT_EQ(rids.size(), keys.count(key)) << "key " << key;
+        }
+    }
+
+    // 已提交的事务插入偶数，未提交的事务插入奇数，使已有的叶子分裂
+    void run_loser_workload(std::set<int> *committed) {
+        exec_sql("create table t (id int, val int);");
+        exec_sql("create index t (id);");
+        for (int key = 0; key < 2 * scale; key += 2) {
+            exec_sql("insert into t values (" + std::to_string(key) + ", " + std::to_string(key * 10) + ");");
+            committed->insert(key);
+        }
+        int leaves_before = count_leaves();
+
+        exec_sql("begin;");
+        for (int key = 1; key < 2 * scale; key += 2) {
+            exec_sql("insert into t values (" + std::to_string(key) + ", " + std::to_string(key * 10) + ");");
+        }
+        exec_sql("delete from t where id < 100;");
+        EXPECT_GT(count_leaves(), leaves_before);
+    }
+
+    int count_leaves() {
+        auto ih = sm_manager_->ihs_.at(ix_manager_->get_index_name("t", std::vector<std::string>{"id"})).get();
+        int leaves = 0;
+        for (int page_no = ih->file_hdr_->first_leaf_; page_no != IX_LEAF_HEADER_PAGE && page_no != IX_NO_PAGE;) {
+            IxNodeHandle *node = ih->fetch_node(page_no);
+            leaves++;
+            page_no = node->get_next_leaf();
+            buffer_pool_manager_->unpin_page(node->get_page_id(), false);
+            delete node;
+        }
+        return leaves;
+    }
+
+    static constexpr int scale = 1000;
+};
+
+/**
+ * @brief 未提交事务分裂的索引页面和插入的记录已经写回磁盘，file header没有写回，恢复时回滚这些修改
+ */
+TEST_F(RecoveryTest, LoserSplitFlushedTest) {
+    std::set<int> committed;
+    run_loser_workload(&committed);
+    crash(true);
+    start();
+    check_table(committed);
+
+    // 恢复之后索引仍然可以正常插入，正常关闭再打开时不需要恢复
+    exec_sql("insert into t values (1, 10);");
+    committed.insert(1);
+    check_table(committed);
+    sm_manager_->close_db();
+    destroy_managers();
+    start();
+    check_table(committed);
+}
+
+/**
+ * @brief 崩溃之前没有写回任何页面，已提交事务的修改全部由redo重做，未提交事务的修改重做后再回滚
+ */
+TEST_F(RecoveryTest, LoserSplitLostTest) {
+    std::set<int> committed;
+    run_loser_workload(&committed);
+    crash(false);
+    start();
+    check_table(committed);
+
+    // 恢复后再次崩溃，恢复过程中写入的补偿日志不会被重复回滚
+    exec_sql("insert into t values (3, 30);");
+    committed.insert(3);
+    crash(false);
+    start();
+    check_table(committed);
+}
+
+/**
+ * @brief 批量导入的记录与唯一索引中已有的键重复时回滚事务，只删除导入的记录自己的索引项，
+ * 已有记录的索引项保留；崩溃后恢复也得到相同的结果
+ */
+TEST_F(RecoveryTest, LoadDuplicateKeyTest) {
+    std::set<int> committed;
+    exec_sql("create table t (id int, val int);");
+    exec_sql("create index t (id);");
+    for (int key = 0; key < 10; key++) {
+        exec_sql("insert into t values (" + std::to_string(key) + ", " + std::to_string(key * 10) + ");");
+        committed.insert(key);
+    }
+
+    // 重复的键在中间：之前的记录已经插入索引，之后的记录已经写入页面但还没有插入索引
+    {
+        std::ofstream csv("t_load.csv");
+        csv << "id,val\n";
+        for (int key = scale; key < 2 * scale; key++) {
+            if (key == scale + scale / 2) csv << 5 << "," << 50 << "\n";
+            csv << key << "," << key * 10 << "\n";
+        }
+    }
+    exec_sql("load t_load.csv into t;");
+    EXPECT_TRUE(aborted_);
+    check_table(committed);
+
+    crash(false);
+    start();
+    check_table(committed);
+}
@@ -13,9 +13,15 @@ See the Mulan PSL v2 for more details. */
 #include <readline/readline.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <strings.h>
 #include <unistd.h>
+#include <algorithm>
 #include <atomic>
+#include <map>
+#include <shared_mutex>
 #include <sstream>
+#include <thread>
+#include <condition_variable>
 
 #include "errors.h"
 #include "optimizer/optimizer.h"
@@ -41,7 +47,8 @@ auto lock_manager = std::make_unique<LockManager>();
 auto txn_manager = std::make_unique<TransactionManager>(lock_manager.get(), sm_manager.get());
 auto ql_manager = std::make_unique<QlManager>(sm_manager.get(), txn_manager.get());
 auto log_manager = std::make_unique<LogManager>(disk_manager.get());
-auto recovery = std::make_unique<RecoveryManager>(disk_manager.get(), buffer_pool_manager.get(), sm_manager.get());
+auto recovery = std::make_unique<RecoveryManager>(disk_manager.get(), buffer_pool_manager.get(), sm_manager.get(),
+                                                  log_manager.get());
 auto planner = std::make_unique<Planner>(sm_manager.get());
 auto optimizer = std::make_unique<Optimizer>(sm_manager.get(), planner.get());
 auto portal = std::make_unique<Portal>(sm_manager.get());
@@ -51,6 +58,42 @@ pthread_mutex_t *sockfd_mutex;
 
 static jmp_buf jmpbuf;
 
+// 后台线程（定期检查点、死锁检测），关闭数据库之前通知它们退出并等待结束
+static std::vector<std::thread> background_threads;
+static std::mutex background_latch;
+static std::condition_variable background_cv;
+static bool background_exit = false;
+
+/**
+ * @description: 启动一个后台线程，每隔interval执行一次task，直到stop_background_threads()被调用
+ * @param {Duration} interval 执行间隔
+ * @param {Task} task 需要定期执行的任务
+ */
+template <typename Duration, typename Task>
+void start_background_thread(Duration interval, Task task) {
+    background_threads.emplace_back([interval, task] {
+        std::unique_lock<std::mutex> lock(background_latch);
+        while (!background_cv.wait_for(lock, interval, [] { return background_exit; })) {
+            lock.unlock();
+            task();
+            lock.lock();
+        }
+    });
+}
+
+// 通知所有后台线程退出并等待它们结束，之后才能关闭数据库
+void stop_background_threads() {
+    {
+        std::lock_guard<std::mutex> lock(background_latch);
+        background_exit = true;
+    }
+    background_cv.notify_all();
+    for (auto &thread: background_threads) {
+        if (thread.joinable()) thread.join();
+    }
+    background_threads.clear();
+}
+
 void sigint_handler(int signo) {
     should_exit = true;
     log_manager->flush_log_to_disk();
@@ -58,15 +101,58 @@ void sigint_handler(int signo) {
     longjmp(jmpbuf, 1);
 }
 
+// 语句是否为SELECT，显式事务之外的SELECT使用只读事务
+bool IsReadOnlyStatement(const char *sql) {
+    while (isspace(*sql)) sql++;
+    return strncasecmp(sql, "select", 6) == 0 && (isspace(sql[6]) || sql[6] == '\0');
+}
+
 // 判断当前正在执行的是显式事务还是单条SQL语句的事务，并更新事务ID
-void SetTransaction(txn_id_t *txn_id, Context *context) {
+// 新事务使用连接当前的隔离级别；READ_COMMITTED的显式事务在每条语句开始时换成新的快照
+// 单条SELECT语句使用只读事务，只读事务不在全局事务表中，不更新事务ID
+void SetTransaction(txn_id_t *txn_id, Context *context, IsolationLevel isolation_level, bool read_only) {
     context->txn_ = txn_manager->get_transaction(*txn_id);
     if (context->txn_ == nullptr || context->txn_->get_state() == TransactionState::COMMITTED ||
         context->txn_->get_state() == TransactionState::ABORTED) {
-        context->txn_ = txn_manager->begin(nullptr, context->log_mgr_);
+        if (read_only) {
+            context->txn_ = txn_manager->begin_read_only();
+            context->txn_->set_txn_mode(false);
+            return;
+        }
+        context->txn_ = txn_manager->begin(nullptr, context->log_mgr_, isolation_level);
         *txn_id = context->txn_->get_transaction_id();
         context->txn_->set_txn_mode(false);
+    } else if (context->txn_->get_isolation_level() == IsolationLevel::READ_COMMITTED) {
+        context->version_store_->refresh_snapshot(context->txn_);
+    }
+}
+
+// 事务已经提交或回滚时把事务对象还给事务管理器，连接回到没有事务的状态
+void ReleaseTransaction(txn_id_t *txn_id, Context *context) {
+    auto state = context->txn_->get_state();
+    if (state != TransactionState::COMMITTED && state != TransactionState::ABORTED) return;
+    txn_manager->release(context->txn_);
+    *txn_id = INVALID_TXN_ID;
+}
+
+// 解析"set transaction isolation level <level>"中的隔离级别，无法识别时返回false
+bool ParseIsolationLevel(const char *level_str, IsolationLevel *isolation_level) {
+    std::string level;
+    for (const char *p = level_str; *p != '\0' && *p != ';'; p++) {
+        if (*p == ' ' && (level.empty() || level.back() == ' ')) continue;
+        level += (char) tolower(*p);
     }
+    while (!level.empty() && level.back() == ' ') level.pop_back();
+    static const std::map<std::string, IsolationLevel> levels = {
+            {"read uncommitted", IsolationLevel::READ_UNCOMMITTED},
+            {"read committed", IsolationLevel::READ_COMMITTED},
+            {"repeatable read", IsolationLevel::REPEATABLE_READ},
+            {"serializable", IsolationLevel::SERIALIZABLE},
+    };
+    auto it = levels.find(level);
+    if (it == levels.end()) return false;
+    *isolation_level = it->second;
+    return true;
 }
 
 void *client_handler(void *sock_fd) {
@@ -88,6 +174,10 @@ void *client_handler(void *sock_fd) {
 
     bool output_ellipsis = false;
     std::string set_off = "set output_file off";
+    // 连接上之后开始的事务使用的隔离级别，默认可串行化
+    IsolationLevel isolation_level = IsolationLevel::SERIALIZABLE;
+    std::string set_isolation = "set transaction isolation level ";
+    std::string set_escalation = "set lock_escalation_threshold ";
 
     while (true) {
         std::cout << "Waiting for request..." << std::endl;
@@ -129,15 +219,43 @@ void *client_handler(void *sock_fd) {
             continue;
         }
 
+        if (strncasecmp(data_recv, set_isolation.c_str(), set_isolation.length()) == 0) {
+            // 只影响之后开始的事务，正在执行的显式事务保持原来的隔离级别
+            memset(data_send, '\0', BUFFER_LENGTH);
+            int len = 1;
+            if (!ParseIsolationLevel(data_recv + set_isolation.length(), &isolation_level)) {
+                std::string str = "unknown isolation level\n";
+                memcpy(data_send, str.c_str(), str.length());
+                len = str.length() + 1;
+            }
+            if (write(fd, data_send, len) == -1) {
+                break;
+            }
+            continue;
+        }
+
+        if (strncasecmp(data_recv, set_escalation.c_str(), set_escalation.length()) == 0) {
+            // 全局生效，0表示不进行锁升级
+            memset(data_send, '\0', BUFFER_LENGTH);
+            lock_escalation_threshold = std::max(0, atoi(data_recv + set_escalation.length()));
+            if (write(fd, data_send, 1) == -1) {
+                break;
+            }
+            continue;
+        }
+
         memset(data_send, '\0', BUFFER_LENGTH);
         offset = 0;
 
+        // 语句执行期间不能确定检查点的redo点
+        std::shared_lock<std::shared_mutex> checkpoint_lock(txn_manager->get_checkpoint_latch());
+
         // 开启事务，初始化系统所需的上下文信息（包括事务对象指针、锁管理器指针、日志管理器指针、存放结果的buffer、记录结果长度的变量）
         Context *context = new Context(lock_manager.get(), log_manager.get(), nullptr, data_send, &offset,
-                                       output_ellipsis);
+                                       output_ellipsis, txn_manager->get_version_store());
 
         //事务处理部分
-        SetTransaction(&txn_id, context);
+        SetTransaction(&txn_id, context, isolation_level, IsReadOnlyStatement(data_recv));
 
         if (memcmp(data_recv, "load", 4) == 0) {
             memset(data_send, '\0', BUFFER_LENGTH);
@@ -153,7 +271,21 @@ void *client_handler(void *sock_fd) {
                 }
             }
             tab_name.pop_back();
-            sm_manager->load_record(file_name, tab_name, context);
+            try {
+                sm_manager->load_record(file_name, tab_name, context);
+            } catch (RMDBError &e) {
+                // 数据文件不存在或格式错误，单条load语句整体回滚
+                std::cerr << e.what() << std::endl;
+                if (!context->txn_->get_txn_mode()) {
+                    txn_manager->abort(context, log_manager.get());
+                }
+            }
+            // 单条load语句同样作为一个完整的事务提交
+            if (!context->txn_->get_txn_mode() && context->txn_->get_state() != TransactionState::ABORTED) {
+                txn_manager->commit(context->txn_, context->log_mgr_);
+            }
+            ReleaseTransaction(&txn_id, context);
+            delete context;
             if (write(fd, data_send, 1) == -1) {
                 break;
             }
@@ -178,6 +310,10 @@ void *client_handler(void *sock_fd) {
                     std::shared_ptr<PortalStmt> portalStmt = portal->start(plan, context);
                     portal->run(portalStmt, ql_manager.get(), &txn_id, context);
                     portal->drop();
+                    // 乐观事务提交时可能验证失败，单条语句的隐式事务在这里提交，失败时和其他回滚一样返回abort
+                    if (!context->txn_->get_txn_mode() && context->txn_->is_optimistic()) {
+                        txn_manager->commit(context->txn_, context->log_mgr_);
+                    }
                 }
             }
         }
@@ -221,18 +357,33 @@ void *client_handler(void *sock_fd) {
             yy_delete_buffer(buf);
             pthread_mutex_unlock(buffer_mutex);
         }
+        // 如果是单挑语句，需要按照一个完整的事务来执行，所以执行完当前语句后，自动提交事务
+        // 提交（包括等待commit日志落盘）之后再返回结果，客户端收到结果时修改已经持久化，对之后的语句可见
+
+        //事务处理部分，已经回滚或提交的事务不再提交
+        if (!context->txn_->get_txn_mode() && context->txn_->get_state() != TransactionState::ABORTED &&
+            context->txn_->get_state() != TransactionState::COMMITTED) {
+            txn_manager->commit(context->txn_, context->log_mgr_);
+        }
+        ReleaseTransaction(&txn_id, context);
+        delete context;
         // future TODO: 格式化 sql_handler.result, 传给客户端
         // send result with fixed format, use protobuf in the future
         if (write(fd, data_send, offset + 1) == -1) {
             break;
         }
-        // 如果是单挑语句，需要按照一个完整的事务来执行，所以执行完当前语句后，自动提交事务
 
-        //事务处理部分
-        if (!context->txn_->get_txn_mode()) {
-            txn_manager->commit(context->txn_, context->log_mgr_);
-        }
+    }
 
+    // 客户端断开时回滚其未结束的显式事务，释放持有的锁，否则等待这些锁的事务永远无法继续
+    Transaction *txn = txn_manager->get_transaction(txn_id);
+    if (txn != nullptr && txn->get_state() != TransactionState::COMMITTED &&
+        txn->get_state() != TransactionState::ABORTED) {
+        std::shared_lock<std::shared_mutex> checkpoint_lock(txn_manager->get_checkpoint_latch());
+        Context context(lock_manager.get(), log_manager.get(), txn, data_send, &offset, output_ellipsis,
+                        txn_manager->get_version_store());
+        txn_manager->abort(&context, log_manager.get());
+        txn_manager->release(txn);
     }
 
     // Clear
@@ -307,26 +458,36 @@ void start_server() {
     int ret = shutdown(sockfd_server, SHUT_WR);  // shut down the all or part of a full-duplex connection.
     if (ret == -1) { printf("%s\n", strerror(errno)); }
 //    assert(ret != -1);
+    // 检查点和死锁检测线程会访问缓冲池和日志，必须在关闭数据库之前结束
+    stop_background_threads();
     sm_manager->close_db();
     std::cout << " DB has been closed.\n";
     std::cout << "Server shuts down." << std::endl;
 }
 
-void *log_timer(void *arg) {
-    //定时将log刷入磁盘
-    while (!should_exit) {
-        std::this_thread::sleep_for(FLUSH_TIMEOUT);
-        std::cout << "flush_log_to_disk\n";
-        log_manager->flush_log_to_disk();
-    }
-}
-
 int main(int argc, char **argv) {
-    if (argc != 2) {
-        // 需要指定数据库名称
-        std::cerr << "Usage: " << argv[0] << " <database>" << std::endl;
+    if (argc != 2 && argc != 3) {
+        // 需要指定数据库名称，可选指定加锁冲突时的处理策略，默认no_wait；occ表示使用乐观并发控制
+        std::cerr << "Usage: " << argv[0] << " <database> [no_wait|wait_die|wound_wait|detection|occ]" << std::endl;
         exit(1);
     }
+    if (argc == 3) {
+        std::string policy = argv[2];
+        if (policy == "no_wait") {
+            lock_manager->set_deadlock_policy(DeadlockPolicy::NO_WAIT);
+        } else if (policy == "wait_die") {
+            lock_manager->set_deadlock_policy(DeadlockPolicy::WAIT_DIE);
+        } else if (policy == "wound_wait") {
+            lock_manager->set_deadlock_policy(DeadlockPolicy::WOUND_WAIT);
+        } else if (policy == "detection") {
+            lock_manager->set_deadlock_policy(DeadlockPolicy::DETECTION);
+        } else if (policy == "occ") {
+            txn_manager->set_concurrency_mode(ConcurrencyMode::OPTIMISTIC);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " <database> [no_wait|wait_die|wound_wait|detection|occ]" << std::endl;
+            exit(1);
+        }
+    }
     signal(SIGINT, sigint_handler);
     try {
         std::cout << "\n"
@@ -351,18 +512,28 @@ int main(int argc, char **argv) {
 
         // recovery database
         recovery->analyze();
+        // 写回页面之前先把页面lsn之前的日志落盘；已有的日志都已经在磁盘上，恢复时的回滚从这里继续写日志
+        log_manager->set_next_lsn(recovery->get_next_lsn());
+        buffer_pool_manager->set_flush_log([](lsn_t lsn) { log_manager->wait_for_flush(lsn); });
         recovery->redo();
         recovery->undo();
+        txn_manager->set_next_txn_id(recovery->get_next_txn_id());
+        // 恢复完成后立即做一次检查点，此后重启时无需再重做之前的日志
+        txn_manager->checkpoint(log_manager.get());
 
-//        pthread_t thread_id;
-//        if(pthread_create(&thread_id, nullptr, &log_timer, nullptr) != 0){
-//            std::cout << "log_timer error!\n";
-//        }
+        // 定期做检查点，截断不再需要的日志
+        start_background_thread(CHECKPOINT_INTERVAL, [] { txn_manager->checkpoint(log_manager.get()); });
+
+        // detection策略下定期检测死锁
+        if (lock_manager->get_deadlock_policy() == DeadlockPolicy::DETECTION) {
+            start_background_thread(cycle_detection_interval, [] { lock_manager->detect_deadlock(); });
+        }
 
         // 开启服务端，开始接受客户端连接
         start_server();
     } catch (RMDBError &e) {
         std::cerr << e.what() << std::endl;
+        stop_background_threads();
         exit(1);
     }
     return 0;
@@ -28,6 +28,41 @@ bool BufferPoolManager::find_victim_page(frame_id_t *frame_id) {
     return true;
 }
 
+/**
+ * @description: 页面写回磁盘之前是否需要等待修改它的日志持久化
+ * @param {Page*} page 要写回的页面
+ */
+bool BufferPoolManager::need_flush_log(Page *page) {
+    return flush_log_ && page->get_page_lsn() > flushed_lsn_;
+}
+
+/**
+ * @description: 释放latch_等待lsn及之前的日志持久化，返回时重新持有latch_，不让一次fsync阻塞整个缓冲池。
+ * 等待期间页表和页面都可能变化，调用者需要重新查找页面
+ * @param {unique_lock&} lock 持有的latch_
+ * @param {lsn_t} lsn 需要持久化的日志记录号
+ */
+void BufferPoolManager::wait_for_log(std::unique_lock<std::mutex> &lock, lsn_t lsn) {
+    lock.unlock();
+    flush_log_(lsn);
+    lock.lock();
+    flushed_lsn_ = std::max(flushed_lsn_, lsn);
+}
+
+/**
+ * @description: 把页面写回磁盘，写回之前先保证修改该页面的日志已经持久化。调用者一般已经通过wait_for_log等待过，
+ * 只有页面在等待之后又被修改时才在持有latch_的情况下等待
+ * @param {Page*} page 写回页指针
+ */
+void BufferPoolManager::write_page(Page *page) {
+    if (need_flush_log(page)) {
+        lsn_t lsn = page->get_page_lsn();
+        flush_log_(lsn);
+        flushed_lsn_ = std::max(flushed_lsn_, lsn);
+    }
+    disk_manager_->write_page(page->id_.fd, page->id_.page_no, page->data_, PAGE_SIZE);
+}
+
 /**
  * @description: 更新页面数据, 如果为脏页则需写入磁盘，再更新为新页面，更新page元数据(data, is_dirty, page_id)和page table
  * @param {Page*} page 写回页指针
@@ -40,7 +75,7 @@ void BufferPoolManager::update_page(Page *page, PageId new_page_id, frame_id_t n
     // 2 更新page table
     // 3 重置page的data，更新page id
     if (page->is_dirty()) {
-        disk_manager_->write_page(page->id_.fd, page->id_.page_no, page->data_, PAGE_SIZE);
+        write_page(page);
         page->is_dirty_ = false;
     }
     PageId old = page->id_;
@@ -68,16 +103,22 @@ Page *BufferPoolManager::fetch_page(PageId page_id) {
     // 3.     调用disk_manager_的read_page读取目标页到frame
     // 4.     固定目标页，更新pin_count_
     // 5.     返回目标页
-    std::scoped_lock lock{latch_};
-    if (page_table_.count(page_id)) {// 存在与页表中
-        frame_id_t fid = page_table_[page_id];
-        replacer_->pin(fid);
-        pages_[fid].pin_count_++;
-        return &pages_[fid];
-    }
+    std::unique_lock<std::mutex> lock{latch_};
     frame_id_t fid = -1;
-    bool ok = find_victim_page(&fid);
-    if (!ok || fid == -1) return nullptr;
+    while (true) {
+        if (page_table_.count(page_id)) {// 存在与页表中
+            fid = page_table_[page_id];
+            replacer_->pin(fid);
+            pages_[fid].pin_count_++;
+            return &pages_[fid];
+        }
+        bool ok = find_victim_page(&fid);
+        if (!ok || fid == -1) return nullptr;
+        if (!pages_[fid].is_dirty() || !need_flush_log(&pages_[fid])) break;
+        // 淘汰的脏页的日志还没有持久化：放回replacer，等待日志落盘之后重新查找目标页并重新选择帧
+        replacer_->unpin(fid);
+        wait_for_log(lock, pages_[fid].get_page_lsn());
+    }
     update_page(&pages_[fid], page_id, fid);
     if(page_id.page_no != INVALID_PAGE_ID){
         disk_manager_->read_page(page_id.fd, page_id.page_no, pages_[fid].data_, PAGE_SIZE);
@@ -110,6 +151,9 @@ bool BufferPoolManager::unpin_page(PageId page_id, bool is_dirty) {
     if (P->pin_count_ <= 0) return false;
     P->pin_count_--;
     // 只能是 false -> true，不能是 true -> false
+    if (is_dirty && !P->is_dirty_) {
+        P->rec_lsn_ = P->get_page_lsn();
+    }
     P->is_dirty_ |= is_dirty;
     if (P->pin_count_ == 0) {
         replacer_->unpin(fid);
@@ -129,15 +173,18 @@ bool BufferPoolManager::flush_page(PageId page_id) {
     // 1.1 目标页P没有被page_table_记录 ，返回false
     // 2. 无论P是否为脏都将其写回磁盘。
     // 3. 更新P的is_dirty_
-    std::scoped_lock lock{latch_};
-    if (!page_table_.count(page_id)) return false;
-    Page *page = pages_ + page_table_[page_id];
-    if (page->get_page_id().page_no != INVALID_PAGE_ID) {
-        disk_manager_->write_page(page->id_.fd, page->id_.page_no, page->data_, PAGE_SIZE);
-        page->is_dirty_ = false;
-        return true;
+    std::unique_lock<std::mutex> lock{latch_};
+    while (true) {
+        if (!page_table_.count(page_id)) return false;
+        Page *page = pages_ + page_table_[page_id];
+        if (page->get_page_id().page_no == INVALID_PAGE_ID) return false;
+        if (!need_flush_log(page)) {
+            write_page(page);
+            page->is_dirty_ = false;
+            return true;
+        }
+        wait_for_log(lock, page->get_page_lsn());
     }
-    return false;
 }
 
 /**
@@ -151,10 +198,16 @@ Page *BufferPoolManager::new_page(PageId *page_id) {
     // 3.   将frame的数据写回磁盘
     // 4.   固定frame，更新pin_count_
     // 5.   返回获得的page
-    std::scoped_lock lock{latch_};
+    std::unique_lock<std::mutex> lock{latch_};
     frame_id_t fid = -1;
-    bool ok = find_victim_page(&fid);
-    if (!ok || fid == -1) return nullptr;
+    while (true) {
+        bool ok = find_victim_page(&fid);
+        if (!ok || fid == -1) return nullptr;
+        if (!pages_[fid].is_dirty() || !need_flush_log(&pages_[fid])) break;
+        // 与fetch_page相同，不在持有latch_时等待淘汰的脏页的日志
+        replacer_->unpin(fid);
+        wait_for_log(lock, pages_[fid].get_page_lsn());
+    }
     Page *page = pages_ + (fid);
     page_id->page_no = disk_manager_->allocate_page(page_id->fd);
     update_page(page, *page_id, fid);
@@ -172,13 +225,19 @@ bool BufferPoolManager::delete_page(PageId page_id) {
     // 1.   在page_table_中查找目标页，若不存在返回true
     // 2.   若目标页的pin_count不为0，则返回false
     // 3.   将目标页数据写回磁盘，从页表中删除目标页，重置其元数据，将其加入free_list_，返回true
-    std::scoped_lock lock{latch_};
-    if (!page_table_.count(page_id)) return true;
-    frame_id_t fid = page_table_[page_id];
-    Page *page = pages_ + fid;
-    if (page->pin_count_ != 0) return false;
+    std::unique_lock<std::mutex> lock{latch_};
+    frame_id_t fid = -1;
+    Page *page = nullptr;
+    while (true) {
+        if (!page_table_.count(page_id)) return true;
+        fid = page_table_[page_id];
+        page = pages_ + fid;
+        if (page->pin_count_ != 0) return false;
+        if (!page->is_dirty() || !need_flush_log(page)) break;
+        wait_for_log(lock, page->get_page_lsn());
+    }
     if (page->is_dirty()) {
-        disk_manager_->write_page(page->id_.fd, page->id_.page_no, page->data_, PAGE_SIZE);
+        write_page(page);
         page->is_dirty_ = false;
     }
     page_table_.erase(page_id);
@@ -192,12 +251,108 @@ bool BufferPoolManager::delete_page(PageId page_id) {
  * @param {int} fd 文件句柄
  */
 void BufferPoolManager::flush_all_pages(int fd) {
-    std::scoped_lock lock{latch_};
-    for (int i = 0; i < pool_size_; i++) {
+    flush_pages_from(fd, 0);
+}
+
+/**
+ * @description: 将buffer_pool中属于fd且页号不小于start_page_no的页面写回磁盘
+ * @param {int} fd 文件句柄
+ * @param {page_id_t} start_page_no 起始页号
+ */
+void BufferPoolManager::flush_pages_from(int fd, page_id_t start_page_no) {
+    std::unique_lock<std::mutex> lock{latch_};
+    // 先等待这些页面中最新的日志持久化，之后写回时不再需要等待，除非页面在等待期间又被修改
+    lsn_t max_lsn = INVALID_LSN;
+    for (size_t i = 0; i < pool_size_; i++) {
+        Page *page = pages_ + i;
+        if (page->id_.fd == fd && page->id_.page_no != INVALID_PAGE_ID && page->id_.page_no >= start_page_no) {
+            max_lsn = std::max(max_lsn, page->get_page_lsn());
+        }
+    }
+    if (flush_log_ && max_lsn > flushed_lsn_) {
+        wait_for_log(lock, max_lsn);
+    }
+    for (size_t i = 0; i < pool_size_; i++) {
         Page *page = pages_ + i;
-        if (page->id_.fd == fd && page->id_.page_no != INVALID_PAGE_ID) {
-            disk_manager_->write_page(fd, page->id_.page_no, page->data_, PAGE_SIZE);
+        if (page->id_.fd == fd && page->id_.page_no != INVALID_PAGE_ID && page->id_.page_no >= start_page_no) {
+            write_page(page);
             page->is_dirty_ = false;
         }
     }
-}
\ No newline at end of file
+}
+
+/**
+ * @description: 获取当前缓冲池中所有页面的页号，用于检查点时刷盘
+ * 记录文件修改页面后不一定通过unpin_page标记脏页，因此缓冲池中的页面都当作脏页处理
+ * @return {vector<PageId>} 缓冲池中页面的页号
+ */
+std::vector<PageId> BufferPoolManager::get_cached_pages() {
+    std::scoped_lock lock{latch_};
+    std::vector<PageId> page_ids;
+    for (size_t i = 0; i < pool_size_; i++) {
+        Page *page = pages_ + i;
+        if (page->id_.page_no != INVALID_PAGE_ID) {
+            page_ids.push_back(page->id_);
+        }
+    }
+    return page_ids;
+}
+
+/**
+ * @description: 获取当前缓冲池中的脏页及其rec_lsn，用于检查点记录脏页表
+ * @return {vector<pair<PageId, lsn_t>>} 脏页的页号和rec_lsn
+ */
+std::vector<std::pair<PageId, lsn_t>> BufferPoolManager::get_dirty_page_table() {
+    std::scoped_lock lock{latch_};
+    std::vector<std::pair<PageId, lsn_t>> dirty_page_table;
+    for (size_t i = 0; i < pool_size_; i++) {
+        Page *page = pages_ + i;
+        if (page->is_dirty_ && page->id_.page_no != INVALID_PAGE_ID) {
+            dirty_page_table.emplace_back(page->id_, page->rec_lsn_);
+        }
+    }
+    return dirty_page_table;
+}
+
+/**
+ * @description: 丢弃buffer_pool中属于fd的所有页面，不写回磁盘
+ * 用于删除文件之前，避免文件关闭后fd被复用时读到旧文件的缓存页
+ * @param {int} fd 文件句柄
+ */
+void BufferPoolManager::discard_all_pages(int fd) {
+    discard_pages_from(fd, 0);
+}
+
+/**
+ * @description: 丢弃buffer_pool中属于fd且页号不小于start_page_no的页面，不写回磁盘
+ * 用于截断文件，被丢弃的页面即使被pin也直接释放，调用者保证之后不再访问这些页面
+ * @param {int} fd 文件句柄
+ * @param {page_id_t} start_page_no 第一个丢弃的页号
+ */
+void BufferPoolManager::discard_pages_from(int fd, page_id_t start_page_no) {
+    std::scoped_lock lock{latch_};
+    for (size_t i = 0; i < pool_size_; i++) {
+        Page *page = pages_ + i;
+        if (page->id_.fd != fd || page->id_.page_no == INVALID_PAGE_ID || page->id_.page_no < start_page_no) continue;
+        page_table_.erase(page->id_);
+        replacer_->pin(static_cast<frame_id_t>(i));
+        page->reset_memory();
+        page->id_.page_no = INVALID_PAGE_ID;
+        page->is_dirty_ = false;
+        page->pin_count_ = 0;
+        free_list_.push_back(static_cast<frame_id_t>(i));
+    }
+}
+
+/**
+ * @description: 预读目标页：若其不在buffer_pool中，则让磁盘异步读取，之后的fetch_page可以更快完成
+ * 不占用frame也不pin页面，因此不会影响其他页面的替换
+ * @param {PageId} page_id 目标页的PageId
+ */
+void BufferPoolManager::prefetch_page(PageId page_id) {
+    {
+        std::scoped_lock lock{latch_};
+        if (page_table_.count(page_id)) return;
+    }
+    disk_manager_->prefetch_page(page_id.fd, page_id.page_no);
+}
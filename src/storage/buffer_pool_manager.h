@@ -13,7 +13,9 @@ See the Mulan PSL v2 for more details. */
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cassert>
+#include <functional>
 #include <list>
 #include <unordered_map>
 #include <vector>
@@ -33,6 +35,8 @@ private:
     DiskManager *disk_manager_;
     Replacer *replacer_;    // buffer_pool的置换策略，当前赛题中为LRU置换策略
     std::mutex latch_;      // 用于共享数据结构的并发控制
+    std::function<void(lsn_t)> flush_log_;  // 写回页面前把日志持久化到页面的page lsn（WAL），由上层设置
+    lsn_t flushed_lsn_ = INVALID_LSN;       // 已知已经持久化的最后一条日志，page lsn不超过它的页面写回前不需要等待
 
 public:
     BufferPoolManager(size_t pool_size, DiskManager *disk_manager)
@@ -64,6 +68,12 @@ public:
      */
     static void mark_dirty(Page *page) { page->is_dirty_ = true; }
 
+    /**
+     * @description: 设置写回页面前持久化日志的回调，保证页面上的修改写回磁盘之前，修改它的日志已经落盘
+     * @param {function<void(lsn_t)>} flush_log 把lsn及之前的日志持久化
+     */
+    void set_flush_log(std::function<void(lsn_t)> flush_log) { flush_log_ = std::move(flush_log); }
+
 public:
     Page *fetch_page(PageId page_id);
 
@@ -77,9 +87,27 @@ public:
 
     void flush_all_pages(int fd);
 
+    void flush_pages_from(int fd, page_id_t start_page_no);
+
+    std::vector<PageId> get_cached_pages();
+
+    std::vector<std::pair<PageId, lsn_t>> get_dirty_page_table();
+
+    void discard_all_pages(int fd);
+
+    void discard_pages_from(int fd, page_id_t start_page_no);
+
+    void prefetch_page(PageId page_id);
+
 private:
 
     bool find_victim_page(frame_id_t *frame_id);
 
     void update_page(Page *page, PageId new_page_id, frame_id_t new_frame_id);
+
+    bool need_flush_log(Page *page);
+
+    void wait_for_log(std::unique_lock<std::mutex> &lock, lsn_t lsn);
+
+    void write_page(Page *page);
 };
\ No newline at end of file
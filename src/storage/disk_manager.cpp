@@ -10,6 +10,8 @@ See the Mulan PSL v2 for more details. */
 
 #include "storage/disk_manager.h"
 
+#include <dirent.h>    // for opendir
+#include <algorithm>
 #include <cassert>    // for assert
 #include <cstring>    // for memset
 #include <sys/stat.h>  // for stat
@@ -63,6 +65,15 @@ void DiskManager::read_page(int fd, page_id_t page_no, char *offset, int num_byt
     }
 }
 
+/**
+ * @description: 提示内核异步预读指定页面，不等待读取完成，失败时忽略
+ * @param {int} fd 磁盘文件的文件句柄
+ * @param {page_id_t} page_no 要预读的页面号
+ */
+void DiskManager::prefetch_page(int fd, page_id_t page_no) {
+    posix_fadvise(fd, (off_t) page_no * PAGE_SIZE, PAGE_SIZE, POSIX_FADV_WILLNEED);
+}
+
 /**
  * @description: 分配一个新的页号
  * @return {page_id_t} 分配的新页号
@@ -232,28 +243,30 @@ int DiskManager::get_file_fd(const std::string &file_name) {
 
 
 /**
- * @description:  读取日志文件内容
+ * @description:  读取日志文件内容，日志由归档的日志段和当前日志文件依次拼接而成，一次读取不跨越日志段
  * @return {int} 返回读取的数据量，若为-1说明读取数据的起始位置超过了文件大小
  * @param {char} *log_data 读取内容到log_data中
  * @param {int} size 读取的数据量大小
- * @param {int} offset 读取的内容在文件中的位置
+ * @param {int} offset 读取的内容在拼接后的日志中的位置
  */
 int DiskManager::read_log(char *log_data, int size, int offset) {
-    // read log file from the previous end
-    if (log_fd_ == -1) {
-        log_fd_ = open_file(LOG_FILE_NAME);
-    }
-    int file_size = get_file_size(LOG_FILE_NAME);
-    if (offset > file_size) {
-        return -1;
+    for (const auto &segment: get_log_segments()) {
+        int file_size = get_file_size(segment);
+        if (offset >= file_size) {
+            offset -= file_size;
+            continue;
+        }
+        size = std::min(size, file_size - offset);
+        int fd = open(segment.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw UnixError();
+        }
+        ssize_t bytes_read = pread(fd, log_data, size, offset);
+        close(fd);
+        assert(bytes_read == size);
+        return bytes_read;
     }
-
-    size = std::min(size, file_size - offset);
-    if (size == 0) return 0;
-    lseek(log_fd_, offset, SEEK_SET);
-    ssize_t bytes_read = read(log_fd_, log_data, size);
-    assert(bytes_read == size);
-    return bytes_read;
+    return offset == 0 ? 0 : -1;
 }
 
 
@@ -263,8 +276,12 @@ int DiskManager::read_log(char *log_data, int size, int offset) {
  * @param {int} size 要写入的内容大小
  */
 void DiskManager::write_log(char *log_data, int size) {
+    // 日志文件只由日志写线程访问，不登记到文件打开列表中
     if (log_fd_ == -1) {
-        log_fd_ = open_file(LOG_FILE_NAME);
+        log_fd_ = open(LOG_FILE_NAME.c_str(), O_RDWR | O_CREAT, 0600);
+        if (log_fd_ < 0) {
+            throw UnixError();
+        }
     }
 
     // write from the file_end
@@ -273,4 +290,105 @@ void DiskManager::write_log(char *log_data, int size) {
     if (bytes_write != size) {
         throw UnixError();
     }
-}
\ No newline at end of file
+    // 日志需要真正落盘后事务才能提交
+    if (fdatasync(log_fd_) != 0) {
+        throw UnixError();
+    }
+}
+
+/**
+ * @description: 把当前日志文件归档为一个日志段（LOG_FILE_NAME.<段中最后一条日志的lsn>），之后的日志写入新的日志文件
+ * @param {lsn_t} last_lsn 当前日志文件中最后一条日志的lsn
+ */
+void DiskManager::switch_log(lsn_t last_lsn) {
+    if (log_fd_ != -1) {
+        close(log_fd_);
+        log_fd_ = -1;
+    }
+    if (rename(LOG_FILE_NAME.c_str(), (LOG_FILE_NAME + "." + std::to_string(last_lsn)).c_str()) != 0) {
+        throw UnixError();
+    }
+}
+
+/**
+ * @description: 把当前日志文件截断为size字节。恢复时丢弃日志尾部写到一半或无法识别的内容，
+ * 之后的日志从文件末尾写入，紧接在最后一条有效的日志之后
+ * @param {size_t} size 有效日志的长度
+ */
+void DiskManager::truncate_log(size_t size) {
+    if (truncate(LOG_FILE_NAME.c_str(), (off_t) size) != 0) {
+        throw UnixError();
+    }
+}
+
+/**
+ * @description: 获取所有日志段，按日志的先后顺序排列，当前日志文件在最后
+ * @return {vector<string>} 日志段的文件名
+ */
+std::vector<std::string> DiskManager::get_log_segments() {
+    std::vector<std::string> segments;
+    for (auto &[last_lsn, name]: list_archived_logs()) {
+        segments.push_back(name);
+    }
+    if (is_file(LOG_FILE_NAME)) {
+        segments.push_back(LOG_FILE_NAME);
+    }
+    return segments;
+}
+
+/**
+ * @description: 删除不再需要的归档日志段，即段中所有日志的lsn都小于lsn
+ * @param {lsn_t} lsn 恢复时需要的最早的日志
+ */
+void DiskManager::remove_log_segments(lsn_t lsn) {
+    for (auto &[last_lsn, name]: list_archived_logs()) {
+        if (last_lsn < lsn && unlink(name.c_str()) != 0) {
+            throw UnixError();
+        }
+    }
+}
+
+/**
+ * @description: 把文件已写入的内容持久化到磁盘
+ * @param {int} fd 文件句柄
+ */
+void DiskManager::sync_file(int fd) {
+    if (fdatasync(fd) != 0) {
+        throw UnixError();
+    }
+}
+
+/**
+ * @description: 把文件截断为前num_pages个页面，之后从num_pages开始重新分配页号
+ * @param {int} fd 文件句柄
+ * @param {page_id_t} num_pages 保留的页面个数
+ */
+void DiskManager::truncate_file(int fd, page_id_t num_pages) {
+    assert(fd >= 0 && fd < MAX_FD);
+    if (ftruncate(fd, (off_t) num_pages * PAGE_SIZE) != 0) {
+        throw UnixError();
+    }
+    fd2pageno_[fd] = num_pages;
+}
+
+/**
+ * @description: 列出当前目录下所有归档的日志段，按段中最后一条日志的lsn排序
+ */
+std::vector<std::pair<lsn_t, std::string>> DiskManager::list_archived_logs() {
+    std::vector<std::pair<lsn_t, std::string>> archived;
+    std::string prefix = LOG_FILE_NAME + ".";
+    DIR *dir = opendir(".");
+    if (dir == nullptr) {
+        throw UnixError();
+    }
+    while (auto *entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+        std::string suffix = name.substr(prefix.size());
+        if (!std::all_of(suffix.begin(), suffix.end(), ::isdigit)) continue;
+        archived.emplace_back(std::stoi(suffix), name);
+    }
+    closedir(dir);
+    std::sort(archived.begin(), archived.end());
+    return archived;
+}
@@ -19,6 +19,7 @@ See the Mulan PSL v2 for more details. */
 #include <iostream>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "common/config.h"
 #include "errors.h"
@@ -36,6 +37,8 @@ public:
 
     void read_page(int fd, page_id_t page_no, char *offset, int num_bytes);
 
+    void prefetch_page(int fd, page_id_t page_no);
+
     page_id_t allocate_page(int fd);
 
     void deallocate_page(page_id_t page_id);
@@ -69,6 +72,18 @@ public:
 
     void write_log(char *log_data, int size);
 
+    void switch_log(lsn_t last_lsn);
+
+    void truncate_log(size_t size);
+
+    std::vector<std::string> get_log_segments();
+
+    void remove_log_segments(lsn_t lsn);
+
+    void sync_file(int fd);
+
+    void truncate_file(int fd, page_id_t num_pages);
+
     void SetLogFd(int log_fd) { log_fd_ = log_fd; }
 
     int GetLogFd() { return log_fd_; }
@@ -90,6 +105,8 @@ public:
     static constexpr int MAX_FD = 8192;
 
 private:
+    std::vector<std::pair<lsn_t, std::string>> list_archived_logs();
+
     // 文件打开列表，用于记录文件是否被打开
     std::unordered_map<std::string, int> path2fd_;  //<Page文件磁盘路径,Page fd>哈希表
     std::unordered_map<int, std::string> fd2path_;  //<Page fd,Page文件磁盘路径>哈希表
@@ -87,6 +87,9 @@ private:
     /** 脏页判断 */
     bool is_dirty_ = false;
 
+    /** 页面变脏时的page lsn，即写回磁盘后第一个修改该页面的日志，用于检查点记录脏页表 */
+    lsn_t rec_lsn_ = INVALID_LSN;
+
     /** The pin count of this page. */
     int pin_count_ = 0;
 };
\ No newline at end of file
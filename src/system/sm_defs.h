@@ -11,3 +11,6 @@ See the Mulan PSL v2 for more details. */
 
 #include "defs.h"
 #include <string>
+
+// 并行导入时数据文件按行切分成块，每个线程每次解析一块
+static constexpr int LOAD_CHUNK_SIZE = 4 * 1024 * 1024;
@@ -10,10 +10,14 @@ See the Mulan PSL v2 for more details. */
 
 #include "sm_manager.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <charconv>
 #include <fstream>
+#include <thread>
 
 #include "index/ix.h"
 #include "record/rm.h"
@@ -112,6 +116,34 @@ void SmManager::flush_meta() {
     ofs << db_;
 }
 
+/**
+ * @description: 把所有打开的表和索引的file header写回磁盘，用于检查点
+ * 表文件中新分配、还未写回的页面先写回磁盘，保证file header中记录的页面都在磁盘上
+ */
+void SmManager::flush_file_hdrs() {
+    for (auto &fh: fhs_) {
+        int fd = fh.second->GetFd();
+        int disk_pages = disk_manager_->get_file_size(disk_manager_->get_file_name(fd)) / PAGE_SIZE;
+        buffer_pool_manager_->flush_pages_from(fd, disk_pages);
+        rm_manager_->flush_file_hdr(fh.second.get());
+    }
+    for (auto &ih: ihs_) {
+        ix_manager_->flush_index_hdr(ih.second.get());
+    }
+}
+
+/**
+ * @description: 把所有打开的表和索引文件已写入的内容持久化到磁盘
+ */
+void SmManager::sync_files() {
+    for (auto &fh: fhs_) {
+        disk_manager_->sync_file(fh.second->GetFd());
+    }
+    for (auto &ih: ihs_) {
+        disk_manager_->sync_file(ih.second->get_fd());
+    }
+}
+
 /**
  * @description: 关闭数据库并把数据落盘
  */
@@ -193,6 +225,7 @@ void SmManager::create_table(const std::string &tab_name, const std::vector<ColD
     int curr_offset = 0;
     TabMeta tab;
     tab.name = tab_name;
+    tab.id = db_.alloc_id();
     for (auto &col_def: col_defs) {
         ColMeta col = {.tab_name = tab_name,
                 .name = col_def.name,
@@ -231,6 +264,9 @@ void SmManager::drop_table(const std::string &tab_name, Context *context) {
         drop_index(tab_name, col_names, context);
     }
     if (fhs_.count(tab_name)) {// 说明被打开了
+        if (context != nullptr && context->version_store_ != nullptr) {
+            context->version_store_->drop_table(fhs_[tab_name]->GetFd());
+        }
         rm_manager_->close_file(fhs_[tab_name].get());
         fhs_.erase(tab_name);
     }
@@ -245,8 +281,11 @@ void SmManager::drop_table(const std::string &tab_name, Context *context) {
  * @param {string&} tab_name 表的名称
  * @param {vector<string>&} col_names 索引包含的字段名称
  * @param {Context*} context
+ * @param {bool} unique 是否为唯一索引
+ * @param {vector<string>&} include_col_names INCLUDE字段名称，只随索引项存放，不参与比较
  */
-void SmManager::create_index(const std::string &tab_name, const std::vector<std::string> &col_names, Context *context) {
+void SmManager::create_index(const std::string &tab_name, const std::vector<std::string> &col_names, Context *context,
+                             bool unique, const std::vector<std::string> &include_col_names) {
     std::vector<ColMeta> cols;
     TabMeta &tab = db_.get_table(tab_name);
     int tot_len = 0;
@@ -255,13 +294,23 @@ void SmManager::create_index(const std::string &tab_name, const std::vector<std:
         cols.push_back(col);
         tot_len += col.len;
     }
-    ix_manager_->create_index(tab_name, cols);
+    std::vector<ColMeta> include_cols;
+    for (const auto &i: include_col_names) {
+        auto col = *tab.get_col(i);
+        // 已经是索引字段的无需重复存放
+        if (std::find(col_names.begin(), col_names.end(), i) != col_names.end()) continue;
+        include_cols.push_back(col);
+    }
+    ix_manager_->create_index(tab_name, cols, unique, include_cols);
     auto ix_name = ix_manager_->get_index_name(tab_name, cols);
     IndexMeta im = {
             .tab_name = tab_name,
             .col_tot_len = tot_len,
             .col_num = (int) col_names.size(),
             .cols = cols,
+            .unique = unique,
+            .include_cols = include_cols,
+            .id = db_.alloc_id(),
     };
     tab.indexes.push_back(im);
     ihs_.emplace(ix_name, ix_manager_->open_index(tab_name, cols));
@@ -278,20 +327,14 @@ void SmManager::create_index(const std::string &tab_name, const std::vector<std:
     while (!scan_->is_end()) {
         auto rid_ = scan_->rid();
         auto rec = rfh->get_record(rid_, context);
-        char *key = new char[tot_len];
-        int offset = 0;
-        for (auto &col: cols) {
-            memcpy(key + offset, rec->data + col.offset, col.len);
-            offset += col.len;
-        }
+        char *key = new char[im.entry_len()];
+        im.get_key(rec->data, key);
 
-        //更新索引插入日志
-        auto *index_log = new IndexInsertLogRecord(context->txn_->get_transaction_id(), key, rid_, ix_name, tot_len);
-        index_log->prev_lsn_ = context->txn_->get_prev_lsn();
-        context->log_mgr_->add_log_to_buffer_load(index_log);
-        context->txn_->set_prev_lsn(index_log->lsn_);
+        //写索引插入日志，由索引在修改完页面后调用
+        auto logger = context->index_logger(LogType::INDEX_INSERT, key, rid_, im.id, im.entry_len());
 
-        auto result = ih->insert_entry(key, rid_, context->txn_);
+        auto result = ih->insert_entry(key, rid_, context->txn_, logger);
+        delete[] key;
         if (!result.second) {
             //说明不满足唯一性，插入失败，需要rollback
             is_fail = true;
@@ -326,6 +369,7 @@ void SmManager::drop_index(const std::string &tab_name, const std::vector<std::s
     tab.indexes.erase(pos);
     auto ix_name = ix_manager_->get_index_name(tab_name, cols);
     if (ihs_.count(ix_name)) {// 说明被打开了
+        buffer_pool_manager_->discard_all_pages(ihs_[ix_name]->get_fd());
         disk_manager_->close_file(ihs_[ix_name]->get_fd());
         ihs_.erase(ix_name);
     }
@@ -345,8 +389,8 @@ void SmManager::drop_index(const std::string &tab_name, const std::vector<ColMet
     for (const auto &col: cols) {
         tot_len += col.len;
     }
-    IndexMeta im = {tab_name, tot_len, (int) cols.size(), cols};
-    auto pos = std::find(tab.indexes.begin(), tab.indexes.end(), im);
+    auto pos = std::find(tab.indexes.begin(), tab.indexes.end(), IndexMeta{tab_name, tot_len, (int) cols.size(), cols});
+    IndexMeta im = *pos;
     tab.indexes.erase(pos);
     auto ix_name = ix_manager_->get_index_name(tab_name, im.cols);
     if (!ihs_.count(ix_name)) {
@@ -364,16 +408,14 @@ void SmManager::drop_index(const std::string &tab_name, const std::vector<ColMet
     while (!scan_->is_end()) {
         auto rid_ = scan_->rid();
         auto rec = rfh->get_record(rid_, context);
-        char *key = new char[tot_len];
-        int offset = 0;
-        for (auto &col: im.cols) {
-            memcpy(key + offset, rec->data + col.offset, col.len);
-            offset += col.len;
-        }
-        ih->delete_entry(key, context->txn_);
+        char *key = new char[im.entry_len()];
+        im.get_key(rec->data, key);
+        ih->delete_entry(key, rid_, context->txn_);
+        delete[] key;
         scan_->next();
     }
     if (ihs_.count(ix_name)) {// 说明被打开了
+        buffer_pool_manager_->discard_all_pages(ihs_[ix_name]->get_fd());
         disk_manager_->close_file(ihs_[ix_name]->get_fd());
         ihs_.erase(ix_name);
     }
@@ -397,10 +439,19 @@ void SmManager::show_index(const std::string &tab_name, Context *context) {
         }
         if (col.back() == ',') col.pop_back();
         col += ")";
-        std::vector<std::string> v = {tab_name, "unique", col};
+        if (!i.include_cols.empty()) {
+            col += " include(";
+            for (const auto &j: i.include_cols) {
+                col += j.name + ",";
+            }
+            col.pop_back();
+            col += ")";
+        }
+        std::string kind = i.unique ? "unique" : "non_unique";
+        std::vector<std::string> v = {tab_name, kind, col};
         printer.print_record(v, context);
         if (!context->output_ellipsis_) {
-            outfile << "| " << tab_name << " | unique | " << col << " |\n";
+            outfile << "| " << tab_name << " | " << kind << " | " << col << " |\n";
         }
     }
     printer.print_separator(context);
@@ -409,91 +460,192 @@ void SmManager::show_index(const std::string &tab_name, Context *context) {
     }
 }
 
-//读取数据
-void SmManager::load_record(const std::string &file_name, const std::string &tab_name, Context *context) {
-    std::string path, input;
-    path += file_name;// 路径
-    std::fstream ifs;// 文件读取流
-    ifs.open(path.c_str(), std::ios::in);
-    assert(fhs_.count(tab_name));
-    auto rfh = fhs_[tab_name].get();
-    auto &tab_info = db_.get_table(tab_name);
-    const std::streamsize buffer_size = 1024 * 1024;
-    char* buffer = new char[buffer_size];
-    ifs.rdbuf()->pubsetbuf(buffer,buffer_size);
-    getline(ifs, input);// 读入表头
-    while (getline(ifs, input)) {
-        RmRecord rec(rfh->get_file_hdr().record_size);// 数据
-        std::string values, value;
-        std::istringstream sin;
-        sin.str(input);
-        int cnt = 0;
-        while (std::getline(sin, value, ',')) { //将字符串流sin中的字符读到field字符串中，以逗号为分隔符
-            Value x;// 构造数据
-            auto &col = tab_info.cols[cnt];
-            switch (col.type) {
-                case TYPE_INT: {
-                    x.set_int(std::stoi(value));
-                    break;
-                }
-                case TYPE_FLOAT: {
-                    x.set_float(std::stof(value));
-                    break;
-                }
-                case TYPE_BIGINT: {
-                    x.set_bigint(std::stoll(value));
-                    break;
-                }
-                case TYPE_STRING: {
-                    x.set_str(value);
-                    break;
-                }
-                case TYPE_DATETIME: {
-                    long long datetime = 0;
-                    for (auto ch: value) {
-                        if (ch >= '0' && ch <= '9') {
-                            datetime = datetime * 10 + ch - '0';
+/**
+ * @description: 解析一个数值字段，字段不是合法的数值时抛出异常
+ */
+template <typename T>
+static void parse_number(const char *first, const char *last, const ColMeta &col, char *dest) {
+    T val{};
+    auto res = std::from_chars(first, last, val);
+    if (res.ec != std::errc()) {
+        throw IncompatibleTypeError(coltype2str(col.type), std::string(first, last));
+    }
+    memcpy(dest, &val, sizeof(T));
+}
+
+/**
+ * @description: 解析数据文件中[begin, end)范围内的行，每行按表的记录格式追加到rows中
+ * @param {vector<ColMeta>&} cols 表的字段
+ * @param {int} record_size 记录的长度
+ * @param {vector<char>*} rows 传出解析出的记录，按record_size连续存放
+ */
+static void parse_csv_rows(const char *begin, const char *end, const std::vector<ColMeta> &cols, int record_size,
+                           std::vector<char> *rows) {
+    while (begin < end) {
+        auto line_end = static_cast<const char *>(memchr(begin, '\n', end - begin));
+        if (line_end == nullptr) line_end = end;
+        const char *last = line_end;
+        if (last > begin && last[-1] == '\r') last--;
+        if (last > begin) {
+            // resize后新记录全为0，字符串字段不足的部分不需要再填充
+            rows->resize(rows->size() + record_size);
+            char *rec = rows->data() + rows->size() - record_size;
+            const char *field = begin;
+            for (auto &col: cols) {
+                auto field_end = static_cast<const char *>(memchr(field, ',', last - field));
+                if (field_end == nullptr) field_end = last;
+                char *dest = rec + col.offset;
+                switch (col.type) {
+                    case TYPE_INT:
+                        parse_number<int>(field, field_end, col, dest);
+                        break;
+                    case TYPE_FLOAT:
+                        parse_number<double>(field, field_end, col, dest);
+                        break;
+                    case TYPE_BIGINT:
+                        parse_number<long long>(field, field_end, col, dest);
+                        break;
+                    case TYPE_STRING:
+                        if (field_end - field > col.len) {
+                            throw StringOverflowError();
+                        }
+                        memcpy(dest, field, field_end - field);
+                        break;
+                    case TYPE_DATETIME: {
+                        long long datetime = 0;
+                        for (const char *ch = field; ch < field_end; ch++) {
+                            if (*ch >= '0' && *ch <= '9') {
+                                datetime = datetime * 10 + *ch - '0';
+                            }
                         }
+                        memcpy(dest, &datetime, sizeof(datetime));
+                        break;
                     }
-                    x.set_datetime(datetime);
-                    break;
                 }
+                field = field_end < last ? field_end + 1 : last;
             }
-            x.init_raw(col.len);
-            cnt++;
-            memcpy(rec.data + col.offset, x.raw->data, col.len);
         }
-        //实际插入
-        auto rid_ = rfh->insert_record(rec.data, context);
-        //更新日志-插入
-        auto *logRecord = new InsertLogRecord(context->txn_->get_transaction_id(), rec, rid_, tab_name);
-        logRecord->prev_lsn_ = context->txn_->get_prev_lsn();
-        context->log_mgr_->add_log_to_buffer_load(logRecord);
-        context->txn_->set_prev_lsn(logRecord->lsn_);
-        // 更新索引
-        for (auto & index : tab_info.indexes) {
-            auto ix_name = get_ix_manager()->get_index_name(tab_name, index.cols);
-            auto ih = ihs_.at(ix_name).get();
-            char *key = new char[index.col_tot_len];
-            int offset = 0;
-            for (size_t j = 0; j < index.col_num; ++j) {
-                memcpy(key + offset, rec.data + index.cols[j].offset, index.cols[j].len);
-                offset += index.cols[j].len;
-            }
+        begin = line_end + 1;
+    }
+}
 
-            //更新索引插入日志
-            auto *index_log = new IndexInsertLogRecord(context->txn_->get_transaction_id(), key, rid_, ix_name,
-                                                       index.col_tot_len);
-            index_log->prev_lsn_ = context->txn_->get_prev_lsn();
-            context->log_mgr_->add_log_to_buffer_load(index_log);
-            context->txn_->set_prev_lsn(index_log->lsn_);
+/**
+ * @description: 批量导入数据。数据文件只读映射到内存中，按行切分成块由多个线程并行解析成记录，
+ * 记录按文件中的顺序整页写入导入时新分配的页面。只写一条批量导入日志代替逐条的insert日志，
+ * 写集合中也只有一项；新页面在语句结束时写回磁盘，回滚时截断这些页面。索引项仍逐条写日志
+ * @param {string&} file_name 数据文件
+ * @param {string&} tab_name 导入的表
+ * @param {Context*} context
+ */
+void SmManager::load_record(const std::string &file_name, const std::string &tab_name, Context *context) {
+    assert(fhs_.count(tab_name));
+    auto rfh = fhs_[tab_name].get();
+    auto &tab_info = db_.get_table(tab_name);
+    int record_size = rfh->get_file_hdr().record_size;
 
-            ih->insert_entry(key, rid_, context->txn_);
-            free(key);
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw FileNotFoundError(file_name);
+    }
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        throw UnixError();
+    }
+    size_t size = st.st_size;
+    const char *data = nullptr;
+    if (size > 0) {
+        void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            close(fd);
+            throw UnixError();
         }
-        //更新事务
-        auto *wr = new WriteRecord(WType::INSERT_TUPLE, tab_name, rid_, rec);
-        context->txn_->append_write_record(wr);
+        madvise(addr, size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(addr);
+    }
+    close(fd);
+
+    // 跳过表头，按LOAD_CHUNK_SIZE切分成块，块的边界对齐到行尾；第i块为[chunks[i], chunks[i + 1])
+    const char *end = data + size;
+    auto next_line = [end](const char *pos) {
+        auto line_end = static_cast<const char *>(memchr(pos, '\n', end - pos));
+        return line_end == nullptr ? end : line_end + 1;
+    };
+    std::vector<const char *> chunks;
+    for (const char *pos = data == nullptr ? end : next_line(data); pos < end;) {
+        chunks.push_back(pos);
+        pos = end - pos > LOAD_CHUNK_SIZE ? next_line(pos + LOAD_CHUNK_SIZE) : end;
     }
-    ifs.close();
+    chunks.push_back(end);
+
+    context->lock_mgr_->lock_exclusive_on_table(context->txn_, rfh->GetFd());
+    int first_page = rfh->get_file_hdr().num_pages;
+    BulkLoadLogRecord load_log(context->txn_->get_transaction_id(), tab_info.id, first_page);
+    load_log.prev_lsn_ = context->txn_->get_prev_lsn();
+    context->log_mgr_->add_log_to_buffer(&load_log);
+    context->txn_->set_prev_lsn(load_log.lsn_);
+    context->txn_->append_write_record(WType::BULK_LOAD, tab_name, Rid{first_page, -1});
+    if (context->version_store_ != nullptr) {
+        // 快照读不加表锁，导入提交之前新页面上的记录对它们不可见
+        context->version_store_->add_bulk_load(rfh->GetFd(), first_page, context->txn_);
+    }
+
+    size_t num_chunks = chunks.size() - 1;
+    size_t thread_num = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), num_chunks);
+    std::vector<Rid> rids;
+    std::vector<char> key;
+    try {
+        // 每一轮由thread_num个线程各解析一块，再按块的顺序写入页面和索引
+        for (size_t wave = 0; wave < num_chunks; wave += thread_num) {
+            size_t wave_size = std::min(thread_num, num_chunks - wave);
+            std::vector<std::vector<char>> rows(wave_size);
+            std::vector<std::exception_ptr> errors(wave_size);
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < wave_size; i++) {
+                workers.emplace_back([&, i] {
+                    try {
+                        parse_csv_rows(chunks[wave + i], chunks[wave + i + 1], tab_info.cols, record_size, &rows[i]);
+                    } catch (...) {
+                        errors[i] = std::current_exception();
+                    }
+                });
+            }
+            for (auto &worker: workers) {
+                worker.join();
+            }
+            for (auto &error: errors) {
+                if (error) std::rethrow_exception(error);
+            }
+            for (auto &chunk_rows: rows) {
+                int num_rows = static_cast<int>(chunk_rows.size() / record_size);
+                rids.clear();
+                rfh->append_records(chunk_rows.data(), num_rows, first_page, load_log.lsn_, &rids);
+                for (auto &index: tab_info.indexes) {
+                    auto ix_name = get_ix_manager()->get_index_name(tab_name, index.cols);
+                    auto ih = ihs_.at(ix_name).get();
+                    key.resize(index.entry_len());
+                    for (int i = 0; i < num_rows; i++) {
+                        index.get_key(chunk_rows.data() + (size_t) i * record_size, key.data());
+                        //写索引插入日志，由索引在修改完页面后调用
+                        auto logger = context->index_logger(LogType::INDEX_INSERT, key.data(), rids[i], index.id,
+                                                            index.entry_len());
+                        auto result = ih->insert_entry(key.data(), rids[i], context->txn_, logger);
+                        if (!result.second) {
+                            // 与唯一索引中已有的键重复，回滚整个事务：删除已经插入的索引项并截断新页面
+                            throw TransactionAbortException(context->txn_->get_transaction_id(),
+                                                            AbortReason::UNIQUE_VIOLATION);
+                        }
+                    }
+                }
+            }
+        }
+    } catch (...) {
+        if (data != nullptr) munmap(const_cast<char *>(data), size);
+        throw;
+    }
+    if (data != nullptr) munmap(const_cast<char *>(data), size);
+    // 新页面上的记录没有日志，在事务提交之前写回磁盘；页面的page lsn是批量导入日志，写回前该日志已经落盘
+    buffer_pool_manager_->flush_pages_from(rfh->GetFd(), first_page);
+    rm_manager_->flush_file_hdr(rfh);
+    disk_manager_->sync_file(rfh->GetFd());
 }
@@ -64,6 +64,10 @@ class SmManager {
 
     void flush_meta();
 
+    void flush_file_hdrs();
+
+    void sync_files();
+
     void show_tables(Context* context);
 
     void show_index(const std::string & tab_name, Context* context);
@@ -74,7 +78,8 @@ class SmManager {
 
     void drop_table(const std::string& tab_name, Context* context);
 
-    void create_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context);
+    void create_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context,
+                      bool unique = true, const std::vector<std::string>& include_col_names = {});
 
     void drop_index(const std::string& tab_name, const std::vector<std::string>& col_names, Context* context);
     
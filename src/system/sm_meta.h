@@ -11,6 +11,7 @@ See the Mulan PSL v2 for more details. */
 #pragma once
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <string>
@@ -45,12 +46,50 @@ struct IndexMeta {
     int col_tot_len;                // 索引字段长度总和
     int col_num;                    // 索引字段数量
     std::vector<ColMeta> cols;      // 索引包含的字段
+    bool unique = true;             // 是否为唯一索引
+    std::vector<ColMeta> include_cols;  // INCLUDE字段，跟随索引字段存放在叶子中，用于index-only scan
+    int id = -1;                    // 索引的id，与表的id统一分配，日志中用id代替索引名
+
+    /* 索引项长度：索引字段 + INCLUDE字段 */
+    int entry_len() const {
+        int len = col_tot_len;
+        for (auto &col: include_cols) len += col.len;
+        return len;
+    }
+
+    /* 从记录rec中取出索引项（索引字段 + INCLUDE字段）存放到key中 */
+    void get_key(const char *rec, char *key) const {
+        int offset = 0;
+        for (auto &col: cols) {
+            memcpy(key + offset, rec + col.offset, col.len);
+            offset += col.len;
+        }
+        for (auto &col: include_cols) {
+            memcpy(key + offset, rec + col.offset, col.len);
+            offset += col.len;
+        }
+    }
+
+    /* 判断字段col_name是否存放在索引项中 */
+    bool covers(const std::string &col_name) const {
+        for (auto &col: cols) {
+            if (col.name == col_name) return true;
+        }
+        for (auto &col: include_cols) {
+            if (col.name == col_name) return true;
+        }
+        return false;
+    }
 
     friend std::ostream &operator<<(std::ostream &os, const IndexMeta &index) {
-        os << index.tab_name << " " << index.col_tot_len << " " << index.col_num;
+        os << index.tab_name << " " << index.col_tot_len << " " << index.col_num << " " << index.unique << " "
+           << index.include_cols.size() << " " << index.id;
         for(auto& col: index.cols) {
             os << "\n" << col;
         }
+        for(auto& col: index.include_cols) {
+            os << "\n" << col;
+        }
         return os;
     }
 
@@ -72,12 +111,18 @@ struct IndexMeta {
     }
 
     friend std::istream &operator>>(std::istream &is, IndexMeta &index) {
-        is >> index.tab_name >> index.col_tot_len >> index.col_num;
+        size_t include_num;
+        is >> index.tab_name >> index.col_tot_len >> index.col_num >> index.unique >> include_num >> index.id;
         for(int i = 0; i < index.col_num; ++i) {
             ColMeta col;
             is >> col;
             index.cols.push_back(col);
         }
+        for(size_t i = 0; i < include_num; ++i) {
+            ColMeta col;
+            is >> col;
+            index.include_cols.push_back(col);
+        }
         return is;
     }
 };
@@ -87,11 +132,13 @@ struct TabMeta {
     std::string name;                   // 表名称
     std::vector<ColMeta> cols;          // 表包含的字段
     std::vector<IndexMeta> indexes;     // 表上建立的索引
+    int id = -1;                        // 表的id，日志中用id代替表名
 
     TabMeta(){}
 
     TabMeta(const TabMeta &other) {
         name = other.name;
+        id = other.id;
         for(auto col : other.cols) cols.push_back(col);
     }
 
@@ -142,7 +189,7 @@ struct TabMeta {
     }
 
     friend std::ostream &operator<<(std::ostream &os, const TabMeta &tab) {
-        os << tab.name << '\n' << tab.cols.size() << '\n';
+        os << tab.name << ' ' << tab.id << '\n' << tab.cols.size() << '\n';
         for (auto &col : tab.cols) {
             os << col << '\n';  // col是ColMeta类型，然后调用重载的ColMeta的操作符<<
         }
@@ -155,7 +202,7 @@ struct TabMeta {
 
     friend std::istream &operator>>(std::istream &is, TabMeta &tab) {
         size_t n;
-        is >> tab.name >> n;
+        is >> tab.name >> tab.id >> n;
         for (size_t i = 0; i < n; i++) {
             ColMeta col;
             is >> col;
@@ -179,6 +226,7 @@ class DbMeta {
    private:
     std::string name_;                      // 数据库名称
     std::map<std::string, TabMeta> tabs_;   // 数据库中包含的表
+    int next_id_ = 0;                       // 下一个分配给表或索引的id，id不会重复使用
 
    public:
     // DbMeta(std::string name) : name_(name) {}
@@ -190,6 +238,11 @@ class DbMeta {
         tabs_[tab_name] = meta;
     }
 
+    const std::map<std::string, TabMeta> &get_tables() const { return tabs_; }
+
+    /* 分配一个新的表或索引id */
+    int alloc_id() { return next_id_++; }
+
     /* 获取指定名称表的元数据 */
     TabMeta &get_table(const std::string &tab_name) {
         auto pos = tabs_.find(tab_name);
@@ -202,7 +255,7 @@ class DbMeta {
 
     // 重载操作符 <<
     friend std::ostream &operator<<(std::ostream &os, const DbMeta &db_meta) {
-        os << db_meta.name_ << '\n' << db_meta.tabs_.size() << '\n';
+        os << db_meta.name_ << ' ' << db_meta.next_id_ << '\n' << db_meta.tabs_.size() << '\n';
         for (auto &entry : db_meta.tabs_) {
             os << entry.second << '\n';
         }
@@ -211,7 +264,7 @@ class DbMeta {
 
     friend std::istream &operator>>(std::istream &is, DbMeta &db_meta) {
         size_t n;
-        is >> db_meta.name_ >> n;
+        is >> db_meta.name_ >> db_meta.next_id_ >> n;
         for (size_t i = 0; i < n; i++) {
             TabMeta tab;
             is >> tab;
@@ -10,6 +10,22 @@ See the Mulan PSL v2 for more details. */
 
 #include "lock_manager.h"
 
+#include <map>
+#include <set>
+#include <string_view>
+
+std::chrono::milliseconds cycle_detection_interval = std::chrono::milliseconds(50);
+std::atomic<int> lock_escalation_threshold = 5000;
+
+/* 锁模式的兼容矩阵，下标依次为SHARED、EXLUCSIVE、INTENTION_SHARED、INTENTION_EXCLUSIVE、S_IX */
+static constexpr bool LOCK_COMPATIBLE[5][5] = {
+    {true, false, true, false, false},
+    {false, false, false, false, false},
+    {true, false, true, true, true},
+    {false, false, true, true, false},
+    {false, false, true, false, false},
+};
+
 /**
  * @description: 申请行级共享锁
  * @return {bool} 加锁是否成功
@@ -18,82 +34,7 @@ See the Mulan PSL v2 for more details. */
  * @param {int} tab_fd
  */
 bool LockManager::lock_shared_on_record(Transaction *txn, const Rid &rid, int tab_fd) {
-    txn->set_state(TransactionState::GROWING);
-//    std::cout << txn->get_transaction_id() << "申请行级S锁" << rid.page_no << " " << rid.slot_no << " " << tab_fd
-//              << '\n';
-    std::unique_lock<std::mutex> lock(latch_);
-    // 获取队列
-    LockDataId lock_data_id_ = {tab_fd, rid, LockDataType::RECORD};
-    auto &request_queue_ = lock_table_[lock_data_id_];
-    bool ok = true;
-    for (auto i: request_queue_.request_queue_) {
-        if (i.txn_id_ == txn->get_transaction_id()) {
-//            std::cout << i.txn_id_ << " " << i.lock_mode_ << " " << i.granted_ << "\n";
-            //已有锁
-            if (i.granted_) return true;
-            //在等待状态
-            ok = false;
-            break;
-        }
-    }
-    if (ok) {
-        //需要加边(进入等待队列)
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::SHARED};
-        request_queue_.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id_);
-    }
-    lock.unlock();
-    while (true) {
-        lock.lock();
-        //判环
-        int flag = 0;
-//        if (!check_loop(txn)) {
-//            flag = 1;
-//        }
-        LockDataId lock_data_id_table = {tab_fd, LockDataType::TABLE};
-        auto &lock_request_queue = lock_table_[lock_data_id_table];
-
-        // 表上有X锁不能申请
-        for (auto &request: lock_request_queue.request_queue_) {
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.txn_id_ != txn->get_transaction_id() &&
-                request.granted_) {
-                flag = 1;
-                break;
-            }
-        }
-
-        // 行上有X锁不能申请
-        LockDataId lock_data_id = {tab_fd, rid, LockDataType::RECORD};
-        auto &request_queue = lock_table_[lock_data_id];
-
-        for (auto &request: request_queue.request_queue_) {
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.txn_id_ != txn->get_transaction_id() &&
-                request.granted_) {
-                flag = 1;
-                break;
-            }
-        }
-        if (flag) {
-//            lock.unlock();
-//            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::DEADLOCK_PREVENTION);
-        }
-        // 行上加S锁
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::SHARED};
-        if (request_queue.group_lock_mode_ == GroupLockMode::NON_LOCK) {
-            request_queue.group_lock_mode_ = GroupLockMode::S;
-        }
-        for (auto &request: request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) {
-                request.granted_ = true;
-                return true;
-            }
-        }
-        lock_request.granted_ = true;
-        request_queue.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id);
-        return true;
-    }
+    return lock_on_record(txn, rid, tab_fd, LockMode::SHARED);
 }
 
 /**
@@ -104,96 +45,7 @@ bool LockManager::lock_shared_on_record(Transaction *txn, const Rid &rid, int ta
  * @param {int} tab_fd 记录所在的表的fd
  */
 bool LockManager::lock_exclusive_on_record(Transaction *txn, const Rid &rid, int tab_fd) {
-    txn->set_state(TransactionState::GROWING);
-//    std::cout << txn->get_transaction_id() << "申请行级X锁" << rid.page_no << " " << rid.slot_no << " " << tab_fd
-//              << '\n';
-    std::unique_lock<std::mutex> lock(latch_);
-    // 获取队列
-    LockDataId lock_data_id_ = {tab_fd, rid, LockDataType::RECORD};
-    auto &request_queue_ = lock_table_[lock_data_id_];
-    bool ok = true;
-    for (auto &i: request_queue_.request_queue_) {
-        if (i.txn_id_ == txn->get_transaction_id()) {
-            if (i.granted_ && i.lock_mode_ == LockMode::EXLUCSIVE) {
-                return true;
-            }
-            i.granted_ = false;
-            ok = false;
-            break;
-        }
-    }
-    if (ok) {
-        //需要加边(进入等待队列)
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::EXLUCSIVE};
-        request_queue_.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id_);
-    }
-    lock.unlock();
-    while (true) {
-        lock.lock();
-        //判环
-        int flag = 0;
-//        if (!check_loop(txn)) {
-//            flag = 1;
-//        }
-        LockDataId lock_data_id_table = {tab_fd, LockDataType::TABLE};
-        auto &lock_request_queue = lock_table_[lock_data_id_table];
-
-        for (auto &request: lock_request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) continue;
-            // 表上有X锁不能申请
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.granted_) {
-                flag = 1;
-                break;
-            }
-            // 表上有S锁不能申请
-            if (request.lock_mode_ == LockMode::SHARED && request.granted_) {
-                flag = 1;
-                break;
-            }
-            // 表上有SIX锁不能申请
-            if (request.lock_mode_ == LockMode::S_IX && request.granted_) {
-                flag = 1;
-                break;
-            }
-        }
-
-        LockDataId lock_data_id = {tab_fd, rid, LockDataType::RECORD};
-        auto &request_queue = lock_table_[lock_data_id];
-        for (auto &request: request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) continue;
-            // 行上有S锁不能申请
-            if (request.lock_mode_ == LockMode::SHARED && request.granted_) {
-                flag = 1;
-                break;
-            }
-            // 行上有X锁不能申请
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.granted_) {
-                flag = 1;
-                break;
-            }
-        }
-
-        if (flag) {
-//            lock.unlock();
-//            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::DEADLOCK_PREVENTION);
-        }
-        // 行上加X锁
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::EXLUCSIVE};
-        request_queue.group_lock_mode_ = GroupLockMode::X;
-        for (auto &request: request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) {
-                request.lock_mode_ = LockMode::EXLUCSIVE;
-                request.granted_ = true;
-                return true;
-            }
-        }
-        lock_request.granted_ = true;
-        request_queue.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id);
-        return true;
-    }
+    return lock_on_record(txn, rid, tab_fd, LockMode::EXLUCSIVE);
 }
 
 /**
@@ -203,76 +55,7 @@ bool LockManager::lock_exclusive_on_record(Transaction *txn, const Rid &rid, int
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_shared_on_table(Transaction *txn, int tab_fd) {
-    txn->set_state(TransactionState::GROWING);
-//    std::cout << txn->get_transaction_id() << "申请表级S锁" << " " << tab_fd << '\n';
-    std::unique_lock<std::mutex> lock(latch_);
-    // 获取队列
-    LockDataId lock_data_id_table_ = {tab_fd, LockDataType::TABLE};
-    auto &request_queue_ = lock_table_[lock_data_id_table_];
-    bool ok = true;
-    for (auto i: request_queue_.request_queue_) {
-        if (i.txn_id_ == txn->get_transaction_id()) {
-            //已有锁
-            if (i.granted_) return true;
-            //在等待状态
-            ok = false;
-            break;
-        }
-    }
-    if (ok) {
-        //需要加边(进入等待队列)
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::SHARED};
-        request_queue_.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id_table_);
-    }
-    lock.unlock();
-    while (true) {
-        lock.lock();
-        //判环
-        int flag = 0;
-//        if (!check_loop(txn)) {
-//            flag = 1;
-//        }
-        LockDataId lock_data_id_table = {tab_fd, LockDataType::TABLE};
-        auto &lock_request_queue = lock_table_[lock_data_id_table];
-
-        for (auto &request: lock_request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) continue;
-            // 表上有IX锁不能申请
-            if (request.lock_mode_ == LockMode::INTENTION_EXCLUSIVE && request.granted_) {
-                flag = 1;
-                break;
-            }
-            // 表上有X锁不能申请
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.granted_) {
-                flag = 1;
-                break;
-            }
-        }
-
-        if (flag) {
-//            lock.unlock();
-//            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::DEADLOCK_PREVENTION);
-        }
-
-        // 表上加S锁
-        LockDataId lock_data_id = {tab_fd, LockDataType::TABLE};
-        auto &request_queue = lock_table_[lock_data_id];
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::SHARED};
-        if (request_queue.group_lock_mode_ == GroupLockMode::NON_LOCK)
-            request_queue.group_lock_mode_ = GroupLockMode::S;
-        for (auto &request: request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) {
-                request.granted_ = true;
-                return true;
-            }
-        }
-        lock_request.granted_ = true;
-        request_queue.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id);
-        return true;
-    }
+    return lock_on_table(txn, tab_fd, LockMode::SHARED);
 }
 
 /**
@@ -282,69 +65,7 @@ bool LockManager::lock_shared_on_table(Transaction *txn, int tab_fd) {
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_exclusive_on_table(Transaction *txn, int tab_fd) {
-    txn->set_state(TransactionState::GROWING);
-//    std::cout << txn->get_transaction_id() << "申请表级X锁" << " " << tab_fd << '\n';
-    std::unique_lock<std::mutex> lock(latch_);
-    // 获取队列
-    LockDataId lock_data_id_ = {tab_fd, LockDataType::TABLE};
-    auto &request_queue_ = lock_table_[lock_data_id_];
-    bool ok = true;
-    for (auto i: request_queue_.request_queue_) {
-        if (i.txn_id_ == txn->get_transaction_id()) {
-            if (i.granted_ && i.lock_mode_ == LockMode::EXLUCSIVE) {
-                return true;
-            }
-            i.granted_ = false;
-            ok = false;
-            break;
-        }
-    }
-    if (ok) {
-        //需要加边(进入等待队列)
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::EXLUCSIVE};
-        request_queue_.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id_);
-    }
-    lock.unlock();
-    while (true) {
-        lock.lock();
-        //判够吧环
-        int flag = 0;
-//        if (!check_loop(txn)) {
-//            flag = 1;
-//        }
-        LockDataId lock_data_id = {tab_fd, LockDataType::TABLE};
-        auto &request_queue = lock_table_[lock_data_id];
-        for (auto &request: request_queue.request_queue_) {
-            if (request.txn_id_ != txn->get_transaction_id()) {
-                //有人持有锁
-                if (request.lock_mode_ == LockMode::EXLUCSIVE && request.granted_) flag = 1;
-                if (request.lock_mode_ == LockMode::INTENTION_EXCLUSIVE && request.granted_) flag = 1;
-                if (request.lock_mode_ == LockMode::SHARED && request.granted_) flag = 1;
-                if (request.lock_mode_ == LockMode::INTENTION_SHARED && request.granted_) flag = 1;
-                if (request.lock_mode_ == LockMode::S_IX && request.granted_) flag = 1;
-            }
-        }
-        if (flag) {
-//            lock.unlock();
-//            std::this_thread::sleep_for(std::chrono::microseconds(100));
-            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::DEADLOCK_PREVENTION);
-        }
-        // 表上加X锁
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::EXLUCSIVE};
-        request_queue.group_lock_mode_ = GroupLockMode::X;
-        for (auto &request: request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) {
-                request.lock_mode_ = LockMode::EXLUCSIVE;
-                request.granted_ = true;
-                return true;
-            }
-        }
-        lock_request.granted_ = true;
-        request_queue.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id);
-        return true;
-    }
+    return lock_on_table(txn, tab_fd, LockMode::EXLUCSIVE);
 }
 
 /**
@@ -354,248 +75,508 @@ bool LockManager::lock_exclusive_on_table(Transaction *txn, int tab_fd) {
  * @param {int} tab_fd 目标表的fd
  */
 bool LockManager::lock_IS_on_table(Transaction *txn, int tab_fd) {
-    txn->set_state(TransactionState::GROWING);
+    return lock_on_table(txn, tab_fd, LockMode::INTENTION_SHARED);
+}
+
+/**
+ * @description: 申请表级意向写锁
+ * @return {bool} 返回加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {int} tab_fd 目标表的fd
+ */
+bool LockManager::lock_IX_on_table(Transaction *txn, int tab_fd) {
+    return lock_on_table(txn, tab_fd, LockMode::INTENTION_EXCLUSIVE);
+}
 
-//    std::cout << txn->get_transaction_id() << "申请表级IS锁" << " " << tab_fd << '\n';
-    std::unique_lock<std::mutex> lock(latch_);
-    // 获取队列
-    LockDataId lock_data_id_table_ = {tab_fd, LockDataType::TABLE};
-    auto &request_queue_ = lock_table_[lock_data_id_table_];
-    bool ok = true;
-    for (auto i: request_queue_.request_queue_) {
-        if (i.txn_id_ == txn->get_transaction_id()) {
-            //已有锁
-            if (i.granted_) return true;
-            //在等待状态
-            ok = false;
-            break;
+/**
+ * @description: 申请索引键上的排他锁。插入、删除和更新索引项之前对涉及的键加锁，
+ * 其他事务插入被删除但尚未提交的键、或插入相同的键时会发生冲突，回滚时重新插入的键不会违反唯一性
+ * @return {bool} 加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {int} index_id 索引的id
+ * @param {char*} key 索引键
+ * @param {int} key_len 索引字段的长度（col_tot_len），不包括INCLUDE字段，与唯一性判断使用的键一致
+ */
+bool LockManager::lock_exclusive_on_key(Transaction *txn, int index_id, const char *key, int key_len) {
+    // 乐观事务不加键锁，唯一索引键上的冲突由版本存储中的写意向检测
+    if (txn->is_optimistic()) return true;
+    size_t key_hash = std::hash<std::string_view>()(std::string_view(key, key_len));
+    return lock_on(txn, {index_id, key_hash, LockDataType::KEY}, LockMode::EXLUCSIVE);
+}
+
+/**
+ * @description: 尝试申请行级排他锁，冲突时不等待也不回滚，用于插入时选择空闲slot，调用者持有表上的IX锁
+ * 空闲slot可能属于其他事务删除但尚未提交的记录，该事务回滚时要在原位置重新插入，这样的slot不能使用
+ * @return {bool} 加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {Rid&} rid 加锁的目标记录ID
+ * @param {int} tab_fd 记录所在的表的fd
+ */
+bool LockManager::try_lock_exclusive_on_record(Transaction *txn, const Rid &rid, int tab_fd) {
+    if (txn->is_optimistic()) return true;
+    auto &stat = txn->get_table_lock_stat(tab_fd);
+    if (stat.exclusive_covered_) return true;
+    LockDataId lock_data_id = {tab_fd, rid, LockDataType::RECORD};
+    auto &bucket = get_bucket(lock_data_id);
+    {
+        std::unique_lock<std::mutex> lock(bucket.latch_);
+        auto &request_queue = bucket.lock_table_[lock_data_id];
+        auto own = find_request(request_queue, txn->get_transaction_id());
+        if (!is_compatible(request_queue, LockMode::EXLUCSIVE, own)) {
+            if (request_queue.request_queue_.empty() && request_queue.waiting_count_ == 0) {
+                bucket.lock_table_.erase(lock_data_id);
+            }
+            return false;
+        }
+        if (own != nullptr) {
+            grant(request_queue, *own, LockMode::EXLUCSIVE);
+            stat.has_exclusive_row_ = true;
+            return true;
         }
+        own = &request_queue.request_queue_.emplace_back(txn, LockMode::EXLUCSIVE);
+        txn->set_lock_set(lock_data_id);
+        grant(request_queue, *own, LockMode::EXLUCSIVE);
     }
-    if (ok) {
-        //需要加边(进入等待队列)
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::INTENTION_SHARED};
-        request_queue_.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id_table_);
+    count_row_lock(txn, tab_fd, LockMode::EXLUCSIVE);
+    return true;
+}
+
+/**
+ * @description: 释放锁
+ * @return {bool} 返回解锁是否成功
+ * @param {Transaction*} txn 要释放锁的事务对象指针
+ * @param {LockDataId} lock_data_id 要释放的锁ID
+ */
+bool LockManager::unlock(Transaction *txn, LockDataId lock_data_id) {
+    txn->set_state(TransactionState::SHRINKING);
+    return release(txn, lock_data_id);
+}
+
+/**
+ * @description: 从加锁队列中删除事务的申请并唤醒等待者，不改变事务的状态，锁升级时也用于释放被表级锁覆盖的行级锁
+ * @return {bool} 事务是否持有该锁
+ */
+bool LockManager::release(Transaction *txn, const LockDataId &lock_data_id) {
+    auto &bucket = get_bucket(lock_data_id);
+    std::unique_lock<std::mutex> lock(bucket.latch_);
+    auto it = bucket.lock_table_.find(lock_data_id);
+    if (it == bucket.lock_table_.end()) return false;
+    auto &request_queue = it->second;
+    auto now = request_queue.request_queue_.begin();
+    for (; now != request_queue.request_queue_.end(); ++now) {
+        if (now->txn_id_ == txn->get_transaction_id()) break;
     }
-    lock.unlock();
-    while (true) {
-        lock.lock();
-        //判够吧环
-        int flag = 0;
-//        if (!check_loop(txn)) {
-//            flag = 1;
-//        }
-        LockDataId lock_data_id = {tab_fd, LockDataType::TABLE};
-        auto &lock_request_queue = lock_table_[lock_data_id];
+    if (now == request_queue.request_queue_.end()) return false;
+    if (now->granted_) {
+        request_queue.granted_count_[static_cast<int>(now->lock_mode_)]--;
+    }
+    request_queue.request_queue_.erase(now);
+    if (request_queue.request_queue_.empty() && request_queue.waiting_count_ == 0) {
+        // 没有申请的加锁队列从锁表中删除，锁表不会随着访问过的记录增长
+        bucket.lock_table_.erase(it);
+        return true;
+    }
+    update_group_lock_mode(request_queue);
+    if (request_queue.waiting_count_ > 0) {
+        request_queue.cv_.notify_all();
+    }
+    return true;
+}
 
-        for (auto &request: lock_request_queue.request_queue_) {
-            // 表上有X锁不能申请
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.txn_id_ != txn->get_transaction_id() &&
-                request.granted_) {
-                flag = 1;
-                break;
+/**
+ * @description: 在waits-for图中从u出发深度优先查找环
+ * @return {bool} 是否找到环
+ * @param {vector<txn_id_t>&} path 当前搜索路径上的事务
+ * @param {txn_id_t&} victim 找到环时返回环中最年轻（ID最大）的事务
+ */
+static bool find_cycle(txn_id_t u, const std::map<txn_id_t, std::set<txn_id_t>> &waits_for,
+                       std::unordered_map<txn_id_t, int> &state, std::vector<txn_id_t> &path, txn_id_t &victim) {
+    // state: 0未访问，1在当前路径上，2已搜索完且不在任何环上
+    state[u] = 1;
+    path.push_back(u);
+    auto it = waits_for.find(u);
+    if (it != waits_for.end()) {
+        for (auto v: it->second) {
+            if (state[v] == 1) {
+                victim = v;
+                for (auto i = path.rbegin(); *i != v; ++i) victim = std::max(victim, *i);
+                return true;
             }
+            if (state[v] == 0 && find_cycle(v, waits_for, state, path, victim)) return true;
         }
-        if (flag) {
-            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::DEADLOCK_PREVENTION);
-        }
+    }
+    state[u] = 2;
+    path.pop_back();
+    return false;
+}
 
-        if (lock_request_queue.group_lock_mode_ == GroupLockMode::NON_LOCK) {
-            lock_request_queue.group_lock_mode_ = GroupLockMode::IS;
+/**
+ * @description: 死锁检测，detection策略下由后台线程每隔cycle_detection_interval调用一次
+ * 持有所有分区的latch构造waits-for图，每找到一个环就选择环中最年轻的事务回滚并从图中删除，直到图中没有环；
+ * 牺牲者都在等待，唤醒后发现自己被要求回滚，抛出异常
+ */
+void LockManager::detect_deadlock() {
+    // 按分区顺序加latch，加锁路径同时至多持有一个分区的latch，不会与之死锁
+    std::vector<std::unique_lock<std::mutex>> locks;
+    locks.reserve(LOCK_TABLE_BUCKETS);
+    for (auto &bucket: buckets_) {
+        locks.emplace_back(bucket.latch_);
+    }
+    std::unique_lock<std::mutex> wait_lock(wait_latch_);
+    std::map<txn_id_t, std::set<txn_id_t>> waits_for;
+    for (auto &[txn_id, wait]: waiting_for_) {
+        // 已经被选为牺牲者的事务即将停止等待
+        if (wait.txn_->is_wounded()) continue;
+        auto &queue = get_bucket(wait.lock_data_id_).lock_table_.at(wait.lock_data_id_);
+        for (auto &request: queue.request_queue_) {
+            if (request.txn_id_ != txn_id &&
+                !LOCK_COMPATIBLE[static_cast<int>(request.lock_mode_)][static_cast<int>(wait.lock_mode_)]) {
+                waits_for[txn_id].insert(request.txn_id_);
+            }
         }
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::INTENTION_SHARED};
-        for (auto &request: lock_request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) {
-                request.granted_ = true;
-                return true;
+    }
+    while (true) {
+        std::unordered_map<txn_id_t, int> state;
+        std::vector<txn_id_t> path;
+        txn_id_t victim = INVALID_TXN_ID;
+        bool found = false;
+        for (auto &[txn_id, _]: waits_for) {
+            if (state[txn_id] == 0 && find_cycle(txn_id, waits_for, state, path, victim)) {
+                found = true;
+                break;
             }
         }
-        lock_request.granted_ = true;
-        lock_request_queue.request_queue_.push_back(lock_request);
+        if (!found) break;
+        waits_for.erase(victim);
+        for (auto &[_, holders]: waits_for) {
+            holders.erase(victim);
+        }
+        auto &wait = waiting_for_.at(victim);
+        wait.txn_->set_wounded();
+        get_bucket(wait.lock_data_id_).lock_table_.at(wait.lock_data_id_).cv_.notify_all();
+    }
+}
+
+/**
+ * @description: 获取加锁对象所在的锁表分区
+ */
+LockManager::LockTableBucket &LockManager::get_bucket(const LockDataId &lock_data_id) {
+    // LockDataId的低位是slot_no，乘法散列后取高位，使相邻的记录分到不同的分区
+    uint64_t hash = static_cast<uint64_t>(lock_data_id.Get()) * 0x9E3779B97F4A7C15ULL;
+    return buckets_[(hash >> 32) % LOCK_TABLE_BUCKETS];
+}
+
+/**
+ * @description: 申请加锁对象上的锁。事务已经持有该对象上的锁时升级为同时覆盖两者的锁模式，例如IX + S = SIX
+ * 与其他事务已授予的锁冲突时按deadlock_policy_等待或回滚
+ * @return {bool} 返回加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {LockDataId&} lock_data_id 加锁对象
+ * @param {LockMode} lock_mode 申请的锁模式
+ */
+bool LockManager::lock_on(Transaction *txn, const LockDataId &lock_data_id, LockMode lock_mode) {
+    auto &bucket = get_bucket(lock_data_id);
+    std::unique_lock<std::mutex> lock(bucket.latch_);
+    auto &request_queue = bucket.lock_table_[lock_data_id];
+    auto own = find_request(request_queue, txn->get_transaction_id());
+    LockMode target = own != nullptr ? upgrade_mode(own->lock_mode_, lock_mode) : lock_mode;
+    if (own != nullptr && own->lock_mode_ == target) return true;
+    wait_compatible(txn, lock, bucket, lock_data_id, request_queue, target);
+    // 等待期间自己的申请不会被删除，但可能是第一次申请
+    own = find_request(request_queue, txn->get_transaction_id());
+    if (own == nullptr) {
+        own = &request_queue.request_queue_.emplace_back(txn, target);
         txn->set_lock_set(lock_data_id);
-        return true;
     }
+    grant(request_queue, *own, target);
+    return true;
 }
 
 /**
- * @description: 申请表级意向写锁
+ * @description: 申请表级锁
  * @return {bool} 返回加锁是否成功
  * @param {Transaction*} txn 要申请锁的事务对象指针
  * @param {int} tab_fd 目标表的fd
+ * @param {LockMode} lock_mode 申请的锁模式
  */
-bool LockManager::lock_IX_on_table(Transaction *txn, int tab_fd) {
+bool LockManager::lock_on_table(Transaction *txn, int tab_fd, LockMode lock_mode) {
+    txn->set_state(TransactionState::GROWING);
+    lock_on(txn, {tab_fd, LockDataType::TABLE}, lock_mode);
+    // 锁只会升级，持有的表级锁至少和这次申请的一样强
+    auto &stat = txn->get_table_lock_stat(tab_fd);
+    stat.shared_covered_ |= lock_mode == LockMode::SHARED || lock_mode == LockMode::EXLUCSIVE;
+    stat.exclusive_covered_ |= lock_mode == LockMode::EXLUCSIVE;
+    return true;
+}
+
+/**
+ * @description: 申请行级锁。先在表上申请IS锁（行级S锁）或IX锁（行级X锁），再申请行级锁；
+ * 表和记录可能在不同的分区，先后加锁，不同时持有两个分区的latch
+ * @return {bool} 加锁是否成功
+ * @param {Transaction*} txn 要申请锁的事务对象指针
+ * @param {Rid&} rid 加锁的目标记录ID
+ * @param {int} tab_fd 记录所在的表的fd
+ * @param {LockMode} lock_mode 申请的锁模式，SHARED或EXLUCSIVE
+ */
+bool LockManager::lock_on_record(Transaction *txn, const Rid &rid, int tab_fd, LockMode lock_mode) {
     txn->set_state(TransactionState::GROWING);
-//    std::cout << txn->get_transaction_id() << "申请表级IX锁" << " " << tab_fd << '\n';
-    std::unique_lock<std::mutex> lock(latch_);
-    // 获取队列
-    LockDataId lock_data_id_ = {tab_fd, LockDataType::TABLE};
-    auto &request_queue_ = lock_table_[lock_data_id_];
-    bool ok = true;
-    for (auto i: request_queue_.request_queue_) {
-        if (i.txn_id_ == txn->get_transaction_id()) {
-            if (i.granted_) {
-                if (i.lock_mode_ == LockMode::INTENTION_EXCLUSIVE || i.lock_mode_ == LockMode::EXLUCSIVE) return true;
+    // 乐观事务不加行锁：读的是快照，写冲突由版本链检测，提交时验证读集合
+    if (txn->is_optimistic()) return true;
+    // 事务持有的表级锁已经覆盖这一行时不再申请行级锁
+    auto &stat = txn->get_table_lock_stat(tab_fd);
+    if (stat.exclusive_covered_ || (stat.shared_covered_ && lock_mode == LockMode::SHARED)) return true;
+    LockDataId lock_data_id = {tab_fd, rid, LockDataType::RECORD};
+    auto &bucket = get_bucket(lock_data_id);
+    bool held = false;
+    {
+        // 已经持有足够强的行级锁时直接返回，事务回滚时重新申请自己持有的锁不会与表上的锁冲突，也不会等待
+        std::unique_lock<std::mutex> lock(bucket.latch_);
+        auto it = bucket.lock_table_.find(lock_data_id);
+        if (it != bucket.lock_table_.end()) {
+            auto own = find_request(it->second, txn->get_transaction_id());
+            if (own != nullptr && upgrade_mode(own->lock_mode_, lock_mode) == own->lock_mode_) {
+                return true;
             }
-            i.granted_ = false;
-            ok = false;
-            break;
+            held = own != nullptr;
         }
     }
-    if (ok) {
-        //需要加边(进入等待队列)
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::INTENTION_EXCLUSIVE};
-        request_queue_.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id_);
+    // 意向锁登记在表的加锁队列中，其他事务之后申请表级S、X锁或锁升级时能看到这一行上的锁
+    LockMode intention = lock_mode == LockMode::SHARED ? LockMode::INTENTION_SHARED : LockMode::INTENTION_EXCLUSIVE;
+    lock_on(txn, {tab_fd, LockDataType::TABLE}, intention);
+    lock_on(txn, lock_data_id, lock_mode);
+    if (held) {
+        stat.has_exclusive_row_ |= lock_mode == LockMode::EXLUCSIVE;
+    } else {
+        count_row_lock(txn, tab_fd, lock_mode);
     }
-    lock.unlock();
-    while (true) {
-        lock.lock();
-        //判够吧环
-        int flag = 0;
-//        if (!check_loop(txn)) {
-//            flag = 1;
-//        }
-        LockDataId lock_data_id = {tab_fd, LockDataType::TABLE};
-        auto &lock_request_queue = lock_table_[lock_data_id];
+    return true;
+}
 
-        for (auto &request: lock_request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) continue;
-            // 表上有X锁不能申请
-            if (request.lock_mode_ == LockMode::EXLUCSIVE && request.granted_) {
-                flag = 1;
-                break;
-            }
-            // 表上有S锁不能申请
-            if (request.lock_mode_ == LockMode::SHARED && request.granted_) {
-                flag = 1;
-                break;
+/**
+ * @description: 记录事务在表上新获得的一个行级锁，行级锁个数达到阈值时尝试升级为表级锁：
+ * 持有行级X锁时升级为表级X锁，否则升级为表级S锁（与持有的IX锁合并为SIX），然后释放被表级锁覆盖的行级锁。
+ * 表上有其他事务不兼容的锁时不等待，继续使用行级锁，每多持有一个阈值的行级锁再尝试一次，
+ * 因此锁升级不会引起新的等待和死锁
+ * @param {Transaction*} txn 获得行级锁的事务
+ * @param {int} tab_fd 记录所在的表的fd
+ * @param {LockMode} lock_mode 获得的行级锁模式
+ */
+void LockManager::count_row_lock(Transaction *txn, int tab_fd, LockMode lock_mode) {
+    auto &stat = txn->get_table_lock_stat(tab_fd);
+    stat.row_locks_++;
+    stat.has_exclusive_row_ |= lock_mode == LockMode::EXLUCSIVE;
+    int threshold = lock_escalation_threshold.load();
+    if (threshold <= 0 || stat.row_locks_ < threshold * (stat.failed_escalations_ + 1)) return;
+
+    LockMode escalated = stat.has_exclusive_row_ ? LockMode::EXLUCSIVE : LockMode::SHARED;
+    LockDataId lock_data_id_table = {tab_fd, LockDataType::TABLE};
+    auto &table_bucket = get_bucket(lock_data_id_table);
+    {
+        std::unique_lock<std::mutex> lock(table_bucket.latch_);
+        auto &table_queue = table_bucket.lock_table_[lock_data_id_table];
+        auto own = find_request(table_queue, txn->get_transaction_id());
+        LockMode target = own != nullptr ? upgrade_mode(own->lock_mode_, escalated) : escalated;
+        if (!is_compatible(table_queue, target, own)) {
+            if (table_queue.request_queue_.empty() && table_queue.waiting_count_ == 0) {
+                table_bucket.lock_table_.erase(lock_data_id_table);
             }
+            stat.failed_escalations_++;
+            return;
         }
-        if (flag) {
-            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::DEADLOCK_PREVENTION);
+        if (own == nullptr) {
+            own = &table_queue.request_queue_.emplace_back(txn, target);
+            txn->set_lock_set(lock_data_id_table);
         }
+        grant(table_queue, *own, target);
+        stat.shared_covered_ = true;
+        stat.exclusive_covered_ = target == LockMode::EXLUCSIVE;
+    }
 
-        lock_request_queue.group_lock_mode_ = GroupLockMode::IX;
-        auto &request_queue = lock_table_[lock_data_id];
-        LockRequest lock_request = {txn->get_transaction_id(), LockMode::INTENTION_EXCLUSIVE};
-        for (auto &request: lock_request_queue.request_queue_) {
-            if (request.txn_id_ == txn->get_transaction_id()) {
-                if (request.lock_mode_ != LockMode::EXLUCSIVE) {
-                    request.lock_mode_ = LockMode::INTENTION_EXCLUSIVE;
-                }
-                request.granted_ = true;
-                return true;
-            }
+    // 释放被覆盖的行级锁：升级为表级X锁时释放全部行级锁，否则只释放行级S锁
+    auto lock_set = txn->get_lock_set();
+    std::vector<LockDataId> covered;
+    for (auto &lock_data_id: *lock_set) {
+        if (lock_data_id.type_ == LockDataType::RECORD && lock_data_id.fd_ == tab_fd) {
+            covered.push_back(lock_data_id);
         }
-        lock_request.granted_ = true;
-        request_queue.request_queue_.push_back(lock_request);
-        txn->set_lock_set(lock_data_id);
-        return true;
+    }
+    for (auto &lock_data_id: covered) {
+        if (!stat.exclusive_covered_) {
+            auto &bucket = get_bucket(lock_data_id);
+            std::unique_lock<std::mutex> lock(bucket.latch_);
+            auto own = find_request(bucket.lock_table_.at(lock_data_id), txn->get_transaction_id());
+            if (own->lock_mode_ != LockMode::SHARED) continue;
+        }
+        release(txn, lock_data_id);
+        lock_set->erase(lock_data_id);
+        stat.row_locks_--;
     }
 }
 
 /**
- * @description: 释放锁
- * @return {bool} 返回解锁是否成功
- * @param {Transaction*} txn 要释放锁的事务对象指针
- * @param {LockDataId} lock_data_id 要释放的锁ID
+ * @description: 等待直到lock_mode与队列中其他事务已授予的锁兼容，调用时持有bucket的latch，返回时仍然持有
+ * no-wait策略下直接回滚；wait-die策略下比任何一个持有冲突锁的事务年轻时回滚（die），否则等待；
+ * wound-wait策略下要求持有冲突锁的更年轻的事务回滚（wound），然后等待。事务ID单调递增，ID越小的事务越老，
+ * 两种策略下等待关系都只有一个方向，不会形成死锁；detection策略下一直等待，直到被死锁检测选为牺牲者
+ * @param {unique_lock&} lock 持有的bucket的latch，等待期间释放
+ * @param {LockDataId&} lock_data_id 加锁对象
+ * @param {LockRequestQueue&} queue 加锁对象的加锁队列
+ * @param {LockMode} lock_mode 申请的锁模式
  */
-bool LockManager::unlock(Transaction *txn, LockDataId lock_data_id) {
-    std::unique_lock<std::mutex> lock(latch_);
-    txn->set_state(TransactionState::SHRINKING);
-    auto &request_queue = lock_table_[lock_data_id];
-    auto lock_request = request_queue.request_queue_.begin();
-    auto now = request_queue.request_queue_.end();
-    for (; lock_request != request_queue.request_queue_.end(); ++lock_request) {
-        if (lock_request->txn_id_ == txn->get_transaction_id()) {
-            now = lock_request;
-            break;
-        }
+void LockManager::wait_compatible(Transaction *txn, std::unique_lock<std::mutex> &lock, LockTableBucket &bucket,
+                                  const LockDataId &lock_data_id, LockRequestQueue &queue, LockMode lock_mode) {
+    txn_id_t txn_id = txn->get_transaction_id();
+    if (is_compatible(queue, lock_mode, find_request(queue, txn_id))) return;
+    auto abort = [&]() {
+        if (queue.request_queue_.empty() && queue.waiting_count_ == 0) {
+            bucket.lock_table_.erase(lock_data_id);
+        }
+        throw TransactionAbortException(txn_id, AbortReason::DEADLOCK_PREVENTION);
+    };
+    if (deadlock_policy_ == DeadlockPolicy::NO_WAIT) abort();
+
+    queue.waiting_count_++;
+    {
+        // 先登记再检查wounded_，wound的一方先设置wounded_再查登记，保证不会错过唤醒
+        std::unique_lock<std::mutex> wait_lock(wait_latch_);
+        waiting_for_.emplace(txn_id, LockWait{lock_data_id, lock_mode, txn});
     }
-    if (now == request_queue.request_queue_.end()) return false;
-    request_queue.request_queue_.erase(now);
-    request_queue.group_lock_mode_ = GroupLockMode::NON_LOCK;
-    for (lock_request = request_queue.request_queue_.begin();
-         lock_request != request_queue.request_queue_.end(); ++lock_request) {
-        if (request_queue.group_lock_mode_ == GroupLockMode::NON_LOCK) {
-            if (lock_request->lock_mode_ == LockMode::SHARED) {
-                request_queue.group_lock_mode_ = GroupLockMode::S;
-                break;
-            } else if (lock_request->lock_mode_ == LockMode::INTENTION_EXCLUSIVE)
-                request_queue.group_lock_mode_ = GroupLockMode::IX;
-            else if (lock_request->lock_mode_ == LockMode::INTENTION_SHARED)
-                request_queue.group_lock_mode_ = GroupLockMode::IS;
-            else if (lock_request->lock_mode_ == LockMode::EXLUCSIVE) {
-                request_queue.group_lock_mode_ = GroupLockMode::X;
-                break;
-            } else if (lock_request->lock_mode_ == LockMode::S_IX) {
-                request_queue.group_lock_mode_ = GroupLockMode::SIX;
-                break;
+    auto stop_waiting = [&]() {
+        queue.waiting_count_--;
+        std::unique_lock<std::mutex> wait_lock(wait_latch_);
+        waiting_for_.erase(txn_id);
+    };
+    while (true) {
+        if (txn->is_wounded()) {
+            stop_waiting();
+            abort();
+        }
+        std::vector<txn_id_t> wounded;
+        bool die = false;
+        for (auto &request: queue.request_queue_) {
+            if (deadlock_policy_ == DeadlockPolicy::DETECTION) break;   // 只需等待，不检查持有冲突锁的事务
+            if (!request.granted_ || request.txn_id_ == txn_id ||
+                LOCK_COMPATIBLE[static_cast<int>(request.lock_mode_)][static_cast<int>(lock_mode)]) {
+                continue;
             }
-        } else if (request_queue.group_lock_mode_ == GroupLockMode::IS) {
-            if (lock_request->lock_mode_ == LockMode::INTENTION_EXCLUSIVE) {
-                request_queue.group_lock_mode_ = GroupLockMode::IX;
+            if (deadlock_policy_ == DeadlockPolicy::WAIT_DIE && request.txn_id_ < txn_id) {
+                die = true;
                 break;
             }
-        }
-    }
-    return true;
-}
-
-bool LockManager::check_loop(Transaction *txn) {
-//    std::cout << "start_check\n";
-    int tot = 0;
-    std::unordered_map<txn_id_t, int> mp;
-    std::unordered_map<int, txn_id_t> rmp;
-    for (auto &i: lock_table_) {
-        for (auto j: i.second.request_queue_) {
-            if (!mp.count(j.txn_id_)) {
-                mp[j.txn_id_] = tot;
-                rmp[tot++] = j.txn_id_;
+            if (deadlock_policy_ == DeadlockPolicy::WOUND_WAIT && request.txn_id_ > txn_id &&
+                !request.txn_->is_wounded()) {
+                request.txn_->set_wounded();
+                wounded.push_back(request.txn_id_);
             }
         }
-    }
-    std::vector<std::vector<int>> e(tot);
-    std::vector<int> du(tot), que(tot);
-    int front = 0, end = 0;
-    for (auto &i: lock_table_) {
-        std::vector<int> granted, un_granted;
-        for (auto j: i.second.request_queue_) {
-            if (j.granted_) {
-                granted.push_back(mp[j.txn_id_]);
-            } else {
-                un_granted.push_back(mp[j.txn_id_]);
-            }
+        if (die) {
+            stop_waiting();
+            abort();
         }
-        for (auto u: un_granted) {
-            for (auto v: granted) {
-                e[u].push_back(v);
-//                std::cout << u << " -> " << v << "\n";
-                du[v]++;
+        if (!wounded.empty()) {
+            // 唤醒正在等待的被wound的事务，期间可能释放latch，需要重新检查
+            for (auto victim: wounded) {
+                notify_waiting(victim, bucket, lock);
             }
+        } else {
+            queue.cv_.wait(lock);
         }
+        if (is_compatible(queue, lock_mode, find_request(queue, txn_id))) break;
     }
-    for (int i = 0; i < tot; i++) {
-        if (!du[i]) que[end++] = i;
-    }
-    while (front < end) {
-        int u = que[front++];
-        for (auto v: e[u]) {
-            du[v]--;
-            if (!du[v]) que[end++] = v;
-        }
+    stop_waiting();
+}
+
+/**
+ * @description: 唤醒正在等待的事务，使其检查自己是否需要回滚
+ * @param {txn_id_t} txn_id 要唤醒的事务ID
+ * @param {LockTableBucket&} bucket 调用者持有latch的分区
+ * @param {unique_lock&} lock 调用者持有的latch，唤醒其他分区中的事务时暂时释放，不同时持有两个分区的latch
+ */
+void LockManager::notify_waiting(txn_id_t txn_id, LockTableBucket &bucket, std::unique_lock<std::mutex> &lock) {
+    std::unique_lock<std::mutex> wait_lock(wait_latch_);
+    auto waiting = waiting_for_.find(txn_id);
+    if (waiting == waiting_for_.end()) return;
+    LockDataId lock_data_id = waiting->second.lock_data_id_;
+    wait_lock.unlock();
+    auto &waiting_bucket = get_bucket(lock_data_id);
+    if (&waiting_bucket != &bucket) {
+        lock.unlock();
+        std::unique_lock<std::mutex> waiting_lock(waiting_bucket.latch_);
+        auto it = waiting_bucket.lock_table_.find(lock_data_id);
+        if (it != waiting_bucket.lock_table_.end()) it->second.cv_.notify_all();
+        waiting_lock.unlock();
+        lock.lock();
+        return;
     }
-    txn_id_t mx = -1;
-    for (int i = 0; i < tot; i++) {
-        if (du[i]) {
-            mx = std::max(mx, rmp[i]);
-        }
+    auto it = bucket.lock_table_.find(lock_data_id);
+    if (it != bucket.lock_table_.end()) it->second.cv_.notify_all();
+}
+
+/**
+ * @description: 在加锁队列中查找事务的申请，每个事务在一个队列中至多有一个申请
+ * @return {LockRequest*} 事务的申请，不存在时返回nullptr
+ */
+LockManager::LockRequest *LockManager::find_request(LockRequestQueue &queue, txn_id_t txn_id) {
+    for (auto &request: queue.request_queue_) {
+        if (request.txn_id_ == txn_id) return &request;
     }
-    if (mx != -1) {
-        if (txn->get_transaction_id() == mx) {
-            throw TransactionAbortException(mx, AbortReason::DEADLOCK_PREVENTION);
-        }
-        return false;
+    return nullptr;
+}
+
+/**
+ * @description: 根据每种锁模式已授予的个数判断lock_mode是否与其他事务已授予的锁兼容
+ * @param {LockRequest*} own 申请者自己在队列中的申请，为nullptr时把所有已授予的锁都当作其他事务的
+ */
+bool LockManager::is_compatible(const LockRequestQueue &queue, LockMode lock_mode, const LockRequest *own) {
+    for (int mode = 0; mode < LOCK_MODE_COUNT; mode++) {
+        int count = queue.granted_count_[mode];
+        if (own != nullptr && own->granted_ && static_cast<int>(own->lock_mode_) == mode) count--;
+        if (count > 0 && !LOCK_COMPATIBLE[mode][static_cast<int>(lock_mode)]) return false;
     }
     return true;
-}
\ No newline at end of file
+}
+
+/**
+ * @description: 已经持有held时申请requested，返回同时覆盖两者的最弱的锁模式
+ */
+LockManager::LockMode LockManager::upgrade_mode(LockMode held, LockMode requested) {
+    if (held == requested) return held;
+    if (held == LockMode::EXLUCSIVE || requested == LockMode::EXLUCSIVE) return LockMode::EXLUCSIVE;
+    if (held == LockMode::INTENTION_SHARED) return requested;
+    if (requested == LockMode::INTENTION_SHARED) return held;
+    // 剩下S、IX、SIX中两个不同的模式，组合起来都是SIX
+    return LockMode::S_IX;
+}
+
+/**
+ * @description: 以lock_mode授予队列中的申请，并更新队列的锁模式统计
+ */
+void LockManager::grant(LockRequestQueue &queue, LockRequest &request, LockMode lock_mode) {
+    if (request.granted_) {
+        queue.granted_count_[static_cast<int>(request.lock_mode_)]--;
+    }
+    request.lock_mode_ = lock_mode;
+    request.granted_ = true;
+    queue.granted_count_[static_cast<int>(lock_mode)]++;
+    update_group_lock_mode(queue);
+}
+
+/**
+ * @description: 根据已授予的锁更新队列的锁模式，即其中排他性最强的锁模式
+ */
+void LockManager::update_group_lock_mode(LockRequestQueue &queue) {
+    auto count = [&](LockMode mode) { return queue.granted_count_[static_cast<int>(mode)]; };
+    if (count(LockMode::EXLUCSIVE)) {
+        queue.group_lock_mode_ = GroupLockMode::X;
+    } else if (count(LockMode::S_IX) || (count(LockMode::SHARED) && count(LockMode::INTENTION_EXCLUSIVE))) {
+        queue.group_lock_mode_ = GroupLockMode::SIX;
+    } else if (count(LockMode::SHARED)) {
+        queue.group_lock_mode_ = GroupLockMode::S;
+    } else if (count(LockMode::INTENTION_EXCLUSIVE)) {
+        queue.group_lock_mode_ = GroupLockMode::IX;
+    } else if (count(LockMode::INTENTION_SHARED)) {
+        queue.group_lock_mode_ = GroupLockMode::IS;
+    } else {
+        queue.group_lock_mode_ = GroupLockMode::NON_LOCK;
+    }
+}
@@ -12,13 +12,20 @@ See the Mulan PSL v2 for more details. */
 
 #include <mutex>
 #include <condition_variable>
+#include <list>
+#include <unordered_map>
 #include "transaction/transaction.h"
 
 static const std::string GroupLockModeStr[10] = {"NON_LOCK", "IS", "IX", "S", "X", "SIX"};
 
+/* 加锁冲突时的处理策略：no-wait直接回滚申请者；wait-die和wound-wait按事务的新旧决定等待还是回滚；
+ * detection总是等待，由后台线程定期检测死锁，启动时选择 */
+enum class DeadlockPolicy { NO_WAIT, WAIT_DIE, WOUND_WAIT, DETECTION };
+
 class LockManager {
     /* 加锁类型，包括共享锁、排他锁、意向共享锁、意向排他锁、SIX（意向排他锁+共享锁） */
     enum class LockMode { SHARED, EXLUCSIVE, INTENTION_SHARED, INTENTION_EXCLUSIVE, S_IX };
+    static constexpr int LOCK_MODE_COUNT = 5;
 
     /* 用于标识加锁队列中排他性最强的锁类型，例如加锁队列中有SHARED和EXLUSIVE两个加锁操作，则该队列的锁模式为X */
     enum class GroupLockMode { NON_LOCK, IS, IX, S, X, SIX};
@@ -26,10 +33,11 @@ class LockManager {
     /* 事务的加锁申请 */
     class LockRequest {
     public:
-        LockRequest(txn_id_t txn_id, LockMode lock_mode)
-            : txn_id_(txn_id), lock_mode_(lock_mode), granted_(false) {}
+        LockRequest(Transaction *txn, LockMode lock_mode)
+            : txn_id_(txn->get_transaction_id()), txn_(txn), lock_mode_(lock_mode), granted_(false) {}
 
         txn_id_t txn_id_;   // 申请加锁的事务ID
+        Transaction *txn_;  // 申请加锁的事务，wound-wait策略下用于通知持有锁的事务回滚
         LockMode lock_mode_;    // 事务申请加锁的类型
         bool granted_;          // 该事务是否已经被赋予锁
     };
@@ -39,7 +47,24 @@ class LockManager {
     public:
         std::list<LockRequest> request_queue_;  // 加锁队列
         std::condition_variable cv_;            // 条件变量，用于唤醒正在等待加锁的申请，在no-wait策略下无需使用
+        int waiting_count_ = 0;                 // 正在等待的事务个数，有事务等待时队列不能从锁表中删除
         GroupLockMode group_lock_mode_ = GroupLockMode::NON_LOCK;   // 加锁队列的锁模式
+        int granted_count_[LOCK_MODE_COUNT] = {};   // 每种锁模式已授予的申请个数，判断兼容性时不需要遍历队列
+    };
+
+    /* 正在等待的事务等待的加锁对象和申请的锁模式，死锁检测时据此构造waits-for图 */
+    class LockWait {
+    public:
+        LockDataId lock_data_id_;
+        LockMode lock_mode_;
+        Transaction *txn_;
+    };
+
+    /* 锁表的一个分区，加锁对象按哈希值分到不同的分区，每个分区由自己的latch保护 */
+    class LockTableBucket {
+    public:
+        std::mutex latch_;
+        std::unordered_map<LockDataId, LockRequestQueue> lock_table_;
     };
 
 public:
@@ -59,11 +84,51 @@ public:
 
     bool lock_IX_on_table(Transaction* txn, int tab_fd);
 
+    bool lock_exclusive_on_key(Transaction* txn, int index_id, const char* key, int key_len);
+
+    bool try_lock_exclusive_on_record(Transaction* txn, const Rid& rid, int tab_fd);
+
     bool unlock(Transaction* txn, LockDataId lock_data_id);
 
-    bool check_loop(Transaction * txn);
+    void detect_deadlock();
+
+    void set_deadlock_policy(DeadlockPolicy deadlock_policy) { deadlock_policy_ = deadlock_policy; }
+
+    DeadlockPolicy get_deadlock_policy() { return deadlock_policy_; }
 
 private:
-    std::mutex latch_;      // 用于锁表的并发
-    std::unordered_map<LockDataId, LockRequestQueue> lock_table_;   // 全局锁表
+    DeadlockPolicy deadlock_policy_ = DeadlockPolicy::NO_WAIT;  // 加锁冲突时的处理策略
+
+    std::mutex wait_latch_;     // 保护waiting_for_
+    std::unordered_map<txn_id_t, LockWait> waiting_for_;       // 正在等待的事务及其等待的加锁对象
+
+    static constexpr size_t LOCK_TABLE_BUCKETS = 64;    // 锁表的分区个数
+    LockTableBucket buckets_[LOCK_TABLE_BUCKETS];       // 按加锁对象分区的全局锁表
+
+    LockTableBucket &get_bucket(const LockDataId &lock_data_id);
+
+    bool lock_on(Transaction* txn, const LockDataId &lock_data_id, LockMode lock_mode);
+
+    bool lock_on_table(Transaction* txn, int tab_fd, LockMode lock_mode);
+
+    bool lock_on_record(Transaction* txn, const Rid& rid, int tab_fd, LockMode lock_mode);
+
+    void count_row_lock(Transaction* txn, int tab_fd, LockMode lock_mode);
+
+    bool release(Transaction* txn, const LockDataId &lock_data_id);
+
+    void wait_compatible(Transaction* txn, std::unique_lock<std::mutex> &lock, LockTableBucket &bucket,
+                         const LockDataId &lock_data_id, LockRequestQueue &queue, LockMode lock_mode);
+
+    void notify_waiting(txn_id_t txn_id, LockTableBucket &bucket, std::unique_lock<std::mutex> &lock);
+
+    static LockRequest *find_request(LockRequestQueue &queue, txn_id_t txn_id);
+
+    static bool is_compatible(const LockRequestQueue &queue, LockMode lock_mode, const LockRequest *own);
+
+    static LockMode upgrade_mode(LockMode held, LockMode requested);
+
+    static void grant(LockRequestQueue &queue, LockRequest &request, LockMode lock_mode);
+
+    static void update_group_lock_mode(LockRequestQueue &queue);
 };
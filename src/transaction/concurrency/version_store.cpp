@@ -0,0 +1,365 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include "version_store.h"
+
+#include <algorithm>
+#include <climits>
+
+/**
+ * @description: 为事务取快照，快照能看到此前提交的所有事务的修改
+ * @param {Transaction*} txn 使用快照读的事务
+ */
+void VersionStore::begin_snapshot(Transaction *txn) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    txn->set_start_ts(last_commit_ts_);
+    snapshots_[txn->get_transaction_id()] = last_commit_ts_;
+}
+
+/**
+ * @description: READ_COMMITTED的事务在每条语句开始时换成新的快照，旧快照不再阻止版本回收
+ * @param {Transaction*} txn 使用快照读的事务
+ */
+void VersionStore::refresh_snapshot(Transaction *txn) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    txn->set_start_ts(last_commit_ts_);
+    snapshots_[txn->get_transaction_id()] = last_commit_ts_;
+    purge();
+}
+
+/**
+ * @description: 写事务修改记录之前保存记录的旧内容，调用者持有记录上的X锁。
+ * 同一事务多次修改同一条记录时只保留第一次修改之前的内容，其他事务要么看到该事务的全部修改，要么全都看不到。
+ * 快照读的事务遵循first-updater-wins：记录在快照之后被其他事务修改并提交时，写入会丢失对方的修改，事务回滚；
+ * 插入使用的是空闲slot，不存在这种冲突。
+ * 只有不加行锁的乐观事务会遇到其他事务未提交的版本：修改记录时立即回滚，插入时不能使用这个slot
+ * @param {int} fd 表的数据文件
+ * @param {Rid&} rid 被修改的记录
+ * @param {Transaction*} txn 写事务
+ * @param {RmRecord*} before 修改之前的记录，插入时为空指针
+ * @return {bool} 插入时slot是否可用
+ */
+bool VersionStore::add_version(int fd, const Rid &rid, Transaction *txn, const RmRecord *before) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    RidKey key{rid.page_no, rid.slot_no};
+    auto &table = chains_[fd];
+    auto chain = table.find(key);
+    if (chain != table.end()) {
+        auto &newest = chain->second.back();
+        if (newest.writer_ == txn->get_transaction_id()) return true;
+        if (newest.commit_ts_ == INVALID_TIMESTAMP) {
+            if (before == nullptr) return false;
+            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::WRITE_CONFLICT);
+        }
+        if (before != nullptr && is_snapshot_isolation(txn) && !is_visible(newest.writer_, newest.commit_ts_, txn)) {
+            throw TransactionAbortException(txn->get_transaction_id(), AbortReason::WRITE_CONFLICT);
+        }
+    }
+    if (chain == table.end()) {
+        epochs_[fd]++;
+    }
+    table[key].emplace_back(txn->get_transaction_id(), before);
+    txn_versions_[txn->get_transaction_id()].emplace_back(fd, key);
+    return true;
+}
+
+/**
+ * @description: 乐观事务在插入、删除或更新唯一索引中的键之前登记写意向，键上已有其他事务的写意向时回滚。
+ * 不加键锁时，其他事务可能插入被删除但尚未提交的键，删除的事务回滚时重新插入就会违反唯一性
+ * @param {int} index_id 索引的id
+ * @param {char*} key 索引键
+ * @param {int} key_len 索引字段的总长度
+ * @param {Transaction*} txn 乐观事务
+ */
+void VersionStore::add_key_intent(int index_id, const char *key, int key_len, Transaction *txn) {
+    if (!txn->is_optimistic()) return;
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    auto [it, inserted] = key_intents_.emplace(std::make_pair(index_id, std::string(key, key_len)),
+                                               txn->get_transaction_id());
+    if (inserted) {
+        txn_key_intents_[txn->get_transaction_id()].push_back(it->first);
+    } else if (it->second != txn->get_transaction_id()) {
+        throw TransactionAbortException(txn->get_transaction_id(), AbortReason::WRITE_CONFLICT);
+    }
+}
+
+/**
+ * @description: 批量导入写入新页面之前登记，导入提交之前开始的快照看不到first_page及之后页面上的记录
+ * @param {int} fd 表的数据文件
+ * @param {int} first_page 本次导入分配的第一个页面
+ * @param {Transaction*} txn 导入数据的事务
+ */
+void VersionStore::add_bulk_load(int fd, int first_page, Transaction *txn) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    bulk_loads_.push_back({fd, first_page, txn->get_transaction_id()});
+    epochs_[fd]++;
+}
+
+/**
+ * @description: 把页面上记录的最新内容变为对事务可见的版本。从最新的版本开始，
+ * 撤销其他事务未提交的修改和快照之后提交的修改，遇到可见的修改时停止
+ * @param {int} fd 表的数据文件
+ * @param {Rid&} rid 记录号
+ * @param {Transaction*} txn 快照读的事务
+ * @param {unique_ptr<RmRecord>*} rec 传入页面上的记录（不存在时为空指针），传出可见的版本（不可见时为空指针）
+ */
+void VersionStore::read_visible(int fd, const Rid &rid, Transaction *txn, std::unique_ptr<RmRecord> *rec) {
+    std::shared_lock<std::shared_mutex> lock(latch_);
+    for (auto &load: bulk_loads_) {
+        if (load.fd_ == fd && rid.page_no >= load.first_page_ && !is_visible(load.writer_, load.commit_ts_, txn)) {
+            rec->reset();
+            return;
+        }
+    }
+    auto table = chains_.find(fd);
+    if (table == chains_.end()) return;
+    auto chain = table->second.find({rid.page_no, rid.slot_no});
+    if (chain == table->second.end()) return;
+    for (auto it = chain->second.rbegin(); it != chain->second.rend(); it++) {
+        if (is_visible(it->writer_, it->commit_ts_, txn)) break;
+        if (it->before_ == nullptr) {
+            rec->reset();
+        } else {
+            *rec = std::make_unique<RmRecord>(*it->before_);
+        }
+    }
+}
+
+/**
+ * @description: 查找after之后第一条有版本链的记录。顺序扫描时，快照中存在但已被删除的记录不在页面上，
+ * 需要从版本链中补上；删除之前先保存了版本，因此扫描越过被删除的位置之后再查找版本链不会遗漏
+ * @param {int} fd 表的数据文件
+ * @param {Rid&} after 从该位置之后开始查找
+ * @param {Rid*} rid 传出找到的记录号
+ * @return {bool} 是否找到
+ */
+bool VersionStore::next_versioned_rid(int fd, const Rid &after, Rid *rid) {
+    std::shared_lock<std::shared_mutex> lock(latch_);
+    auto table = chains_.find(fd);
+    if (table == chains_.end()) return false;
+    auto it = table->second.upper_bound({after.page_no, after.slot_no});
+    if (it == table->second.end()) return false;
+    *rid = Rid{it->first.first, it->first.second};
+    return true;
+}
+
+/**
+ * @description: 返回表上所有有版本链的记录，按rid排列
+ * @param {int} fd 表的数据文件
+ * @param {Transaction*} txn 快照读的事务，传出对它不可见的批量导入的范围时使用
+ * @param {int*} invisible_page 传出对txn不可见的批量导入的最小first_page，这个页面及之后的记录都不可见，没有时为INT_MAX
+ * @param {uint64_t*} epoch 传出此时表上的版本计数，之后get_epoch()不变说明没有新的版本链
+ */
+std::vector<Rid> VersionStore::get_versioned_rids(int fd, Transaction *txn, int *invisible_page, uint64_t *epoch) {
+    std::shared_lock<std::shared_mutex> lock(latch_);
+    std::vector<Rid> rids;
+    if (invisible_page != nullptr) {
+        *invisible_page = INT_MAX;
+        for (auto &load: bulk_loads_) {
+            if (load.fd_ == fd && !is_visible(load.writer_, load.commit_ts_, txn)) {
+                *invisible_page = std::min(*invisible_page, load.first_page_);
+            }
+        }
+    }
+    if (epoch != nullptr) {
+        auto it = epochs_.find(fd);
+        *epoch = it == epochs_.end() ? 0 : it->second;
+    }
+    auto table = chains_.find(fd);
+    if (table == chains_.end()) return rids;
+    rids.reserve(table->second.size());
+    for (auto &[key, chain]: table->second) {
+        rids.push_back(Rid{key.first, key.second});
+    }
+    return rids;
+}
+
+/**
+ * @description: 表上新建版本链和登记批量导入的次数
+ * @param {int} fd 表的数据文件
+ */
+uint64_t VersionStore::get_epoch(int fd) {
+    std::shared_lock<std::shared_mutex> lock(latch_);
+    auto it = epochs_.find(fd);
+    return it == epochs_.end() ? 0 : it->second;
+}
+
+/**
+ * @description: 为事务的所有版本打上提交时间戳。调用者在释放锁之前调用，
+ * 之后修改同一条记录的事务一定能看到这里的时间戳。
+ * 乐观事务先验证读集合，验证失败时抛出异常，事务的状态保持不变，由调用者回滚
+ * @param {Transaction*} txn 提交的事务
+ * @param {vector<AfterImage>*} after_images 乐观事务修改的记录的最新内容
+ * @return {timestamp_t} 事务的提交时间戳
+ */
+timestamp_t VersionStore::commit(Transaction *txn, std::vector<AfterImage> *after_images) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    txn_id_t txn_id = txn->get_transaction_id();
+    auto versions = txn_versions_.find(txn_id);
+    bool has_load = std::any_of(bulk_loads_.begin(), bulk_loads_.end(),
+                                [txn_id](const BulkLoadVersion &load) { return load.writer_ == txn_id; });
+    // 只读事务读到的是一致的快照，相当于在快照时刻执行，不需要验证
+    if (txn->is_optimistic() && (versions != txn_versions_.end() || has_load) && !validate(txn)) {
+        throw TransactionAbortException(txn_id, AbortReason::VALIDATION_FAILED);
+    }
+    end_snapshot(txn);
+    release_key_intents(txn_id);
+    if (versions == txn_versions_.end() && !has_load) {
+        // 只读事务不产生新的提交时间戳
+        purge();
+        return last_commit_ts_;
+    }
+    timestamp_t commit_ts = ++last_commit_ts_;
+    for (auto &load: bulk_loads_) {
+        if (load.writer_ == txn_id) load.commit_ts_ = commit_ts;
+    }
+    if (versions != txn_versions_.end()) {
+        for (auto &[fd, key]: versions->second) {
+            auto &table = chains_[fd];
+            auto chain = table.find(key);
+            if (chain == table.end()) continue;
+            for (auto it = chain->second.rbegin(); it != chain->second.rend() && it->writer_ == txn_id; it++) {
+                it->commit_ts_ = commit_ts;
+            }
+        }
+        for (size_t i = 0; after_images != nullptr && i < after_images->size(); i++) {
+            auto &image = (*after_images)[i];
+            auto &table = chains_[image.fd_];
+            auto chain = table.find({image.rid_.page_no, image.rid_.slot_no});
+            if (chain != table.end() && chain->second.back().writer_ == txn_id) {
+                chain->second.back().after_ = std::move(image.rec_);
+            }
+        }
+        committed_.emplace_back(commit_ts, std::move(versions->second));
+        txn_versions_.erase(versions);
+    }
+    purge();
+    return commit_ts;
+}
+
+/**
+ * @description: 回滚完成后删除事务产生的版本，此时页面上已经恢复为修改之前的内容
+ * @param {Transaction*} txn 回滚的事务
+ */
+void VersionStore::abort(Transaction *txn) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    txn_id_t txn_id = txn->get_transaction_id();
+    end_snapshot(txn);
+    release_key_intents(txn_id);
+    bulk_loads_.erase(std::remove_if(bulk_loads_.begin(), bulk_loads_.end(),
+                                     [txn_id](const BulkLoadVersion &load) { return load.writer_ == txn_id; }),
+                      bulk_loads_.end());
+    auto versions = txn_versions_.find(txn_id);
+    if (versions != txn_versions_.end()) {
+        for (auto &[fd, key]: versions->second) {
+            auto &table = chains_[fd];
+            auto chain = table.find(key);
+            if (chain == table.end()) continue;
+            auto &list = chain->second;
+            list.erase(std::remove_if(list.begin(), list.end(),
+                                      [txn_id](const RecordVersion &v) { return v.writer_ == txn_id; }),
+                       list.end());
+            if (list.empty()) table.erase(chain);
+        }
+        txn_versions_.erase(versions);
+    }
+    purge();
+}
+
+/**
+ * @description: 删除表时丢弃表上的所有版本，文件描述符之后可能被其他表复用
+ * @param {int} fd 被删除的表的数据文件
+ */
+void VersionStore::drop_table(int fd) {
+    std::unique_lock<std::shared_mutex> lock(latch_);
+    chains_.erase(fd);
+    bulk_loads_.erase(std::remove_if(bulk_loads_.begin(), bulk_loads_.end(),
+                                     [fd](const BulkLoadVersion &load) { return load.fd_ == fd; }),
+                      bulk_loads_.end());
+}
+
+/**
+ * @description: 验证乐观事务的读集合：快照之后提交的其他事务修改之前或之后的记录满足某次扫描的条件时，
+ * 这次扫描的结果已经失效。快照之后提交的版本在快照结束之前不会被回收，调用者持有latch_
+ * @param {Transaction*} txn 提交的乐观事务
+ * @return {bool} 验证是否通过
+ */
+bool VersionStore::validate(Transaction *txn) {
+    auto changed_after_snapshot = [txn](txn_id_t writer, timestamp_t commit_ts) {
+        return writer != txn->get_transaction_id() && commit_ts != INVALID_TIMESTAMP && commit_ts > txn->get_start_ts();
+    };
+    for (auto &read: *txn->get_read_set()) {
+        for (auto &load: bulk_loads_) {
+            if (load.fd_ == read.fd_ && changed_after_snapshot(load.writer_, load.commit_ts_)) return false;
+        }
+        auto table = chains_.find(read.fd_);
+        if (table == chains_.end()) continue;
+        for (auto &[key, chain]: table->second) {
+            for (auto &version: chain) {
+                if (!changed_after_snapshot(version.writer_, version.commit_ts_)) continue;
+                if ((version.before_ != nullptr && read.match_(*version.before_)) ||
+                    (version.after_ != nullptr && read.match_(*version.after_))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @description: 结束事务的快照，调用者持有latch_
+ */
+void VersionStore::end_snapshot(Transaction *txn) {
+    snapshots_.erase(txn->get_transaction_id());
+}
+
+/**
+ * @description: 事务结束时释放它在索引键上的写意向，调用者持有latch_
+ */
+void VersionStore::release_key_intents(txn_id_t txn_id) {
+    auto intents = txn_key_intents_.find(txn_id);
+    if (intents == txn_key_intents_.end()) return;
+    for (auto &key: intents->second) {
+        key_intents_.erase(key);
+    }
+    txn_key_intents_.erase(intents);
+}
+
+/**
+ * @description: 回收所有活跃快照都能看到的已提交版本：提交时间戳不大于最老快照的修改不会再被撤销。
+ * 调用者持有latch_
+ */
+void VersionStore::purge() {
+    timestamp_t oldest = last_commit_ts_;
+    for (auto &[txn_id, start_ts]: snapshots_) {
+        oldest = std::min(oldest, start_ts);
+    }
+    while (!committed_.empty() && committed_.front().first <= oldest) {
+        for (auto &[fd, key]: committed_.front().second) {
+            auto table = chains_.find(fd);
+            if (table == chains_.end()) continue;
+            auto chain = table->second.find(key);
+            if (chain == table->second.end()) continue;
+            auto &list = chain->second;
+            auto first_needed = std::find_if(list.begin(), list.end(), [oldest](const RecordVersion &v) {
+                return v.commit_ts_ == INVALID_TIMESTAMP || v.commit_ts_ > oldest;
+            });
+            list.erase(list.begin(), first_needed);
+            if (list.empty()) table->second.erase(chain);
+        }
+        committed_.pop_front();
+    }
+    bulk_loads_.erase(std::remove_if(bulk_loads_.begin(), bulk_loads_.end(),
+                                     [oldest](const BulkLoadVersion &load) {
+                                         return load.commit_ts_ != INVALID_TIMESTAMP && load.commit_ts_ <= oldest;
+                                     }),
+                      bulk_loads_.end());
+}
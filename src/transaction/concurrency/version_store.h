@@ -0,0 +1,124 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "record/rm_defs.h"
+#include "transaction/transaction.h"
+
+/* 记录被修改之前的一个版本，由写事务在修改记录之前保存 */
+struct RecordVersion {
+    txn_id_t writer_;                               // 进行这次修改的事务
+    timestamp_t commit_ts_ = INVALID_TIMESTAMP;     // writer_的提交时间戳，未提交时为INVALID_TIMESTAMP
+    std::unique_ptr<RmRecord> before_;              // 修改之前的记录内容，插入产生的版本为空指针
+    std::unique_ptr<RmRecord> after_;               // 乐观事务提交时修改之后的记录内容，删除时为空指针，用于验证读集合
+
+    RecordVersion(txn_id_t writer, const RmRecord *before)
+        : writer_(writer), before_(before != nullptr ? std::make_unique<RmRecord>(*before) : nullptr) {}
+};
+
+/* 乐观事务提交时被修改的记录的最新内容，记录被删除时rec_为空指针 */
+struct AfterImage {
+    int fd_;
+    Rid rid_;
+    std::unique_ptr<RmRecord> rec_;
+};
+
+/* 批量导入分配的新页面，导入对快照不可见时这些页面上的记录都不可见 */
+struct BulkLoadVersion {
+    int fd_;
+    int first_page_;
+    txn_id_t writer_;
+    timestamp_t commit_ts_ = INVALID_TIMESTAMP;
+};
+
+/**
+ * @description: 基于undo的多版本存储。页面上始终是记录的最新内容，写事务在修改记录之前把旧内容挂到该记录的版本链上，
+ * 快照读从页面上的最新内容出发，沿版本链从新到旧撤销对自己不可见的修改，得到快照时刻的记录。
+ * 提交时间戳也在这里分发：提交时在latch_下为事务的所有版本打上时间戳，开始快照时读取最后一个提交时间戳，
+ * 因此快照要么看到一个事务的全部修改，要么全都看不到。
+ * 所有活跃快照都能看到的版本不再需要，在提交和结束快照时回收。
+ * 乐观并发控制的事务不加行锁和键锁：版本链上未提交的版本和唯一索引键上的写意向标识正在修改它们的事务，
+ * 其他事务再修改时立即回滚；提交时在latch_下验证读集合，验证和分配提交时间戳之间不会有其他事务提交
+ */
+class VersionStore {
+   public:
+    VersionStore() = default;
+
+    ~VersionStore() = default;
+
+    // 是否使用快照读：REPEATABLE_READ和乐观事务在事务开始时取快照，READ_COMMITTED在每条语句开始时取快照
+    static bool is_snapshot_isolation(Transaction *txn) {
+        return txn->get_isolation_level() == IsolationLevel::REPEATABLE_READ ||
+               txn->get_isolation_level() == IsolationLevel::READ_COMMITTED || txn->is_optimistic();
+    }
+
+    void begin_snapshot(Transaction *txn);
+
+    void refresh_snapshot(Transaction *txn);
+
+    bool add_version(int fd, const Rid &rid, Transaction *txn, const RmRecord *before);
+
+    void add_key_intent(int index_id, const char *key, int key_len, Transaction *txn);
+
+    void add_bulk_load(int fd, int first_page, Transaction *txn);
+
+    void read_visible(int fd, const Rid &rid, Transaction *txn, std::unique_ptr<RmRecord> *rec);
+
+    bool next_versioned_rid(int fd, const Rid &after, Rid *rid);
+
+    std::vector<Rid> get_versioned_rids(int fd, Transaction *txn = nullptr, int *invisible_page = nullptr,
+                                        uint64_t *epoch = nullptr);
+
+    uint64_t get_epoch(int fd);
+
+    timestamp_t commit(Transaction *txn, std::vector<AfterImage> *after_images = nullptr);
+
+    void abort(Transaction *txn);
+
+    void drop_table(int fd);
+
+   private:
+    using RidKey = std::pair<int, int>;     // (page_no, slot_no)，版本链按rid有序，便于和顺序扫描合并
+    using VersionChain = std::vector<RecordVersion>;   // 从旧到新
+
+    bool is_visible(txn_id_t writer, timestamp_t commit_ts, Transaction *txn) const {
+        return writer == txn->get_transaction_id() ||
+               (commit_ts != INVALID_TIMESTAMP && commit_ts <= txn->get_start_ts());
+    }
+
+    bool validate(Transaction *txn);
+
+    void end_snapshot(Transaction *txn);
+
+    void release_key_intents(txn_id_t txn_id);
+
+    void purge();
+
+    std::shared_mutex latch_;
+    timestamp_t last_commit_ts_ = 0;    // 最后一个提交的事务的时间戳，新快照能看到它及之前提交的所有修改
+    std::unordered_map<txn_id_t, timestamp_t> snapshots_;   // 活跃快照的时间戳
+    std::unordered_map<int, std::map<RidKey, VersionChain>> chains_;    // 每张表上的版本链
+    std::unordered_map<txn_id_t, std::vector<std::pair<int, RidKey>>> txn_versions_;   // 未提交事务产生的版本位置
+    std::deque<std::pair<timestamp_t, std::vector<std::pair<int, RidKey>>>> committed_;  // 按提交时间戳排列，等待回收
+    std::vector<BulkLoadVersion> bulk_loads_;
+    std::unordered_map<int, uint64_t> epochs_;  // 每张表上新建版本链和登记批量导入的次数，流式快照扫描据此发现新的版本链
+    std::map<std::pair<int, std::string>, txn_id_t> key_intents_;  // 乐观事务在唯一索引键上的写意向
+    std::unordered_map<txn_id_t, std::vector<std::pair<int, std::string>>> txn_key_intents_;
+};
@@ -1,8 +1,17 @@
 #include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <unordered_map>
 
 #include "gtest/gtest.h"
-#include "transaction_manager.h"
+#define private public
+#include "transaction/transaction.h"
+#define class struct  // LockManager的成员默认是private，它依赖的头文件已经在上面包含
 #include "concurrency/lock_manager.h"
+#undef class
+#include "transaction_manager.h"
+#undef private  // for use private members in "lock_manager.h"
 #include "execution/execution_manager.h"
 
 const std::string TEST_DB_NAME = "LockManagerTestDB";
@@ -32,8 +41,35 @@ public:
         txn_manager_ = std::make_unique<TransactionManager>(lock_manager_.get(), sm_manager_.get());
 //        log_manager_->SetLogMode(false);
     }
+
+    // 事务在加锁对象上的申请，不存在时返回nullptr
+    LockManager::LockRequest *get_request(const LockDataId &lock_data_id, Transaction *txn) {
+        auto &bucket = lock_manager_->get_bucket(lock_data_id);
+        std::unique_lock<std::mutex> lock(bucket.latch_);
+        auto it = bucket.lock_table_.find(lock_data_id);
+        if (it == bucket.lock_table_.end()) return nullptr;
+        return LockManager::find_request(it->second, txn->get_transaction_id());
+    }
+
+    // 等待直到pred成立，最多等待timeout，返回pred是否成立
+    static bool wait_until(const std::function<bool()> &pred,
+                           std::chrono::milliseconds timeout = std::chrono::milliseconds(5000)) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!pred()) {
+            if (std::chrono::steady_clock::now() > deadline) return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+    // 事务是否正在等待加锁
+    bool is_waiting(Transaction *txn) {
+        std::unique_lock<std::mutex> lock(lock_manager_->wait_latch_);
+        return lock_manager_->waiting_for_.count(txn->get_transaction_id()) > 0;
+    }
 };
 
+
 /**
  * BasicTest系列只用于未处理死锁的lock_manager接口测试，如果加入了死锁预防，可以忽略BasicTest的结果，后续会对BasicTest进行处理
  * Deadlock_Prevention_Test用于测试死锁预防
@@ -261,6 +297,8 @@ TEST_F(LockManagerTest, BasicTest4_EXCLUSIVE_TABLE) {
 TEST_F(LockManagerTest, BasicTest5_INTENTION_SHARED) {
     // txnA -> table1.tuple{1,1} shared
     // txnB -> table1 exclusive
+    // txnB需要阻塞等待txnA释放锁，no-wait策略下会直接回滚
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::DETECTION);
     Rid rid{0, 0};
     int tab_fd = 0;
     LockDataId tuple1(tab_fd, rid, LockDataType::RECORD);
@@ -316,6 +354,8 @@ TEST_F(LockManagerTest, BasicTest5_INTENTION_SHARED) {
 TEST_F(LockManagerTest, BasicTest6_INTENTION_EXCLUSIVE) {
     // txnA -> table1.tuple{1,1} exclusive
     // txnB -> table1 shared
+    // txnB需要阻塞等待txnA释放锁，no-wait策略下会直接回滚
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::DETECTION);
     Rid rid{0, 0};
     int tab_fd = 0;
     LockDataId tuple1(tab_fd, rid, LockDataType::RECORD);
@@ -415,4 +455,414 @@ TEST_F(LockManagerTest, Deadlock_Prevetion_Test) {
     t0.join();
     t1.join();
 
-}
\ No newline at end of file
+}
+
+using LockMode = LockManager::LockMode;
+
+// test lock mode upgrade: the weakest mode covering both the held and the requested mode
+TEST_F(LockManagerTest, UpgradeModeTest) {
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::SHARED, LockMode::SHARED), LockMode::SHARED);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::INTENTION_SHARED, LockMode::SHARED), LockMode::SHARED);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::INTENTION_SHARED, LockMode::INTENTION_EXCLUSIVE),
+              LockMode::INTENTION_EXCLUSIVE);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::S_IX, LockMode::INTENTION_SHARED), LockMode::S_IX);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::INTENTION_EXCLUSIVE, LockMode::SHARED), LockMode::S_IX);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::SHARED, LockMode::INTENTION_EXCLUSIVE), LockMode::S_IX);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::S_IX, LockMode::INTENTION_EXCLUSIVE), LockMode::S_IX);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::S_IX, LockMode::SHARED), LockMode::S_IX);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::SHARED, LockMode::EXLUCSIVE), LockMode::EXLUCSIVE);
+    EXPECT_EQ(LockManager::upgrade_mode(LockMode::EXLUCSIVE, LockMode::INTENTION_SHARED), LockMode::EXLUCSIVE);
+}
+
+// test compatibility against the granted modes of other transactions
+TEST_F(LockManagerTest, CompatibilityTest) {
+    Transaction txn0(0);
+    Transaction txn1(1);
+    LockManager::LockRequestQueue queue;
+
+    auto &request0 = queue.request_queue_.emplace_back(&txn0, LockMode::INTENTION_EXCLUSIVE);
+    LockManager::grant(queue, request0, LockMode::INTENTION_EXCLUSIVE);
+    EXPECT_EQ(queue.group_lock_mode_, LockManager::GroupLockMode::IX);
+    EXPECT_TRUE(LockManager::is_compatible(queue, LockMode::INTENTION_SHARED, nullptr));
+    EXPECT_TRUE(LockManager::is_compatible(queue, LockMode::INTENTION_EXCLUSIVE, nullptr));
+    EXPECT_FALSE(LockManager::is_compatible(queue, LockMode::SHARED, nullptr));
+    EXPECT_FALSE(LockManager::is_compatible(queue, LockMode::S_IX, nullptr));
+    EXPECT_FALSE(LockManager::is_compatible(queue, LockMode::EXLUCSIVE, nullptr));
+    // 自己持有的锁不与自己的申请冲突
+    EXPECT_TRUE(LockManager::is_compatible(queue, LockMode::EXLUCSIVE, &request0));
+
+    auto &request1 = queue.request_queue_.emplace_back(&txn1, LockMode::INTENTION_SHARED);
+    LockManager::grant(queue, request1, LockMode::INTENTION_SHARED);
+    EXPECT_EQ(queue.group_lock_mode_, LockManager::GroupLockMode::IX);
+    EXPECT_TRUE(LockManager::is_compatible(queue, LockMode::S_IX, &request0));
+    EXPECT_FALSE(LockManager::is_compatible(queue, LockMode::EXLUCSIVE, &request0));
+    EXPECT_FALSE(LockManager::is_compatible(queue, LockMode::SHARED, &request1));
+
+    LockManager::grant(queue, request0, LockMode::S_IX);
+    EXPECT_EQ(queue.group_lock_mode_, LockManager::GroupLockMode::SIX);
+    EXPECT_EQ(queue.granted_count_[static_cast<int>(LockMode::INTENTION_EXCLUSIVE)], 0);
+    EXPECT_EQ(queue.granted_count_[static_cast<int>(LockMode::S_IX)], 1);
+    EXPECT_FALSE(LockManager::is_compatible(queue, LockMode::INTENTION_EXCLUSIVE, &request1));
+    EXPECT_TRUE(LockManager::is_compatible(queue, LockMode::INTENTION_SHARED, &request1));
+}
+
+// test lock upgrade on a table: IX + S = SIX, conflicting requests abort under no-wait
+TEST_F(LockManagerTest, TableLockUpgradeTest) {
+    int tab_fd = 0;
+    LockDataId table(tab_fd, LockDataType::TABLE);
+    Transaction txn0(0);
+    Transaction txn1(1);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::NO_WAIT);
+
+    EXPECT_TRUE(lock_manager_->lock_IX_on_table(&txn0, tab_fd));
+    EXPECT_TRUE(lock_manager_->lock_shared_on_table(&txn0, tab_fd));
+    auto request = get_request(table, &txn0);
+    ASSERT_NE(request, nullptr);
+    EXPECT_EQ(request->lock_mode_, LockMode::S_IX);
+    EXPECT_TRUE(txn0.get_table_lock_stat(tab_fd).shared_covered_);
+    EXPECT_FALSE(txn0.get_table_lock_stat(tab_fd).exclusive_covered_);
+    // 再申请更弱的锁不改变锁模式
+    EXPECT_TRUE(lock_manager_->lock_IS_on_table(&txn0, tab_fd));
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::S_IX);
+
+    EXPECT_TRUE(lock_manager_->lock_IS_on_table(&txn1, tab_fd));
+    EXPECT_THROW(lock_manager_->lock_IX_on_table(&txn1, tab_fd), TransactionAbortException);
+    EXPECT_EQ(get_request(table, &txn1)->lock_mode_, LockMode::INTENTION_SHARED);
+    EXPECT_THROW(lock_manager_->lock_exclusive_on_table(&txn0, tab_fd), TransactionAbortException);
+
+    EXPECT_TRUE(lock_manager_->unlock(&txn1, table));
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_table(&txn0, tab_fd));
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::EXLUCSIVE);
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, table));
+    EXPECT_EQ(get_request(table, &txn0), nullptr);
+}
+
+// test wait-die: a younger requester dies at once, an older requester waits for the younger holder
+TEST_F(LockManagerTest, WaitDieTest) {
+    int tab_fd = 0;
+    Rid rid{0, 0};
+    LockDataId tuple(tab_fd, rid, LockDataType::RECORD);
+    Transaction txn0(0);
+    Transaction txn1(1);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::WAIT_DIE);
+
+    // txn0 older holds X, txn1 younger dies
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, rid, tab_fd));
+    EXPECT_THROW(lock_manager_->lock_shared_on_record(&txn1, rid, tab_fd), TransactionAbortException);
+    EXPECT_EQ(get_request(tuple, &txn1), nullptr);
+    EXPECT_FALSE(is_waiting(&txn1));
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, tuple));
+
+    // txn3 younger holds X, txn2 older waits until txn3 releases
+    Transaction txn2(2);
+    Transaction txn3(3);
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn3, rid, tab_fd));
+    std::atomic<bool> granted = false;
+    std::thread t0([&] {
+        EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn2, rid, tab_fd));
+        granted = true;
+    });
+    EXPECT_TRUE(wait_until([&] { return is_waiting(&txn2); }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(granted);
+    EXPECT_FALSE(txn3.is_wounded());
+    EXPECT_TRUE(lock_manager_->unlock(&txn3, tuple));
+    t0.join();
+    EXPECT_TRUE(granted);
+    EXPECT_EQ(get_request(tuple, &txn2)->lock_mode_, LockMode::EXLUCSIVE);
+    EXPECT_TRUE(lock_manager_->unlock(&txn2, tuple));
+}
+
+// test wound-wait: an older requester wounds the younger holder, a younger requester waits for the older holder
+TEST_F(LockManagerTest, WoundWaitTest) {
+    int tab_fd = 0;
+    Rid rid{0, 0};
+    LockDataId tuple(tab_fd, rid, LockDataType::RECORD);
+    Transaction txn0(0);
+    Transaction txn1(1);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::WOUND_WAIT);
+
+    // txn1 younger holds X, txn0 older wounds it and waits until the wounded txn1 rolls back
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn1, rid, tab_fd));
+    std::atomic<bool> granted = false;
+    std::thread t0([&] {
+        EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, rid, tab_fd));
+        granted = true;
+    });
+    EXPECT_TRUE(wait_until([&] { return txn1.is_wounded(); }));
+    EXPECT_FALSE(granted);
+    EXPECT_FALSE(txn0.is_wounded());
+    EXPECT_TRUE(lock_manager_->unlock(&txn1, tuple));
+    t0.join();
+    EXPECT_TRUE(granted);
+
+    // txn0 older holds X, txn3 younger waits and txn0 is not wounded
+    Transaction txn3(3);
+    granted = false;
+    std::thread t1([&] {
+        EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn3, rid, tab_fd));
+        granted = true;
+    });
+    EXPECT_TRUE(wait_until([&] { return is_waiting(&txn3); }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(granted);
+    EXPECT_FALSE(txn0.is_wounded());
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, tuple));
+    t1.join();
+    EXPECT_TRUE(granted);
+    EXPECT_EQ(get_request(tuple, &txn3)->lock_mode_, LockMode::SHARED);
+    EXPECT_TRUE(lock_manager_->unlock(&txn3, tuple));
+}
+
+// test wound-wait on a waiting victim: the wounded transaction stops waiting and aborts
+TEST_F(LockManagerTest, WoundWaitingTest) {
+    int tab_fd = 0;
+    Rid rid0{0, 0};
+    Rid rid1{1, 1};
+    Transaction txn0(0);
+    Transaction txn1(1);
+    Transaction txn2(2);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::WOUND_WAIT);
+
+    // txn1 holds rid0 and waits for rid1 held by the younger txn2, then txn0 wounds txn1
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn1, rid0, tab_fd));
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn2, rid1, tab_fd));
+    std::atomic<bool> aborted = false;
+    std::thread t1([&] {
+        try {
+            lock_manager_->lock_exclusive_on_record(&txn1, rid1, tab_fd);
+        } catch (TransactionAbortException &e) {
+            aborted = true;
+            lock_manager_->unlock(&txn1, LockDataId(tab_fd, rid0, LockDataType::RECORD));
+        }
+    });
+    // txn1比txn2老，会先wound txn2；txn2不回滚，txn1一直等待
+    EXPECT_TRUE(wait_until([&] { return txn2.is_wounded(); }));
+    EXPECT_TRUE(wait_until([&] { return is_waiting(&txn1); }));
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, rid0, tab_fd));
+    t1.join();
+    EXPECT_TRUE(aborted);
+    EXPECT_TRUE(txn1.is_wounded());
+    EXPECT_FALSE(txn0.is_wounded());
+    lock_manager_->unlock(&txn0, LockDataId(tab_fd, rid0, LockDataType::RECORD));
+    lock_manager_->unlock(&txn2, LockDataId(tab_fd, rid1, LockDataType::RECORD));
+}
+
+// test deadlock detection: the youngest transaction in a cycle is the only victim
+TEST_F(LockManagerTest, DetectDeadlockTest) {
+    int tab_fd = 0;
+    Rid rid0{0, 0};
+    Rid rid1{1, 1};
+    Rid rid2{2, 2};
+    Transaction txn0(0);
+    Transaction txn1(1);
+    Transaction txn2(2);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::DETECTION);
+
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, rid0, tab_fd));
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn1, rid1, tab_fd));
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn2, rid2, tab_fd));
+
+    // txn0 -> txn1 -> txn0构成环，txn2等待txn0但不在环上，不能被选为牺牲者
+    std::atomic<bool> aborted[3] = {false, false, false};
+    auto task = [&](Transaction *txn, Rid wait_rid, Rid held_rid) {
+        try {
+            lock_manager_->lock_exclusive_on_record(txn, wait_rid, tab_fd);
+            lock_manager_->unlock(txn, LockDataId(tab_fd, wait_rid, LockDataType::RECORD));
+        } catch (TransactionAbortException &e) {
+            aborted[txn->get_transaction_id()] = true;
+        }
+        lock_manager_->unlock(txn, LockDataId(tab_fd, held_rid, LockDataType::RECORD));
+    };
+    std::thread t0(task, &txn0, rid1, rid0);
+    std::thread t1(task, &txn1, rid0, rid1);
+    std::thread t2(task, &txn2, rid0, rid2);
+    EXPECT_TRUE(wait_until([&] { return is_waiting(&txn0) && is_waiting(&txn1) && is_waiting(&txn2); }));
+
+    lock_manager_->detect_deadlock();
+    t0.join();
+    t1.join();
+    t2.join();
+    EXPECT_FALSE(aborted[0]);
+    EXPECT_TRUE(aborted[1]);
+    EXPECT_FALSE(aborted[2]);
+    EXPECT_FALSE(txn0.is_wounded());
+    EXPECT_FALSE(txn2.is_wounded());
+}
+
+// test deadlock detection without a cycle: waiting transactions are left alone
+TEST_F(LockManagerTest, DetectNoDeadlockTest) {
+    int tab_fd = 0;
+    Rid rid{0, 0};
+    LockDataId tuple(tab_fd, rid, LockDataType::RECORD);
+    Transaction txn0(0);
+    Transaction txn1(1);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::DETECTION);
+
+    EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn1, rid, tab_fd));
+    std::atomic<bool> granted = false;
+    std::thread t0([&] {
+        EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, rid, tab_fd));
+        granted = true;
+    });
+    EXPECT_TRUE(wait_until([&] { return is_waiting(&txn0); }));
+    lock_manager_->detect_deadlock();
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_FALSE(granted);
+    EXPECT_FALSE(txn0.is_wounded());
+    EXPECT_FALSE(txn1.is_wounded());
+    EXPECT_TRUE(lock_manager_->unlock(&txn1, tuple));
+    t0.join();
+    EXPECT_TRUE(granted);
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, tuple));
+}
+
+// test lock escalation: row S locks under IS escalate to a table S lock and the covered row locks are released
+TEST_F(LockManagerTest, SharedEscalationTest) {
+    int tab_fd = 0;
+    LockDataId table(tab_fd, LockDataType::TABLE);
+    Transaction txn0(0);
+    int threshold = lock_escalation_threshold.exchange(4);
+
+    EXPECT_TRUE(lock_manager_->lock_IS_on_table(&txn0, tab_fd));
+    for (int i = 0; i < 3; i++) {
+        EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn0, Rid{i, i}, tab_fd));
+    }
+    auto &stat = txn0.get_table_lock_stat(tab_fd);
+    EXPECT_EQ(stat.row_locks_, 3);
+    EXPECT_FALSE(stat.shared_covered_);
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::INTENTION_SHARED);
+
+    EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn0, Rid{3, 3}, tab_fd));
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::SHARED);
+    EXPECT_TRUE(stat.shared_covered_);
+    EXPECT_FALSE(stat.exclusive_covered_);
+    EXPECT_EQ(stat.row_locks_, 0);
+    EXPECT_EQ(txn0.get_lock_set()->size(), 1);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(get_request(LockDataId(tab_fd, Rid{i, i}, LockDataType::RECORD), &txn0), nullptr);
+    }
+    // 之后的行级S锁被表级锁覆盖，不再申请
+    EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn0, Rid{4, 4}, tab_fd));
+    EXPECT_EQ(get_request(LockDataId(tab_fd, Rid{4, 4}, LockDataType::RECORD), &txn0), nullptr);
+    EXPECT_EQ(stat.row_locks_, 0);
+
+    lock_escalation_threshold = threshold;
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, table));
+}
+
+// test lock escalation with row X locks: escalate to a table X lock, or keep row locks while the table is in use
+TEST_F(LockManagerTest, ExclusiveEscalationTest) {
+    int tab_fd = 0;
+    LockDataId table(tab_fd, LockDataType::TABLE);
+    Transaction txn0(0);
+    Transaction txn1(1);
+    int threshold = lock_escalation_threshold.exchange(4);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::NO_WAIT);
+
+    // txn1在表上持有IS锁，与表级X锁冲突，升级失败但不等待也不回滚
+    EXPECT_TRUE(lock_manager_->lock_IS_on_table(&txn1, tab_fd));
+    EXPECT_TRUE(lock_manager_->lock_IX_on_table(&txn0, tab_fd));
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, Rid{i, i}, tab_fd));
+    }
+    auto &stat = txn0.get_table_lock_stat(tab_fd);
+    EXPECT_EQ(stat.failed_escalations_, 1);
+    EXPECT_EQ(stat.row_locks_, 4);
+    EXPECT_FALSE(stat.exclusive_covered_);
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::INTENTION_EXCLUSIVE);
+
+    // 再持有一个阈值的行级锁时才再次尝试升级
+    EXPECT_TRUE(lock_manager_->unlock(&txn1, table));
+    for (int i = 4; i < 7; i++) {
+        EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, Rid{i, i}, tab_fd));
+    }
+    EXPECT_EQ(stat.row_locks_, 7);
+    EXPECT_FALSE(stat.exclusive_covered_);
+
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, Rid{7, 7}, tab_fd));
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::EXLUCSIVE);
+    EXPECT_TRUE(stat.shared_covered_);
+    EXPECT_TRUE(stat.exclusive_covered_);
+    EXPECT_EQ(stat.row_locks_, 0);
+    EXPECT_EQ(txn0.get_lock_set()->size(), 1);
+    for (int i = 0; i < 8; i++) {
+        EXPECT_EQ(get_request(LockDataId(tab_fd, Rid{i, i}, LockDataType::RECORD), &txn0), nullptr);
+    }
+    EXPECT_THROW(lock_manager_->lock_IS_on_table(&txn1, tab_fd), TransactionAbortException);
+
+    lock_escalation_threshold = threshold;
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, table));
+}
+
+// test lock escalation to SIX: row S locks under IX escalate to a table SIX lock, later row X locks are still taken
+TEST_F(LockManagerTest, SixEscalationTest) {
+    int tab_fd = 0;
+    LockDataId table(tab_fd, LockDataType::TABLE);
+    LockDataId tuple(tab_fd, Rid{4, 4}, LockDataType::RECORD);
+    Transaction txn0(0);
+    int threshold = lock_escalation_threshold.exchange(4);
+
+    EXPECT_TRUE(lock_manager_->lock_IX_on_table(&txn0, tab_fd));
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn0, Rid{i, i}, tab_fd));
+    }
+    auto &stat = txn0.get_table_lock_stat(tab_fd);
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::S_IX);
+    EXPECT_TRUE(stat.shared_covered_);
+    EXPECT_FALSE(stat.exclusive_covered_);
+    EXPECT_EQ(stat.row_locks_, 0);
+    for (int i = 0; i < 4; i++) {
+        EXPECT_EQ(get_request(LockDataId(tab_fd, Rid{i, i}, LockDataType::RECORD), &txn0), nullptr);
+    }
+
+    // SIX不覆盖行级X锁
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, Rid{4, 4}, tab_fd));
+    EXPECT_EQ(get_request(tuple, &txn0)->lock_mode_, LockMode::EXLUCSIVE);
+    EXPECT_EQ(stat.row_locks_, 1);
+    EXPECT_TRUE(stat.has_exclusive_row_);
+
+    lock_escalation_threshold = threshold;
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, tuple));
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, table));
+}
+
+// test row locks register intention locks on the table: an uncommitted update only takes row X locks,
+// a table S lock or a shared escalation must not be granted while it holds them
+TEST_F(LockManagerTest, RowLockIntentionTest) {
+    int tab_fd = 0;
+    LockDataId table(tab_fd, LockDataType::TABLE);
+    LockDataId tuple(tab_fd, Rid{0, 0}, LockDataType::RECORD);
+    Transaction txn0(0);
+    Transaction txn1(1);
+    int threshold = lock_escalation_threshold.exchange(4);
+    lock_manager_->set_deadlock_policy(DeadlockPolicy::NO_WAIT);
+
+    EXPECT_TRUE(lock_manager_->lock_exclusive_on_record(&txn0, Rid{0, 0}, tab_fd));
+    ASSERT_NE(get_request(table, &txn0), nullptr);
+    EXPECT_EQ(get_request(table, &txn0)->lock_mode_, LockMode::INTENTION_EXCLUSIVE);
+
+    // 表级S锁与txn0的IX锁冲突，txn1不能不加行锁读到未提交的修改
+    EXPECT_THROW(lock_manager_->lock_shared_on_table(&txn1, tab_fd), TransactionAbortException);
+    EXPECT_EQ(get_request(table, &txn1), nullptr);
+    EXPECT_FALSE(txn1.get_table_lock_stat(tab_fd).shared_covered_);
+
+    // txn1在其他行上的S锁达到阈值时升级为表级S锁失败，继续使用行级锁
+    for (int i = 1; i <= 4; i++) {
+        EXPECT_TRUE(lock_manager_->lock_shared_on_record(&txn1, Rid{i, i}, tab_fd));
+    }
+    auto &stat = txn1.get_table_lock_stat(tab_fd);
+    EXPECT_EQ(get_request(table, &txn1)->lock_mode_, LockMode::INTENTION_SHARED);
+    EXPECT_EQ(stat.failed_escalations_, 1);
+    EXPECT_FALSE(stat.shared_covered_);
+    EXPECT_THROW(lock_manager_->lock_shared_on_record(&txn1, Rid{0, 0}, tab_fd), TransactionAbortException);
+
+    // txn0提交后txn1可以加表级S锁
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, tuple));
+    EXPECT_TRUE(lock_manager_->unlock(&txn0, table));
+    EXPECT_TRUE(lock_manager_->lock_shared_on_table(&txn1, tab_fd));
+    EXPECT_EQ(get_request(table, &txn1)->lock_mode_, LockMode::SHARED);
+
+    lock_escalation_threshold = threshold;
+    EXPECT_TRUE(lock_manager_->unlock(&txn1, table));
+}
@@ -11,23 +11,46 @@ See the Mulan PSL v2 for more details. */
 #pragma once
 
 #include <atomic>
+#include <cstddef>
+#include <cstring>
 #include <deque>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <memory>
+#include <new>
 #include "txn_defs.h"
 
 class Transaction {
    public:
     explicit Transaction(txn_id_t txn_id, IsolationLevel isolation_level = IsolationLevel::SERIALIZABLE)
-        : state_(TransactionState::DEFAULT), isolation_level_(isolation_level), txn_id_(txn_id) {
+        : isolation_level_(isolation_level), txn_id_(txn_id) {
         write_set_ = std::make_shared<std::deque<WriteRecord *>>();
+        read_set_ = std::make_shared<std::deque<ReadRecord>>();
         lock_set_ = std::make_shared<std::unordered_set<LockDataId>>();
         index_latch_page_set_ = std::make_shared<std::deque<Page *>>();
         index_deleted_page_set_ = std::make_shared<std::deque<Page*>>();
-        prev_lsn_ = INVALID_LSN;
+        reset(txn_id, isolation_level);
+    }
+
+    /**
+     * @description: 复用已经结束的事务对象开始新事务，调用前已经通过clear()清空了各个集合
+     * @param {txn_id_t} txn_id 新事务的ID
+     * @param {IsolationLevel} isolation_level 新事务的隔离级别
+     */
+    void reset(txn_id_t txn_id, IsolationLevel isolation_level) {
+        txn_mode_ = false;
+        state_ = TransactionState::DEFAULT;
+        isolation_level_ = isolation_level;
+        optimistic_ = false;
+        read_only_ = false;
         thread_id_ = std::this_thread::get_id();
+        prev_lsn_ = INVALID_LSN;
+        begin_lsn_ = INVALID_LSN;
+        txn_id_ = txn_id;
+        start_ts_ = 0;
+        wounded_ = false;
     }
 
     ~Transaction() = default;
@@ -44,21 +67,59 @@ class Transaction {
 
     inline IsolationLevel get_isolation_level() { return isolation_level_; }
 
+    inline bool is_optimistic() { return optimistic_; }
+    inline void set_optimistic(bool optimistic) { optimistic_ = optimistic; }
+
+    inline bool is_read_only() { return read_only_; }
+    inline void set_read_only(bool read_only) { read_only_ = read_only; }
+
     inline TransactionState get_state() { return state_; }
     inline void set_state(TransactionState state) { state_ = state; }
 
+    inline bool is_wounded() { return wounded_; }
+    inline void set_wounded() { wounded_ = true; }
+
     inline lsn_t get_prev_lsn() { return prev_lsn_; }
     inline void set_prev_lsn(lsn_t prev_lsn) { prev_lsn_ = prev_lsn; }
 
+    inline lsn_t get_begin_lsn() { return begin_lsn_; }
+    inline void set_begin_lsn(lsn_t begin_lsn) { begin_lsn_ = begin_lsn; }
+
     inline std::shared_ptr<std::deque<WriteRecord *>> get_write_set() { return write_set_; }  
-    inline void append_write_record(WriteRecord* write_record) { write_set_->push_back(write_record); }
-    inline void delete_write_record() { write_set_->pop_back(); }
+    /**
+     * @description: 在事务的arena中记录一个写操作，record为回滚时需要的记录内容，批量导入时为空指针
+     */
+    inline void append_write_record(WType wtype, const std::string &tab_name, const Rid &rid,
+                                    const RmRecord *record = nullptr) {
+        auto *write_record = new (arena_.allocate(sizeof(WriteRecord), alignof(WriteRecord)))
+                WriteRecord(wtype, tab_name, rid);
+        if (record != nullptr) {
+            auto *image = static_cast<char *>(arena_.allocate(record->size, alignof(std::max_align_t)));
+            memcpy(image, record->data, record->size);
+            write_record->SetImage(image, record->size);
+        }
+        write_set_->push_back(write_record);
+    }
+    // 删除最后一个写操作，arena中的空间在事务结束时统一回收
+    inline void delete_write_record() {
+        write_set_->back()->~WriteRecord();
+        write_set_->pop_back();
+    }
     inline WriteRecord * get_last_write_record() { return write_set_->back(); }
+    inline std::shared_ptr<std::deque<ReadRecord>> get_read_set() { return read_set_; }
+    inline void append_read_record(ReadRecord read_record) { read_set_->push_back(std::move(read_record)); }
+
     inline void clear(){
+        for (auto *write_record: *write_set_) {
+            write_record->~WriteRecord();
+        }
         write_set_->clear();
+        arena_.reset();
+        read_set_->clear();
         lock_set_->clear();
         index_latch_page_set_->clear();
         index_deleted_page_set_->clear();
+        table_lock_stats_.clear();
     }
 
     inline std::shared_ptr<std::deque<Page*>> get_index_deleted_page_set() { return index_deleted_page_set_; }
@@ -71,17 +132,26 @@ class Transaction {
     inline void set_lock_set(LockDataId lockDataId) { lock_set_->insert(lockDataId); }
     inline bool erase_lock_set(LockDataId lockDataId) { return lock_set_->erase(lockDataId); }
 
+    inline TableLockStat &get_table_lock_stat(int tab_fd) { return table_lock_stats_[tab_fd]; }
+
    private:
     bool txn_mode_{};                   // 用于标识当前事务为显式事务还是单条SQL语句的隐式事务
     TransactionState state_;          // 事务状态
     IsolationLevel isolation_level_;  // 事务的隔离级别，默认隔离级别为可串行化
+    bool optimistic_{};               // 是否使用乐观并发控制：不加行锁，提交时验证读集合
+    bool read_only_{};                // 是否为单条SELECT的只读事务：读快照，不加锁，不写日志，不进入全局事务表
     std::thread::id thread_id_;       // 当前事务对应的线程id
     lsn_t prev_lsn_;                  // 当前事务执行的最后一条操作对应的lsn，用于系统故障恢复
+    lsn_t begin_lsn_;                 // 事务begin日志的lsn，早于所有活跃事务begin日志的日志才能被截断
     txn_id_t txn_id_;                 // 事务的ID，唯一标识符
     timestamp_t start_ts_{};            // 事务的开始时间戳
+    std::atomic<bool> wounded_{false};  // wound-wait策略下被更老的事务要求回滚，或被死锁检测选为牺牲者，由其他线程设置
 
     std::shared_ptr<std::deque<WriteRecord *>> write_set_;  // 事务包含的所有写操作
+    TxnArena arena_;                                        // 写操作记录和其中的undo镜像
+    std::shared_ptr<std::deque<ReadRecord>> read_set_;      // 乐观并发控制下事务的所有读操作
     std::shared_ptr<std::unordered_set<LockDataId>> lock_set_;  // 事务申请的所有锁
+    std::unordered_map<int, TableLockStat> table_lock_stats_;   // 每张表上的行级锁个数和表级锁覆盖情况，只由事务自己的线程访问
     std::shared_ptr<std::deque<Page*>> index_latch_page_set_;          // 维护事务执行过程中加锁的索引页面
     std::shared_ptr<std::deque<Page*>> index_deleted_page_set_;    // 维护事务执行过程中删除的索引页面
 };
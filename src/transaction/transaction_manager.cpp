@@ -19,25 +19,82 @@ std::unordered_map<txn_id_t, Transaction *> TransactionManager::txn_map = {};
  * @return {Transaction*} 开始事务的指针
  * @param {Transaction*} txn 事务指针，空指针代表需要创建新事务，否则开始已有事务
  * @param {LogManager*} log_manager 日志管理器指针
+ * @param {IsolationLevel} isolation_level 新事务的隔离级别，快照读的事务在开始时取快照
  */
-Transaction * TransactionManager::begin(Transaction* txn, LogManager* log_manager) {
+Transaction * TransactionManager::begin(Transaction* txn, LogManager* log_manager, IsolationLevel isolation_level) {
     // Todo:
     // 1. 判断传入事务参数是否为空指针
     // 2. 如果为空指针，创建新事务
     // 3. 把开始事务加入到全局事务表中
     // 4. 返回当前事务指针
     if(txn == nullptr){
-        txn = new Transaction(get_next_txn_id());
+        // 乐观事务在开始时取快照，整个事务读同一个快照，提交时验证
+        bool optimistic = concurrency_mode_ == ConcurrencyMode::OPTIMISTIC;
+        txn = acquire_transaction(optimistic ? IsolationLevel::SERIALIZABLE : isolation_level);
+        txn->set_optimistic(optimistic);
+    }
+    if (VersionStore::is_snapshot_isolation(txn)) {
+        version_store_.begin_snapshot(txn);
     }
     std::unique_lock<std::mutex> lock(latch_);
     txn_map.emplace(txn->get_transaction_id(), txn);
-    auto *log = new BeginLogRecord(txn->get_transaction_id());
-    log->prev_lsn_ = txn->get_prev_lsn();
-    log_manager->add_log_to_buffer(log);
-    txn->set_prev_lsn(log->lsn_);
+    BeginLogRecord log(txn->get_transaction_id());
+    log.prev_lsn_ = txn->get_prev_lsn();
+    log_manager->add_log_to_buffer(&log);
+    txn->set_prev_lsn(log.lsn_);
+    txn->set_begin_lsn(log.lsn_);
+    return txn;
+}
+
+/**
+ * @description: 开始单条SELECT语句的只读事务。只读事务读开始时刻的快照，不加锁，
+ * 不写begin/commit日志，也不加入全局事务表，结束时只需要释放快照，调用者负责释放事务对象。
+ * 快照中恰好是此前提交的所有事务的修改，在可串行化级别下相当于在快照时刻执行
+ * @return {Transaction*} 只读事务的指针
+ */
+Transaction *TransactionManager::begin_read_only() {
+    auto *txn = acquire_transaction(IsolationLevel::REPEATABLE_READ);
+    txn->set_read_only(true);
+    txn->set_state(TransactionState::GROWING);
+    version_store_.begin_snapshot(txn);
     return txn;
 }
 
+/**
+ * @description: 事务结束后由调用者释放事务对象：从全局事务表中删除，对象放回池中供之后的事务复用。
+ * 提交和回滚时已经清空了事务的各个集合，写操作记录所在的arena也已重置
+ * @param {Transaction*} txn 已经提交或回滚的事务
+ */
+void TransactionManager::release(Transaction *txn) {
+    std::unique_lock<std::mutex> lock(latch_);
+    txn_map.erase(txn->get_transaction_id());
+    if (txn_pool_.size() < TXN_POOL_SIZE) {
+        txn_pool_.push_back(txn);
+    } else {
+        delete txn;
+    }
+}
+
+/**
+ * @description: 从池中取出一个事务对象并分配新的事务ID，池为空时创建新对象
+ * @param {IsolationLevel} isolation_level 新事务的隔离级别
+ * @return {Transaction*} 状态为DEFAULT的事务对象
+ */
+Transaction *TransactionManager::acquire_transaction(IsolationLevel isolation_level) {
+    txn_id_t txn_id = get_next_txn_id();
+    {
+        std::unique_lock<std::mutex> lock(latch_);
+        if (!txn_pool_.empty()) {
+            auto *txn = txn_pool_.back();
+            txn_pool_.pop_back();
+            lock.unlock();
+            txn->reset(txn_id, isolation_level);
+            return txn;
+        }
+    }
+    return new Transaction(txn_id, isolation_level);
+}
+
 /**
  * @description: 事务的提交方法
  * @param {Transaction*} txn 需要提交的事务
@@ -50,6 +107,27 @@ void TransactionManager::commit(Transaction* txn, LogManager* log_manager) {
     // 3. 释放事务相关资源，eg.锁集
     // 4. 把事务日志刷入磁盘中
     // 5. 更新事务状态
+    // 只读事务没有锁和日志，释放快照即可
+    if (txn->is_read_only()) {
+        version_store_.commit(txn);
+        txn->set_state(TransactionState::COMMITTED);
+        return;
+    }
+    // 在释放锁之前打上提交时间戳，之后获得锁的事务能据此判断写冲突
+    // 乐观事务先验证读集合，验证失败时抛出异常，由调用者回滚；修改之后的记录一并交给版本存储，用于验证其他事务
+    if (txn->is_optimistic()) {
+        std::vector<AfterImage> after_images;
+        Context context(lock_manager_, log_manager, txn);
+        for (auto *write_record: *txn->get_write_set()) {
+            auto fh = sm_manager_->fhs_.find(write_record->GetTableName());
+            if (write_record->GetWriteType() == WType::BULK_LOAD || fh == sm_manager_->fhs_.end()) continue;
+            const Rid &rid = write_record->GetRid();
+            after_images.push_back({fh->second->GetFd(), rid, fh->second->get_visible_record(rid, &context)});
+        }
+        version_store_.commit(txn, &after_images);
+    } else {
+        version_store_.commit(txn);
+    }
     //释放所有锁
     //释放事务相关资源，eg.锁集
     auto lock_set = txn->get_lock_set();
@@ -58,60 +136,104 @@ void TransactionManager::commit(Transaction* txn, LogManager* log_manager) {
     }
     txn->clear();
     // 4. 把事务日志刷入磁盘中
-    auto *log = new CommitLogRecord(txn->get_transaction_id());
-    log->prev_lsn_ = txn->get_prev_lsn();
-    log_manager->add_log_to_buffer(log);
-    txn->set_prev_lsn(log->lsn_);
+    CommitLogRecord log(txn->get_transaction_id());
+    log.prev_lsn_ = txn->get_prev_lsn();
+    log_manager->add_log_to_buffer(&log);
+    txn->set_prev_lsn(log.lsn_);
+    // 等待日志写线程把commit日志持久化
+    log_manager->wait_for_flush(log.lsn_);
     // 5. 更新事务状态
     txn->set_state(TransactionState::COMMITTED);
 }
 
-void TransactionManager::delete_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_){
+/**
+ * @description: 找出索引项会因为记录从old_rec变为new_rec而改变的索引，即包含被修改字段的索引
+ * @return {vector<const IndexMeta *>} 受影响的索引
+ * @param {TabMeta&} tab 记录所在的表
+ * @param {RmRecord&} old_rec 修改之前的记录
+ * @param {RmRecord&} new_rec 修改之后的记录
+ */
+std::vector<const IndexMeta *> TransactionManager::affected_indexes(const TabMeta &tab, const RmRecord &old_rec,
+                                                                    const RmRecord &new_rec) {
+    std::vector<const IndexMeta *> indexes;
+    for (auto &index: tab.indexes) {
+        for (auto &col: tab.cols) {
+            if (memcmp(old_rec.data + col.offset, new_rec.data + col.offset, col.len) != 0 &&
+                index.covers(col.name)) {
+                indexes.push_back(&index);
+                break;
+            }
+        }
+    }
+    return indexes;
+}
+
+/**
+ * @description: 删除记录rec在表上的索引项
+ * @param {vector<const IndexMeta *>*} indexes 只删除这些索引中的索引项，为nullptr时删除所有索引中的索引项
+ */
+void TransactionManager::delete_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_,
+                                      const std::vector<const IndexMeta *> *indexes){
     // 删除索引
     auto &tab = sm_manager_->db_.get_table(tab_name);
     for (auto &index: tab.indexes) {
+        if (indexes != nullptr && std::find(indexes->begin(), indexes->end(), &index) == indexes->end()) continue;
         auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name, index.cols);
         auto ih = sm_manager_->ihs_.at(ix_name).get();
-        char *key = new char[index.col_tot_len];
-        int offset = 0;
-        for (size_t j = 0; j < index.col_num; ++j) {
-            memcpy(key + offset, rec->data + index.cols[j].offset, index.cols[j].len);
-            offset += index.cols[j].len;
+        std::vector<char> key(index.entry_len());
+        index.get_key(rec->data, key.data());
+
+        //写索引删除日志，由索引在修改完页面后调用
+        auto logger = context_->index_logger(LogType::INDEX_DELETE, key.data(), rid_, index.id, index.entry_len());
+
+        ih->delete_entry(key.data(), rid_, nullptr, logger);
+    }
+}
+
+/**
+ * @description: 删除批量导入的记录rec在表上的索引项。导入因唯一索引键重复而回滚时，失败的记录及其之后的记录
+ * 没有插入索引项，唯一索引按key删除会删掉已有记录的索引项，因此只删除指向rid的索引项
+ */
+void TransactionManager::delete_loaded_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_) {
+    auto &tab = sm_manager_->db_.get_table(tab_name);
+    for (auto &index: tab.indexes) {
+        auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name, index.cols);
+        auto ih = sm_manager_->ihs_.at(ix_name).get();
+        std::vector<char> key(index.entry_len());
+        index.get_key(rec->data, key.data());
+        if (index.unique) {
+            std::vector<Rid> rids;
+            ih->get_value(key.data(), &rids, nullptr);
+            if (rids.empty() || rids[0] != rid_) continue;
         }
 
-        //更新索引删除日志
-        auto *index_log = new IndexDeleteLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name, index.col_tot_len);
-        index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-        context_->log_mgr_->add_log_to_buffer(index_log);
-        context_->txn_->set_prev_lsn(index_log->lsn_);
+        //写索引删除日志，由索引在修改完页面后调用
+        auto logger = context_->index_logger(LogType::INDEX_DELETE, key.data(), rid_, index.id, index.entry_len());
 
-        ih->delete_entry(key, nullptr);
-        free(key);
+        ih->delete_entry(key.data(), rid_, nullptr, logger);
     }
 }
 
-void TransactionManager::insert_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_){
+/**
+ * @description: 插入记录rec在表上的索引项
+ * @param {vector<const IndexMeta *>*} indexes 只插入这些索引中的索引项，为nullptr时插入所有索引中的索引项
+ */
+void TransactionManager::insert_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_,
+                                      const std::vector<const IndexMeta *> *indexes){
     // 插入索引
     auto &tab = sm_manager_->db_.get_table(tab_name);
     for (auto & index : tab.indexes) {
+        if (indexes != nullptr && std::find(indexes->begin(), indexes->end(), &index) == indexes->end()) continue;
         auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name, index.cols);
         auto ih = sm_manager_->ihs_.at(ix_name).get();
-        char *key = new char[index.col_tot_len];
-        int offset = 0;
-        for (size_t j = 0; j < index.col_num; ++j) {
-            memcpy(key + offset, rec->data + index.cols[j].offset, index.cols[j].len);
-            offset += index.cols[j].len;
-        }
+        std::vector<char> key(index.entry_len());
+        index.get_key(rec->data, key.data());
 
-        //更新索引插入日志
-        auto *index_log = new IndexInsertLogRecord(context_->txn_->get_transaction_id(), key, rid_, ix_name, index.col_tot_len);
-        index_log->prev_lsn_ = context_->txn_->get_prev_lsn();
-        context_->log_mgr_->add_log_to_buffer(index_log);
-        context_->txn_->set_prev_lsn(index_log->lsn_);
+        //写索引插入日志，由索引在修改完页面后调用
+        auto logger = context_->index_logger(LogType::INDEX_INSERT, key.data(), rid_, index.id, index.entry_len());
 
-        auto result = ih->insert_entry(key, rid_, nullptr);
+        auto result = ih->insert_entry(key.data(), rid_, nullptr, logger);
         assert(result.second == true);
-        free(key);
     }
 }
 
@@ -128,56 +250,81 @@ void TransactionManager::abort(Context * context, LogManager *log_manager) {
     // 4. 把事务日志刷入磁盘中
     // 5. 更新事务状态
     auto txn = context->txn_;
+    if (txn->is_read_only()) {
+        version_store_.abort(txn);
+        txn->set_state(TransactionState::ABORTED);
+        return;
+    }
     auto write_set = txn->get_write_set();
     //从后往前遍历
     while(!write_set->empty()){
         auto last = write_set->back();
-        write_set->pop_back();
         auto type = last->GetWriteType();
         auto rid = last->GetRid();
         auto tab_name = last->GetTableName();
         auto rec = last->GetRecord();
         assert(sm_manager_->fhs_.count(tab_name));
         auto rfh = sm_manager_->fhs_[tab_name].get();
+        auto &tab = sm_manager_->db_.get_table(tab_name);
         if(type == WType::INSERT_TUPLE){
             //插入操作, 应该删除
 //            std::cout << "rollback insert\n";
 
             //更新日志
-            auto *logRecord = new DeleteLogRecord(context->txn_->get_transaction_id(), rec, rid,tab_name);
-            logRecord->prev_lsn_ = context->txn_->get_prev_lsn();
-            context->log_mgr_->add_log_to_buffer(logRecord);
-            context->txn_->set_prev_lsn(logRecord->lsn_);
+            DeleteLogRecord logRecord(context->txn_->get_transaction_id(), rec, rid, tab.id);
+            logRecord.prev_lsn_ = context->txn_->get_prev_lsn();
+            context->log_mgr_->add_log_to_buffer(&logRecord);
+            context->txn_->set_prev_lsn(logRecord.lsn_);
 
             delete_index(tab_name, &rec, rid, context);
-            rfh->delete_record(rid, context);
+            rfh->delete_record(rid, context, logRecord.lsn_);
         }else if(type == WType::DELETE_TUPLE){
             //删除操作, 应该插入
 //            std::cout << "rollback delete\n";
             //更新日志-插入
-            auto *logRecord = new InsertLogRecord(context->txn_->get_transaction_id(), rec, rid,tab_name);
-            logRecord->prev_lsn_ = context->txn_->get_prev_lsn();
-            context->log_mgr_->add_log_to_buffer(logRecord);
-            context->txn_->set_prev_lsn(logRecord->lsn_);
+            InsertLogRecord logRecord(context->txn_->get_transaction_id(), rec, rid, tab.id);
+            logRecord.prev_lsn_ = context->txn_->get_prev_lsn();
+            context->log_mgr_->add_log_to_buffer(&logRecord);
+            context->txn_->set_prev_lsn(logRecord.lsn_);
 
             insert_index(tab_name, &rec, rid, context);
-            rfh->insert_record(rid, rec.data);
+            rfh->insert_record(rid, rec.data, logRecord.lsn_);
         }else if(type == WType::UPDATE_TUPLE){
             //更新操作, 应该更新
 //            std::cout << "rollback update\n";
             auto old = rfh->get_record(rid, context);
 
             //更新日志
-            auto *logRecord = new UpdateLogRecord(context->txn_->get_transaction_id(), *old, rid,tab_name, rec);
-            logRecord->prev_lsn_ = context->txn_->get_prev_lsn();
-            context->log_mgr_->add_log_to_buffer(logRecord);
-            context->txn_->set_prev_lsn(logRecord->lsn_);
+            UpdateLogRecord logRecord(context->txn_->get_transaction_id(), *old, rid, tab.id, rec, tab.cols);
+            logRecord.prev_lsn_ = context->txn_->get_prev_lsn();
+            context->log_mgr_->add_log_to_buffer(&logRecord);
+            context->txn_->set_prev_lsn(logRecord.lsn_);
 
-            delete_index(tab_name, old.get(), rid, context);
-            rfh->update_record(rid, rec.data, context);
-            insert_index(tab_name, &rec, rid, context);
+            // 只有包含被修改字段的索引需要恢复索引项，与UpdateExecutor只维护受影响的索引一致
+            auto indexes = affected_indexes(tab, *old, rec);
+            delete_index(tab_name, old.get(), rid, context, &indexes);
+            rfh->update_record(rid, rec.data, context, logRecord.lsn_);
+            insert_index(tab_name, &rec, rid, context, &indexes);
+        }else if(type == WType::BULK_LOAD){
+            //批量导入, 删除新页面上记录的索引项后截断新页面
+            //之后的写操作已经回滚, 新页面上恰好是导入的记录
+            int num_pages = rfh->get_file_hdr().num_pages;
+            for (int page_no = rid.page_no; !tab.indexes.empty() && page_no < num_pages; page_no++) {
+                auto rph = rfh->fetch_page_handle(page_no);
+                int n = rph.file_hdr->num_records_per_page;
+                for (int slot_no = Bitmap::first_bit(true, rph.bitmap, n); slot_no < n;
+                     slot_no = Bitmap::next_bit(true, rph.bitmap, n, slot_no)) {
+                    RmRecord loaded(rph.file_hdr->record_size, rph.get_slot(slot_no));
+                    delete_loaded_index(tab_name, &loaded, Rid{page_no, slot_no}, context);
+                }
+                sm_manager_->get_bpm()->unpin_page(rph.page->get_page_id(), false);
+            }
+            rfh->truncate(rid.page_no);
         }
+        txn->delete_write_record();
     }
+    // 页面已经恢复为修改之前的内容，不再需要事务产生的版本
+    version_store_.abort(txn);
     //释放所有锁
     auto lock_set = txn->get_lock_set();
     for(auto i : *lock_set){
@@ -186,10 +333,71 @@ void TransactionManager::abort(Context * context, LogManager *log_manager) {
     //释放事务相关资源，eg.锁集
     txn->clear();
     // 4. 把事务日志刷入磁盘中
-    auto *log = new AbortLogRecord(txn->get_transaction_id());
-    log->prev_lsn_ = txn->get_prev_lsn();
-    log_manager->add_log_to_buffer(log);
-    txn->set_prev_lsn(log->lsn_);
+    AbortLogRecord log(txn->get_transaction_id());
+    log.prev_lsn_ = txn->get_prev_lsn();
+    log_manager->add_log_to_buffer(&log);
+    txn->set_prev_lsn(log.lsn_);
     // 5. 更新事务状态
     txn->set_state(TransactionState::ABORTED);
-}
\ No newline at end of file
+}
+
+/**
+ * @description: 模糊检查点。只在语句之间短暂阻塞语句的执行，写回页面期间事务可以继续执行
+ * 1. 把缓冲池中的页面分批写回磁盘，每批都在语句之间进行，写回前先把日志刷盘，保证页面上的修改都已有日志
+ * 2. 记录此时的脏页表（写回之后又被修改的页面），并写回新分配的页面和所有文件的file header
+ * 3. 写入检查点日志并等待其落盘，恢复时只需重做脏页表中的页面和检查点之后修改的页面
+ * 4. 删除所有脏页的rec_lsn和所有活跃事务的begin日志之前的日志段
+ * @param {LogManager*} log_manager 日志管理器指针
+ */
+void TransactionManager::checkpoint(LogManager* log_manager) {
+    auto bpm = sm_manager_->get_bpm();
+    auto cached_pages = bpm->get_cached_pages();
+    for (size_t i = 0; i < cached_pages.size(); i += CHECKPOINT_FLUSH_BATCH) {
+        std::unique_lock<std::shared_mutex> checkpoint_lock(checkpoint_latch_);
+        log_manager->flush_log_to_disk();
+        for (size_t j = i; j < std::min(cached_pages.size(), i + CHECKPOINT_FLUSH_BATCH); j++) {
+            bpm->flush_page(cached_pages[j]);
+        }
+    }
+
+    lsn_t snapshot_lsn;
+    lsn_t truncate_lsn;
+    std::vector<DirtyPageEntry> dpt;
+    {
+        std::unique_lock<std::shared_mutex> checkpoint_lock(checkpoint_latch_);
+        snapshot_lsn = log_manager->get_next_lsn();
+        truncate_lsn = snapshot_lsn;
+        std::unique_lock<std::mutex> lock(latch_);
+        for (auto &[txn_id, txn]: txn_map) {
+            if (txn->get_state() == TransactionState::COMMITTED || txn->get_state() == TransactionState::ABORTED) {
+                continue;
+            }
+            truncate_lsn = std::min(truncate_lsn, txn->get_begin_lsn());
+        }
+        lock.unlock();
+        // 脏页表中用表和索引的id标识页面所在的文件
+        std::unordered_map<int, int> fd2id;
+        for (auto &[tab_name, tab]: sm_manager_->db_.get_tables()) {
+            fd2id.emplace(sm_manager_->fhs_.at(tab_name)->GetFd(), tab.id);
+            for (auto &index: tab.indexes) {
+                auto ix_name = sm_manager_->get_ix_manager()->get_index_name(tab_name, index.cols);
+                fd2id.emplace(sm_manager_->ihs_.at(ix_name)->get_fd(), index.id);
+            }
+        }
+        for (auto &[page_id, rec_lsn]: bpm->get_dirty_page_table()) {
+            auto it = fd2id.find(page_id.fd);
+            if (it == fd2id.end()) continue;
+            dpt.push_back({it->second, page_id.page_no, rec_lsn});
+            truncate_lsn = std::min(truncate_lsn, rec_lsn);
+        }
+        log_manager->flush_log_to_disk();
+        sm_manager_->flush_file_hdrs();
+    }
+    sm_manager_->sync_files();
+
+    CheckpointLogRecord log(snapshot_lsn, next_txn_id_, std::move(dpt));
+    log_manager->add_log_to_buffer(&log);
+    log_manager->wait_for_flush(log.lsn_);
+
+    log_manager->truncate_log(truncate_lsn);
+}
@@ -11,15 +11,18 @@ See the Mulan PSL v2 for more details. */
 #pragma once
 
 #include <atomic>
+#include <shared_mutex>
 #include <unordered_map>
+#include <vector>
 
 #include "transaction.h"
 #include "recovery/log_manager.h"
 #include "concurrency/lock_manager.h"
+#include "concurrency/version_store.h"
 #include "system/sm_manager.h"
 
-/* 系统采用的并发控制算法，当前题目中要求两阶段封锁并发控制算法 */
-enum class ConcurrencyMode { TWO_PHASE_LOCKING = 0, BASIC_TO };
+/* 系统采用的并发控制算法，默认为两阶段封锁；OPTIMISTIC下事务不加行锁和键锁，提交时验证读集合，适合冲突少的短事务 */
+enum class ConcurrencyMode { TWO_PHASE_LOCKING = 0, BASIC_TO, OPTIMISTIC };
 
 class TransactionManager{
 public:
@@ -32,22 +35,41 @@ public:
     
     ~TransactionManager() = default;
 
-    Transaction* begin(Transaction* txn, LogManager* log_manager);
+    Transaction* begin(Transaction* txn, LogManager* log_manager,
+                       IsolationLevel isolation_level = IsolationLevel::SERIALIZABLE);
+
+    Transaction* begin_read_only();
 
     void commit(Transaction* txn, LogManager* log_manager);
 
     void abort(Context* context, LogManager* log_manager);
 
+    void release(Transaction* txn);
+
+    void checkpoint(LogManager* log_manager);
+
+    // 每条语句执行期间持有共享锁，检查点确定redo点时持有排他锁，保证redo点之前的日志对应的修改都已写入页面
+    std::shared_mutex& get_checkpoint_latch() { return checkpoint_latch_; }
+
     ConcurrencyMode get_concurrency_mode() { return concurrency_mode_; }
 
     void set_concurrency_mode(ConcurrencyMode concurrency_mode) { concurrency_mode_ = concurrency_mode; }
 
     LockManager* get_lock_manager() { return lock_manager_; }
 
+    VersionStore* get_version_store() { return &version_store_; }
+
     //辅助函数
-    void delete_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_);
+    void delete_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_,
+                      const std::vector<const IndexMeta *> *indexes = nullptr);
 
-    void insert_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_);
+    void insert_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_,
+                      const std::vector<const IndexMeta *> *indexes = nullptr);
+
+    void delete_loaded_index(const std::string& tab_name, RmRecord* rec, Rid rid_, Context* context_);
+
+    static std::vector<const IndexMeta *> affected_indexes(const TabMeta &tab, const RmRecord &old_rec,
+                                                          const RmRecord &new_rec);
     /**
      * @description: 获取事务ID为txn_id的事务对象
      * @return {Transaction*} 事务对象的指针
@@ -70,13 +92,22 @@ public:
         return next_txn_id_++;
     }
 
+    // 恢复完成后调用，事务ID在重启后继续递增，避免与日志中已有的事务ID重复
+    void set_next_txn_id(txn_id_t next_txn_id) { next_txn_id_ = next_txn_id; }
+
     static std::unordered_map<txn_id_t, Transaction *> txn_map;     // 全局事务表，存放事务ID与事务对象的映射关系
 
 private:
-    ConcurrencyMode concurrency_mode_;      // 事务使用的并发控制算法，目前只需要考虑2PL
+    static constexpr size_t TXN_POOL_SIZE = 256;    // 池中最多保留的空闲事务对象个数
+
+    Transaction* acquire_transaction(IsolationLevel isolation_level);
+
+    ConcurrencyMode concurrency_mode_;      // 事务使用的并发控制算法，2PL或乐观并发控制
     std::atomic<txn_id_t> next_txn_id_{0};  // 用于分发事务ID
-    std::atomic<timestamp_t> next_timestamp_{0};    // 用于分发事务时间戳
-    std::mutex latch_;  // 用于txn_map的并发
+    std::mutex latch_;  // 用于txn_map和txn_pool_的并发
+    std::vector<Transaction *> txn_pool_;   // 已经结束的事务对象，开始新事务时复用
+    std::shared_mutex checkpoint_latch_;    // 检查点与语句执行之间的同步
     SmManager *sm_manager_;
     LockManager *lock_manager_;
+    VersionStore version_store_;    // 记录的旧版本，并分发快照和提交时间戳
 };
\ No newline at end of file
@@ -10,7 +10,11 @@ See the Mulan PSL v2 for more details. */
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include "common/config.h"
 #include "defs.h"
@@ -19,37 +23,70 @@ See the Mulan PSL v2 for more details. */
 /* 标识事务状态 */
 enum class TransactionState { DEFAULT, GROWING, SHRINKING, COMMITTED, ABORTED };
 
-/* 系统的隔离级别，当前赛题中为可串行化隔离级别 */
+/* 系统的隔离级别，默认为可串行化（两阶段封锁）；REPEATABLE_READ和READ_COMMITTED使用快照读，读操作不加锁 */
 enum class IsolationLevel { READ_UNCOMMITTED, REPEATABLE_READ, READ_COMMITTED, SERIALIZABLE };
 
-/* 事务写操作类型，包括插入、删除、更新三种操作 */
-enum class WType { INSERT_TUPLE = 0, DELETE_TUPLE, UPDATE_TUPLE};
+/* 事务写操作类型，包括插入、删除、更新，以及批量导入（rid.page_no为导入分配的第一个页面） */
+enum class WType { INSERT_TUPLE = 0, DELETE_TUPLE, UPDATE_TUPLE, BULK_LOAD};
+
+/**
+ * @brief 事务私有的内存区，按块顺序分配写操作记录和undo镜像，不单独释放。
+ * 事务结束时整体重置，保留第一个块供复用事务对象的下一个事务使用
+ */
+class TxnArena {
+   public:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+    void *allocate(size_t size, size_t align) {
+        size_t offset = (offset_ + align - 1) & ~(align - 1);
+        if (blocks_.empty() || offset + size > block_size_) {
+            block_size_ = std::max(BLOCK_SIZE, size);
+            blocks_.emplace_back(new char[block_size_]);
+            offset = 0;
+        }
+        offset_ = offset + size;
+        return blocks_.back().get() + offset;
+    }
+
+    void reset() {
+        if (blocks_.size() > 1 || block_size_ != BLOCK_SIZE) {
+            blocks_.clear();
+        }
+        offset_ = 0;
+        block_size_ = blocks_.empty() ? 0 : BLOCK_SIZE;
+    }
+
+   private:
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_size_ = 0;     // 当前块的大小
+    size_t offset_ = 0;         // 当前块中已分配的字节数
+};
 
 /**
  * @brief 事务的写操作记录，用于事务的回滚
- * INSERT
- * --------------------------------
- * | wtype | tab_name | tuple_rid |
- * --------------------------------
- * DELETE / UPDATE
+ * INSERT / DELETE / UPDATE
  * ----------------------------------------------
  * | wtype | tab_name | tuple_rid | tuple_value |
  * ----------------------------------------------
+ * BULK_LOAD
+ * --------------------------------
+ * | wtype | tab_name | tuple_rid |
+ * --------------------------------
+ * 记录和tuple_value都分配在事务的TxnArena中，tuple_value不拥有自己的内存，由Transaction::append_write_record创建
  */
 class WriteRecord {
    public:
-    WriteRecord() = default;
-
-    // constructor for insert operation
     WriteRecord(WType wtype, const std::string &tab_name, const Rid &rid)
         : wtype_(wtype), tab_name_(tab_name), rid_(rid) {}
 
-    // constructor for delete & update operation
-    WriteRecord(WType wtype, const std::string &tab_name, const Rid &rid, const RmRecord &record)
-        : wtype_(wtype), tab_name_(tab_name), rid_(rid), record_(record) {}
-
     ~WriteRecord() = default;
 
+    // tuple_value指向arena中的一份拷贝
+    inline void SetImage(char *data, int size) {
+        record_.data = data;
+        record_.size = size;
+    }
+
     inline RmRecord &GetRecord() { return record_; }
 
     inline Rid &GetRid() { return rid_; }
@@ -65,8 +102,17 @@ class WriteRecord {
     RmRecord record_;
 };
 
-/* 多粒度锁，加锁对象的类型，包括记录和表 */
-enum class LockDataType { TABLE = 0, RECORD = 1 };
+/**
+ * @brief 乐观并发控制下事务的读操作记录，用于提交时的验证
+ * 扫描不加锁地读取快照，记录扫描的表和扫描条件；期间提交的事务修改之前或之后的记录满足条件时，读到的结果已经失效
+ */
+struct ReadRecord {
+    int fd_;                                        // 扫描的表的数据文件
+    std::function<bool(const RmRecord &)> match_;   // 记录是否满足扫描条件
+};
+
+/* 多粒度锁，加锁对象的类型，包括记录和表；索引键上的锁用于保证唯一索引在并发插入、删除时的正确性 */
+enum class LockDataType { TABLE = 0, RECORD = 1, KEY = 2 };
 
 /**
  * @description: 加锁对象的唯一标识
@@ -90,14 +136,26 @@ class LockDataId {
         type_ = type;
     }
 
+    /* 索引键上的锁，fd为索引的id，键的哈希值存放在rid_中，哈希冲突只会造成不必要的等待 */
+    LockDataId(int fd, size_t key_hash, LockDataType type) {
+        assert(type == LockDataType::KEY);
+        fd_ = fd;
+        rid_.page_no = static_cast<int>(key_hash >> 32);
+        rid_.slot_no = static_cast<int>(key_hash);
+        type_ = type;
+    }
+
     inline int64_t Get() const {
         if (type_ == LockDataType::TABLE) {
             // fd_
             return static_cast<int64_t>(fd_);
-        } else {
+        } else if (type_ == LockDataType::RECORD) {
             // fd_, rid_.page_no, rid.slot_no
             return ((static_cast<int64_t>(type_)) << 63) | ((static_cast<int64_t>(fd_)) << 31) |
                    ((static_cast<int64_t>(rid_.page_no)) << 16) | rid_.slot_no;
+        } else {
+            // 键的哈希值与索引的id
+            return ((static_cast<int64_t>(rid_.page_no) << 32) | static_cast<uint32_t>(rid_.slot_no)) ^ fd_;
         }
     }
 
@@ -116,8 +174,18 @@ struct std::hash<LockDataId> {
     size_t operator()(const LockDataId &obj) const { return std::hash<int64_t>()(obj.Get()); }
 };
 
+/* 事务在一张表上的加锁情况，用于锁升级：行级锁个数超过阈值时升级为表级锁，之后表级锁覆盖的行级锁不再申请 */
+struct TableLockStat {
+    int row_locks_ = 0;                 // 持有的行级锁个数
+    bool has_exclusive_row_ = false;    // 是否持有行级X锁，决定升级为表级S锁还是X锁
+    int failed_escalations_ = 0;        // 表级锁冲突而没有升级的次数，每多持有一个阈值的行级锁再尝试一次
+    bool shared_covered_ = false;       // 持有表级S、SIX或X锁，不需要再申请行级S锁
+    bool exclusive_covered_ = false;    // 持有表级X锁，不需要再申请任何行级锁
+};
+
 /* 事务回滚原因 */
-enum class AbortReason { LOCK_ON_SHIRINKING = 0, UPGRADE_CONFLICT, DEADLOCK_PREVENTION };
+enum class AbortReason { LOCK_ON_SHIRINKING = 0, UPGRADE_CONFLICT, DEADLOCK_PREVENTION, WRITE_CONFLICT, VALIDATION_FAILED,
+                         UNIQUE_VIOLATION };
 
 /* 事务回滚异常，在rmdb.cpp中进行处理 */
 class TransactionAbortException : public std::exception {
@@ -146,6 +214,21 @@ class TransactionAbortException : public std::exception {
                 return "Transaction " + std::to_string(txn_id_) + " aborted for deadlock prevention\n";
             } break;
 
+            case AbortReason::WRITE_CONFLICT: {
+                return "Transaction " + std::to_string(txn_id_) +
+                       " aborted because the record was modified by a transaction committed after its snapshot\n";
+            } break;
+
+            case AbortReason::VALIDATION_FAILED: {
+                return "Transaction " + std::to_string(txn_id_) +
+                       " aborted because data it read was modified by a transaction committed during its execution\n";
+            } break;
+
+            case AbortReason::UNIQUE_VIOLATION: {
+                return "Transaction " + std::to_string(txn_id_) +
+                       " aborted because a loaded record duplicates a key in a unique index\n";
+            } break;
+
             default: {
                 return "Transaction aborted\n";
             } break;
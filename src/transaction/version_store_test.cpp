@@ -0,0 +1,269 @@
+/* Copyright (c) 2023 Renmin University of China
+RMDB is licensed under Mulan PSL v2.
+You can use this software according to the terms and conditions of the Mulan PSL v2.
+You may obtain a copy of Mulan PSL v2 at:
+        http://license.coscl.org.cn/MulanPSL2
+THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND,
+EITHER EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT,
+MERCHANTABILITY OR FIT FOR A PARTICULAR PURPOSE.
+See the Mulan PSL v2 for more details. */
+
+#include <climits>
+
+#include "gtest/gtest.h"
+
+#define private public
+#include "concurrency/version_store.h"
+#undef private  // for use private variables in "version_store.h"
+
+/**
+ * 版本存储的测试只模拟页面上记录的最新内容，记录只有一个int字段
+ */
+class VersionStoreTest : public ::testing::Test {
+   public:
+    VersionStore version_store_;
+    const int fd_ = 3;
+
+    static std::unique_ptr<RmRecord> make_record(int val) {
+        return std::make_unique<RmRecord>(sizeof(int), (char *) &val);
+    }
+
+    // 页面上的记录为val（INT_MIN表示记录不在页面上）时，事务读到的版本，不可见时为INT_MIN
+    int read(const Rid &rid, Transaction *txn, int val) {
+        auto rec = val == INT_MIN ? nullptr : make_record(val);
+        version_store_.read_visible(fd_, rid, txn, &rec);
+        return rec == nullptr ? INT_MIN : *(int *) rec->data;
+    }
+
+    std::unique_ptr<Transaction> begin(txn_id_t txn_id) {
+        auto txn = std::make_unique<Transaction>(txn_id, IsolationLevel::REPEATABLE_READ);
+        version_store_.begin_snapshot(txn.get());
+        return txn;
+    }
+};
+
+/**
+ * @brief 快照只能看到开始之前提交的修改，写事务总能看到自己的修改
+ */
+TEST_F(VersionStoreTest, VisibilityTest) {
+    Rid rid{1, 0};
+    auto writer = begin(1);
+    auto before = begin(2);
+
+    // 更新：页面上是1，修改之前是0
+    auto old_rec = make_record(0);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), old_rec.get()));
+    EXPECT_EQ(read(rid, writer.get(), 1), 1);
+    EXPECT_EQ(read(rid, before.get(), 1), 0);
+
+    // 插入：未提交时对其他事务不可见
+    Rid inserted{1, 1};
+    EXPECT_TRUE(version_store_.add_version(fd_, inserted, writer.get(), nullptr));
+    EXPECT_EQ(read(inserted, writer.get(), 7), 7);
+    EXPECT_EQ(read(inserted, before.get(), 7), INT_MIN);
+
+    // 删除：记录已经不在页面上，其他事务仍然能读到删除之前的内容
+    Rid deleted{2, 0};
+    auto deleted_rec = make_record(9);
+    EXPECT_TRUE(version_store_.add_version(fd_, deleted, writer.get(), deleted_rec.get()));
+    EXPECT_EQ(read(deleted, writer.get(), INT_MIN), INT_MIN);
+    EXPECT_EQ(read(deleted, before.get(), INT_MIN), 9);
+
+    // 同一事务再次修改时只保留第一次修改之前的内容
+    auto rec1 = make_record(1);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), rec1.get()));
+    EXPECT_EQ(read(rid, before.get(), 2), 0);
+
+    timestamp_t commit_ts = version_store_.commit(writer.get());
+    EXPECT_EQ(writer->get_start_ts() + 1, commit_ts);
+
+    // 提交之前开始的快照仍然看不到，提交之后开始的快照可以看到
+    auto after = begin(3);
+    EXPECT_EQ(read(rid, before.get(), 2), 0);
+    EXPECT_EQ(read(inserted, before.get(), 7), INT_MIN);
+    EXPECT_EQ(read(deleted, before.get(), INT_MIN), 9);
+    EXPECT_EQ(read(rid, after.get(), 2), 2);
+    EXPECT_EQ(read(inserted, after.get(), 7), 7);
+    EXPECT_EQ(read(deleted, after.get(), INT_MIN), INT_MIN);
+
+    // first-updater-wins：快照之后被其他事务修改并提交的记录不能再修改
+    auto rec2 = make_record(2);
+    EXPECT_THROW(version_store_.add_version(fd_, rid, before.get(), rec2.get()), TransactionAbortException);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, after.get(), rec2.get()));
+
+    version_store_.abort(before.get());
+    version_store_.commit(after.get());
+}
+
+/**
+ * @brief 回滚的事务的版本被删除，其他事务重新看到页面上恢复的内容
+ */
+TEST_F(VersionStoreTest, AbortTest) {
+    Rid rid{1, 0};
+    auto writer = begin(1);
+    auto reader = begin(2);
+    auto old_rec = make_record(0);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), old_rec.get()));
+    EXPECT_EQ(version_store_.get_versioned_rids(fd_).size(), 1);
+
+    // 未提交的版本上不能再有其他事务的插入
+    Rid inserted{1, 1};
+    EXPECT_TRUE(version_store_.add_version(fd_, inserted, writer.get(), nullptr));
+    EXPECT_FALSE(version_store_.add_version(fd_, inserted, reader.get(), nullptr));
+
+    version_store_.abort(writer.get());
+    EXPECT_TRUE(version_store_.get_versioned_rids(fd_).empty());
+    EXPECT_EQ(read(rid, reader.get(), 0), 0);
+    EXPECT_EQ(read(inserted, reader.get(), INT_MIN), INT_MIN);
+    version_store_.commit(reader.get());
+}
+
+/**
+ * @brief 所有活跃快照都能看到的版本在提交和结束快照时回收，还有快照需要的版本不能回收
+ */
+TEST_F(VersionStoreTest, PurgeTest) {
+    Rid rid{1, 0};
+    auto old_rec = make_record(0);
+
+    // 没有其他快照时，提交后版本立即回收
+    auto writer = begin(1);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), old_rec.get()));
+    uint64_t epoch = version_store_.get_epoch(fd_);
+    EXPECT_EQ(epoch, 1);
+    version_store_.commit(writer.get());
+    EXPECT_TRUE(version_store_.get_versioned_rids(fd_).empty());
+
+    // 旧快照结束之前保留它需要的版本
+    auto reader = begin(2);
+    auto writer1 = begin(3);
+    auto rec1 = make_record(1);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer1.get(), rec1.get()));
+    version_store_.commit(writer1.get());
+    EXPECT_EQ(version_store_.get_epoch(fd_), epoch + 1);
+
+    auto writer2 = begin(4);
+    auto rec2 = make_record(2);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer2.get(), rec2.get()));
+    version_store_.commit(writer2.get());
+    auto rids = version_store_.get_versioned_rids(fd_);
+    ASSERT_EQ(rids.size(), 1);
+    EXPECT_EQ(rids[0], rid);
+    EXPECT_EQ(read(rid, reader.get(), 3), 1);
+
+    // 只读事务结束快照时回收
+    version_store_.commit(reader.get());
+    EXPECT_TRUE(version_store_.get_versioned_rids(fd_).empty());
+    // 回收不会新建版本链
+    EXPECT_EQ(version_store_.get_epoch(fd_), epoch + 1);
+}
+
+/**
+ * @brief 多个快照时只回收最老的快照也能看到的版本，版本链中较新的版本保留
+ */
+TEST_F(VersionStoreTest, PartialPurgeTest) {
+    Rid rid{1, 0};
+    auto reader0 = begin(1);
+
+    auto writer1 = begin(2);
+    auto rec0 = make_record(0);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer1.get(), rec0.get()));
+    version_store_.commit(writer1.get());
+
+    auto reader1 = begin(3);
+    auto writer2 = begin(4);
+    auto rec1 = make_record(1);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer2.get(), rec1.get()));
+    version_store_.commit(writer2.get());
+
+    EXPECT_EQ(read(rid, reader0.get(), 2), 0);
+    EXPECT_EQ(read(rid, reader1.get(), 2), 1);
+
+    // reader0结束后只剩reader1需要的版本
+    version_store_.commit(reader0.get());
+    EXPECT_EQ(version_store_.chains_.at(fd_).at({rid.page_no, rid.slot_no}).size(), 1);
+    EXPECT_EQ(read(rid, reader1.get(), 2), 1);
+
+    version_store_.commit(reader1.get());
+    EXPECT_TRUE(version_store_.get_versioned_rids(fd_).empty());
+}
+
+/**
+ * @brief 乐观事务提交时验证读集合：快照之后提交的修改之前或之后的记录满足扫描条件时验证失败
+ */
+TEST_F(VersionStoreTest, ValidateTest) {
+    Rid rid{1, 0};
+    Rid other{1, 1};
+    auto match5 = [](const RmRecord &rec) { return *(int *) rec.data == 5; };
+
+    // 修改之前的记录满足条件
+    auto occ = begin(1);
+    occ->set_optimistic(true);
+    occ->append_read_record({fd_, match5});
+    auto writer = begin(2);
+    auto rec5 = make_record(5);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), rec5.get()));
+    version_store_.commit(writer.get());
+    auto rec0 = make_record(0);
+    EXPECT_TRUE(version_store_.add_version(fd_, other, occ.get(), rec0.get()));
+    try {
+        version_store_.commit(occ.get());
+        FAIL() << "validation should fail";
+    } catch (TransactionAbortException &e) {
+        EXPECT_EQ(e.GetAbortReason(), AbortReason::VALIDATION_FAILED);
+    }
+    version_store_.abort(occ.get());
+
+    // 修改前后都不满足条件时验证通过
+    occ = begin(3);
+    occ->set_optimistic(true);
+    occ->append_read_record({fd_, match5});
+    writer = begin(4);
+    auto rec7 = make_record(7);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), rec7.get()));
+    std::vector<AfterImage> after_images;
+    after_images.push_back({fd_, rid, make_record(8)});
+    version_store_.commit(writer.get(), &after_images);
+    EXPECT_TRUE(version_store_.add_version(fd_, other, occ.get(), rec0.get()));
+    EXPECT_NO_THROW(version_store_.commit(occ.get()));
+
+    // 修改之后的记录满足条件
+    occ = begin(5);
+    occ->set_optimistic(true);
+    occ->append_read_record({fd_, match5});
+    auto writer_occ = begin(6);
+    writer_occ->set_optimistic(true);
+    auto rec8 = make_record(8);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer_occ.get(), rec8.get()));
+    after_images.clear();
+    after_images.push_back({fd_, rid, make_record(5)});
+    version_store_.commit(writer_occ.get(), &after_images);
+    EXPECT_TRUE(version_store_.add_version(fd_, Rid{1, 2}, occ.get(), nullptr));
+    EXPECT_THROW(version_store_.commit(occ.get()), TransactionAbortException);
+    version_store_.abort(occ.get());
+}
+
+/**
+ * @brief 只读的乐观事务读到的是一致的快照，不需要验证；快照之前提交的修改不影响验证
+ */
+TEST_F(VersionStoreTest, ValidateReadOnlyTest) {
+    Rid rid{1, 0};
+    auto match5 = [](const RmRecord &rec) { return *(int *) rec.data == 5; };
+
+    auto writer = begin(1);
+    auto rec5 = make_record(5);
+    auto reader = begin(2);
+    EXPECT_TRUE(version_store_.add_version(fd_, rid, writer.get(), rec5.get()));
+    version_store_.commit(writer.get());
+
+    // reader的快照在writer提交之前，但它没有修改任何记录
+    reader->set_optimistic(true);
+    reader->append_read_record({fd_, match5});
+    EXPECT_NO_THROW(version_store_.commit(reader.get()));
+
+    // 快照在writer提交之后，writer的修改已经包含在快照中
+    auto occ = begin(3);
+    occ->set_optimistic(true);
+    occ->append_read_record({fd_, match5});
+    EXPECT_TRUE(version_store_.add_version(fd_, Rid{1, 1}, occ.get(), nullptr));
+    EXPECT_NO_THROW(version_store_.commit(occ.get()));
+}
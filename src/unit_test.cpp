@@ -19,12 +19,16 @@ See the Mulan PSL v2 for more details. */
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <future>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <random>
 #include <set>
 #include <string>
@@ -329,6 +333,72 @@ TEST_F(BufferPoolManagerTest, SampleTest) {
     bpm->flush_all_pages(fd);
 }
 
+// 淘汰脏页时释放latch_等待日志持久化，等待期间其他线程仍然可以访问缓冲池中的页面
+TEST_F(BufferPoolManagerTest, FlushLogUnlatchedTest) {
+    auto bpm = std::make_unique<BufferPoolManager>(2, BufferPoolManagerTest::disk_manager_.get());
+    int fd = BufferPoolManagerTest::fd_;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool released = false;
+    std::vector<lsn_t> waited;
+    bpm->set_flush_log([&](lsn_t lsn) {
+        std::unique_lock<std::mutex> lock(mutex);
+        waited.push_back(lsn);
+        cv.notify_all();
+        cv.wait(lock, [&] { return released; });
+    });
+
+    // page 0是最久未使用的脏页，page lsn为10；page 1仍然被pin住
+    PageId page_id = {.fd = fd, .page_no = INVALID_PAGE_ID};
+    Page *page0 = bpm->new_page(&page_id);
+    ASSERT_NE(nullptr, page0);
+    page0->set_page_lsn(10);
+    snprintf(page0->get_data() + sizeof(lsn_t), 16, "Hello");
+    EXPECT_TRUE(bpm->unpin_page(page_id, true));
+    ASSERT_NE(nullptr, bpm->new_page(&page_id));
+    EXPECT_EQ(1, page_id.page_no);
+
+    // 淘汰page 0时等待日志
+    Page *page2 = nullptr;
+    std::thread t0([&] {
+        PageId new_page_id = {.fd = fd, .page_no = INVALID_PAGE_ID};
+        page2 = bpm->new_page(&new_page_id);
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&] { return !waited.empty(); });
+    }
+    EXPECT_EQ(waited, std::vector<lsn_t>{10});
+    // 等待期间可以访问缓冲池中的其他页面
+    auto fetched = std::async(std::launch::async, [&] { return bpm->fetch_page(PageId{fd, 1}); });
+    EXPECT_EQ(std::future_status::ready, fetched.wait_for(std::chrono::seconds(5)));
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        released = true;
+        cv.notify_all();
+    }
+    t0.join();
+    EXPECT_NE(nullptr, fetched.get());
+    EXPECT_TRUE(bpm->unpin_page(PageId{fd, 1}, false));
+    ASSERT_NE(nullptr, page2);
+    EXPECT_EQ(2, page2->get_page_id().page_no);
+
+    // page 0在日志持久化之后写回磁盘
+    char buf[PAGE_SIZE];
+    BufferPoolManagerTest::disk_manager_->read_page(fd, 0, buf, PAGE_SIZE);
+    EXPECT_EQ(0, strcmp(buf + sizeof(lsn_t), "Hello"));
+    EXPECT_TRUE(bpm->unpin_page(page2->get_page_id(), false));
+    page0 = bpm->fetch_page(PageId{fd, 0});
+    ASSERT_NE(nullptr, page0);
+    EXPECT_EQ(0, strcmp(page0->get_data() + sizeof(lsn_t), "Hello"));
+    EXPECT_TRUE(bpm->unpin_page(PageId{fd, 0}, true));
+
+    // page 0的日志已经持久化，再次淘汰时不再等待
+    PageId new_page_id = {.fd = fd, .page_no = INVALID_PAGE_ID};
+    EXPECT_NE(nullptr, bpm->new_page(&new_page_id));
+    EXPECT_EQ(waited.size(), 1);
+}
+
 /** 注意：每个测试点只测试了单个文件！
  * 对于每个测试点，先创建和进入目录TEST_DB_NAME
  * 然后在此目录下创建和打开文件TEST_FILE_NAME_CCUR，记录其文件描述符fd */